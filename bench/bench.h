@@ -0,0 +1,84 @@
+#pragma once
+
+#include "memory.h"
+#include "cpu.h"
+#include "perfcounters.h"
+
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+// Helpers shared by the 6502_bench suites.
+
+// Every benchmark that runs guest code reports the emulated clock, as
+// "cycles" per second of host time, and the host time per emulated
+// instruction. Both are rates over the measured time, so they stay
+// comparable across runs of different lengths.
+inline void reportRates(benchmark::State & state, double cycles, double instructions) {
+    state.counters["cycles"] = benchmark::Counter(cycles, benchmark::Counter::kIsRate);
+    state.counters["time/insn"] = benchmark::Counter(instructions,
+                                                     benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+}
+
+// Set by --perf (main.cpp): guest-code benchmarks also read the host's
+// hardware counters over their timed runs
+extern bool benchPerf;
+
+// One benchmark's counters, opened only under --perf
+struct BenchPerf {
+    PerfCounters counters;
+    bool enabled = benchPerf && counters.open();
+
+    void start() { if (enabled) counters.start(); }
+    void stop() { if (enabled) counters.stop(); }
+};
+
+// The host counts per emulated instruction, and the host's instructions
+// per cycle, for those counters the host provides
+inline void reportPerf(benchmark::State & state, const BenchPerf & perf, double instructions) {
+    if (!perf.enabled || instructions <= 0)
+        return;
+    const PerfCounters & c = perf.counters;
+    const struct { PerfCounters::Event event; const char * name; } perInstruction[] = {
+        { PerfCounters::Cycles, "host-cycles" },
+        { PerfCounters::Instructions, "host-insns" },
+        { PerfCounters::BranchMisses, "branch-misses" },
+        { PerfCounters::L1dMisses, "L1d-misses" },
+        { PerfCounters::L1iMisses, "L1i-misses" },
+    };
+    for (const auto & counter : perInstruction)
+        if (c.available(counter.event))
+            state.counters[counter.name] = c.count(counter.event) / instructions;
+    if (c.available(PerfCounters::Cycles) && c.available(PerfCounters::Instructions) && c.count(PerfCounters::Cycles) > 0)
+        state.counters["IPC"] = c.count(PerfCounters::Instructions) / c.count(PerfCounters::Cycles);
+}
+
+// Guest loops start here and end with JMP loopStart
+constexpr Word loopStart = 0x0200;
+
+// Instructions and cycles of one pass through the loop at loopStart, stepped
+// with execute() on copies of the memory and registers so that the timed
+// run starts afresh
+inline void measureLoop(Memory mem, const CPUState & from, long long & instructions, long long & cycles) {
+    CPU step(&mem);
+    step.PC = from.PC;
+    step.SP = from.SP;
+    step.A = from.A;
+    step.X = from.X;
+    step.Y = from.Y;
+    step.P = from.P;
+    step.cycles = 0;
+    instructions = 0;
+    do {
+        step.execute();
+        instructions++;
+    } while (step.PC != loopStart);
+    cycles = step.cycles;
+}
+
+// Writes body at loopStart followed by JMP loopStart
+inline void loadLoop(Memory & mem, const std::vector<Byte> & body) {
+    mem.writeBlock(loopStart, body.data(), body.size());
+    const Byte jump[] = { 0x4C, loopStart & 0xFF, loopStart >> 8 };
+    mem.writeBlock(Word(loopStart + body.size()), jump, sizeof(jump));
+}
@@ -0,0 +1,30 @@
+#include "bench.h"
+
+#include <cstring>
+#include <iostream>
+
+bool benchPerf = false;
+
+// Google Benchmark's main, taking --perf out of the arguments first
+int main(int argc, char ** argv) {
+    int kept = 1;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--perf") == 0)
+            benchPerf = true;
+        else
+            argv[kept++] = argv[i];
+    }
+    argc = kept;
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+    if (benchPerf) {
+        PerfCounters probe;
+        if (!probe.open())
+            std::cerr << "--perf: perf_event_open is unavailable, so no host counters are reported" << std::endl;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,141 @@
+#include "bench.h"
+
+#include <string>
+#include <vector>
+
+// Per-opcode and per-addressing-mode throughput: each case repeats one
+// instruction (or a pair that undoes itself) 16 times in a loop and runs it
+// on the dispatch, block and JIT engines. Idle and delay loops are stepped,
+// or the loops that change nothing would be fast-forwarded.
+//
+// Registers start as A=$11, X=Y=$01, SP=$FF; $10 holds $42, and the
+// pointer at $20 points at $1234.
+
+namespace {
+
+struct OpcodeCase {
+    const char * name;
+    std::vector<Byte> body;
+    Byte p;
+};
+
+constexpr Byte binary = 0x24;   // I and bit 5
+constexpr Byte decimal = 0x2C;  // and D
+
+const std::vector<OpcodeCase> & opcodeCases() {
+    static const std::vector<OpcodeCase> cases = {
+        { "LDA #imm", { 0xA9, 0x42 }, binary },
+        { "LDA zp", { 0xA5, 0x10 }, binary },
+        { "LDA zp,X", { 0xB5, 0x10 }, binary },
+        { "LDA abs", { 0xAD, 0x34, 0x12 }, binary },
+        { "LDA abs,X", { 0xBD, 0x34, 0x12 }, binary },
+        { "LDA abs,X page cross", { 0xBD, 0xFF, 0x12 }, binary },
+        { "LDA abs,Y", { 0xB9, 0x34, 0x12 }, binary },
+        { "LDA (zp,X)", { 0xA1, 0x1F }, binary },
+        { "LDA (zp),Y", { 0xB1, 0x20 }, binary },
+        { "STA zp", { 0x85, 0x10 }, binary },
+        { "STA abs", { 0x8D, 0x34, 0x12 }, binary },
+        { "STA abs,X", { 0x9D, 0x34, 0x12 }, binary },
+        { "STA (zp),Y", { 0x91, 0x20 }, binary },
+        { "ADC #imm", { 0x69, 0x01 }, binary },
+        { "ADC #imm decimal", { 0x69, 0x01 }, decimal },
+        { "SBC #imm", { 0xE9, 0x01 }, binary },
+        { "SBC #imm decimal", { 0xE9, 0x01 }, decimal },
+        { "AND #imm", { 0x29, 0xFF }, binary },
+        { "ORA #imm", { 0x09, 0x00 }, binary },
+        { "EOR #imm", { 0x49, 0x00 }, binary },
+        { "CMP #imm", { 0xC9, 0x11 }, binary },
+        { "BIT zp", { 0x24, 0x10 }, binary },
+        { "INC zp", { 0xE6, 0x10 }, binary },
+        { "INC abs", { 0xEE, 0x34, 0x12 }, binary },
+        { "DEC abs,X", { 0xDE, 0x34, 0x12 }, binary },
+        { "ASL A", { 0x0A }, binary },
+        { "ROL zp", { 0x26, 0x10 }, binary },
+        { "LSR abs", { 0x4E, 0x34, 0x12 }, binary },
+        { "INX", { 0xE8 }, binary },
+        { "DEY", { 0x88 }, binary },
+        { "TAX", { 0xAA }, binary },
+        { "TSX", { 0xBA }, binary },
+        { "CLC", { 0x18 }, binary },
+        { "NOP", { 0xEA }, binary },
+        { "PHA/PLA", { 0x48, 0x68 }, binary },
+        { "PHP/PLP", { 0x08, 0x28 }, binary },
+        { "JSR/RTS", { 0x20, 0x00, 0x03 }, binary },
+        { "BNE taken", { 0xD0, 0x00 }, binary },
+        { "BEQ not taken", { 0xF0, 0x00 }, binary },
+    };
+    return cases;
+}
+
+void opcodeBenchmark(benchmark::State & state, std::vector<Byte> body, Byte p, CPU::Engine engine) {
+    Memory mem;
+    mem.mem[0x10] = 0x42;
+    mem.mem[0x20] = 0x34;
+    mem.mem[0x21] = 0x12;
+    mem.mem[0x0300] = 0x60;  // RTS
+    loadLoop(mem, body);
+
+    CPU cpu(&mem);
+    cpu.engine = engine;
+    cpu.skipIdleLoops = false;
+    cpu.skipDelayLoops = false;
+    cpu.PC = loopStart;
+    cpu.SP = 0xFF;
+    cpu.A = 0x11;
+    cpu.X = cpu.Y = 0x01;
+    cpu.P = p;
+    cpu.cycles = 0;
+
+    long long loopInstructions, loopCycles;
+    measureLoop(mem, cpu, loopInstructions, loopCycles);
+    BenchPerf perf;
+    perf.start();
+    for (auto _ : state)
+        cpu.run(100000);
+    perf.stop();
+    double instructions = double(cpu.cycles) * loopInstructions / loopCycles;
+    reportRates(state, double(cpu.cycles), instructions);
+    reportPerf(state, perf, instructions);
+}
+
+// The body repeated 16 times
+std::vector<Byte> repeated(const std::vector<Byte> & body) {
+    std::vector<Byte> loop;
+    for (int i = 0; i < 16; i++)
+        loop.insert(loop.end(), body.begin(), body.end());
+    return loop;
+}
+
+// JMP abs cannot repeat in place, so it jumps along a chain of 16
+std::vector<Byte> jumpChain() {
+    std::vector<Byte> loop;
+    for (int i = 0; i < 16; i++) {
+        Word next = Word(loopStart + loop.size() + 3);
+        loop.insert(loop.end(), { 0x4C, Byte(next & 0xFF), Byte(next >> 8) });
+    }
+    return loop;
+}
+
+const struct {
+    const char * name;
+    CPU::Engine engine;
+} engines[] = {
+    { "dispatch", CPU::Engine::Dispatch },
+    { "blocks", CPU::Engine::Blocks },
+    { "jit", CPU::Engine::Jit },
+};
+
+bool registerOpcodeBenchmarks() {
+    for (const auto & engine : engines) {
+        for (const OpcodeCase & c : opcodeCases())
+            benchmark::RegisterBenchmark((std::string("Opcode/") + c.name + "/" + engine.name).c_str(),
+                                         opcodeBenchmark, repeated(c.body), c.p, engine.engine);
+        benchmark::RegisterBenchmark((std::string("Opcode/JMP abs/") + engine.name).c_str(),
+                                     opcodeBenchmark, jumpChain(), binary, engine.engine);
+    }
+    return true;
+}
+
+const bool registered = registerOpcodeBenchmarks();
+
+}
@@ -0,0 +1,109 @@
+#include "bench.h"
+#include "aot.h"
+
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+
+// End to end: Klaus Dormann's functional test from reset to its success
+// trap, on every engine of CPU and on the other cores.
+
+namespace {
+
+constexpr Word klausStart = 0x0400;
+constexpr Word klausSuccess = 0x3469;
+
+// The loaded image, with the cycles and instructions of a full pass
+struct KlausImage {
+    Memory mem;
+    bool loaded = false;
+    long long cycles = 0;
+    long long instructions = 0;
+};
+
+template <class Core>
+std::unique_ptr<Core> klausCore(Memory & mem) {
+    std::unique_ptr<Core> cpu(new Core(&mem));
+    cpu->reset();
+    cpu->PC = klausStart;
+    cpu->cycles = 0;
+    return cpu;
+}
+
+const KlausImage & klaus() {
+    static const KlausImage image = []() {
+        KlausImage k;
+        std::ifstream file(TEST_PROGRAMS_DIR "/6502_functional_test.bin", std::ios::binary);
+        std::vector<Byte> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (bytes.size() != MEMORY_SIZE)
+            return k;
+        k.mem.writeBlock(0, bytes.data(), bytes.size());
+        Memory mem = k.mem;
+        auto cpu = klausCore<CPU>(mem);
+        cpu->run(100000000);
+        mem = k.mem;
+        auto fast = klausCore<FastCPU>(mem);
+        fast->run(100000000);
+        k.cycles = cpu->cycles;
+        k.instructions = fast->cycles;
+        k.loaded = cpu->PC == klausSuccess && fast->PC == klausSuccess;
+        return k;
+    }();
+    return image;
+}
+
+// Each pass gets new memory and a new core, so that no engine starts with
+// blocks or translations left from the last
+template <class Core>
+void runKlaus(benchmark::State & state, CPU::Engine engine = CPU::Engine::Dispatch) {
+    const KlausImage & k = klaus();
+    if (!k.loaded) {
+        state.SkipWithError("6502_functional_test.bin missing or failing");
+        return;
+    }
+    BenchPerf perf;
+    for (auto _ : state) {
+        state.PauseTiming();
+        std::unique_ptr<Memory> mem(new Memory(k.mem));
+        auto cpu = klausCore<Core>(*mem);
+        cpu->engine = engine;
+        for (const AotProgram * program : aotPrograms())
+            if (std::string(program->name) == "klaus")
+                cpu->aotProgram = program;
+        state.ResumeTiming();
+        perf.start();
+        cpu->run(100000000);
+        perf.stop();
+        state.PauseTiming();
+        bool passed = cpu->PC == klausSuccess;
+        cpu.reset();
+        mem.reset();
+        state.ResumeTiming();
+        if (!passed) {
+            state.SkipWithError("functional test failed");
+            return;
+        }
+    }
+    reportRates(state, double(k.cycles) * state.iterations(), double(k.instructions) * state.iterations());
+    reportPerf(state, perf, double(k.instructions) * state.iterations());
+}
+
+// CPU on each engine; Aot runs the copy recompiled into this binary
+void Klaus(benchmark::State & state, CPU::Engine engine) {
+    runKlaus<CPU>(state, engine);
+}
+BENCHMARK_CAPTURE(Klaus, dispatch, CPU::Engine::Dispatch)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(Klaus, blocks, CPU::Engine::Blocks)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(Klaus, jit, CPU::Engine::Jit)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(Klaus, aot, CPU::Engine::Aot)->Unit(benchmark::kMillisecond);
+
+template <class Core>
+void KlausCore(benchmark::State & state) {
+    runKlaus<Core>(state);
+}
+BENCHMARK_TEMPLATE(KlausCore, FastCPU)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(KlausCore, TracingCPU)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(KlausCore, MappedCPU)->Unit(benchmark::kMillisecond);
+
+}
@@ -0,0 +1,171 @@
+#include "bench.h"
+#include "alu.h"
+
+#include <type_traits>
+
+// Subsystems on their own: the table handlers against the dispatch loop on
+// each core, the lazy-flag and ALU helpers, and a load or store through each
+// bus policy.
+
+namespace {
+
+// LDY #0 / loop: LDA ($20),Y / STA ($22),Y / INY / BNE loop, copying a page
+const std::vector<Byte> copyLoop = { 0xA0, 0x00, 0xB1, 0x20, 0x91, 0x22, 0xC8, 0xD0, 0xF9 };
+
+template <class Core>
+void loadCopyLoop(Memory & mem, Core & cpu) {
+    mem.mem[0x20] = 0x00;
+    mem.mem[0x21] = 0x40;
+    mem.mem[0x22] = 0x00;
+    mem.mem[0x23] = 0x50;
+    loadLoop(mem, copyLoop);
+    cpu.PC = loopStart;
+    cpu.SP = 0xFF;
+    cpu.A = cpu.X = cpu.Y = 0;
+    cpu.P = 0x24;
+    cpu.cycles = 0;
+}
+
+// One instruction at a time through the opcode table
+void TableStep(benchmark::State & state) {
+    Memory mem;
+    CPU cpu(&mem);
+    loadCopyLoop(mem, cpu);
+    long long instructions = 0;
+    BenchPerf perf;
+    perf.start();
+    for (auto _ : state) {
+        for (int i = 0; i < 1000; i++)
+            cpu.execute();
+        instructions += 1000;
+    }
+    perf.stop();
+    reportRates(state, double(cpu.cycles), double(instructions));
+    reportPerf(state, perf, double(instructions));
+}
+BENCHMARK(TableStep);
+
+// The dispatch loop specialised for each core. FastCPU counts instructions
+// instead of cycles, so its cycles are worked out from the loop's ratio.
+template <class Core>
+void DispatchLoop(benchmark::State & state) {
+    Memory mem;
+    Core cpu(&mem);
+    loadCopyLoop(mem, cpu);
+    long long loopInstructions, loopCycles;
+    measureLoop(mem, cpu, loopInstructions, loopCycles);
+    BenchPerf perf;
+    perf.start();
+    for (auto _ : state)
+        cpu.run(100000);
+    perf.stop();
+    double ratio = double(loopInstructions) / loopCycles;
+    bool countsInstructions = std::is_same<typename Core::Cycles, InstructionCount>::value;
+    double instructions = countsInstructions ? double(cpu.cycles) : cpu.cycles * ratio;
+    reportRates(state, instructions / ratio, instructions);
+    reportPerf(state, perf, instructions);
+}
+BENCHMARK_TEMPLATE(DispatchLoop, CPU);
+BENCHMARK_TEMPLATE(DispatchLoop, FastCPU);
+BENCHMARK_TEMPLATE(DispatchLoop, TracingCPU);
+BENCHMARK_TEMPLATE(DispatchLoop, MappedCPU);
+BENCHMARK_TEMPLATE(DispatchLoop, ProfilingCPU);
+
+// Lazy flags: P unpacked into Flags and assembled again, as around PHP and
+// each run() of the dispatch loop
+void FlagsPackUnpack(benchmark::State & state) {
+    for (auto _ : state) {
+        for (int p = 0; p < 256; p++) {
+            Byte packed = packFlags(unpackFlags(Byte(p)));
+            benchmark::DoNotOptimize(packed);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * 256);
+}
+BENCHMARK(FlagsPackUnpack);
+
+// ADC and SBC over every operand, in binary (0) and decimal mode (1)
+void FlagsAdc(benchmark::State & state) {
+    Flags f = unpackFlags(state.range(0) ? 0x2C : 0x24);
+    Byte a = 0x11;
+    for (auto _ : state) {
+        for (int v = 0; v < 256; v++)
+            adc(a, f, Byte(v));
+        benchmark::DoNotOptimize(a);
+        benchmark::DoNotOptimize(f);
+    }
+    state.SetItemsProcessed(state.iterations() * 256);
+}
+BENCHMARK(FlagsAdc)->Arg(0)->Arg(1);
+
+void FlagsSbc(benchmark::State & state) {
+    Flags f = unpackFlags(state.range(0) ? 0x2D : 0x25);
+    Byte a = 0x99;
+    for (auto _ : state) {
+        for (int v = 0; v < 256; v++)
+            sbc(a, f, Byte(v));
+        benchmark::DoNotOptimize(a);
+        benchmark::DoNotOptimize(f);
+    }
+    state.SetItemsProcessed(state.iterations() * 256);
+}
+BENCHMARK(FlagsSbc)->Arg(0)->Arg(1);
+
+void FlagsCompare(benchmark::State & state) {
+    Flags f = unpackFlags(0x24);
+    for (auto _ : state) {
+        for (int v = 0; v < 256; v++) {
+            compare(f, 0x80, Byte(v));
+            benchmark::DoNotOptimize(f);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * 256);
+}
+BENCHMARK(FlagsCompare);
+
+// Loads and stores striding through memory on each bus. The argument maps
+// page $40 as: 0 RAM, 1 a device, 2 RAM with decoded code on it, which only
+// MemoryBus tracks stores to.
+void mapPage(Memory & mem, int64_t kind) {
+    if (kind == 1)
+        mem.mapDevice(0x40, 1, Device { [](Word addr) { return Byte(addr); }, [](Word, Byte) {} });
+    if (kind == 2) {
+        mem.codePage[0x40] = 1;
+        for (Word addr = 0x4000; addr < 0x4100; addr += 2)
+            mem.codeBytes[addr] = true;
+    }
+}
+
+template <class Bus>
+void BusRead(benchmark::State & state) {
+    Memory mem;
+    mapPage(mem, state.range(0));
+    unsigned sum = 0;
+    for (auto _ : state) {
+        for (Word addr = 0x4000; addr < 0x4100; addr++)
+            sum += Bus::read(mem, addr);
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * 256);
+}
+BENCHMARK_TEMPLATE(BusRead, MemoryBus)->Arg(0);
+BENCHMARK_TEMPLATE(BusRead, DirectBus)->Arg(0);
+BENCHMARK_TEMPLATE(BusRead, PagedBus)->Arg(0)->Arg(1);
+
+template <class Bus>
+void BusWrite(benchmark::State & state) {
+    Memory mem;
+    mapPage(mem, state.range(0));
+    for (auto _ : state) {
+        for (Word addr = 0x4000; addr < 0x4100; addr++)
+            Bus::write(mem, addr, Byte(addr));
+        benchmark::ClobberMemory();
+        mem.dirtyCode.clear();
+    }
+    state.SetItemsProcessed(state.iterations() * 256);
+}
+BENCHMARK_TEMPLATE(BusWrite, MemoryBus)->Arg(0)->Arg(2);
+BENCHMARK_TEMPLATE(BusWrite, DirectBus)->Arg(0);
+BENCHMARK_TEMPLATE(BusWrite, PagedBus)->Arg(0)->Arg(1);
+
+}
@@ -0,0 +1,147 @@
+#include "acia.h"
+#include "cpu.h"
+
+#include <algorithm>
+#include <climits>
+
+Acia6551::Acia6551(CPUState & cpu, unsigned irqSource, long long cyclesPerSecond)
+    : cpu(cpu), irqSource(irqSource), cyclesPerSecond(cyclesPerSecond)
+{
+}
+
+Acia6551::~Acia6551()
+{
+    if (event)
+        cpu.events.cancel(event);
+    cpu.setIRQ(false, irqSource);
+}
+
+void Acia6551::map(Memory & mem, Byte firstPage, int pages)
+{
+    mem.mapDevice(firstPage, pages, Device {
+        [this](Word addr) { return read(addr); },
+        [this](Word addr, Byte value) { write(addr, value); } });
+}
+
+void Acia6551::reset()
+{
+    // A hardware reset; bytes already in the host rings stay there
+    command = control = 0;
+    irq = rxFull = false;
+    txEmpty = true;
+    updateIrq();
+    schedule();
+}
+
+long long Acia6551::characterCycles() const
+{
+    static const double baud[16] = {
+        115200, 50, 75, 109.92, 134.58, 150, 300, 600,
+        1200, 1800, 2400, 3600, 4800, 7200, 9600, 19200
+    };
+    // Start bit, data bits, parity and stop bits
+    int bits = 1 + (8 - ((control >> 5) & 3)) + ((command & 0x20) ? 1 : 0) + ((control & 0x80) ? 2 : 1);
+    return std::max(1LL, static_cast<long long>(cyclesPerSecond * bits / baud[control & 0x0F]));
+}
+
+Byte Acia6551::read(Word addr)
+{
+    update();
+    Byte value = 0;
+    switch (addr & 3) {
+    case Data:
+        value = received;
+        rxFull = false;
+        break;
+    case Status:
+        value = (rxFull ? RxFull : 0) | (txEmpty ? TxEmpty : 0) | (irq ? Irq : 0);
+        irq = false;
+        break;
+    case Command: value = command; break;
+    case Control: value = control; break;
+    }
+    updateIrq();
+    schedule();
+    return value;
+}
+
+void Acia6551::write(Word addr, Byte value)
+{
+    update();
+    switch (addr & 3) {
+    case Data:
+        // Like the chip, a byte written before TDRE is set replaces the one waiting
+        if (txEmpty)
+            txDone = cpu.cycles + characterCycles();
+        sending = value;
+        txEmpty = false;
+        break;
+    case Status:
+        // Programmed reset
+        command &= 0xE0;
+        irq = false;
+        break;
+    case Command:
+        command = value;
+        if (txIrqEnabled() && txEmpty)
+            irq = true;
+        break;
+    case Control:
+        control = value;
+        break;
+    }
+    updateIrq();
+    schedule();
+}
+
+void Acia6551::update()
+{
+    const long long now = cpu.cycles;
+    if (!txEmpty && now >= txDone) {
+        if (tx.push(sending)) {
+            txEmpty = true;
+            if (txIrqEnabled())
+                irq = true;
+        } else {
+            txDone = now + characterCycles();
+        }
+    }
+    Byte value;
+    if (receiverOn() && !rxFull && now >= rxNext && rx.pop(value)) {
+        received = value;
+        rxFull = true;
+        rxNext = now + characterCycles();
+        if (command & 0x10)
+            tx.push(value);
+        if (rxIrqEnabled())
+            irq = true;
+    }
+}
+
+void Acia6551::updateIrq()
+{
+    cpu.setIRQ(irq, irqSource);
+}
+
+void Acia6551::schedule()
+{
+    // The byte on its way out, and while a receive interrupt could come,
+    // a look at rx once per character time. An earlier event already
+    // pending is kept: waking up early only costs an update().
+    long long when = LLONG_MAX;
+    if (!txEmpty)
+        when = txDone;
+    if (rxIrqEnabled() && !rxFull)
+        when = std::min(when, std::max(rxNext, cpu.cycles + characterCycles()));
+    if (when == LLONG_MAX || (event && eventAt <= when))
+        return;
+    if (event)
+        cpu.events.cancel(event);
+    eventAt = when;
+    event = cpu.events.at(when, [this](CPUState &) {
+        event = 0;
+        update();
+        updateIrq();
+        schedule();
+    });
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "types.h"
+#include "memory.h"
+#include "ringbuffer.h"
+#include "scheduler.h"
+
+class CPUState;
+
+// MOS 6551 Asynchronous Communications Interface Adapter: one serial port
+// with data, status, command and control registers, driving the CPU's IRQ
+// line.
+//
+// The wire is a pair of lock-free single-producer/single-consumer rings.
+// The guest side only pops rx and pushes tx, so it never makes a host
+// syscall and never waits; a HostSerial (serial.h) on another thread moves
+// bytes between the rings and stdin/stdout, a pipe or a socket. Without
+// one, the embedder may fill rx and drain tx itself.
+//
+// Baud rate is modelled from the cycle count, one character every
+// characterCycles(). A byte written to the data register clears TDRE and
+// goes out when its character time ends; a received byte lands in the data
+// register no sooner than one character time after the last. Both happen
+// at the next register access or at a scheduled event, and events are only
+// scheduled while a byte is on its way out or while a receive interrupt is
+// enabled and the data register is empty, then once per character time.
+// Nothing runs per instruction. The host rings are flow-controlled, so
+// received bytes wait in rx rather than overrun, and a byte whose time is
+// up while tx is full goes out at the next character time.
+//
+// Registers repeat every 4 bytes over the pages given to map(), which need
+// a core on PagedBus (MappedCPU) counting cycles. Baud rates are against
+// cyclesPerSecond; the external-clock setting (control bits 0-3 clear)
+// runs at 115200 baud. DCD and DSR always read as asserted, parity is
+// counted in the character time but never checked, and echo mode returns
+// each received byte through tx.
+
+class Acia6551
+{
+public:
+    enum Register : Byte { Data, Status, Command, Control };
+
+    enum StatusBit : Byte {
+        ParityError = 0x01, FramingError = 0x02, Overrun = 0x04, RxFull = 0x08,
+        TxEmpty = 0x10, NoDcd = 0x20, NoDsr = 0x40, Irq = 0x80
+    };
+
+    // irqSource is this chip's bit in CPUState::setIRQ()
+    Acia6551(CPUState & cpu, unsigned irqSource = 1, long long cyclesPerSecond = 1000000);
+    ~Acia6551();
+    Acia6551(const Acia6551 &) = delete;
+    Acia6551 & operator=(const Acia6551 &) = delete;
+
+    // Host to guest, filled by the I/O thread
+    SpscRing<Byte, 4096> rx;
+    // Guest to host, drained by the I/O thread
+    SpscRing<Byte, 4096> tx;
+
+    // Maps the registers over pages in mem
+    void map(Memory & mem, Byte firstPage, int pages = 1);
+    Byte read(Word addr);
+    void write(Word addr, Byte value);
+    void reset();
+
+    // Cycles to send or receive one character with the current settings
+    long long characterCycles() const;
+
+private:
+    void update();
+    void updateIrq();
+    void schedule();
+    bool receiverOn() const { return command & 0x01; }
+    bool rxIrqEnabled() const { return receiverOn() && !(command & 0x02); }
+    bool txIrqEnabled() const { return (command & 0x0C) == 0x04; }
+
+    CPUState & cpu;
+    unsigned irqSource;
+    long long cyclesPerSecond;
+
+    Byte command = 0;
+    Byte control = 0;
+    bool irq = false;
+
+    Byte received = 0;
+    bool rxFull = false;
+    long long rxNext = 0;      // earliest cycle the next byte may land
+
+    Byte sending = 0;
+    bool txEmpty = true;
+    long long txDone = 0;      // cycle the byte being sent is out
+
+    Scheduler::EventId event = 0;
+    long long eventAt = 0;
+};
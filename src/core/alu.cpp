@@ -0,0 +1,48 @@
+#include "alu.h"
+
+// The decimal-mode tables, built from bcdAdd/bcdSubtract with the flag rules
+// the handlers always applied: V compares the signs of A, the operand and the
+// BCD result, and SBC sets C when the BCD subtraction did not borrow. Each
+// table is its own constant so no single evaluation runs into the compiler's
+// constexpr step limit.
+
+namespace {
+
+constexpr DecimalTable makeAdcTable(Byte carry) {
+    DecimalTable table {};
+    for (int a = 0; a < 256; a++) {
+        for (int v = 0; v < 256; v++) {
+            Word sum = bcdAdd(a, v, carry);
+            Byte result = sum & 0xFF;
+            Word entry = result | (sum & 0x100 ? DecimalCarry : 0);
+            if ((~(a ^ v)) & (a ^ result) & 0x80)
+                entry |= DecimalOverflow;
+            table[a][v] = entry;
+        }
+    }
+    return table;
+}
+
+constexpr DecimalTable makeSbcTable(Byte carry) {
+    DecimalTable table {};
+    for (int a = 0; a < 256; a++) {
+        for (int v = 0; v < 256; v++) {
+            Word difference = bcdSubtract(a, v, carry ? 0 : 1);
+            Byte result = difference & 0xFF;
+            Word entry = result | (difference & 0x100 ? 0 : DecimalCarry);
+            if ((a ^ v) & (a ^ result) & 0x80)
+                entry |= DecimalOverflow;
+            table[a][v] = entry;
+        }
+    }
+    return table;
+}
+
+constexpr DecimalTable adcClear = makeAdcTable(0);
+constexpr DecimalTable adcSet = makeAdcTable(1);
+constexpr DecimalTable sbcClear = makeSbcTable(0);
+constexpr DecimalTable sbcSet = makeSbcTable(1);
+
+}
+
+constexpr DecimalTables decimalTables = { { adcClear, adcSet }, { sbcClear, sbcSet } };
@@ -0,0 +1,179 @@
+#pragma once
+
+#include "types.h"
+
+#include <array>
+
+// ALU helpers shared by the execution engines. The BCD helpers build the
+// decimal-mode tables below; bit 8 of their result carries the decimal
+// carry (ADC) or borrow (SBC).
+
+constexpr Word bcdAdd(Byte a, Byte b, Byte carry) {
+    // Add low nibbles (ones place)
+    Word lowNibble = (a & 0x0F) + (b & 0x0F) + carry;
+    Word lowCarry = 0;
+    if (lowNibble > 9) {
+        lowNibble += 6;  // Adjust for BCD
+    }
+    // Check if we need to carry to high nibble
+    if (lowNibble > 15) {
+        lowCarry = 1;
+    }
+
+    // Add high nibble (tens place) with carry from low nibble
+    Word highNibble = (a >> 4) + (b >> 4) + lowCarry;
+    Word highCarry = 0;
+    if (highNibble > 9) {
+        highNibble += 6;  // Adjust for BCD
+    }
+    // Check if we need to carry out
+    if (highNibble > 15) {
+        highCarry = 1;
+    }
+
+    // Combine nibbles - result is in BCD format
+    Word result = ((highNibble & 0x0F) << 4) | (lowNibble & 0x0F);
+
+    // Return with carry bit in upper byte if overflow
+    if (highCarry) {
+        result |= 0x100;
+    }
+
+    return result;
+}
+
+constexpr Word bcdSubtract(Byte a, Byte b, Byte borrow) {
+    // Subtract low nibble (ones place)
+    int lowNibble = (a & 0x0F) - (b & 0x0F) - borrow;
+    int lowBorrow = 0;
+    if (lowNibble < 0) {
+        lowNibble += 10;  // Borrow from high nibble
+        lowBorrow = 1;
+    }
+
+    // Subtract high nibble (tens place) with borrow from low nibble
+    int highNibble = (a >> 4) - (b >> 4) - lowBorrow;
+    int highBorrow = 0;
+    if (highNibble < 0) {
+        highNibble += 10;  // Underflow
+        highBorrow = 1;
+    }
+
+    // Combine nibbles
+    Word result = ((highNibble & 0x0F) << 4) | (lowNibble & 0x0F);
+
+    // Set bit 8 if there was a borrow (for carry flag detection)
+    if (highBorrow) {
+        result |= 0x100;
+    }
+
+    return result;
+}
+
+// Decimal-mode ADC/SBC results, indexed by carry, A and the operand and
+// generated from bcdAdd/bcdSubtract at compile time (alu.cpp). An entry
+// holds the result in its low byte, C in bit 8 and V in bit 14, so
+// entry >> 8 lines the flags up with P.
+enum : Word {
+    DecimalCarry = 0x0100,
+    DecimalOverflow = 0x4000,
+};
+
+using DecimalTable = std::array<std::array<Word, 256>, 256>;
+
+struct DecimalTables {
+    DecimalTable adc[2];
+    DecimalTable sbc[2];
+};
+
+extern const DecimalTables decimalTables;
+
+// Lazy status flags. Between instructions N/Z/C/V live unpacked in locals:
+// N and Z are derived from the last result byte(s) instead of being masked
+// into P by every ALU op. P is only assembled when something reads it whole
+// (PHP, BRK, or the caller once run() returns).
+struct Flags {
+    Byte n;     // N is bit 7 of n
+    Byte z;     // Z is set when z is zero
+    Byte c;     // 0 or 1
+    Byte v;     // 0 or 0x40
+    Byte idb;   // I, D, B and bit 5, exactly as in P
+};
+
+inline Flags unpackFlags(Byte p) {
+    return { p, Byte(!(p & 0x02)), Byte(p & 0x01), Byte(p & 0x40), Byte(p & 0x3C) };
+}
+
+inline Byte packFlags(const Flags & f) {
+    return (f.n & 0x80) | f.v | f.idb | (f.z ? 0x00 : 0x02) | f.c;
+}
+
+// ALU operations, matching the table handlers bit for bit.
+
+inline void decimalResult(Byte & a, Flags & f, Word entry) {
+    a = entry & 0xFF;
+    f.n = f.z = a;
+    f.c = (entry >> 8) & 0x01;
+    f.v = (entry >> 8) & 0x40;
+}
+
+inline void adc(Byte & a, Flags & f, Byte v) {
+    if (f.idb & 0x08) {
+        decimalResult(a, f, decimalTables.adc[f.c][a][v]);
+        return;
+    }
+    Word binary = a + f.c + v;
+    Byte result = binary & 0xFF;
+    f.v = (((~(a ^ v)) & (a ^ result) & 0x80) >> 1);
+    f.n = f.z = result;
+    f.c = binary > 0xFF;
+    a = result;
+}
+
+inline void sbc(Byte & a, Flags & f, Byte v) {
+    if (f.idb & 0x08) {
+        decimalResult(a, f, decimalTables.sbc[f.c][a][v]);
+        return;
+    }
+    Word binary = a - v - (f.c ? 0 : 1);
+    Byte result = binary & 0xFF;
+    f.v = (((a ^ v) & (a ^ result) & 0x80) >> 1);
+    f.n = f.z = result;
+    f.c = !(binary & 0x100);
+    a = result;
+}
+
+inline void compare(Flags & f, Byte reg, Byte v) {
+    f.n = f.z = reg - v;
+    f.c = reg >= v;
+}
+
+inline Byte asl(Flags & f, Byte v) {
+    f.c = v >> 7;
+    v <<= 1;
+    f.n = f.z = v;
+    return v;
+}
+
+inline Byte lsr(Flags & f, Byte v) {
+    f.c = v & 0x01;
+    v >>= 1;
+    f.n = f.z = v;
+    return v;
+}
+
+inline Byte rol(Flags & f, Byte v) {
+    Byte carry = f.c;
+    f.c = v >> 7;
+    v = (v << 1) | carry;
+    f.n = f.z = v;
+    return v;
+}
+
+inline Byte ror(Flags & f, Byte v) {
+    Byte carry = f.c;
+    f.c = v & 0x01;
+    v = (v >> 1) | (carry << 7);
+    f.n = f.z = v;
+    return v;
+}
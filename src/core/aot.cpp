@@ -0,0 +1,113 @@
+#include "aot.h"
+#include "engines.h"
+
+#include <algorithm>
+
+static std::vector<const AotProgram *> & registry()
+{
+    static std::vector<const AotProgram *> programs;
+    return programs;
+}
+
+AotRegistration::AotRegistration(const AotProgram & program)
+{
+    registry().push_back(&program);
+}
+
+const std::vector<const AotProgram *> & aotPrograms()
+{
+    return registry();
+}
+
+AotRuntime::AotRuntime(const AotProgram & _program, Memory * _mem)
+    : program(_program)
+    , mem(_mem)
+    , valid(_program.blockCount, 0)
+    , index(MEMORY_SIZE, -1)
+{
+    std::vector<bool> immediate(MEMORY_SIZE, false);
+    for (size_t i = 0; i < program.immediateCount; i++)
+        immediate[program.immediates[i]] = true;
+
+    for (size_t i = 0; i < program.blockCount; i++) {
+        const AotBlock & block = program.blocks[i];
+        index[block.start] = int(i);
+
+        // Only blocks whose code is what was compiled may run
+        bool same = true;
+        for (Word k = 0; k < block.length && same; k++) {
+            Word addr = block.start + k;
+            same = immediate[addr] || mem->read(addr) == program.code[block.code + k];
+        }
+        if (!same)
+            continue;
+        valid[i] = 1;
+
+        for (Word k = 0; k < block.length; k++) {
+            Word addr = block.start + k;
+            if (!immediate[addr]) {
+                mem->codeBytes.set(addr);
+                mem->codePage[addr >> 8] = 1;
+            }
+        }
+        Byte page = block.start >> 8;
+        for (;;) {
+            pageBlocks[page].push_back(int(i));
+            if (page == Byte(Word(block.start + block.length - 1) >> 8))
+                break;
+            page++;
+        }
+    }
+}
+
+void AotRuntime::invalidateDirty()
+{
+    for (Word addr : mem->dirtyCode) {
+        for (int i : pageBlocks[addr >> 8]) {
+            const AotBlock & block = program.blocks[i];
+            if (Word(addr - block.start) < block.length)
+                valid[i] = 0;
+        }
+    }
+    mem->dirtyCode.clear();
+    mem->codeDirty = false;
+}
+
+size_t AotRuntime::validBlocks() const
+{
+    return std::count(valid.begin(), valid.end(), 1);
+}
+
+CPU::StopReason runAot(CPU & cpu, long long cycleLimit)
+{
+    if (!cpu.aotRuntime || &cpu.aotRuntime->program != cpu.aotProgram || cpu.aotRuntime->mem != cpu.mem)
+        cpu.aotRuntime.reset(new AotRuntime(*cpu.aotProgram, cpu.mem));
+    AotRuntime & rt = *cpu.aotRuntime;
+    const AotProgram & program = rt.program;
+    Memory & m = *cpu.mem;
+
+    CPU::StopReason reason = CPU::StopReason::Budget;
+    while (reason == CPU::StopReason::Budget && cpu.cycles < cycleLimit) {
+        if (m.codeDirty)
+            rt.invalidateDirty();
+
+        int block = rt.blockAt(cpu.PC);
+        if (block >= 0 && rt.valid[block] && cpu.cycles + program.blocks[block].maxCycles <= cycleLimit) {
+            BlockState s { &m, cpu.PC, cpu.A, cpu.X, cpu.Y, cpu.SP, unpackFlags(cpu.P), cpu.cycles, CPU::StopReason::Budget, cycleLimit };
+            program.blocks[block].run(s, rt.valid.data());
+            cpu.PC = s.pc;
+            cpu.A = s.a;
+            cpu.X = s.x;
+            cpu.Y = s.y;
+            cpu.SP = s.sp;
+            cpu.P = packFlags(s.f);
+            cpu.cycles = s.cyc;
+            reason = s.stop;
+            continue;
+        }
+
+        // No compiled code here: one instruction through the dispatch loop
+        reason = runDispatch(cpu, std::min(cpu.cycles + 1, cycleLimit));
+    }
+    return reason;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "blockcache.h"
+#include "cycles.h"
+
+#include <cstddef>
+#include <vector>
+
+// Statically recompiled programs behind CPU::Engine::Aot.
+//
+// The 6502_aot tool follows control flow through a binary from its entry
+// points and writes a C++ translation unit with one label per basic block,
+// grouped into functions of neighbouring blocks. Linked into the host, it runs
+// those blocks with no decode or dispatch; branches and jumps between blocks
+// of a function are plain gotos. The generated code returns whenever it
+// reaches a block of another function, an address it has no block for, a
+// block invalidated by a store, or a block that might not fit in the budget.
+// The engine then calls the next function or steps the dispatch loop until it
+// lands on a block again.
+//
+// Each block checks at entry that it is still valid. When the engine starts,
+// blocks whose bytes in memory differ from the compiled image are dropped,
+// and stores to their code through Memory::write drop them from then on.
+// Immediate operands are read from memory at run time, as in the block
+// engine, so code that patches its own immediates stays compiled.
+
+struct AotBlock {
+    Word start;
+    Word length;
+    unsigned maxCycles; // upper bound on the cycles the block can take
+    unsigned code;      // offset of its bytes in AotProgram::code
+    // Runs compiled blocks from s.pc while it can. Only called with s.pc on a
+    // block of the same function that is valid and fits the budget.
+    void (*run)(BlockState & s, const Byte * valid);
+};
+
+struct AotProgram {
+    const char * name;
+    const AotBlock * blocks;
+    size_t blockCount;
+    const Byte * code;          // bytes each block was compiled from
+    const Word * immediates;    // immediate operand addresses, not watched for stores
+    size_t immediateCount;
+};
+
+// Addressing modes whose address depends on run-time state, charging the same
+// page-cross penalties as the dispatch loop. The generated code adds each
+// instruction's opcodeCycles itself.
+
+inline Word aotAbsoluteIndexed(Word base, Byte index, long long & cyc) {
+    cyc += absoluteIndexedPenalty(base, index);
+    return base + index;
+}
+
+inline Word aotIndexedIndirect(const Memory & m, Byte operand, Byte x) {
+    Byte zp = operand + x;
+    return m.read(zp) | (m.read(zp + 1) << 8);
+}
+
+inline Word aotIndirectIndexed(const Memory & m, Byte zp, Byte y, long long & cyc) {
+    Word addr = m.read(zp) | (m.read(zp + 1) << 8);
+    addr += y;
+    cyc += indirectIndexedPenalty(addr);
+    return addr;
+}
+
+// Generated translation units register their program at start-up
+struct AotRegistration {
+    explicit AotRegistration(const AotProgram & program);
+};
+
+const std::vector<const AotProgram *> & aotPrograms();
+
+// Per-CPU state for a program: which blocks are still valid. Blocks that did
+// not match memory when it was created stay dropped, so reset CPU::aotRuntime
+// after loading a new image behind the engine's back.
+class AotRuntime
+{
+public:
+    AotRuntime(const AotProgram & program, Memory * mem);
+
+    // Index of the block starting at pc, or -1
+    inline int blockAt(Word pc) const { return index[pc]; }
+    void invalidateDirty();
+    size_t validBlocks() const;
+
+    const AotProgram & program;
+    Memory * mem;
+    std::vector<Byte> valid;
+
+private:
+    std::vector<int> index;
+    std::vector<int> pageBlocks[256];   // valid blocks by each page they cover
+};
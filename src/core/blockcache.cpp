@@ -0,0 +1,513 @@
+#include "blockcache.h"
+#include "engines.h"
+#include "cycles.h"
+
+#include <algorithm>
+#include <type_traits>
+
+// Block engine handlers. Addressing modes resolve the pre-decoded operand and
+// charge the same penalties as the CPU:: helpers; operation classes hold the
+// semantics. The handler templates combine the two per opcode. Static costs
+// come from opcodeCycles when a block is decoded.
+
+namespace {
+
+typedef BlockState S;
+
+// Immediate operands are read at run time from the byte after the opcode, so
+// code that patches its own immediates does not force a re-decode
+struct Imm  { static const Byte bytes = 2; static Word ea(S &, Word operand) { return operand; } };
+struct Zp   { static const Byte bytes = 2; static Word ea(S &, Word operand) { return operand; } };
+struct Zpx  { static const Byte bytes = 2; static Word ea(S & s, Word operand) { return Byte(operand + s.x); } };
+struct Zpy  { static const Byte bytes = 2; static Word ea(S & s, Word operand) { return Byte(operand + s.y); } };
+struct Abs  { static const Byte bytes = 3; static Word ea(S &, Word operand) { return operand; } };
+
+struct Absx {
+    static const Byte bytes = 3;
+    static Word ea(S & s, Word operand) {
+        s.cyc += absoluteIndexedPenalty(operand, s.x);
+        return operand + s.x;
+    }
+};
+
+struct Absy {
+    static const Byte bytes = 3;
+    static Word ea(S & s, Word operand) {
+        s.cyc += absoluteIndexedPenalty(operand, s.y);
+        return operand + s.y;
+    }
+};
+
+struct Ix {
+    static const Byte bytes = 2;
+    static Word ea(S & s, Word operand) {
+        Byte zp = operand + s.x;
+        return s.m->read(zp) | (s.m->read(zp + 1) << 8);
+    }
+};
+
+struct Iy {
+    static const Byte bytes = 2;
+    static Word ea(S & s, Word operand) {
+        Word addr = (s.m->read(operand) | (s.m->read(operand + 1) << 8)) + s.y;
+        s.cyc += indirectIndexedPenalty(addr);
+        return addr;
+    }
+};
+
+template <class Mode> inline Byte readOperand(S & s, Word operand) { return s.m->read(Mode::ea(s, operand)); }
+
+// Operations
+
+struct LDA { static void apply(S & s, Byte v) { s.a = v; s.f.n = s.f.z = v; } };
+struct LDX { static void apply(S & s, Byte v) { s.x = v; s.f.n = s.f.z = v; } };
+struct LDY { static void apply(S & s, Byte v) { s.y = v; s.f.n = s.f.z = v; } };
+struct AND { static void apply(S & s, Byte v) { s.a &= v; s.f.n = s.f.z = s.a; } };
+struct ORA { static void apply(S & s, Byte v) { s.a |= v; s.f.n = s.f.z = s.a; } };
+struct EOR { static void apply(S & s, Byte v) { s.a ^= v; s.f.n = s.f.z = s.a; } };
+struct ADC { static void apply(S & s, Byte v) { adc(s.a, s.f, v); } };
+struct SBC { static void apply(S & s, Byte v) { sbc(s.a, s.f, v); } };
+struct CMP { static void apply(S & s, Byte v) { compare(s.f, s.a, v); } };
+struct CPX { static void apply(S & s, Byte v) { compare(s.f, s.x, v); } };
+struct CPY { static void apply(S & s, Byte v) { compare(s.f, s.y, v); } };
+struct BIT { static void apply(S & s, Byte v) { s.f.n = v; s.f.z = s.a & v; s.f.v = v & 0x40; } };
+
+struct STA { static Byte value(const S & s) { return s.a; } };
+struct STX { static Byte value(const S & s) { return s.x; } };
+struct STY { static Byte value(const S & s) { return s.y; } };
+
+struct ASL { static Byte apply(S & s, Byte v) { return asl(s.f, v); } };
+struct LSR { static Byte apply(S & s, Byte v) { return lsr(s.f, v); } };
+struct ROL { static Byte apply(S & s, Byte v) { return rol(s.f, v); } };
+struct ROR { static Byte apply(S & s, Byte v) { return ror(s.f, v); } };
+struct INC { static Byte apply(S & s, Byte v) { v++; s.f.n = s.f.z = v; return v; } };
+struct DEC { static Byte apply(S & s, Byte v) { v--; s.f.n = s.f.z = v; return v; } };
+
+struct BPL { static bool taken(const Flags & f) { return !(f.n & 0x80); } };
+struct BMI { static bool taken(const Flags & f) { return f.n & 0x80; } };
+struct BVC { static bool taken(const Flags & f) { return !f.v; } };
+struct BVS { static bool taken(const Flags & f) { return f.v; } };
+struct BCC { static bool taken(const Flags & f) { return !f.c; } };
+struct BCS { static bool taken(const Flags & f) { return f.c; } };
+struct BNE { static bool taken(const Flags & f) { return f.z; } };
+struct BEQ { static bool taken(const Flags & f) { return !f.z; } };
+
+// Handler templates
+
+template <class Mode, class Op>
+void readHandler(S & s, const DecodedOp & op) {
+    Op::apply(s, readOperand<Mode>(s, op.operand));
+}
+
+template <class Mode, class Op>
+void writeHandler(S & s, const DecodedOp & op) {
+    s.m->write(Mode::ea(s, op.operand), Op::value(s));
+}
+
+template <class Mode, class Op>
+void rmwHandler(S & s, const DecodedOp & op) {
+    Word ea = Mode::ea(s, op.operand);
+    s.m->write(ea, Op::apply(s, s.m->read(ea)));
+}
+
+template <class Op>
+void accumulatorHandler(S & s, const DecodedOp &) {
+    s.a = Op::apply(s, s.a);
+}
+
+template <class Cond>
+void branchHandler(S & s, const DecodedOp & op) {
+    if (Cond::taken(s.f)) {
+        s.cyc += branchTakenPenalty(op.next, op.operand);
+        s.pc = op.operand;
+        if (op.operand == op.pc) s.stop = CPU::StopReason::Trap;
+    }
+}
+
+inline void push(S & s, Byte v) { s.m->write(0x100 + s.sp--, v); }
+inline Byte pull(S & s) { return s.m->read(0x100 + ++s.sp); }
+
+void INX(S & s, const DecodedOp &) { s.x++; s.f.n = s.f.z = s.x; }
+void INY(S & s, const DecodedOp &) { s.y++; s.f.n = s.f.z = s.y; }
+void DEX(S & s, const DecodedOp &) { s.x--; s.f.n = s.f.z = s.x; }
+void DEY(S & s, const DecodedOp &) { s.y--; s.f.n = s.f.z = s.y; }
+void TAX(S & s, const DecodedOp &) { s.x = s.a; s.f.n = s.f.z = s.x; }
+void TAY(S & s, const DecodedOp &) { s.y = s.a; s.f.n = s.f.z = s.y; }
+void TXA(S & s, const DecodedOp &) { s.a = s.x; s.f.n = s.f.z = s.a; }
+void TYA(S & s, const DecodedOp &) { s.a = s.y; s.f.n = s.f.z = s.a; }
+void TSX(S & s, const DecodedOp &) { s.x = s.sp; s.f.n = s.f.z = s.x; }
+void TXS(S & s, const DecodedOp &) { s.sp = s.x; }
+void PHA(S & s, const DecodedOp &) { push(s, s.a); }
+void PHP(S & s, const DecodedOp &) { push(s, packFlags(s.f) | 0x30); }
+void PLA(S & s, const DecodedOp &) { s.a = pull(s); s.f.n = s.f.z = s.a; }
+void PLP(S & s, const DecodedOp &) { s.f = unpackFlags(pull(s)); }
+void CLC(S & s, const DecodedOp &) { s.f.c = 0; }
+void SEC(S & s, const DecodedOp &) { s.f.c = 1; }
+void CLI(S & s, const DecodedOp &) { s.f.idb &= ~0x04; }
+void SEI(S & s, const DecodedOp &) { s.f.idb |= 0x04; }
+void CLV(S & s, const DecodedOp &) { s.f.v = 0; }
+void CLD(S & s, const DecodedOp &) { s.f.idb &= ~0x08; }
+void SED(S & s, const DecodedOp &) { s.f.idb |= 0x08; }
+void NOP(S &, const DecodedOp &) {}
+
+void JMPABS(S & s, const DecodedOp & op) {
+    s.pc = op.operand;
+    if (s.pc == op.pc) s.stop = CPU::StopReason::Trap;
+}
+
+void JMPIND(S & s, const DecodedOp & op) {
+    s.pc = s.m->read16(op.operand);
+    if (s.pc == op.pc) s.stop = CPU::StopReason::Trap;
+}
+
+void JSR(S & s, const DecodedOp & op) {
+    Word ret = op.pc + 2;
+    push(s, ret >> 8);
+    push(s, ret & 0xFF);
+    s.pc = op.operand;
+}
+
+void RTS(S & s, const DecodedOp &) {
+    Byte lo = pull(s);
+    Byte hi = pull(s);
+    s.pc = ((hi << 8) | lo) + 1;
+}
+
+void RTI(S & s, const DecodedOp &) {
+    s.f = unpackFlags(pull(s));
+    Byte lo = pull(s);
+    Byte hi = pull(s);
+    s.pc = (hi << 8) | lo;
+}
+
+void BRK(S & s, const DecodedOp & op) {
+    Word ret = op.pc + 2;
+    push(s, ret >> 8);
+    push(s, ret & 0xFF);
+    push(s, packFlags(s.f) | 0x30);
+    s.pc = s.m->read16(0xFFFE);
+    s.f.idb |= 0x04;
+}
+
+void HALT(S & s, const DecodedOp & op) {
+    s.pc = op.pc;
+    s.stop = CPU::StopReason::Halt;
+}
+
+// Decode table
+
+struct OpInfo {
+    BlockHandler handler;
+    Byte bytes;
+    bool ends;      // control flow leaves the straight line
+    bool writes;
+    bool branch;    // operand is a relative offset
+    bool immediate; // operand is the address of the immediate byte, which is not cached
+};
+
+struct DecodeTable {
+    OpInfo ops[256];
+
+    template <class Mode, class Op> void read(Byte opcode)  { ops[opcode] = { &readHandler<Mode, Op>, Mode::bytes, false, false, false, std::is_same<Mode, Imm>::value }; }
+    template <class Mode, class Op> void write(Byte opcode) { ops[opcode] = { &writeHandler<Mode, Op>, Mode::bytes, false, true, false, false }; }
+    template <class Mode, class Op> void rmw(Byte opcode)   { ops[opcode] = { &rmwHandler<Mode, Op>, Mode::bytes, false, true, false, false }; }
+    template <class Cond> void branch(Byte opcode)          { ops[opcode] = { &branchHandler<Cond>, 2, true, false, true, false }; }
+    void op(Byte opcode, BlockHandler h, Byte bytes, bool ends = false, bool writes = false) { ops[opcode] = { h, bytes, ends, writes, false, false }; }
+
+    DecodeTable() {
+        for (OpInfo & info : ops)
+            info = { &HALT, 1, true, false, false, false };
+
+        read<Imm, LDA>(0xA9); read<Zp, LDA>(0xA5); read<Zpx, LDA>(0xB5); read<Abs, LDA>(0xAD);
+        read<Absx, LDA>(0xBD); read<Absy, LDA>(0xB9); read<Ix, LDA>(0xA1); read<Iy, LDA>(0xB1);
+        read<Imm, LDX>(0xA2); read<Zp, LDX>(0xA6); read<Zpy, LDX>(0xB6); read<Abs, LDX>(0xAE); read<Absy, LDX>(0xBE);
+        read<Imm, LDY>(0xA0); read<Zp, LDY>(0xA4); read<Zpx, LDY>(0xB4); read<Abs, LDY>(0xAC); read<Absx, LDY>(0xBC);
+
+        write<Zp, STA>(0x85); write<Zpx, STA>(0x95); write<Abs, STA>(0x8D); write<Absx, STA>(0x9D);
+        write<Absy, STA>(0x99); write<Ix, STA>(0x81); write<Iy, STA>(0x91);
+        write<Zp, STX>(0x86); write<Zpy, STX>(0x96); write<Abs, STX>(0x8E);
+        write<Zp, STY>(0x84); write<Zpx, STY>(0x94); write<Abs, STY>(0x8C);
+
+        read<Imm, ADC>(0x69); read<Zp, ADC>(0x65); read<Zpx, ADC>(0x75); read<Abs, ADC>(0x6D);
+        read<Absx, ADC>(0x7D); read<Absy, ADC>(0x79); read<Ix, ADC>(0x61); read<Iy, ADC>(0x71);
+        read<Imm, SBC>(0xE9); read<Zp, SBC>(0xE5); read<Zpx, SBC>(0xF5); read<Abs, SBC>(0xED);
+        read<Absx, SBC>(0xFD); read<Absy, SBC>(0xF9); read<Ix, SBC>(0xE1); read<Iy, SBC>(0xF1);
+        read<Imm, AND>(0x29); read<Zp, AND>(0x25); read<Zpx, AND>(0x35); read<Abs, AND>(0x2D);
+        read<Absx, AND>(0x3D); read<Absy, AND>(0x39); read<Ix, AND>(0x21); read<Iy, AND>(0x31);
+        read<Imm, ORA>(0x09); read<Zp, ORA>(0x05); read<Zpx, ORA>(0x15); read<Abs, ORA>(0x0D);
+        read<Absx, ORA>(0x1D); read<Absy, ORA>(0x19); read<Ix, ORA>(0x01); read<Iy, ORA>(0x11);
+        read<Imm, EOR>(0x49); read<Zp, EOR>(0x45); read<Zpx, EOR>(0x55); read<Abs, EOR>(0x4D);
+        read<Absx, EOR>(0x5D); read<Absy, EOR>(0x59); read<Ix, EOR>(0x41); read<Iy, EOR>(0x51);
+        read<Imm, CMP>(0xC9); read<Zp, CMP>(0xC5); read<Zpx, CMP>(0xD5); read<Abs, CMP>(0xCD);
+        read<Absx, CMP>(0xDD); read<Absy, CMP>(0xD9); read<Ix, CMP>(0xC1); read<Iy, CMP>(0xD1);
+        read<Imm, CPX>(0xE0); read<Zp, CPX>(0xE4); read<Abs, CPX>(0xEC);
+        read<Imm, CPY>(0xC0); read<Zp, CPY>(0xC4); read<Abs, CPY>(0xCC);
+        read<Zp, BIT>(0x24); read<Abs, BIT>(0x2C);
+
+        rmw<Zp, INC>(0xE6); rmw<Zpx, INC>(0xF6); rmw<Abs, INC>(0xEE); rmw<Absx, INC>(0xFE);
+        rmw<Zp, DEC>(0xC6); rmw<Zpx, DEC>(0xD6); rmw<Abs, DEC>(0xCE); rmw<Absx, DEC>(0xDE);
+        rmw<Zp, ASL>(0x06); rmw<Zpx, ASL>(0x16); rmw<Abs, ASL>(0x0E); rmw<Absx, ASL>(0x1E);
+        rmw<Zp, LSR>(0x46); rmw<Zpx, LSR>(0x56); rmw<Abs, LSR>(0x4E); rmw<Absx, LSR>(0x5E);
+        rmw<Zp, ROL>(0x26); rmw<Zpx, ROL>(0x36); rmw<Abs, ROL>(0x2E); rmw<Absx, ROL>(0x3E);
+        rmw<Zp, ROR>(0x66); rmw<Zpx, ROR>(0x76); rmw<Abs, ROR>(0x6E); rmw<Absx, ROR>(0x7E);
+        op(0x0A, &accumulatorHandler<ASL>, 1);
+        op(0x4A, &accumulatorHandler<LSR>, 1);
+        op(0x2A, &accumulatorHandler<ROL>, 1);
+        op(0x6A, &accumulatorHandler<ROR>, 1);
+
+        op(0xE8, &INX, 1); op(0xC8, &INY, 1); op(0xCA, &DEX, 1); op(0x88, &DEY, 1);
+        op(0xAA, &TAX, 1); op(0xA8, &TAY, 1); op(0x8A, &TXA, 1); op(0x98, &TYA, 1);
+        op(0xBA, &TSX, 1); op(0x9A, &TXS, 1);
+        op(0x48, &PHA, 1, false, true); op(0x08, &PHP, 1, false, true);
+        op(0x68, &PLA, 1); op(0x28, &PLP, 1);
+        op(0x18, &CLC, 1); op(0x38, &SEC, 1); op(0x58, &CLI, 1); op(0x78, &SEI, 1);
+        op(0xB8, &CLV, 1); op(0xD8, &CLD, 1); op(0xF8, &SED, 1);
+        op(0xEA, &NOP, 1);
+
+        branch<BPL>(0x10); branch<BMI>(0x30); branch<BVC>(0x50); branch<BVS>(0x70);
+        branch<BCC>(0x90); branch<BCS>(0xB0); branch<BNE>(0xD0); branch<BEQ>(0xF0);
+
+        op(0x4C, &JMPABS, 3, true);
+        op(0x6C, &JMPIND, 3, true);
+        op(0x20, &JSR, 3, true, true);
+        op(0x60, &RTS, 1, true);
+        op(0x40, &RTI, 1, true);
+        op(0x00, &BRK, 2, true, true);
+    }
+};
+
+const DecodeTable decodeTable;
+
+// Superinstructions. The fused op is the first op with the second's next
+// address and both cycle costs; both handlers are known here, so they
+// inline into one.
+
+template <BlockHandler First, BlockHandler Second>
+void fusedHandler(S & s, const DecodedOp & op) {
+    First(s, op);
+    Second(s, *op.second);
+}
+
+struct FusionTable {
+    struct Pair {
+        Byte second;
+        BlockHandler handler;
+    };
+    std::vector<Pair> pairs[256];   // by first opcode
+
+    template <BlockHandler First, BlockHandler Second> void fuse(Byte first, Byte second) {
+        pairs[first].push_back({ second, &fusedHandler<First, Second> });
+    }
+
+    template <class Mode> void loadStore(Byte lda) {
+        fuse<&readHandler<Mode, LDA>, &writeHandler<Zp, STA>>(lda, 0x85);
+        fuse<&readHandler<Mode, LDA>, &writeHandler<Zpx, STA>>(lda, 0x95);
+        fuse<&readHandler<Mode, LDA>, &writeHandler<Abs, STA>>(lda, 0x8D);
+        fuse<&readHandler<Mode, LDA>, &writeHandler<Absx, STA>>(lda, 0x9D);
+        fuse<&readHandler<Mode, LDA>, &writeHandler<Absy, STA>>(lda, 0x99);
+        fuse<&readHandler<Mode, LDA>, &writeHandler<Ix, STA>>(lda, 0x81);
+        fuse<&readHandler<Mode, LDA>, &writeHandler<Iy, STA>>(lda, 0x91);
+    }
+
+    BlockHandler find(Byte first, Byte second) const {
+        for (const Pair & pair : pairs[first])
+            if (pair.second == second)
+                return pair.handler;
+        return nullptr;
+    }
+
+    // The pairs that dominate typical guest loops; 6502_pairs reports which
+    // pairs a program actually runs
+    FusionTable() {
+        fuse<&DEX, &branchHandler<BNE>>(0xCA, 0xD0);
+        fuse<&DEY, &branchHandler<BNE>>(0x88, 0xD0);
+
+        loadStore<Imm>(0xA9); loadStore<Zp>(0xA5); loadStore<Zpx>(0xB5); loadStore<Abs>(0xAD);
+        loadStore<Absx>(0xBD); loadStore<Absy>(0xB9); loadStore<Ix>(0xA1); loadStore<Iy>(0xB1);
+
+        fuse<&readHandler<Imm, CMP>, &branchHandler<BEQ>>(0xC9, 0xF0);
+        fuse<&readHandler<Zp, CMP>, &branchHandler<BEQ>>(0xC5, 0xF0);
+        fuse<&readHandler<Zpx, CMP>, &branchHandler<BEQ>>(0xD5, 0xF0);
+        fuse<&readHandler<Abs, CMP>, &branchHandler<BEQ>>(0xCD, 0xF0);
+        fuse<&readHandler<Absx, CMP>, &branchHandler<BEQ>>(0xDD, 0xF0);
+        fuse<&readHandler<Absy, CMP>, &branchHandler<BEQ>>(0xD9, 0xF0);
+        fuse<&readHandler<Ix, CMP>, &branchHandler<BEQ>>(0xC1, 0xF0);
+        fuse<&readHandler<Iy, CMP>, &branchHandler<BEQ>>(0xD1, 0xF0);
+
+        // Only the modes with a static address, so build() can check it
+        fuse<&rmwHandler<Zp, INC>, &branchHandler<BNE>>(0xE6, 0xD0);
+        fuse<&rmwHandler<Abs, INC>, &branchHandler<BNE>>(0xEE, 0xD0);
+    }
+};
+
+const FusionTable fusionTable;
+
+}
+
+bool fusesPair(Byte first, Byte second)
+{
+    return fusionTable.find(first, second) != nullptr;
+}
+
+BlockCache::BlockCache(Memory * _mem): mem(_mem) {
+
+}
+
+Block & BlockCache::build(Word start)
+{
+    Block * block = new Block();
+    block->start = start;
+    blocks[start].reset(block);
+    count++;
+
+    DecodedOp ops[MaxBlockOps];
+    Byte opcodes[MaxBlockOps];
+    int n = 0;
+    Word pc = start;
+    while (n < MaxBlockOps) {
+        Byte opcode = mem->read(pc);
+        const OpInfo & info = decodeTable.ops[opcode];
+        opcodes[n] = opcode;
+        DecodedOp & op = ops[n++];
+        op.handler = info.handler;
+        op.second = nullptr;
+        op.pc = pc;
+        op.next = pc + info.bytes;
+        op.cycles = opcodeCycles[opcode];
+        op.writes = info.writes;
+        if (info.branch)
+            op.operand = op.next + static_cast<signed char>(mem->read(pc + 1));
+        else if (info.immediate)
+            op.operand = pc + 1;
+        else if (info.bytes == 3)
+            op.operand = mem->read16(pc + 1);
+        else if (info.bytes == 2)
+            op.operand = mem->read(pc + 1);
+        else
+            op.operand = 0;
+
+        Word cached = info.immediate ? pc + 1 : op.next;
+        for (Word addr = op.pc; addr != cached; addr++)
+            mem->codeBytes.set(addr);
+
+        pc = op.next;
+        if (info.ends)
+            break;
+    }
+    block->ops.assign(ops, ops + n);
+
+    // Fuse pairs left to right. A first half that stores must not store into
+    // the second, which would then have to be re-decoded between them.
+    for (int i = 0; i < n; i++) {
+        DecodedOp op = ops[i];
+        BlockHandler fused = i + 1 < n ? fusionTable.find(opcodes[i], opcodes[i + 1]) : nullptr;
+        const DecodedOp * second = fused ? &block->ops[i + 1] : nullptr;
+        if (second && (!op.writes || Word(op.operand - second->pc) >= Word(second->next - second->pc))) {
+            op.handler = fused;
+            op.next = second->next;
+            op.cycles += second->cycles;
+            op.writes |= second->writes;
+            op.second = second;
+            i++;
+        }
+        block->fused.push_back(op);
+    }
+
+    block->length = pc - start;
+    block->maxCycles = 0;
+    block->loops = (decodeTable.ops[opcodes[n - 1]].branch || opcodes[n - 1] == 0x4C) && ops[n - 1].operand == start;
+    block->counted = n == 2 && opcodes[1] == 0xD0 && ops[1].operand == start;
+    for (int i = 0; i < n; i++) {
+        block->maxCycles += ops[i].cycles + maxPenaltyCycles;
+        block->loops &= !ops[i].writes;
+    }
+
+    block->pages.push_back(start >> 8);
+    if ((start >> 8) != (Word(pc - 1) >> 8))
+        block->pages.push_back(Word(pc - 1) >> 8);
+    for (Byte page : block->pages) {
+        pageBlocks[page].push_back(start);
+        mem->codePage[page] = 1;
+    }
+    return *block;
+}
+
+void BlockCache::invalidate(Word start)
+{
+    std::unique_ptr<Block> block = std::move(blocks[start]);
+    if (!block)
+        return;
+    count--;
+    nativeEntry[start] = nullptr;
+    for (Byte page : block->pages) {
+        std::vector<Word> & starts = pageBlocks[page];
+        starts.erase(std::remove(starts.begin(), starts.end(), start), starts.end());
+        if (starts.empty())
+            mem->codePage[page] = 0;
+    }
+}
+
+void BlockCache::invalidateAt(Word addr)
+{
+    std::vector<Word> starts = pageBlocks[addr >> 8];
+    for (Word start : starts) {
+        const Block & block = *blocks[start];
+        if (Word(addr - block.start) < block.length)
+            invalidate(start);
+    }
+    // codeBytes stays set: another block may still cover addr, and a stale bit
+    // only costs a scan that finds nothing
+}
+
+void BlockCache::flushDirty()
+{
+    for (Word addr : mem->dirtyCode)
+        invalidateAt(addr);
+    mem->dirtyCode.clear();
+    mem->codeDirty = false;
+}
+
+void BlockCache::flush()
+{
+    for (int start = 0; start < MEMORY_SIZE; start++)
+        invalidate(start);
+    mem->codeBytes.reset();
+    mem->dirtyCode.clear();
+    mem->codeDirty = false;
+}
+
+CPU::StopReason runBlocks(CPU & cpu, long long cycleLimit)
+{
+    if (!cpu.blockCache || cpu.blockCache->mem != cpu.mem)
+        cpu.blockCache.reset(new BlockCache(cpu.mem));
+    BlockCache & cache = *cpu.blockCache;
+    Memory & m = *cpu.mem;
+
+    BlockState s { &m, cpu.PC, cpu.A, cpu.X, cpu.Y, cpu.SP, unpackFlags(cpu.P), cpu.cycles, CPU::StopReason::Budget, cycleLimit };
+
+    while (s.stop == CPU::StopReason::Budget) {
+        if (m.codeDirty)
+            cache.flushDirty();
+        const Block & block = cache.lookup(s.pc);
+        if (block.loops || block.counted) {
+            if (block.counted && cpu.skipDelayLoops && runDelayLoop(s, block, cycleLimit))
+                continue;
+            if (block.loops && cpu.skipIdleLoops) {
+                if (!runIdleCandidate(s, cycleLimit, [&] { return runBlock(s, block, cycleLimit); }))
+                    break;
+                continue;
+            }
+        }
+        if (!runBlock(s, block, cycleLimit))
+            break;
+    }
+
+    cpu.PC = s.pc;
+    cpu.A = s.a;
+    cpu.X = s.x;
+    cpu.Y = s.y;
+    cpu.SP = s.sp;
+    cpu.P = packFlags(s.f);
+    cpu.cycles = s.cyc;
+    return s.stop;
+}
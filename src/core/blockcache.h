@@ -0,0 +1,171 @@
+#pragma once
+
+#include "cpu.h"
+#include "alu.h"
+#include "idle.h"
+#include "delay.h"
+
+#include <memory>
+#include <vector>
+
+// Pre-decoded basic-block cache behind CPU::Engine::Blocks.
+//
+// Straight-line code is decoded once into a Block of DecodedOps, each holding
+// the handler for its opcode, its resolved operand and its static cycle cost,
+// so running a hot block skips opcode fetch, operand fetch and addressing-mode
+// decode. Blocks are keyed by start PC; when Memory::write stores to a decoded
+// byte, only the blocks whose bytes cover that address are dropped.
+//
+// Common opcode pairs (DEX/BNE, LDA/STA, ...) are fused when a block is
+// decoded into a superinstruction that runs both from one dispatch, with
+// their cycles charged together. Block::fused holds the ops with pairs
+// merged; Block::ops keeps every instruction on its own, for runs where the
+// budget may end between the two halves and for the JIT.
+//
+// A block that stores nothing and ends by jumping back to its own start is a
+// candidate idle loop (idle.h): runIdleCandidate() checks each pass and
+// fast-forwards once one leaves the registers unchanged. A block that is a
+// counter step and a BNE back to it may be a delay loop (delay.h), which
+// runDelayLoop() finishes in closed form from its start.
+
+struct BlockState;
+struct DecodedOp;
+
+typedef void (*BlockHandler)(BlockState &, const DecodedOp &);
+typedef void (*NativeBlock)(BlockState *);
+
+// Registers as the block engine holds them while it runs
+struct BlockState {
+    Memory * m;
+    Word pc;
+    Byte a, x, y, sp;
+    Flags f;
+    long long cyc;
+    CPU::StopReason stop;
+    long long limit;    // cycle budget; the JIT checks it before chaining blocks
+};
+
+struct DecodedOp {
+    BlockHandler handler;
+    Word pc;        // address of the instruction
+    Word next;      // address of the following instruction
+    Word operand;   // immediate value, zero-page/absolute address or branch target
+    Byte cycles;    // static cost; page-cross and branch penalties are added by the handler
+    bool writes;    // may store to memory, so cached code can be stale afterwards
+    const DecodedOp * second;   // in Block::fused, the op a superinstruction also runs; else null
+};
+
+struct Block {
+    std::vector<DecodedOp> ops;
+    std::vector<DecodedOp> fused;   // ops with fusable pairs merged
+    std::vector<Byte> pages;    // pages the block was decoded from
+    Word start;
+    Word length;                // bytes decoded, from start
+    long long maxCycles;        // upper bound on the cycles the whole block can take
+    bool loops;                 // stores nothing and may jump back to start: a candidate idle loop
+    bool counted;               // one op and a BNE back to start: a candidate delay loop
+    unsigned hits = 0;
+    NativeBlock native = nullptr;   // translated code, once the JIT engine finds the block hot
+};
+
+class BlockCache
+{
+public:
+    explicit BlockCache(Memory *);
+
+    static const int MaxBlockOps = 32;
+
+    inline Block & lookup(Word pc) { Block * b = blocks[pc].get(); return b ? *b : build(pc); }
+    void flushDirty();
+    void flush();
+    size_t size() const { return count; }
+
+    Memory * mem;
+
+    // Body entry of each block's translated code, if any, keyed by start PC.
+    // Translated blocks jump through this to chain without leaving native
+    // code; invalidating a block clears its entry.
+    const void * nativeEntry[MEMORY_SIZE] = {};
+
+private:
+    Block & build(Word pc);
+    void invalidate(Word start);
+    void invalidateAt(Word addr);
+
+    std::unique_ptr<Block> blocks[MEMORY_SIZE];
+    std::vector<Word> pageBlocks[256];
+    size_t count = 0;
+};
+
+// Whether the block engine fuses first followed by second. INC/BNE is only
+// fused when the INC does not store into the BNE.
+bool fusesPair(Byte first, Byte second);
+
+// Runs one block through its handlers, stopping early once the budget is spent
+// (returns false) or when a store rewrites decoded code.
+inline bool runBlock(BlockState & s, const Block & block, long long cycleLimit)
+{
+    // The budget cannot run out inside the block, so no stop can land between
+    // the halves of a pair: run the fused ops without per-op checks
+    if (s.cyc + block.maxCycles < cycleLimit) {
+        for (const DecodedOp & op : block.fused) {
+            s.pc = op.next;
+            op.handler(s, op);
+            s.cyc += op.cycles;
+            if (op.writes && s.m->codeDirty)
+                break;
+        }
+        return true;
+    }
+
+    for (const DecodedOp & op : block.ops) {
+        if (s.cyc >= cycleLimit) {
+            s.pc = op.pc;
+            return false;
+        }
+        s.pc = op.next;
+        op.handler(s, op);
+        s.cyc += op.cycles;
+        // A store may have rewritten this very block; re-decode from here
+        if (op.writes && s.m->codeDirty)
+            break;
+    }
+    return true;
+}
+
+// Runs the Block::counted block at s.pc as a delay loop in closed form, if
+// it is one and ends within the budget
+inline bool runDelayLoop(BlockState & s, const Block & block, long long cycleLimit)
+{
+    DelayLoop loop = delayLoop(*s.m, block.start, block.ops[1].pc, s.x, s.y);
+    if (!loop.passes || s.cyc + loop.cycles > cycleLimit)
+        return false;
+    switch (loop.step) {
+    case 0xCA: case 0xE8: s.x = 0; break;
+    case 0x88: case 0xC8: s.y = 0; break;
+    default: s.m->write(loop.counter, 0); break;
+    }
+    s.f.n = s.f.z = 0;
+    s.pc = loop.exit;
+    s.cyc += loop.cycles;
+    return true;
+}
+
+inline IdleState idleState(const BlockState & s)
+{
+    return IdleState { s.pc, s.a, s.x, s.y, s.sp, s.f, s.cyc };
+}
+
+// One pass of a Block::loops block through run(s), which returns runBlock's
+// result. A pass that came back to the start with every register unchanged
+// is repeated until the budget by skipping its cycles.
+template <class Run>
+inline bool runIdleCandidate(BlockState & s, long long cycleLimit, Run run)
+{
+    IdleState before = idleState(s);
+    if (!run())
+        return false;
+    if (s.stop == CPU::StopReason::Budget && sameRegisters(before, idleState(s)))
+        s.cyc += idleSkip(s.cyc, s.cyc - before.cycles, cycleLimit);
+    return true;
+}
@@ -0,0 +1,138 @@
+#include "blockdev.h"
+#include "cpu.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if !defined(_WIN32)
+#define CPU_BLOCK_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define CPU_BLOCK_MMAP 0
+#endif
+
+BlockDevice::BlockDevice(CPUState & cpu) : cpu(cpu)
+{
+}
+
+BlockDevice::~BlockDevice()
+{
+    close();
+}
+
+bool BlockDevice::open(const std::string & path, bool readOnly)
+{
+    close();
+#if CPU_BLOCK_MMAP
+    fd = ::open(path.c_str(), readOnly ? O_RDONLY : O_RDWR);
+    if (fd < 0)
+        return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < static_cast<off_t>(sectorSize)) {
+        close();
+        return false;
+    }
+    void * mapping = mmap(nullptr, info.st_size, readOnly ? PROT_READ : PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+        close();
+        return false;
+    }
+    image = static_cast<Byte *>(mapping);
+    size = info.st_size;
+    this->readOnly = readOnly;
+    error = false;
+    return true;
+#else
+    (void)path;
+    (void)readOnly;
+    return false;
+#endif
+}
+
+void BlockDevice::close()
+{
+#if CPU_BLOCK_MMAP
+    if (image)
+        munmap(image, size);
+    if (fd >= 0)
+        ::close(fd);
+#endif
+    image = nullptr;
+    size = 0;
+    fd = -1;
+}
+
+void BlockDevice::map(Memory & mem, Byte firstPage, int pages)
+{
+    mem.mapDevice(firstPage, pages, Device {
+        [this](Word addr) { return read(addr); },
+        [this](Word addr, Byte value) { write(addr, value); } });
+}
+
+Byte BlockDevice::read(Word addr)
+{
+    Byte reg = addr & 7;
+    if (reg != Command)
+        return registers[reg];
+    return (image ? Ready : 0) | (readOnly ? ReadOnly : 0) | (error ? Error : 0);
+}
+
+void BlockDevice::write(Word addr, Byte value)
+{
+    Byte reg = addr & 7;
+    if (reg != Command) {
+        registers[reg] = value;
+        return;
+    }
+    error = !transfer(value);
+}
+
+bool BlockDevice::transfer(Byte command)
+{
+    if (!image)
+        return false;
+    if (command == Flush) {
+        cpu.cycles += setupCycles;
+#if CPU_BLOCK_MMAP
+        return readOnly || msync(image, size, MS_SYNC) == 0;
+#else
+        return true;
+#endif
+    }
+    if (command != Read && command != Write)
+        return false;
+    if (command == Write && readOnly)
+        return false;
+
+    size_t sector = registers[Sector0] | (registers[Sector1] << 8) | (registers[Sector2] << 16);
+    size_t count = registers[Count] ? registers[Count] : 256;
+    if (sector + count > sectors())
+        return false;
+
+    Memory & mem = *cpu.mem;
+    Byte * disk = image + sector * sectorSize;
+    size_t bytes = count * sectorSize;
+    Word address = registers[AddressLow] | (registers[AddressHigh] << 8);
+    // In runs that stop at the top of memory
+    for (size_t done = 0; done < bytes; ) {
+        size_t run = std::min(bytes - done, size_t(MEMORY_SIZE - address));
+        if (command == Read) {
+            std::memcpy(mem.mem + address, disk + done, run);
+            for (size_t page = address >> 8; page <= (address + run - 1) >> 8; page++) {
+                if (!mem.codePage[page])
+                    continue;
+                for (size_t at = std::max<size_t>(address, page << 8); at < std::min(address + run, (page + 1) << 8); at++)
+                    mem.markCodeDirty(at);
+            }
+        } else {
+            std::memcpy(disk + done, mem.mem + address, run);
+        }
+        done += run;
+        address += run;
+    }
+    cpu.cycles += setupCycles + cyclesPerSector * count;
+    return true;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "types.h"
+#include "memory.h"
+
+#include <cstddef>
+#include <string>
+
+class CPUState;
+
+// Block storage with DMA: the guest sets a sector number, a memory address
+// and a sector count, then writes a command; the whole transfer happens
+// inside that store.
+//
+// The disk image is mapped into the host's address space, so a read is a
+// memcpy from the mapping into Memory::mem and a write a memcpy back, with
+// no per-byte emulation and no file I/O until the host pages it in or out.
+// Flush syncs the mapping to the file. The CPU is stalled for the transfer:
+// setupCycles plus cyclesPerSector for each sector are added to
+// CPUState::cycles before the store returns, so the guest sees the status
+// already settled. DMA goes straight to Memory::mem, beneath the page
+// table, and wraps at $FFFF; stores over pre-decoded code are reported to
+// the block cache like any other.
+//
+// Registers repeat every 8 bytes over the pages given to map(), which need
+// a core on PagedBus (MappedCPU). Sector numbers are 24 bits, a count of 0
+// means 256 sectors, and none of the registers advance after a transfer. A
+// transfer reaching past the image, a write to a read-only image or any
+// command without one sets Error and moves nothing. POSIX hosts only;
+// elsewhere open() fails.
+
+class BlockDevice
+{
+public:
+    static constexpr size_t sectorSize = 256;
+
+    enum Register : Byte {
+        Command,                // write: a CommandCode; read: status
+        Sector0, Sector1, Sector2,
+        AddressLow, AddressHigh,
+        Count
+    };
+
+    enum CommandCode : Byte { Read = 1, Write = 2, Flush = 3 };
+
+    enum StatusBit : Byte { Error = 0x01, ReadOnly = 0x02, Ready = 0x40 };
+
+    explicit BlockDevice(CPUState & cpu);
+    ~BlockDevice();
+    BlockDevice(const BlockDevice &) = delete;
+    BlockDevice & operator=(const BlockDevice &) = delete;
+
+    long long setupCycles = 100;
+    long long cyclesPerSector = 256;
+
+    // Maps the image at path; false if it cannot be opened or mapped
+    bool open(const std::string & path, bool readOnly = false);
+    void close();
+    size_t sectors() const { return size / sectorSize; }
+
+    // Maps the registers over pages in mem
+    void map(Memory & mem, Byte firstPage, int pages = 1);
+    Byte read(Word addr);
+    void write(Word addr, Byte value);
+
+private:
+    bool transfer(Byte command);
+
+    CPUState & cpu;
+    Byte * image = nullptr;
+    size_t size = 0;
+    int fd = -1;
+    bool readOnly = false;
+
+    Byte registers[8] = {};
+    bool error = false;
+};
@@ -1,7 +1,16 @@
 #include "cpu.h"
+#include "aot.h"
+#include "blockcache.h"
+#include "jit.h"
+#include "engines.h"
+
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 // Forward declaration of common helper function
-void SetNZ(CPU * cpu, Byte reg);
+template <class C> void SetNZ(C * cpu, Byte reg);
 
 #include "../instructions/load.cpp"
 #include "../instructions/store.cpp"
@@ -17,52 +26,59 @@ void SetNZ(CPU * cpu, Byte reg);
 #include "../instructions/shifts.cpp"
 #include "../instructions/misc.cpp"
 
-CPU::CPU(Memory *_mem): mem(_mem){
+CPUState::CPUState(Memory *_mem): mem(_mem){
 
 }
 
-void BRK(CPU * cpu) {
+CPUState::~CPUState() = default;
+
+template <class C>
+void BRK(C * cpu) {
     cpu->PC++;  // BRK has a dummy operand byte, skip it
     cpu->push(cpu->PC >> 8);
     cpu->push(cpu->PC & 0xFF);
     cpu->push(cpu->P | 0x30);  // B flag and unused flag (bits 4 & 5) are set when pushed
-    cpu->PC = cpu->mem->read16(0XFFFE);
+    cpu->PC = cpu->read16(0XFFFE);
     cpu->setI(true);  // Set interrupt disable flag
+    cpu->hooks.transfer(Transfer::Interrupt, cpu->PC, cpu->SP, cpu->cycles);
 }
 
 // Common helper function for setting N and Z flags
-void SetNZ(CPU * cpu, Byte reg) {
+template <class C>
+void SetNZ(C * cpu, Byte reg) {
     cpu->setZ(reg == 0);
     cpu->setN((reg & 0b10000000) > 0);
 }
 
 
-#define re mem->read
-#define wr mem->write
+#define re read
+#define wr write
 
 //Instructions
-void (*functptr[256])(CPU *) = {
+template <class C>
+void (* const functptr[256])(C *) = {
         //          0        1       2       3       4       5       6       7       8       9       A       B       C       D       E       F
-        /*0*/       &BRK,    &ORAIX, 0,      0,      0,      &ORAZP, &ASLZP, 0,      &PHP,   &ORAI,  &ASLA,  0,      0,      &ORAA,  &ASLABS,0,
-        /*1*/       &BPL,    &ORAIY, 0,      0,      0,      &ORAZPX,&ASLZPX,0,      &CLC,   &ORAAY, 0,      0,      0,      &ORAAX, &ASLABSX,0,
-        /*2*/       &JSR,    &ANDIX, 0,      0,      &BITZP, &ANDZP, &ROLZP, 0,      &PLP,   &ANDI,  &ROLA,  0,      &BITABS,&ANDA,  &ROLABS,0,
-        /*3*/       &BMI,    &ANDIY, 0,      0,      0,      &ANDZPX,&ROLZPX,0,      &SEC,   &ANDAY, 0,      0,      0,      &ANDAX, &ROLABSX,0,
-        /*4*/       &RTI,    &EORIX, 0,      0,      0,      &EORZP, &LSRZP, 0,      &PHA,   &EORI,  &LSRA,  0,      &JMPABS,&EORA,  &LSRABS,0,
-        /*5*/       &BVC,    &EORIY, 0,      0,      0,      &EORZPX,&LSRZPX,0,      &CLI,   &EORAY, 0,      0,      0,      &EORAX, &LSRABSX,0,
-        /*6*/       &RTS,    &ADCIX, 0,      0,      0,      &ADCZ,  &RORZP, 0,      &PLA,   &ADCI,  &RORA,  0,      &JMPIND,&ADCA,  &RORABS,0,
-        /*7*/       &BVS,    &ADCIY, 0,      0,      0,      &ADCZX, &RORZPX,0,      &SEI,   &ADCAY, 0,      0,      0,      &ADCAX, &RORABSX,0,
-        /*8*/       0,       &STAIX, 0,      0,      &STYZP, &STAZ,  &STXZP, 0,      &DEY,   0,      &TXA,   0,      &STYA,  &STAA,  &STXA,  0,
-        /*9*/       &BCC,    &STAIY, 0,      0,      &STYZPX,&STAZX, &STXZPY,0,      &TYA,   &STAAY, &TXS,   0,      0,      &STAAX, 0,      0,
-        /*A*/       &LDYI,   &LDAIX, &LDXI,  0,      &LDYZP, &LDAZ,  &LDXZP, 0,      &TAY,   &LDAI,  &TAX,   0,      &LDYA,  &LDAA,  &LDXA,  0,
-        /*B*/       &BCS,    &LDAIY, 0,      0,      &LDYZPY,&LDAZX, &LDXZPY,0,      &CLV,   &LDAAY, &TSX,   0,      &LDYAY, &LDAAX, &LDXAY, 0,
-        /*C*/       &CPYI,   &CMPIX, 0,      0,      &CPYZP, &CMPZP, &DECZP, 0,      &INY,   &CMPI,  &DEX,   0,      &CPYA,  &CMPA,  &DECA,  0,
-        /*D*/       &BNE,    &CMPIY, 0,      0,      0,      &CMPZPX,&DECZPX,0,      &CLD,   &CMPAY, 0,      0,      0,      &CMPAX, &DECAX, 0,
-        /*E*/       &CPXI,   &SBCIX, 0,      0,      &CPXZP, &SBCZP, &INCZP, 0,      &INX,   &SBCI,  &NOP,   0,      &CPXA,  &SBCA,  &INCA,  0,
-        /*F*/       &BEQ,    &SBCIY, 0,      0,      0,      &SBCZPX,&INCZPX,0,      &SED,   &SBCAY, 0,      0,      0,      &SBCAX, &INCAX, 0
+        /*0*/       &BRK<C>,    &ORAIX<C>, 0,      0,      0,      &ORAZP<C>, &ASLZP<C>, 0,      &PHP<C>,   &ORAI<C>,  &ASLA<C>,  0,      0,      &ORAA<C>,  &ASLABS<C>,0,
+        /*1*/       &BPL<C>,    &ORAIY<C>, 0,      0,      0,      &ORAZPX<C>,&ASLZPX<C>,0,      &CLC<C>,   &ORAAY<C>, 0,      0,      0,      &ORAAX<C>, &ASLABSX<C>,0,
+        /*2*/       &JSR<C>,    &ANDIX<C>, 0,      0,      &BITZP<C>, &ANDZP<C>, &ROLZP<C>, 0,      &PLP<C>,   &ANDI<C>,  &ROLA<C>,  0,      &BITABS<C>,&ANDA<C>,  &ROLABS<C>,0,
+        /*3*/       &BMI<C>,    &ANDIY<C>, 0,      0,      0,      &ANDZPX<C>,&ROLZPX<C>,0,      &SEC<C>,   &ANDAY<C>, 0,      0,      0,      &ANDAX<C>, &ROLABSX<C>,0,
+        /*4*/       &RTI<C>,    &EORIX<C>, 0,      0,      0,      &EORZP<C>, &LSRZP<C>, 0,      &PHA<C>,   &EORI<C>,  &LSRA<C>,  0,      &JMPABS<C>,&EORA<C>,  &LSRABS<C>,0,
+        /*5*/       &BVC<C>,    &EORIY<C>, 0,      0,      0,      &EORZPX<C>,&LSRZPX<C>,0,      &CLI<C>,   &EORAY<C>, 0,      0,      0,      &EORAX<C>, &LSRABSX<C>,0,
+        /*6*/       &RTS<C>,    &ADCIX<C>, 0,      0,      0,      &ADCZ<C>,  &RORZP<C>, 0,      &PLA<C>,   &ADCI<C>,  &RORA<C>,  0,      &JMPIND<C>,&ADCA<C>,  &RORABS<C>,0,
+        /*7*/       &BVS<C>,    &ADCIY<C>, 0,      0,      0,      &ADCZX<C>, &RORZPX<C>,0,      &SEI<C>,   &ADCAY<C>, 0,      0,      0,      &ADCAX<C>, &RORABSX<C>,0,
+        /*8*/       0,       &STAIX<C>, 0,      0,      &STYZP<C>, &STAZ<C>,  &STXZP<C>, 0,      &DEY<C>,   0,      &TXA<C>,   0,      &STYA<C>,  &STAA<C>,  &STXA<C>,  0,
+        /*9*/       &BCC<C>,    &STAIY<C>, 0,      0,      &STYZPX<C>,&STAZX<C>, &STXZPY<C>,0,      &TYA<C>,   &STAAY<C>, &TXS<C>,   0,      0,      &STAAX<C>, 0,      0,
+        /*A*/       &LDYI<C>,   &LDAIX<C>, &LDXI<C>,  0,      &LDYZP<C>, &LDAZ<C>,  &LDXZP<C>, 0,      &TAY<C>,   &LDAI<C>,  &TAX<C>,   0,      &LDYA<C>,  &LDAA<C>,  &LDXA<C>,  0,
+        /*B*/       &BCS<C>,    &LDAIY<C>, 0,      0,      &LDYZPY<C>,&LDAZX<C>, &LDXZPY<C>,0,      &CLV<C>,   &LDAAY<C>, &TSX<C>,   0,      &LDYAY<C>, &LDAAX<C>, &LDXAY<C>, 0,
+        /*C*/       &CPYI<C>,   &CMPIX<C>, 0,      0,      &CPYZP<C>, &CMPZP<C>, &DECZP<C>, 0,      &INY<C>,   &CMPI<C>,  &DEX<C>,   0,      &CPYA<C>,  &CMPA<C>,  &DECA<C>,  0,
+        /*D*/       &BNE<C>,    &CMPIY<C>, 0,      0,      0,      &CMPZPX<C>,&DECZPX<C>,0,      &CLD<C>,   &CMPAY<C>, 0,      0,      0,      &CMPAX<C>, &DECAX<C>, 0,
+        /*E*/       &CPXI<C>,   &SBCIX<C>, 0,      0,      &CPXZP<C>, &SBCZP<C>, &INCZP<C>, 0,      &INX<C>,   &SBCI<C>,  &NOP<C>,   0,      &CPXA<C>,  &SBCA<C>,  &INCA<C>,  0,
+        /*F*/       &BEQ<C>,    &SBCIY<C>, 0,      0,      0,      &SBCZPX<C>,&INCZPX<C>,0,      &SED<C>,   &SBCAY<C>, 0,      0,      0,      &SBCAX<C>, &INCAX<C>, 0
         } ;
 
 
-void CPU::reset()
+template <class CyclePolicy, class BusPolicy, class HookPolicy>
+void BasicCPU<CyclePolicy, BusPolicy, HookPolicy>::reset()
 {
     A = 0X0;
     X = 0X0;
@@ -79,148 +95,302 @@ void CPU::reset()
     cycl();
     SP--;
     cycl();
-    PC = mem->read16(0XFFFC);
+    PC = read16(0XFFFC);
     cycl();
 
 }
 
-void CPU::execute()
+template <class CyclePolicy, class BusPolicy, class HookPolicy>
+void BasicCPU<CyclePolicy, BusPolicy, HookPolicy>::execute()
+{
+    if (interrupts && serviceInterrupt())
+        return;
+    hooks.instruction(CPUTrace { PC, A, X, Y, SP, P, cycles });
+    CyclePolicy::instruction(cycles);
+    Byte instruction = read(PC++);
+    // The whole static cost at once; handlers only add their penalties
+    cycl(opcodeCycles[instruction]);
+    if (functptr<BasicCPU>[instruction])
+        functptr<BasicCPU>[instruction](this);
+    else if (hostCall && instruction == hostCallOpcode)
+        hostCall(*this);  // a single step has no run to end
+    else
+        PC--;  // unimplemented opcode: leave PC on it, as run() does
+}
+
+// The engine selected for the core, up to cycleLimit or a stop
+template <class C>
+static CPUState::StopReason runEngine(C & cpu, long long cycleLimit)
+{
+    // The block, JIT and AOT engines implement CPU only; the other cores run
+    // their own instantiation of the dispatch loop
+    if constexpr (std::is_same<C, CPU>::value) {
+        if (cpu.breakpointCount || !cpu.routines.empty() || (cpu.interrupts & CPUState::IrqAsserted)
+            || cpu.engine == CPUState::Engine::Dispatch)
+            return runDispatch(cpu, cycleLimit);
+        if (cpu.engine == CPUState::Engine::Jit)
+            return runJit(cpu, cycleLimit);
+        if (cpu.engine == CPUState::Engine::Aot)
+            return cpu.aotProgram ? runAot(cpu, cycleLimit) : runDispatch(cpu, cycleLimit);
+        return runBlocks(cpu, cycleLimit);
+    } else {
+        return runDispatch(cpu, cycleLimit);
+    }
+}
+
+template <class CyclePolicy, class BusPolicy, class HookPolicy>
+CPUState::StopReason BasicCPU<CyclePolicy, BusPolicy, HookPolicy>::run(uint64_t budget)
+{
+    long long cycleLimit = cycles + static_cast<long long>(budget);
+    for (;;) {
+        if (interrupts && serviceInterrupt()) {
+            if (cycles >= cycleLimit)
+                return StopReason::Budget;
+            if (breakpointCount && breakpoints[PC])
+                return StopReason::Breakpoint;
+        }
+        // The engine runs up to the next deadline, a budget like any other
+        const Word pc = PC;
+        const long long before = cycles;
+        StopReason reason = runEngine(*this, std::min(cycleLimit, events.deadline()));
+        if (reason == StopReason::Halt && hostCall && mem->mem[PC] == hostCallOpcode) {
+            // Host calls halt the engine like any unimplemented opcode
+            PC++;
+            if (!hostCall(*this))
+                return StopReason::Exit;
+        } else if (reason != StopReason::Budget) {
+            return reason;
+        }
+        events.fire(*this);
+        if (cycles >= cycleLimit)
+            return StopReason::Budget;
+        // The engine runs the instruction under PC before it checks
+        // breakpoints, so one it stopped on before doing so is still ahead
+        if (breakpointCount && breakpoints[PC] && (PC != pc || cycles != before))
+            return StopReason::Breakpoint;
+    }
+}
+
+template <class CyclePolicy, class BusPolicy, class HookPolicy>
+bool BasicCPU<CyclePolicy, BusPolicy, HookPolicy>::serviceInterrupt()
+{
+    Word vector;
+    if (interrupts & NmiLatched) {
+        interrupts &= ~NmiLatched;
+        vector = 0xFFFA;
+    } else if ((interrupts & IrqAsserted) && !I()) {
+        vector = 0xFFFE;
+    } else {
+        return false;
+    }
+    push(PC >> 8);
+    push(PC & 0xFF);
+    push((P & ~0x10) | 0x20);  // B clear tells the handler it was not BRK
+    setI(true);
+    PC = read16(vector);
+    hooks.transfer(Transfer::Interrupt, PC, SP, cycles);
+    cycl(interruptCycles);
+    CyclePolicy::instruction(cycles);
+    return true;
+}
+
+template <class CyclePolicy, class BusPolicy, class HookPolicy>
+bool BasicCPU<CyclePolicy, BusPolicy, HookPolicy>::callRoutine()
+{
+    auto found = routines.find(PC);
+    if (found == routines.end())
+        return true;
+    const NativeRoutine & routine = found->second;
+    // The routine, its cost and its RTS; a FastCPU counts it as one instruction
+    auto runNative = [&]() {
+        routine.run(*this);
+        cycl(routine.cycles);
+        CyclePolicy::instruction(cycles);
+        SP++;
+        Byte lo = read(0x100 + SP);
+        SP++;
+        Byte hi = read(0x100 + SP);
+        PC = ((hi << 8) | lo) + 1;
+        hooks.transfer(Transfer::Return, PC, SP, cycles);
+    };
+    if (!verifyRoutines) {
+        runNative();
+        return true;
+    }
+
+    const Word entry = PC;
+    const Byte a = A, x = X, y = Y, sp = SP, p = P;
+    const long long start = cycles;
+    const Word back = Word((mem->mem[0x100 + Byte(sp + 1)] | (mem->mem[0x100 + Byte(sp + 2)] << 8)) + 1);
+    std::vector<Byte> before(mem->mem, mem->mem + MEMORY_SIZE);
+    runNative();
+    const Word nativePC = PC;
+    const Byte nativeA = A, nativeX = X, nativeY = Y, nativeSP = SP, nativeP = P;
+    std::vector<Byte> native(mem->mem, mem->mem + MEMORY_SIZE);
+
+    // Back to the entry, through write() so the block cache sees code restored
+    for (int addr = 0; addr < MEMORY_SIZE; addr++) {
+        if (mem->mem[addr] != before[addr])
+            mem->write(addr, before[addr]);
+    }
+    PC = entry;
+    A = a; X = x; Y = y; SP = sp; P = p;
+    cycles = start;
+
+    // The guest code has returned once its RTS pops the return address the call pushed
+    const long long MaxSteps = 10000000;
+    for (long long step = 0; step < MaxSteps && !(PC == back && SP == Byte(sp + 2)); step++) {
+        if (!functptr<BasicCPU>[mem->mem[PC]])
+            break;
+        execute();
+    }
+    bool same = PC == nativePC && A == nativeA && X == nativeX && Y == nativeY && SP == nativeSP && P == nativeP
+             && std::equal(native.begin(), native.end(), mem->mem);
+    if (!same)
+        routineMismatches++;
+    return same;
+}
+
+template <class CyclePolicy, class BusPolicy, class HookPolicy>
+CPUState::StopReason BasicCPU<CyclePolicy, BusPolicy, HookPolicy>::runUntil(Word address, uint64_t budget)
+{
+    bool wasSet = breakpoints[address];
+    setBreakpoint(address, true);
+    StopReason reason = run(budget);
+    setBreakpoint(address, wasSet);
+    return reason;
+}
+
+void CPUState::setBreakpoint(Word address, bool enabled)
+{
+    if (breakpoints[address] == enabled)
+        return;
+    breakpoints[address] = enabled;
+    breakpointCount += enabled ? 1 : -1;
+}
+
+void CPUState::clearBreakpoints()
+{
+    breakpoints.reset();
+    breakpointCount = 0;
+}
+
+void CPUState::setIRQ(bool asserted, unsigned source)
+{
+    irqSources = asserted ? irqSources | source : irqSources & ~source;
+    interrupts = irqSources ? interrupts | IrqAsserted : interrupts & ~IrqAsserted;
+}
+
+void CPUState::setNMI(bool asserted)
+{
+    if (asserted && !nmiLine)
+        interrupts |= NmiLatched;
+    nmiLine = asserted;
+}
+
+void CPUState::hookRoutine(Word address, std::function<void(CPUState &)> routine, long long cycles)
+{
+    routines[address] = NativeRoutine { std::move(routine), cycles };
+    routinePages[address >> 8] = true;
+}
+
+void CPUState::unhookRoutine(Word address)
+{
+    routines.erase(address);
+    auto next = routines.lower_bound(address & 0xFF00);
+    routinePages[address >> 8] = next != routines.end() && (next->first >> 8) == (address >> 8);
+}
+
+void CPUState::clearRoutines()
 {
-    Byte instruction = mem->read(PC++);
-    functptr[instruction](this);
+    routines.clear();
+    routinePages.reset();
 }
 
-// cycl() made inline in CPU header for better performance (hot-path inlining).
-// Original out-of-line definition removed.
+// cycl() and the flag setters are inline in the CPU header for better performance (hot-path inlining).
+// Original out-of-line definitions removed.
 
-void CPU::push(uint8_t v) {
-    mem->write(0x100+SP, v);
+template <class CyclePolicy, class BusPolicy, class HookPolicy>
+void BasicCPU<CyclePolicy, BusPolicy, HookPolicy>::push(uint8_t v) {
+    write(0x100+SP, v);
     SP--;
 }
 
-uint8_t CPU::pop() {
-    return mem->read(0x100+SP);
+template <class CyclePolicy, class BusPolicy, class HookPolicy>
+uint8_t BasicCPU<CyclePolicy, BusPolicy, HookPolicy>::pop() {
+    return read(0x100+SP);
     SP++;
 }
 
-Word CPU::immediate() {
+template <class CyclePolicy, class BusPolicy, class HookPolicy>
+Word BasicCPU<CyclePolicy, BusPolicy, HookPolicy>::immediate() {
     return PC++;
 }
 
-Byte CPU::zeroPage() {
-    cycl();
+template <class CyclePolicy, class BusPolicy, class HookPolicy>
+Byte BasicCPU<CyclePolicy, BusPolicy, HookPolicy>::zeroPage() {
     addr8 = re(PC++);
     return addr8;
 }
 
-Byte CPU::zeroPageX() {
-    cycl();
+template <class CyclePolicy, class BusPolicy, class HookPolicy>
+Byte BasicCPU<CyclePolicy, BusPolicy, HookPolicy>::zeroPageX() {
     addr16 = re(PC++);
-    cycl();
     addr16 += X;
     return addr16;
 }
 
-Byte CPU::zeroPageY() {
-    cycl();
+template <class CyclePolicy, class BusPolicy, class HookPolicy>
+Byte BasicCPU<CyclePolicy, BusPolicy, HookPolicy>::zeroPageY() {
     addr16 = re(PC++);
-    cycl();
     addr16 += Y;
     return addr16;
 }
 
-Word CPU::absolute() {
-    Word addr = mem->read16(PC);
-    cycl(); PC++;
-    cycl(); PC++;
+template <class CyclePolicy, class BusPolicy, class HookPolicy>
+Word BasicCPU<CyclePolicy, BusPolicy, HookPolicy>::absolute() {
+    Word addr = read16(PC);
+    PC += 2;
     return addr;
 }
 
-Word CPU::absoluteX() {
-    cycl();
-    addr16 = re(PC++) + X;
-    if (addr16 > 0xFF) cycl();
-    cycl();
-    addr16 += re(PC++) << 8;
+template <class CyclePolicy, class BusPolicy, class HookPolicy>
+Word BasicCPU<CyclePolicy, BusPolicy, HookPolicy>::absoluteX() {
+    addr16 = re(PC++);
+    cycl(absoluteIndexedPenalty(addr16, X));
+    addr16 += X + (re(PC++) << 8);
     return addr16;
 }
 
-Word CPU::absoluteY() {
-    cycl();
-    addr16 = re(PC++) + Y;
-    if (addr16 > 0xFF) cycl();
-    cycl();
-    addr16 += re(PC++) << 8;
+template <class CyclePolicy, class BusPolicy, class HookPolicy>
+Word BasicCPU<CyclePolicy, BusPolicy, HookPolicy>::absoluteY() {
+    addr16 = re(PC++);
+    cycl(absoluteIndexedPenalty(addr16, Y));
+    addr16 += Y + (re(PC++) << 8);
     return addr16;
 }
 
-Word CPU::indirectX() {
-    cycl();
+template <class CyclePolicy, class BusPolicy, class HookPolicy>
+Word BasicCPU<CyclePolicy, BusPolicy, HookPolicy>::indirectX() {
     addr8 = re(PC++);
-    cycl();
     addr8 += X;
-    cycl();
     addr16 = re(addr8);
-    cycl();
     addr16 += re(addr8+1) << 8;
     return addr16;
 }
 
-Word CPU::indirectY() {
-    cycl();
+template <class CyclePolicy, class BusPolicy, class HookPolicy>
+Word BasicCPU<CyclePolicy, BusPolicy, HookPolicy>::indirectY() {
     addr8 = re(PC++);
-    cycl();
     addr16 = re(addr8);
-    cycl();
     addr16 += re(addr8+1) << 8;
-    cycl();
     addr16 += Y;
-    if (addr16 > 0xFF) cycl();
+    cycl(indirectIndexedPenalty(addr16));
     return addr16;
 }
 
-void CPU::setN(bool f){
-    int pos = 7;
-    P  = P & ~(1 << pos);
-    P |= (f << pos);
-}
-
-void CPU::setV(bool f){
-    int pos = 6;
-    P  = P & ~(1 << pos);
-    P |= (f << pos);
-}
-
-void CPU::setB(bool f){
-    int pos = 4;
-    P  = P & ~(1 << pos);
-    P |= (f << pos);
-}
-
-void CPU::setD(bool f){
-    int pos = 3;
-    P  = P & ~(1 << pos);
-    P |= (f << pos);
-}
-
-void CPU::setI(bool f){
-    int pos = 2;
-    P  = P & ~(1 << pos);
-    P |= (f << pos);
-}
-
-void CPU::setZ(bool f){
-    int pos = 1;
-    P  = P & ~(1 << pos);
-    P |= (f << pos);
-}
-
-
-void CPU::setC(bool f){
-    int pos = 0;
-    P  = P & ~(1 << pos);
-    P |= (f << pos);
-
-}
-
-
+template class BasicCPU<CycleCount, MemoryBus, NoHooks>;
+template class BasicCPU<InstructionCount, DirectBus, NoHooks>;
+template class BasicCPU<CycleCount, MemoryBus, TraceHooks>;
+template class BasicCPU<CycleCount, PagedBus, NoHooks>;
+template class BasicCPU<CycleCount, MemoryBus, ProfileHooks>;
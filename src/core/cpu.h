@@ -2,19 +2,93 @@
 
 #include "types.h"
 #include "memory.h"
+#include "policies.h"
+#include "cycles.h"
+#include "hle.h"
+#include "scheduler.h"
+#include "profiler.h"
 
-class CPU
+#include <bitset>
+#include <cstdint>
+#include <map>
+#include <memory>
+
+class BlockCache;
+class Jit;
+class AotRuntime;
+struct AotProgram;
+
+// Registers and run-time configuration shared by every BasicCPU
+class CPUState
 {
 
 public:
-    CPU(Memory *);
+    CPUState(Memory *);
+    ~CPUState();
     Memory * mem;
 
     Byte addr8;
     Word addr16;
 
-    void reset();
-    void execute();
+    enum class StopReason {
+        Budget,      // cycle budget exhausted
+        Trap,        // an instruction jumped to itself
+        Breakpoint,  // PC reached a breakpoint (or the runUntil address)
+        Halt,        // unimplemented opcode, PC left on it
+        Mismatch,    // verifyRoutines found a native routine disagreeing with its guest code
+        Exit         // the host call handler ended the run, PC after the trap
+    };
+
+    enum class Engine {
+        Dispatch,    // inlined dispatch loop (src/core/dispatch.cpp)
+        Blocks,      // pre-decoded basic-block cache (src/core/blockcache.cpp)
+        Jit,         // block cache with hot blocks translated to x86-64 (src/core/jit.cpp)
+        Aot          // code recompiled ahead of time by 6502_aot (src/core/aot.cpp)
+    };
+    // Only CPU honours engine; the other cores always run the dispatch loop
+    Engine engine = Engine::Dispatch;
+    std::unique_ptr<BlockCache> blockCache;
+    std::unique_ptr<Jit> jit;
+    unsigned jitThreshold = 16;  // executions of a block before the JIT translates it
+    const AotProgram * aotProgram = nullptr;  // run by Engine::Aot, which is the dispatch loop without one
+    std::unique_ptr<AotRuntime> aotRuntime;
+    bool skipIdleLoops = true;   // fast-forward loops that can only spin until the budget ends (idle.h)
+    bool skipDelayLoops = true;  // run counted DEX/BNE-style loops in closed form (delay.h)
+
+    void setBreakpoint(Word address, bool enabled = true);
+    void clearBreakpoints();
+    std::bitset<MEMORY_SIZE> breakpoints;
+    int breakpointCount = 0;
+
+    // Native routines run by JSR or JMP to their address (hle.h)
+    void hookRoutine(Word address, std::function<void(CPUState &)> routine, long long cycles);
+    void unhookRoutine(Word address);
+    void clearRoutines();
+    std::map<Word, NativeRoutine> routines;
+    std::bitset<256> routinePages;  // pages holding a hooked address
+    bool verifyRoutines = false;    // also step each routine's guest code and compare
+    long long routineMismatches = 0;
+
+    // Host-call trap: hostCallOpcode calls hostCall instead of halting (hle.h)
+    std::function<bool(CPUState &)> hostCall;
+    Byte hostCallOpcode = 0x02;
+
+    // Cycle-keyed events, fired by run() as their deadlines pass (scheduler.h)
+    Scheduler events;
+
+    // Interrupt inputs. IRQ is level-triggered and wired-OR, each source
+    // holding its own bit, and masked by I; NMI latches on the edge to
+    // asserted. Interrupts are taken between instructions, and the engines
+    // only test the single word interrupts: run() before it enters one, the
+    // dispatch loop after CLI, PLP and RTI, and per instruction only on
+    // MappedCPU, whose device pages could raise one mid-run. While IRQ is
+    // asserted runs use the dispatch loop.
+    void setIRQ(bool asserted, unsigned source = 1);
+    void setNMI(bool asserted);
+    enum : Byte { IrqAsserted = 1, NmiLatched = 2 };
+    Byte interrupts = 0;
+    unsigned irqSources = 0;
+    bool nmiLine = false;
 
     Word PC;
     Byte SP;
@@ -25,10 +99,69 @@ public:
 
     Byte P;
 
-    inline void cycl() { ++cycles; }
+    inline void setN(bool f) { P = (P & ~(1 << 7)) | (f << 7); }
+    Byte N() { return (P & (1 << 7)) > 0; };
+    inline void setV(bool f) { P = (P & ~(1 << 6)) | (f << 6); }
+    Byte V() { return (P & (1 << 6)) > 0; };
+    inline void setB(bool f) { P = (P & ~(1 << 4)) | (f << 4); }
+    Byte B() { return (P & (1 << 4)) > 0; };
+    inline void setD(bool f) { P = (P & ~(1 << 3)) | (f << 3); }
+    Byte D() { return (P & (1 << 3)) > 0; };
+    inline void setI(bool f) { P = (P & ~(1 << 2)) | (f << 2); }
+    Byte I() { return (P & (1 << 2)) > 0; };
+    inline void setZ(bool f) { P = (P & ~(1 << 1)) | (f << 1); }
+    Byte Z() { return (P & (1 << 1)) > 0; };
+    inline void setC(bool f) { P = (P & ~(1 << 0)) | (f << 0); }
+    Byte C() { return (P & (1 << 0)) > 0; };
+
+    // Cycles
+    long long cycles = 0;
+};
+
+// A 6502 core specialised at compile time by three policies (policies.h):
+// how cycles are counted, how the bus reaches Memory and which hooks fire.
+// The table handlers and the dispatch loop are both instantiated per core,
+// so a policy that does nothing costs nothing. cpu.cpp and dispatch.cpp
+// instantiate the cores declared below.
+template <class CyclePolicy, class BusPolicy, class HookPolicy>
+class BasicCPU : public CPUState
+{
+
+public:
+    typedef CyclePolicy Cycles;
+    typedef BusPolicy Bus;
+    typedef HookPolicy Hooks;
+
+    BasicCPU(Memory * _mem): CPUState(_mem) { hooks.attach(_mem); }
+
+    HookPolicy hooks;
+
+    void reset();
+    void execute();
+    // Takes a latched NMI, or an asserted IRQ while I is clear: pushes PC and
+    // P with B clear, sets I and jumps through the vector. False when neither
+    // is due. run() and execute() call it between instructions.
+    bool serviceInterrupt();
+    // Runs the routine hooked at PC, if any, as JSR or JMP just reached it.
+    // False when verifyRoutines caught it disagreeing with the guest code.
+    bool callRoutine();
+
+    // Batched execution through the selected engine, at most one instruction past the budget.
+    // Breakpoints and hooked routines are always served by the dispatch loop. Scheduled
+    // events cut the engine's budget at their deadlines and fire in between.
+    StopReason run(uint64_t cycles);
+    StopReason runUntil(Word address, uint64_t cycles);
+
+    inline Byte read(Word addr) { Byte value = BusPolicy::read(*mem, addr); hooks.read(addr, value); return value; }
+    inline Word read16(Word addr) { Byte low = read(addr); return static_cast<Word>((read(addr + 1) << 8) | low); }
+    inline void write(Word addr, Byte value) { BusPolicy::write(*mem, addr, value); hooks.write(addr, value); }
+
+    inline void cycl(long long n = 1) { CyclePolicy::cycle(cycles, n); }
     void push(Byte);
     Byte pop();
 
+    // Addressing modes. Their static cost is part of opcodeCycles; the indexed
+    // ones charge their page-cross penalty.
     Word immediate();
     Byte zeroPage();
     Byte zeroPageX();
@@ -38,22 +171,21 @@ public:
     Word absoluteY();
     Word indirectX();
     Word indirectY();
+};
 
-    void setN(bool);
-    Byte N() { return (P & (1 << 7)) > 0; };
-    void setV(bool);
-    Byte V() { return (P & (1 << 6)) > 0; };
-    void setB(bool);
-    Byte B() { return (P & (1 << 4)) > 0; };
-    void setD(bool);
-    Byte D() { return (P & (1 << 3)) > 0; };
-    void setI(bool);
-    Byte I() { return (P & (1 << 2)) > 0; };
-    void setZ(bool);
-    Byte Z() { return (P & (1 << 1)) > 0; };
-    void setC(bool);
-    Byte C() { return (P & (1 << 0)) > 0; };
+// Cycle-counting core, the behaviour CPU always had
+typedef BasicCPU<CycleCount, MemoryBus, NoHooks> CPU;
+// Instruction-accurate core without cycle bookkeeping or store tracking
+typedef BasicCPU<InstructionCount, DirectBus, NoHooks> FastCPU;
+// Cycle-counting core reporting every instruction and bus access to TraceHooks
+typedef BasicCPU<CycleCount, MemoryBus, TraceHooks> TracingCPU;
+// Cycle-counting core on Memory's page table, for ROM and memory-mapped devices
+typedef BasicCPU<CycleCount, PagedBus, NoHooks> MappedCPU;
+// Cycle-counting core counting executions and cycles per opcode and PC (profiler.h)
+typedef BasicCPU<CycleCount, MemoryBus, ProfileHooks> ProfilingCPU;
 
-    // Cycles
-    long long cycles = 0;
-};
+extern template class BasicCPU<CycleCount, MemoryBus, NoHooks>;
+extern template class BasicCPU<InstructionCount, DirectBus, NoHooks>;
+extern template class BasicCPU<CycleCount, MemoryBus, TraceHooks>;
+extern template class BasicCPU<CycleCount, PagedBus, NoHooks>;
+extern template class BasicCPU<CycleCount, MemoryBus, ProfileHooks>;
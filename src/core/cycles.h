@@ -0,0 +1,50 @@
+#pragma once
+
+#include "types.h"
+
+// Cycle costs as this emulator counts them, shared by every engine.
+//
+// An instruction costs opcodeCycles[opcode], charged once when it executes,
+// plus the run-time penalties below, charged by the instruction once its
+// address or branch outcome is known. The opcode fetch itself is not counted:
+// reads and stores cost 1 plus their addressing mode, read-modify-write
+// instructions 3 plus their addressing mode, where the modes cost immediate 0,
+// zp 1, zp,X / zp,Y / abs / abs,X / abs,Y 2 and (zp,X) / (zp),Y 4.
+
+// Static cost per opcode; 0 for BRK and for unimplemented opcodes
+constexpr Byte opcodeCycles[256] = {
+    //  0  1  2  3  4  5  6  7  8  9  A  B  C  D  E  F
+        0, 5, 0, 0, 0, 2, 4, 0, 2, 1, 1, 0, 0, 3, 5, 0,  // 0
+        1, 5, 0, 0, 0, 3, 5, 0, 1, 3, 0, 0, 0, 3, 5, 0,  // 1
+        5, 5, 0, 0, 2, 2, 4, 0, 3, 1, 1, 0, 3, 3, 5, 0,  // 2
+        1, 5, 0, 0, 0, 3, 5, 0, 1, 3, 0, 0, 0, 3, 5, 0,  // 3
+        6, 5, 0, 0, 0, 2, 4, 0, 2, 1, 1, 0, 2, 3, 5, 0,  // 4
+        1, 5, 0, 0, 0, 3, 5, 0, 1, 3, 0, 0, 0, 3, 5, 0,  // 5
+        5, 5, 0, 0, 0, 2, 4, 0, 3, 1, 1, 0, 4, 3, 5, 0,  // 6
+        1, 5, 0, 0, 0, 3, 5, 0, 1, 3, 0, 0, 0, 3, 5, 0,  // 7
+        0, 5, 0, 0, 2, 2, 2, 0, 1, 0, 1, 0, 3, 3, 3, 0,  // 8
+        1, 5, 0, 0, 3, 3, 3, 0, 1, 3, 1, 0, 0, 3, 0, 0,  // 9
+        1, 5, 1, 0, 2, 2, 2, 0, 1, 1, 1, 0, 3, 3, 3, 0,  // A
+        1, 5, 0, 0, 3, 3, 3, 0, 1, 3, 1, 0, 3, 3, 3, 0,  // B
+        1, 5, 0, 0, 2, 2, 4, 0, 1, 1, 1, 0, 3, 3, 5, 0,  // C
+        1, 5, 0, 0, 0, 3, 5, 0, 1, 3, 0, 0, 0, 3, 5, 0,  // D
+        1, 5, 0, 0, 2, 2, 4, 0, 1, 1, 1, 0, 3, 3, 5, 0,  // E
+        1, 5, 0, 0, 0, 3, 5, 0, 1, 3, 0, 0, 0, 3, 5, 0   // F
+};
+
+// abs,X / abs,Y: the index carries out of the low byte of the base
+constexpr int absoluteIndexedPenalty(Word base, Byte index) { return (base & 0xFF) + index > 0xFF; }
+
+// (zp),Y: the indexed address is outside the zero page
+constexpr int indirectIndexedPenalty(Word address) { return address > 0xFF; }
+
+// Taken branch: one cycle, two when the target is on another page than the
+// instruction after the branch
+constexpr int branchTakenPenalty(Word next, Word target) { return (next & 0xFF00) != (target & 0xFF00) ? 2 : 1; }
+
+// Entering an IRQ or NMI handler: pushing PC and P and fetching the vector,
+// as on hardware
+constexpr int interruptCycles = 7;
+
+// Upper bound on the penalties of a single instruction
+constexpr int maxPenaltyCycles = 2;
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "types.h"
+#include "memory.h"
+#include "cycles.h"
+
+// Counted delay loops, run in closed form by the dispatch loop, the block
+// engine and the JIT.
+//
+// A delay loop is a counter step followed by a BNE back to it: DEX, DEY,
+// INX or INY on a register, or DEC/INC on a zero-page or absolute counter.
+// From the head with the counter at c it makes c passes counting down, or
+// 256 - c counting up (256 when c is 0), and ends with the counter 0, N
+// clear, Z set and PC after the BNE; the other flags are untouched. Each
+// pass costs the step and the BNE, plus the taken-branch penalty for all
+// but the last. Nested loops (DEY/BNE inside DEX/BNE) gain through their
+// inner loop. An engine only applies a loop that ends within the budget, and
+// steps it when hooks or a breakpoint inside it must see every pass.
+
+struct DelayLoop {
+    int passes;         // 0 when the code at head is not a delay loop
+    Byte step;          // opcode of the counter step
+    Word counter;       // address of a DEC/INC counter
+    Word exit;          // address after the BNE
+    long long cycles;   // cost of all the passes
+};
+
+// The delay loop at head, with its BNE at from, as it runs from registers x and y
+inline DelayLoop delayLoop(const Memory & m, Word head, Word from, Byte x, Byte y)
+{
+    DelayLoop loop { 0, m.mem[head], 0, Word(from + 2), 0 };
+    Byte value;
+    bool up;
+    switch (loop.step) {
+    case 0xCA: value = x; up = false; break;    // DEX
+    case 0x88: value = y; up = false; break;    // DEY
+    case 0xE8: value = x; up = true; break;     // INX
+    case 0xC8: value = y; up = true; break;     // INY
+    case 0xC6: case 0xE6:                       // DEC/INC zp
+        loop.counter = m.mem[Word(head + 1)];
+        value = m.mem[loop.counter];
+        up = loop.step == 0xE6;
+        break;
+    case 0xCE: case 0xEE:                       // DEC/INC abs
+        loop.counter = m.mem[Word(head + 1)] | (m.mem[Word(head + 2)] << 8);
+        value = m.mem[loop.counter];
+        up = loop.step == 0xEE;
+        break;
+    default:
+        return loop;
+    }
+    Byte length = loop.step == 0xCE || loop.step == 0xEE ? 3 : loop.step == 0xC6 || loop.step == 0xE6 ? 2 : 1;
+    // The BNE must follow the step and return to it, and a memory counter
+    // must not be part of the loop
+    if (Word(head + length) != from || m.mem[from] != 0xD0
+        || Word(from + 2 + static_cast<signed char>(m.mem[Word(from + 1)])) != head)
+        return loop;
+    if (length > 1 && Word(loop.counter - head) < length + 2)
+        return loop;
+
+    Byte left = up ? Byte(-value) : value;
+    loop.passes = left ? left : 256;
+    loop.cycles = loop.passes * (opcodeCycles[loop.step] + opcodeCycles[0xD0])
+                + (loop.passes - 1) * branchTakenPenalty(loop.exit, head);
+    return loop;
+}
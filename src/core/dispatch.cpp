@@ -0,0 +1,557 @@
+#include "cpu.h"
+#include "alu.h"
+#include "cycles.h"
+#include "engines.h"
+#include "idle.h"
+#include "delay.h"
+
+#include <type_traits>
+
+// Dispatch-loop interpreter core, the default engine behind CPU::run().
+//
+// CPU::execute() costs one indirect call through functptr[] per instruction,
+// and every handler reloads the registers through the CPU pointer. runLoop()
+// keeps the registers in locals for the whole run and inlines every handler
+// into a single loop: computed goto on GCC/Clang, a plain switch elsewhere.
+// Each instruction charges opcodeCycles[] as it starts, a constant once the
+// handler is inlined, and penalties where they arise, exactly like the table
+// handlers, so both cores can be mixed freely on the same CPU. Breakpoint checks are compiled into a
+// separate instantiation of the loop that only runs while any are set, and
+// each BasicCPU gets its own instantiation with its cycle, bus and hook
+// policies inlined. Backward jumps and branches feed an IdleTracker, which
+// fast-forwards loops that provably spin until the budget ends (idle.h), and
+// BNE runs counted delay loops in closed form (delay.h). JSR and JMP leave
+// the loop for runDispatch() to call a native routine hooked at their
+// target (hle.h).
+
+#if defined(__GNUC__) || defined(__clang__)
+#define CPU_COMPUTED_GOTO 1
+#else
+#define CPU_COMPUTED_GOTO 0
+#endif
+
+namespace {
+
+// The loop reaches memory through the core's bus policy and reports every
+// access to its hooks; both compile away for CPU
+template <class C>
+struct LoopBus {
+    Memory & mem;
+    typename C::Hooks & hooks;
+
+    inline Byte read(Word addr) const { Byte value = C::Bus::read(mem, addr); hooks.read(addr, value); return value; }
+    inline Word read16(Word addr) const { Byte low = read(addr); return static_cast<Word>((read(addr + 1) << 8) | low); }
+    inline void write(Word addr, Byte value) const { C::Bus::write(mem, addr, value); hooks.write(addr, value); }
+};
+
+// Cycle count in a local, advanced through the core's cycle policy
+template <class Cycles>
+struct CycleCounter {
+    long long value;
+
+    inline void operator+=(long long n) { Cycles::cycle(value, n); }
+    inline void instruction(long long n = 1) { Cycles::instruction(value, n); }
+    inline operator long long() const { return value; }
+};
+
+// The same, left in CPUState::cycles for a bus with device pages, so that a
+// device handler sees the count as of the access
+template <class Cycles>
+struct SharedCycleCounter {
+    long long & value;
+
+    inline void operator+=(long long n) { Cycles::cycle(value, n); }
+    inline void instruction(long long n = 1) { Cycles::instruction(value, n); }
+    inline void operator=(long long n) { value = n; }
+    inline operator long long() const { return value; }
+};
+
+// Addressing modes whose cost depends on the address. Each one charges the same
+// penalty as its CPU:: counterpart.
+
+template <class Bus, class Counter>
+inline Word absoluteIndexed(const Bus & m, Word & pc, Byte index, Counter & cyc) {
+    Word addr = m.read(pc++);
+    cyc += absoluteIndexedPenalty(addr, index);
+    addr += index + (m.read(pc++) << 8);
+    return addr;
+}
+
+template <class Bus>
+inline Word indexedIndirect(const Bus & m, Word & pc, Byte x) {
+    Byte zp = m.read(pc++) + x;
+    return m.read(zp) | (m.read(zp + 1) << 8);
+}
+
+template <class Bus, class Counter>
+inline Word indirectIndexed(const Bus & m, Word & pc, Byte y, Counter & cyc) {
+    Byte zp = m.read(pc++);
+    Word addr = m.read(zp) | (m.read(zp + 1) << 8);
+    addr += y;
+    cyc += indirectIndexedPenalty(addr);
+    return addr;
+}
+
+}
+
+// Finishes the delay loop whose BNE at from just branched back to pc, if it
+// ends within the budget and has no breakpoint inside
+template <bool CheckBreakpoints, class C, class Counter>
+inline bool runDelayLoop(C & cpu, const LoopBus<C> & m, Word & pc, Byte & x, Byte & y, Flags & f, Counter & cyc,
+                         long long cycleLimit, Word from)
+{
+    DelayLoop loop = delayLoop(*cpu.mem, pc, from, x, y);
+    if (!loop.passes)
+        return false;
+    CycleCounter<typename C::Cycles> after { cyc };
+    after += loop.cycles;
+    after.instruction(2 * loop.passes);
+    if (after > cycleLimit)
+        return false;
+    if (CheckBreakpoints) {
+        for (Word addr = pc; addr != loop.exit; addr++) {
+            if (cpu.breakpoints[addr])
+                return false;
+        }
+    }
+    switch (loop.step) {
+    case 0xCA: case 0xE8: x = 0; break;
+    case 0x88: case 0xC8: y = 0; break;
+    default: m.write(loop.counter, 0); break;
+    }
+    f.n = f.z = 0;
+    pc = loop.exit;
+    cyc = after;
+    return true;
+}
+
+template <bool CheckBreakpoints, class C>
+static CPU::StopReason runLoop(C & cpu, long long cycleLimit, IdleTracker & idle, bool & call)
+{
+    const LoopBus<C> m { *cpu.mem, cpu.hooks };
+    Word pc = cpu.PC;
+    Byte a = cpu.A, x = cpu.X, y = cpu.Y, sp = cpu.SP;
+    Flags f = unpackFlags(cpu.P);
+    typename std::conditional<C::Bus::flat, CycleCounter<typename C::Cycles>,
+                              SharedCycleCounter<typename C::Cycles>>::type cyc { cpu.cycles };
+    CPU::StopReason reason = CPU::StopReason::Budget;
+    const bool skipIdle = std::is_same<typename C::Hooks, NoHooks>::value && C::Bus::flat && cpu.skipIdleLoops;
+    const bool skipDelay = std::is_same<typename C::Hooks, NoHooks>::value && C::Bus::flat && cpu.skipDelayLoops;
+    // Only a device page can raise an interrupt or schedule an event from
+    // inside the loop
+    constexpr bool pollDevices = !C::Bus::flat;
+
+#define EA_IMM()    (pc++)
+#define EA_ZP()     Word(m.read(pc++))
+#define EA_ZPX()    Word(Byte(m.read(pc++) + x))
+#define EA_ZPY()    Word(Byte(m.read(pc++) + y))
+#define EA_ABS()    (pc += 2, m.read16(Word(pc - 2)))
+#define EA_ABSX()   absoluteIndexed(m, pc, x, cyc)
+#define EA_ABSY()   absoluteIndexed(m, pc, y, cyc)
+#define EA_IX()     indexedIndirect(m, pc, x)
+#define EA_IY()     indirectIndexed(m, pc, y, cyc)
+
+#define PUSH(v)     m.write(0x100 + sp--, (v))
+#define PULL()      m.read(0x100 + ++sp)
+
+// An instruction that jumps to itself can never make progress
+#define TRAP_IF(cond) if (cond) { reason = CPU::StopReason::Trap; goto done; }
+
+// A jump from the instruction at from back to pc, which is where a loop can
+// idle. Samples are taken by runDispatch(), so no call in the loop keeps the
+// compiler from giving every handler its own indirect jump. A breakpoint at
+// the loop head must stop the run here rather than be run over on re-entry.
+#define BACKWARD_JUMP(from)                                     \
+    if (skipIdle && idle.due(from) && !(CheckBreakpoints && cpu.breakpoints[pc])) { \
+        idle.pending = true;                                    \
+        goto done;                                              \
+    }
+
+// Control flow a loop body could be re-entered by without a backward jump
+#define FORGET_LOOP() idle.forget();
+
+// A JSR or JMP into a page with a hooked routine; runDispatch() calls it
+#define CALL_ROUTINE()                                          \
+    if (cpu.routinePages[pc >> 8]) {                            \
+        call = true;                                            \
+        goto done;                                              \
+    }
+
+// counted: the branch is BNE and may close a delay loop
+#define BRANCH(cond, counted) {                                 \
+        signed char offset = m.read(pc++);                      \
+        if (cond) {                                             \
+            Word target = pc + offset;                          \
+            Word from = pc - 2;                                 \
+            cyc += branchTakenPenalty(pc, target);              \
+            pc = target;                                        \
+            TRAP_IF(offset == -2)                               \
+            if (offset < 0 && !(counted && offset >= -5 && skipDelay \
+                    && runDelayLoop<CheckBreakpoints>(cpu, m, pc, x, y, f, cyc, cycleLimit, from))) { \
+                BACKWARD_JUMP(from)                             \
+            }                                                   \
+        }                                                       \
+    }
+
+// An IRQ the instruction just unmasked is taken by run(), so the loop ends
+// here as if the budget ran out
+#define IRQ_UNMASKED()                                          \
+    if ((cpu.interrupts & CPUState::IrqAsserted) && !(f.idb & 0x04)) \
+        cycleLimit = cyc;
+
+#define CHECK_LIMITS()                                          \
+    if (cyc >= cycleLimit) goto done;                           \
+    if (pollDevices && ((cpu.interrupts && ((cpu.interrupts & CPUState::NmiLatched) || !(f.idb & 0x04))) \
+            || cyc >= cpu.events.deadline()))                   \
+        goto done;                                              \
+    if (CheckBreakpoints && cpu.breakpoints[pc]) {              \
+        reason = CPU::StopReason::Breakpoint;                   \
+        goto done;                                              \
+    }
+
+// Runs before every instruction fetch
+#define BEGIN_INSTRUCTION()                                     \
+    cpu.hooks.instruction(CPUTrace { pc, a, x, y, sp, packFlags(f), cyc }); \
+    cyc.instruction();
+
+#if CPU_COMPUTED_GOTO
+#define OP(code)    op_##code: cyc += opcodeCycles[0x##code];
+#define DISPATCH()  do { CHECK_LIMITS() BEGIN_INSTRUCTION() goto *labels[m.read(pc++)]; } while (0)
+
+    static void * const labels[256] = {
+        //          0       1       2       3       4       5       6       7       8       9       A       B       C       D       E       F
+        /*0*/       &&op_00,&&op_01,&&bad,  &&bad,  &&bad,  &&op_05,&&op_06,&&bad,  &&op_08,&&op_09,&&op_0A,&&bad,  &&bad,  &&op_0D,&&op_0E,&&bad,
+        /*1*/       &&op_10,&&op_11,&&bad,  &&bad,  &&bad,  &&op_15,&&op_16,&&bad,  &&op_18,&&op_19,&&bad,  &&bad,  &&bad,  &&op_1D,&&op_1E,&&bad,
+        /*2*/       &&op_20,&&op_21,&&bad,  &&bad,  &&op_24,&&op_25,&&op_26,&&bad,  &&op_28,&&op_29,&&op_2A,&&bad,  &&op_2C,&&op_2D,&&op_2E,&&bad,
+        /*3*/       &&op_30,&&op_31,&&bad,  &&bad,  &&bad,  &&op_35,&&op_36,&&bad,  &&op_38,&&op_39,&&bad,  &&bad,  &&bad,  &&op_3D,&&op_3E,&&bad,
+        /*4*/       &&op_40,&&op_41,&&bad,  &&bad,  &&bad,  &&op_45,&&op_46,&&bad,  &&op_48,&&op_49,&&op_4A,&&bad,  &&op_4C,&&op_4D,&&op_4E,&&bad,
+        /*5*/       &&op_50,&&op_51,&&bad,  &&bad,  &&bad,  &&op_55,&&op_56,&&bad,  &&op_58,&&op_59,&&bad,  &&bad,  &&bad,  &&op_5D,&&op_5E,&&bad,
+        /*6*/       &&op_60,&&op_61,&&bad,  &&bad,  &&bad,  &&op_65,&&op_66,&&bad,  &&op_68,&&op_69,&&op_6A,&&bad,  &&op_6C,&&op_6D,&&op_6E,&&bad,
+        /*7*/       &&op_70,&&op_71,&&bad,  &&bad,  &&bad,  &&op_75,&&op_76,&&bad,  &&op_78,&&op_79,&&bad,  &&bad,  &&bad,  &&op_7D,&&op_7E,&&bad,
+        /*8*/       &&bad,  &&op_81,&&bad,  &&bad,  &&op_84,&&op_85,&&op_86,&&bad,  &&op_88,&&bad,  &&op_8A,&&bad,  &&op_8C,&&op_8D,&&op_8E,&&bad,
+        /*9*/       &&op_90,&&op_91,&&bad,  &&bad,  &&op_94,&&op_95,&&op_96,&&bad,  &&op_98,&&op_99,&&op_9A,&&bad,  &&bad,  &&op_9D,&&bad,  &&bad,
+        /*A*/       &&op_A0,&&op_A1,&&op_A2,&&bad,  &&op_A4,&&op_A5,&&op_A6,&&bad,  &&op_A8,&&op_A9,&&op_AA,&&bad,  &&op_AC,&&op_AD,&&op_AE,&&bad,
+        /*B*/       &&op_B0,&&op_B1,&&bad,  &&bad,  &&op_B4,&&op_B5,&&op_B6,&&bad,  &&op_B8,&&op_B9,&&op_BA,&&bad,  &&op_BC,&&op_BD,&&op_BE,&&bad,
+        /*C*/       &&op_C0,&&op_C1,&&bad,  &&bad,  &&op_C4,&&op_C5,&&op_C6,&&bad,  &&op_C8,&&op_C9,&&op_CA,&&bad,  &&op_CC,&&op_CD,&&op_CE,&&bad,
+        /*D*/       &&op_D0,&&op_D1,&&bad,  &&bad,  &&bad,  &&op_D5,&&op_D6,&&bad,  &&op_D8,&&op_D9,&&bad,  &&bad,  &&bad,  &&op_DD,&&op_DE,&&bad,
+        /*E*/       &&op_E0,&&op_E1,&&bad,  &&bad,  &&op_E4,&&op_E5,&&op_E6,&&bad,  &&op_E8,&&op_E9,&&op_EA,&&bad,  &&op_EC,&&op_ED,&&op_EE,&&bad,
+        /*F*/       &&op_F0,&&op_F1,&&bad,  &&bad,  &&bad,  &&op_F5,&&op_F6,&&bad,  &&op_F8,&&op_F9,&&bad,  &&bad,  &&bad,  &&op_FD,&&op_FE,&&bad
+    };
+
+    // The instruction under PC runs even if it is a breakpoint, so a stopped run can resume
+    if (cyc >= cycleLimit) goto done;
+    BEGIN_INSTRUCTION()
+    goto *labels[m.read(pc++)];
+#else
+#define OP(code)    case 0x##code: cyc += opcodeCycles[0x##code];
+#define DISPATCH()  continue
+
+    // The instruction under PC runs even if it is a breakpoint, so a stopped run can resume
+    for (bool first = true; ; first = false) {
+        if (!first) { CHECK_LIMITS() }
+        else if (cyc >= cycleLimit) goto done;
+        BEGIN_INSTRUCTION()
+        switch (m.read(pc++)) {
+#endif
+
+    // Loads
+    OP(A9) { a = m.read(EA_IMM()); f.n = f.z = a; DISPATCH(); }
+    OP(A5) { a = m.read(EA_ZP()); f.n = f.z = a; DISPATCH(); }
+    OP(B5) { a = m.read(EA_ZPX()); f.n = f.z = a; DISPATCH(); }
+    OP(AD) { a = m.read(EA_ABS()); f.n = f.z = a; DISPATCH(); }
+    OP(BD) { a = m.read(EA_ABSX()); f.n = f.z = a; DISPATCH(); }
+    OP(B9) { a = m.read(EA_ABSY()); f.n = f.z = a; DISPATCH(); }
+    OP(A1) { a = m.read(EA_IX()); f.n = f.z = a; DISPATCH(); }
+    OP(B1) { a = m.read(EA_IY()); f.n = f.z = a; DISPATCH(); }
+    OP(A2) { x = m.read(EA_IMM()); f.n = f.z = x; DISPATCH(); }
+    OP(A6) { x = m.read(EA_ZP()); f.n = f.z = x; DISPATCH(); }
+    OP(B6) { x = m.read(EA_ZPY()); f.n = f.z = x; DISPATCH(); }
+    OP(AE) { x = m.read(EA_ABS()); f.n = f.z = x; DISPATCH(); }
+    OP(BE) { x = m.read(EA_ABSY()); f.n = f.z = x; DISPATCH(); }
+    OP(A0) { y = m.read(EA_IMM()); f.n = f.z = y; DISPATCH(); }
+    OP(A4) { y = m.read(EA_ZP()); f.n = f.z = y; DISPATCH(); }
+    OP(B4) { y = m.read(EA_ZPX()); f.n = f.z = y; DISPATCH(); }
+    OP(AC) { y = m.read(EA_ABS()); f.n = f.z = y; DISPATCH(); }
+    OP(BC) { y = m.read(EA_ABSX()); f.n = f.z = y; DISPATCH(); }
+
+    // Stores
+    OP(85) { m.write(EA_ZP(), a); DISPATCH(); }
+    OP(95) { m.write(EA_ZPX(), a); DISPATCH(); }
+    OP(8D) { m.write(EA_ABS(), a); DISPATCH(); }
+    OP(9D) { m.write(EA_ABSX(), a); DISPATCH(); }
+    OP(99) { m.write(EA_ABSY(), a); DISPATCH(); }
+    OP(81) { m.write(EA_IX(), a); DISPATCH(); }
+    OP(91) { m.write(EA_IY(), a); DISPATCH(); }
+    OP(86) { m.write(EA_ZP(), x); DISPATCH(); }
+    OP(96) { m.write(EA_ZPY(), x); DISPATCH(); }
+    OP(8E) { m.write(EA_ABS(), x); DISPATCH(); }
+    OP(84) { m.write(EA_ZP(), y); DISPATCH(); }
+    OP(94) { m.write(EA_ZPX(), y); DISPATCH(); }
+    OP(8C) { m.write(EA_ABS(), y); DISPATCH(); }
+
+    // ADC / SBC
+    OP(69) { adc(a, f, m.read(EA_IMM())); DISPATCH(); }
+    OP(65) { adc(a, f, m.read(EA_ZP())); DISPATCH(); }
+    OP(75) { adc(a, f, m.read(EA_ZPX())); DISPATCH(); }
+    OP(6D) { adc(a, f, m.read(EA_ABS())); DISPATCH(); }
+    OP(7D) { adc(a, f, m.read(EA_ABSX())); DISPATCH(); }
+    OP(79) { adc(a, f, m.read(EA_ABSY())); DISPATCH(); }
+    OP(61) { adc(a, f, m.read(EA_IX())); DISPATCH(); }
+    OP(71) { adc(a, f, m.read(EA_IY())); DISPATCH(); }
+    OP(E9) { sbc(a, f, m.read(EA_IMM())); DISPATCH(); }
+    OP(E5) { sbc(a, f, m.read(EA_ZP())); DISPATCH(); }
+    OP(F5) { sbc(a, f, m.read(EA_ZPX())); DISPATCH(); }
+    OP(ED) { sbc(a, f, m.read(EA_ABS())); DISPATCH(); }
+    OP(FD) { sbc(a, f, m.read(EA_ABSX())); DISPATCH(); }
+    OP(F9) { sbc(a, f, m.read(EA_ABSY())); DISPATCH(); }
+    OP(E1) { sbc(a, f, m.read(EA_IX())); DISPATCH(); }
+    OP(F1) { sbc(a, f, m.read(EA_IY())); DISPATCH(); }
+
+    // AND / ORA / EOR
+    OP(29) { a &= m.read(EA_IMM()); f.n = f.z = a; DISPATCH(); }
+    OP(25) { a &= m.read(EA_ZP()); f.n = f.z = a; DISPATCH(); }
+    OP(35) { a &= m.read(EA_ZPX()); f.n = f.z = a; DISPATCH(); }
+    OP(2D) { a &= m.read(EA_ABS()); f.n = f.z = a; DISPATCH(); }
+    OP(3D) { a &= m.read(EA_ABSX()); f.n = f.z = a; DISPATCH(); }
+    OP(39) { a &= m.read(EA_ABSY()); f.n = f.z = a; DISPATCH(); }
+    OP(21) { a &= m.read(EA_IX()); f.n = f.z = a; DISPATCH(); }
+    OP(31) { a &= m.read(EA_IY()); f.n = f.z = a; DISPATCH(); }
+    OP(09) { a |= m.read(EA_IMM()); f.n = f.z = a; DISPATCH(); }
+    OP(05) { a |= m.read(EA_ZP()); f.n = f.z = a; DISPATCH(); }
+    OP(15) { a |= m.read(EA_ZPX()); f.n = f.z = a; DISPATCH(); }
+    OP(0D) { a |= m.read(EA_ABS()); f.n = f.z = a; DISPATCH(); }
+    OP(1D) { a |= m.read(EA_ABSX()); f.n = f.z = a; DISPATCH(); }
+    OP(19) { a |= m.read(EA_ABSY()); f.n = f.z = a; DISPATCH(); }
+    OP(01) { a |= m.read(EA_IX()); f.n = f.z = a; DISPATCH(); }
+    OP(11) { a |= m.read(EA_IY()); f.n = f.z = a; DISPATCH(); }
+    OP(49) { a ^= m.read(EA_IMM()); f.n = f.z = a; DISPATCH(); }
+    OP(45) { a ^= m.read(EA_ZP()); f.n = f.z = a; DISPATCH(); }
+    OP(55) { a ^= m.read(EA_ZPX()); f.n = f.z = a; DISPATCH(); }
+    OP(4D) { a ^= m.read(EA_ABS()); f.n = f.z = a; DISPATCH(); }
+    OP(5D) { a ^= m.read(EA_ABSX()); f.n = f.z = a; DISPATCH(); }
+    OP(59) { a ^= m.read(EA_ABSY()); f.n = f.z = a; DISPATCH(); }
+    OP(41) { a ^= m.read(EA_IX()); f.n = f.z = a; DISPATCH(); }
+    OP(51) { a ^= m.read(EA_IY()); f.n = f.z = a; DISPATCH(); }
+
+    // BIT
+    OP(24) { Byte v = m.read(EA_ZP()); f.n = v; f.z = a & v; f.v = v & 0x40; DISPATCH(); }
+    OP(2C) { Byte v = m.read(EA_ABS()); f.n = v; f.z = a & v; f.v = v & 0x40; DISPATCH(); }
+
+    // CMP / CPX / CPY
+    OP(C9) { compare(f, a, m.read(EA_IMM())); DISPATCH(); }
+    OP(C5) { compare(f, a, m.read(EA_ZP())); DISPATCH(); }
+    OP(D5) { compare(f, a, m.read(EA_ZPX())); DISPATCH(); }
+    OP(CD) { compare(f, a, m.read(EA_ABS())); DISPATCH(); }
+    OP(DD) { compare(f, a, m.read(EA_ABSX())); DISPATCH(); }
+    OP(D9) { compare(f, a, m.read(EA_ABSY())); DISPATCH(); }
+    OP(C1) { compare(f, a, m.read(EA_IX())); DISPATCH(); }
+    OP(D1) { compare(f, a, m.read(EA_IY())); DISPATCH(); }
+    OP(E0) { compare(f, x, m.read(EA_IMM())); DISPATCH(); }
+    OP(E4) { compare(f, x, m.read(EA_ZP())); DISPATCH(); }
+    OP(EC) { compare(f, x, m.read(EA_ABS())); DISPATCH(); }
+    OP(C0) { compare(f, y, m.read(EA_IMM())); DISPATCH(); }
+    OP(C4) { compare(f, y, m.read(EA_ZP())); DISPATCH(); }
+    OP(CC) { compare(f, y, m.read(EA_ABS())); DISPATCH(); }
+
+    // INC / DEC memory
+    OP(E6) { Word ea = EA_ZP();   Byte v = m.read(ea) + 1; m.write(ea, v); f.n = f.z = v; DISPATCH(); }
+    OP(F6) { Word ea = EA_ZPX();  Byte v = m.read(ea) + 1; m.write(ea, v); f.n = f.z = v; DISPATCH(); }
+    OP(EE) { Word ea = EA_ABS();  Byte v = m.read(ea) + 1; m.write(ea, v); f.n = f.z = v; DISPATCH(); }
+    OP(FE) { Word ea = EA_ABSX(); Byte v = m.read(ea) + 1; m.write(ea, v); f.n = f.z = v; DISPATCH(); }
+    OP(C6) { Word ea = EA_ZP();   Byte v = m.read(ea) - 1; m.write(ea, v); f.n = f.z = v; DISPATCH(); }
+    OP(D6) { Word ea = EA_ZPX();  Byte v = m.read(ea) - 1; m.write(ea, v); f.n = f.z = v; DISPATCH(); }
+    OP(CE) { Word ea = EA_ABS();  Byte v = m.read(ea) - 1; m.write(ea, v); f.n = f.z = v; DISPATCH(); }
+    OP(DE) { Word ea = EA_ABSX(); Byte v = m.read(ea) - 1; m.write(ea, v); f.n = f.z = v; DISPATCH(); }
+
+    // INX / INY / DEX / DEY
+    OP(E8) { x++; f.n = f.z = x; DISPATCH(); }
+    OP(C8) { y++; f.n = f.z = y; DISPATCH(); }
+    OP(CA) { x--; f.n = f.z = x; DISPATCH(); }
+    OP(88) { y--; f.n = f.z = y; DISPATCH(); }
+
+    // Shifts and rotates
+    OP(0A) { a = asl(f, a); DISPATCH(); }
+    OP(06) { Word ea = EA_ZP();   m.write(ea, asl(f, m.read(ea))); DISPATCH(); }
+    OP(16) { Word ea = EA_ZPX();  m.write(ea, asl(f, m.read(ea))); DISPATCH(); }
+    OP(0E) { Word ea = EA_ABS();  m.write(ea, asl(f, m.read(ea))); DISPATCH(); }
+    OP(1E) { Word ea = EA_ABSX(); m.write(ea, asl(f, m.read(ea))); DISPATCH(); }
+    OP(4A) { a = lsr(f, a); DISPATCH(); }
+    OP(46) { Word ea = EA_ZP();   m.write(ea, lsr(f, m.read(ea))); DISPATCH(); }
+    OP(56) { Word ea = EA_ZPX();  m.write(ea, lsr(f, m.read(ea))); DISPATCH(); }
+    OP(4E) { Word ea = EA_ABS();  m.write(ea, lsr(f, m.read(ea))); DISPATCH(); }
+    OP(5E) { Word ea = EA_ABSX(); m.write(ea, lsr(f, m.read(ea))); DISPATCH(); }
+    OP(2A) { a = rol(f, a); DISPATCH(); }
+    OP(26) { Word ea = EA_ZP();   m.write(ea, rol(f, m.read(ea))); DISPATCH(); }
+    OP(36) { Word ea = EA_ZPX();  m.write(ea, rol(f, m.read(ea))); DISPATCH(); }
+    OP(2E) { Word ea = EA_ABS();  m.write(ea, rol(f, m.read(ea))); DISPATCH(); }
+    OP(3E) { Word ea = EA_ABSX(); m.write(ea, rol(f, m.read(ea))); DISPATCH(); }
+    OP(6A) { a = ror(f, a); DISPATCH(); }
+    OP(66) { Word ea = EA_ZP();   m.write(ea, ror(f, m.read(ea))); DISPATCH(); }
+    OP(76) { Word ea = EA_ZPX();  m.write(ea, ror(f, m.read(ea))); DISPATCH(); }
+    OP(6E) { Word ea = EA_ABS();  m.write(ea, ror(f, m.read(ea))); DISPATCH(); }
+    OP(7E) { Word ea = EA_ABSX(); m.write(ea, ror(f, m.read(ea))); DISPATCH(); }
+
+    // Transfers
+    OP(AA) { x = a; f.n = f.z = x; DISPATCH(); }
+    OP(A8) { y = a; f.n = f.z = y; DISPATCH(); }
+    OP(8A) { a = x; f.n = f.z = a; DISPATCH(); }
+    OP(98) { a = y; f.n = f.z = a; DISPATCH(); }
+    OP(BA) { x = sp; f.n = f.z = x; DISPATCH(); }
+    OP(9A) { sp = x; DISPATCH(); }
+
+    // Stack
+    OP(48) { PUSH(a); DISPATCH(); }
+    OP(08) { PUSH(packFlags(f) | 0x30); DISPATCH(); }
+    OP(68) { a = PULL(); f.n = f.z = a; DISPATCH(); }
+    OP(28) { f = unpackFlags(PULL()); IRQ_UNMASKED() DISPATCH(); }
+
+    // Flags
+    OP(18) { f.c = 0; DISPATCH(); }
+    OP(38) { f.c = 1; DISPATCH(); }
+    OP(58) { f.idb &= ~0x04; IRQ_UNMASKED() DISPATCH(); }
+    OP(78) { f.idb |= 0x04; DISPATCH(); }
+    OP(B8) { f.v = 0; DISPATCH(); }
+    OP(D8) { f.idb &= ~0x08; DISPATCH(); }
+    OP(F8) { f.idb |= 0x08; DISPATCH(); }
+
+    // Branches
+    OP(10) { BRANCH(!(f.n & 0x80), false); DISPATCH(); }
+    OP(30) { BRANCH(f.n & 0x80, false);    DISPATCH(); }
+    OP(50) { BRANCH(!f.v, false);          DISPATCH(); }
+    OP(70) { BRANCH(f.v, false);           DISPATCH(); }
+    OP(90) { BRANCH(!f.c, false);          DISPATCH(); }
+    OP(B0) { BRANCH(f.c, false);           DISPATCH(); }
+    OP(D0) { BRANCH(f.z, true);            DISPATCH(); }
+    OP(F0) { BRANCH(!f.z, false);          DISPATCH(); }
+
+    // Jumps, subroutines and interrupts
+    OP(4C) {
+        Word from = pc - 1;
+        pc = m.read16(pc);
+        TRAP_IF(pc == from)
+        CALL_ROUTINE()
+        if (pc < from) { BACKWARD_JUMP(from) }
+        DISPATCH();
+    }
+    OP(6C) { Word from = pc - 1; pc = m.read16(m.read16(pc)); TRAP_IF(pc == from) FORGET_LOOP() CALL_ROUTINE() DISPATCH(); }
+    OP(20) {
+        FORGET_LOOP()
+        Word target = m.read16(pc);
+        pc++;
+        PUSH(pc >> 8);
+        PUSH(pc & 0xFF);
+        pc = target;
+        cpu.hooks.transfer(Transfer::Call, pc, sp, cyc);
+        CALL_ROUTINE()
+        DISPATCH();
+    }
+    OP(60) {
+        FORGET_LOOP()
+        Byte lo = PULL();
+        Byte hi = PULL();
+        pc = ((hi << 8) | lo) + 1;
+        cpu.hooks.transfer(Transfer::Return, pc, sp, cyc);
+        DISPATCH();
+    }
+    OP(40) {
+        FORGET_LOOP()
+        f = unpackFlags(PULL());
+        Byte lo = PULL();
+        Byte hi = PULL();
+        pc = (hi << 8) | lo;
+        cpu.hooks.transfer(Transfer::Return, pc, sp, cyc);
+        IRQ_UNMASKED()
+        DISPATCH();
+    }
+    OP(00) {
+        FORGET_LOOP()
+        pc++;
+        PUSH(pc >> 8);
+        PUSH(pc & 0xFF);
+        PUSH(packFlags(f) | 0x30);
+        pc = m.read16(0xFFFE);
+        f.idb |= 0x04;
+        cpu.hooks.transfer(Transfer::Interrupt, pc, sp, cyc);
+        DISPATCH();
+    }
+    OP(EA) { DISPATCH(); }
+
+#if !CPU_COMPUTED_GOTO
+        default:
+            goto bad;
+        }
+    }
+#endif
+
+bad:
+    // Unimplemented opcode: leave PC on it and stop.
+    pc--;
+    reason = CPU::StopReason::Halt;
+done:
+    cpu.PC = pc;
+    cpu.A = a;
+    cpu.X = x;
+    cpu.Y = y;
+    cpu.SP = sp;
+    cpu.P = packFlags(f);
+    cpu.cycles = cyc;
+    return reason;
+
+#undef EA_IMM
+#undef EA_ZP
+#undef EA_ZPX
+#undef EA_ZPY
+#undef EA_ABS
+#undef EA_ABSX
+#undef EA_ABSY
+#undef EA_IX
+#undef EA_IY
+#undef PUSH
+#undef PULL
+#undef TRAP_IF
+#undef BACKWARD_JUMP
+#undef FORGET_LOOP
+#undef CALL_ROUTINE
+#undef BRANCH
+#undef IRQ_UNMASKED
+#undef CHECK_LIMITS
+#undef BEGIN_INSTRUCTION
+#undef OP
+#undef DISPATCH
+}
+
+template <class C>
+CPU::StopReason runDispatch(C & cpu, long long cycleLimit)
+{
+    IdleTracker idle;
+    bool call = false;
+    for (;;) {
+        CPU::StopReason reason = cpu.breakpointCount ? runLoop<true>(cpu, cycleLimit, idle, call) : runLoop<false>(cpu, cycleLimit, idle, call);
+        if (call) {
+            // The routine is part of the JSR or JMP, so the limits are checked after it
+            call = false;
+            idle.forget();
+            if (!cpu.callRoutine())
+                return CPU::StopReason::Mismatch;
+            if (cpu.cycles >= cycleLimit)
+                return CPU::StopReason::Budget;
+            if (cpu.breakpointCount && cpu.breakpoints[cpu.PC])
+                return CPU::StopReason::Breakpoint;
+            // A routine that raised an interrupt or scheduled an event leaves it to run()
+            if (cpu.interrupts || cpu.events.deadline() < cycleLimit)
+                return CPU::StopReason::Budget;
+            continue;
+        }
+        if (!idle.pending)
+            return reason;
+        idle.pending = false;
+        IdleState now { cpu.PC, cpu.A, cpu.X, cpu.Y, cpu.SP, unpackFlags(cpu.P), cpu.cycles };
+        cpu.cycles += idle.sample(*cpu.mem, now, cycleLimit, cpu.breakpointCount ? &cpu.breakpoints : nullptr);
+    }
+}
+
+template CPU::StopReason runDispatch(CPU &, long long);
+template CPU::StopReason runDispatch(FastCPU &, long long);
+template CPU::StopReason runDispatch(TracingCPU &, long long);
+template CPU::StopReason runDispatch(MappedCPU &, long long);
+template CPU::StopReason runDispatch(ProfilingCPU &, long long);
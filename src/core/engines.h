@@ -0,0 +1,14 @@
+#pragma once
+
+#include "cpu.h"
+
+// Execution engines behind CPU::run(). Each runs until cycles reaches
+// cycleLimit or one of the other StopReasons fires, and leaves the CPU
+// registers exactly as the table handlers would.
+
+// Instantiated for CPU, FastCPU, TracingCPU, MappedCPU and ProfilingCPU
+template <class C>
+CPU::StopReason runDispatch(C & cpu, long long cycleLimit);
+CPU::StopReason runBlocks(CPU & cpu, long long cycleLimit);
+CPU::StopReason runJit(CPU & cpu, long long cycleLimit);
+CPU::StopReason runAot(CPU & cpu, long long cycleLimit);
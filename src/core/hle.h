@@ -0,0 +1,44 @@
+#pragma once
+
+#include "types.h"
+
+#include <functional>
+
+class CPUState;
+
+// High-level emulation of known guest routines (a ROM's multiply, memcpy or
+// CRC), registered with CPUState::hookRoutine().
+//
+// A JSR or JMP whose target is a hooked address runs the native routine as
+// part of that instruction: it updates the registers, flags and memory as
+// the guest routine would, the instruction is charged the routine's cycles
+// on top of its own, and the routine's RTS is performed. The guest code at
+// the address is never reached, so breakpoints on it do not fire; the run
+// stops at the return address as it would after any instruction. A native
+// routine reaches memory through CPUState::mem and reports nothing to hooks.
+//
+// Runs with routines hooked use the dispatch loop, like runs with
+// breakpoints, and only JSR and JMP look the target up: a bit per page says
+// whether any routine lives there, so calls elsewhere cost one test.
+//
+// With CPUState::verifyRoutines set, each call runs the native routine, then
+// restores the state and steps the guest code until its RTS returns, and
+// compares registers and memory. The guest's results, cycles included, are
+// kept either way; a disagreement is counted in routineMismatches and stops
+// run() with StopReason::Mismatch.
+//
+// Host calls are the guest's way in: with CPUState::hostCall set, the
+// unimplemented opcode CPUState::hostCallOpcode ($02 unless changed) calls
+// it instead of halting. By convention the guest passes a service number in
+// A and a pointer in Y:X, and the handler works on the registers and
+// CPUState::mem directly (console output, file I/O, bulk copies). PC is past
+// the opcode when it runs; returning false ends the run with
+// StopReason::Exit. Every engine already stops on an unimplemented opcode,
+// so run() serves the call where they return and resumes the engine: the
+// trap costs nothing until it executes. The opcode itself charges nothing,
+// so the handler adds to CPUState::cycles whatever the service should cost.
+
+struct NativeRoutine {
+    std::function<void(CPUState &)> run;
+    long long cycles;   // charged for the whole routine, its RTS included
+};
@@ -0,0 +1,75 @@
+#include "idle.h"
+
+#include <array>
+
+namespace {
+
+// Length of each opcode an idle body may hold, 0 for the rest: stores,
+// read-modify-writes, stack operations and control flow
+constexpr std::array<Byte, 256> makeIdleOpBytes() {
+    std::array<Byte, 256> bytes {};
+    const Byte implied[] = {
+        0x0A, 0x4A, 0x2A, 0x6A,                                 // ASL/LSR/ROL/ROR A
+        0xE8, 0xC8, 0xCA, 0x88,                                 // INX/INY/DEX/DEY
+        0xAA, 0xA8, 0x8A, 0x98, 0xBA, 0x9A,                     // transfers
+        0x18, 0x38, 0x58, 0x78, 0xB8, 0xD8, 0xF8,               // flag operations
+        0xEA                                                    // NOP
+    };
+    const Byte twoBytes[] = {
+        0xA9, 0xA2, 0xA0, 0x29, 0x09, 0x49, 0x69, 0xE9, 0xC9, 0xE0, 0xC0,     // immediate
+        0xA5, 0xA6, 0xA4, 0x25, 0x05, 0x45, 0x65, 0xE5, 0xC5, 0xE4, 0xC4, 0x24, // zero page
+        0xB5, 0xB4, 0x35, 0x15, 0x55, 0x75, 0xF5, 0xD5, 0xB6,                 // zero page indexed
+        0xA1, 0x21, 0x01, 0x41, 0x61, 0xE1, 0xC1,                             // (zp,X)
+        0xB1, 0x31, 0x11, 0x51, 0x71, 0xF1, 0xD1                              // (zp),Y
+    };
+    const Byte threeBytes[] = {
+        0xAD, 0xAE, 0xAC, 0x2D, 0x0D, 0x4D, 0x6D, 0xED, 0xCD, 0xEC, 0xCC, 0x2C, // absolute
+        0xBD, 0xBC, 0x3D, 0x1D, 0x5D, 0x7D, 0xFD, 0xDD,                         // absolute,X
+        0xB9, 0xBE, 0x39, 0x19, 0x59, 0x79, 0xF9, 0xD9                          // absolute,Y
+    };
+    for (Byte opcode : implied)
+        bytes[opcode] = 1;
+    for (Byte opcode : twoBytes)
+        bytes[opcode] = 2;
+    for (Byte opcode : threeBytes)
+        bytes[opcode] = 3;
+    return bytes;
+}
+
+constexpr std::array<Byte, 256> idleOpBytes = makeIdleOpBytes();
+
+}
+
+bool idleBody(const Memory & m, Word head, Word end, const std::bitset<MEMORY_SIZE> * breakpoints)
+{
+    // head < end, so the walk cannot wrap
+    for (Word pc = head; pc != end; ) {
+        if (breakpoints && (*breakpoints)[pc])
+            return false;
+        Byte bytes = idleOpBytes[m.mem[pc]];
+        if (!bytes || Word(end - pc) < bytes)
+            return false;
+        pc += bytes;
+    }
+    return !breakpoints || !(*breakpoints)[end];
+}
+
+long long IdleTracker::sample(const Memory & m, const IdleState & now, long long cycleLimit,
+                              const std::bitset<MEMORY_SIZE> * breakpoints)
+{
+    if (!armed || !sameRegisters(now, last)) {
+        if (armed && interval < MaxSamplePasses)
+            interval *= 2;
+        last = now;
+        armed = true;
+        idle = false;
+        return 0;
+    }
+    long long skip = 0;
+    if (idle)
+        skip = idleSkip(now.cycles, now.cycles - last.cycles, cycleLimit);
+    else
+        idle = idleBody(m, now.pc, Word(lastFrom), breakpoints);
+    last.cycles = now.cycles + skip;
+    return skip;
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "types.h"
+#include "memory.h"
+#include "alu.h"
+
+#include <bitset>
+
+// Idle-loop fast-forward, shared by the dispatch loop and the block engine.
+//
+// A loop is idle when one pass over its body stores nothing and brings A, X,
+// Y, SP, the flags and PC back to what they were at its head. Memory only
+// changes through the CPU's own stores, so every later pass repeats that one
+// exactly and the loop can only end with the budget (LDA $D011 / BPL *-3
+// polling a register nothing will ever set). Once an engine sees such a pass
+// it adds whole passes worth of cycles up to the budget and steps the last,
+// partial pass normally, so the run stops with exactly the state and cycle
+// count stepping would have reached. Jumps to themselves still stop the run
+// with StopReason::Trap.
+//
+// Only cores without hooks fast-forward, since the skipped passes would not
+// be reported, and only while CPUState::skipIdleLoops is set.
+
+// Registers at the head of a loop, and the cycle count they were seen at
+struct IdleState {
+    Word pc;
+    Byte a, x, y, sp;
+    Flags f;
+    long long cycles;
+};
+
+// Whether a pass left every register and flag as it found them
+inline bool sameRegisters(const IdleState & l, const IdleState & r)
+{
+    return l.pc == r.pc && l.a == r.a && l.x == r.x && l.y == r.y && l.sp == r.sp
+        && l.f.n == r.f.n && l.f.z == r.f.z && l.f.c == r.f.c && l.f.v == r.f.v && l.f.idb == r.f.idb;
+}
+
+// Cycles covered by the passes of period cycles that fit before cycleLimit.
+// Every instruction boundary inside them stays below the limit.
+inline long long idleSkip(long long cycles, long long period, long long cycleLimit)
+{
+    if (period <= 0 || cycles >= cycleLimit)
+        return 0;
+    return (cycleLimit - cycles) / period * period;
+}
+
+// Whether the code from head up to the jump at end is straight-line and
+// stores nothing: loads, compares, register and flag operations only. With
+// breakpoints, none may be set from head to end.
+bool idleBody(const Memory & m, Word head, Word end, const std::bitset<MEMORY_SIZE> * breakpoints);
+
+// Watches the dispatch loop's backward jumps for idle passes. Tracking every
+// pass would slow down loops that do work, so the registers are only sampled
+// every SamplePasses consecutive passes, twice as far apart after each
+// sample that found them changed; a body that stores nothing and comes back
+// to the same registers after that many passes is just as periodic as one
+// that does after one.
+class IdleTracker
+{
+public:
+    static const int SamplePasses = 16;
+    static const int MaxSamplePasses = 4096;
+
+    // Called for each backward jump or taken branch at from. True when the
+    // registers should be passed to sample().
+    inline bool due(Word from) {
+        if (from != lastFrom) {
+            lastFrom = from;
+            interval = countdown = SamplePasses;
+            armed = false;
+            return false;
+        }
+        if (--countdown)
+            return false;
+        countdown = interval;
+        return true;
+    }
+
+    // Takes the registers the loop head at now.pc sees after the jump at
+    // from and returns the cycles to skip. The body is checked on the second
+    // identical sample and trusted from the third, since the passes between
+    // them then ran code that cannot have stored anything.
+    long long sample(const Memory & m, const IdleState & now, long long cycleLimit, const std::bitset<MEMORY_SIZE> * breakpoints);
+
+    // Set by the dispatch loop when it returned to have a sample taken
+    bool pending = false;
+
+    // Called on control flow due() does not see (JSR, RTS, RTI, BRK, JMP
+    // indirect), which could re-enter a loop body from elsewhere
+    inline void forget() { lastFrom = -1; }
+
+private:
+    int lastFrom = -1;
+    int countdown = 0;
+    int interval = SamplePasses;
+    IdleState last {};
+    bool armed = false;     // last holds the registers at an earlier sample
+    bool idle = false;      // and the passes since then were identical over an idle body
+};
@@ -0,0 +1,748 @@
+#include "jit.h"
+#include "engines.h"
+#include "cycles.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <vector>
+
+#if defined(__x86_64__) && !defined(_WIN32)
+#define CPU_JIT_X86_64 1
+#include <sys/mman.h>
+#else
+#define CPU_JIT_X86_64 0
+#endif
+
+namespace {
+
+#if CPU_JIT_X86_64
+
+enum Reg { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+
+// Host registers while a translated block runs. All callee-saved, so the
+// guest registers survive calls into handlers and Memory.
+const int STATE = RBX;      // BlockState *
+const int MEM = R12;        // Memory::mem
+const int REG_A = R13;
+const int REG_X = R14;
+const int REG_Y = R15;
+const int REG_SP = RBP;
+
+enum Cond { CC_B = 2, CC_AE = 3, CC_E = 4, CC_NE = 5, CC_BE = 6, CC_A = 7, CC_G = 15 };
+
+const int32_t OFF_PC = offsetof(BlockState, pc);
+const int32_t OFF_A = offsetof(BlockState, a);
+const int32_t OFF_X = offsetof(BlockState, x);
+const int32_t OFF_Y = offsetof(BlockState, y);
+const int32_t OFF_SP = offsetof(BlockState, sp);
+const int32_t OFF_N = offsetof(BlockState, f) + offsetof(Flags, n);
+const int32_t OFF_Z = offsetof(BlockState, f) + offsetof(Flags, z);
+const int32_t OFF_C = offsetof(BlockState, f) + offsetof(Flags, c);
+const int32_t OFF_V = offsetof(BlockState, f) + offsetof(Flags, v);
+const int32_t OFF_IDB = offsetof(BlockState, f) + offsetof(Flags, idb);
+const int32_t OFF_CYC = offsetof(BlockState, cyc);
+const int32_t OFF_STOP = offsetof(BlockState, stop);
+const int32_t OFF_LIMIT = offsetof(BlockState, limit);
+
+// Worst case for any block: seven static cycles plus the penalties per op.
+// Chaining into a block requires this much budget left, so it never has to
+// stop part way through.
+const int32_t MaxBlockCycles = BlockCache::MaxBlockOps * (7 + maxPenaltyCycles);
+
+// [base + index + disp]; index < 0 for none
+struct Mem {
+    int base;
+    int index;
+    int32_t disp;
+};
+
+// Just enough of an x86-64 assembler for the translator. Memory operands
+// always use a 32-bit displacement, which keeps the encoding uniform.
+class Emitter
+{
+public:
+    explicit Emitter(Byte * at) : start(at), p(at) {}
+
+    Byte * start;
+    Byte * p;
+
+    size_t size() const { return p - start; }
+
+    void byte(Byte b) { *p++ = b; }
+    void dword(uint32_t v) { std::memcpy(p, &v, 4); p += 4; }
+    void qword(uint64_t v) { std::memcpy(p, &v, 8); p += 8; }
+
+    // byteReg forces a REX prefix so that 4-7 select SPL..DIL rather than AH..BH
+    void rex(bool w, int reg, int index, int base, bool byteReg) {
+        Byte r = 0x40 | (w << 3) | ((reg >> 3) << 2) | ((index >> 3) << 1) | (base >> 3);
+        if (r != 0x40 || byteReg)
+            byte(r);
+    }
+
+    void op(std::initializer_list<Byte> opcode, int reg, Mem m, bool w = false, bool byteReg = false) {
+        rex(w, reg, m.index < 0 ? 0 : m.index, m.base, byteReg);
+        for (Byte b : opcode)
+            byte(b);
+        if (m.index < 0 && (m.base & 7) != RSP) {
+            byte(0x80 | ((reg & 7) << 3) | (m.base & 7));
+        } else {
+            byte(0x80 | ((reg & 7) << 3) | 4);
+            byte((((m.index < 0 ? RSP : m.index) & 7) << 3) | (m.base & 7));
+        }
+        dword(m.disp);
+    }
+
+    void opr(std::initializer_list<Byte> opcode, int reg, int rm, bool w = false, bool byteReg = false) {
+        rex(w, reg, 0, rm, byteReg);
+        for (Byte b : opcode)
+            byte(b);
+        byte(0xC0 | ((reg & 7) << 3) | (rm & 7));
+    }
+
+    void movzxb(int dst, Mem m) { op({ 0x0F, 0xB6 }, dst, m); }
+    void movzxw(int dst, Mem m) { op({ 0x0F, 0xB7 }, dst, m); }
+    void movzxb(int dst, int src) { opr({ 0x0F, 0xB6 }, dst, src, false, true); }
+    void movzxw(int dst, int src) { opr({ 0x0F, 0xB7 }, dst, src); }
+    void storeb(Mem m, int src) { op({ 0x88 }, src, m, false, true); }
+    void storew(Mem m, int src) { byte(0x66); op({ 0x89 }, src, m); }
+    void storebImm(Mem m, Byte imm) { op({ 0xC6 }, 0, m); byte(imm); }
+    void storedImm(Mem m, uint32_t imm) { op({ 0xC7 }, 0, m); dword(imm); }
+    void storewImm(Mem m, Word imm) { byte(0x66); op({ 0xC7 }, 0, m); byte(imm & 0xFF); byte(imm >> 8); }
+    void addqImm(Mem m, int32_t imm) { op({ 0x81 }, 0, m, true); dword(imm); }
+    void cmpbImm(Mem m, Byte imm) { op({ 0x80 }, 7, m); byte(imm); }
+    void testbImm(Mem m, Byte imm) { op({ 0xF6 }, 0, m); byte(imm); }
+    void andbImm(Mem m, Byte imm) { op({ 0x80 }, 4, m); byte(imm); }
+    void orbImm(Mem m, Byte imm) { op({ 0x80 }, 1, m); byte(imm); }
+    void lea(int dst, Mem m) { op({ 0x8D }, dst, m); }
+    void loadq(int dst, Mem m) { op({ 0x8B }, dst, m, true); }
+    void cmpq(int reg, Mem m) { op({ 0x3B }, reg, m, true); }
+
+    void mov(int dst, int src) { opr({ 0x8B }, dst, src); }
+    void movq(int dst, int src) { opr({ 0x8B }, dst, src, true); }
+    void movImm(int dst, uint32_t imm) { rex(false, 0, 0, dst, false); byte(0xB8 + (dst & 7)); dword(imm); }
+    void movImm64(int dst, uint64_t imm) { rex(true, 0, 0, dst, false); byte(0xB8 + (dst & 7)); qword(imm); }
+    // 0x03 add, 0x0B or, 0x23 and, 0x2B sub, 0x33 xor
+    void alu(Byte opcode, int dst, int src) { opr({ opcode }, dst, src); }
+    // /0 add, /1 or, /4 and, /5 sub, /6 xor, /7 cmp
+    void aluImm(int digit, int dst, int32_t imm) { opr({ 0x81 }, digit, dst); dword(imm); }
+    // /4 shl, /5 shr
+    void shiftImm(int digit, int dst, Byte count) { opr({ 0xC1 }, digit, dst); byte(count); }
+    void setcc(Cond cc, int dst) { opr({ 0x0F, Byte(0x90 + cc) }, 0, dst, false, true); }
+    void testb(int a, int b) { opr({ 0x84 }, b, a, false, true); }
+    void testq(int a, int b) { opr({ 0x85 }, b, a, true); }
+    void addqImm(int dst, int32_t imm) { opr({ 0x81 }, 0, dst, true); dword(imm); }
+
+    void push(int r) { if (r >= 8) byte(0x41); byte(0x50 + (r & 7)); }
+    void pop(int r) { if (r >= 8) byte(0x41); byte(0x58 + (r & 7)); }
+    void callRax() { byte(0xFF); byte(0xD0); }
+    void jmpRax() { byte(0xFF); byte(0xE0); }
+    void ret() { byte(0xC3); }
+
+    // Forward jumps, patched by bind() once the target is known
+    Byte * jccShort(Cond cc) { byte(0x70 + cc); byte(0); return p - 1; }
+    Byte * jcc(Cond cc) { byte(0x0F); byte(0x80 + cc); dword(0); return p - 4; }
+    Byte * jmp() { byte(0xE9); dword(0); return p - 4; }
+    void bindShort(Byte * at) { *at = Byte(p - (at + 1)); }
+    void bind(Byte * at) { int32_t rel = int32_t(p - (at + 4)); std::memcpy(at, &rel, 4); }
+};
+
+bool markCodeDirty(Memory * m, Word addr)
+{
+    m->markCodeDirty(addr);
+    return m->codeDirty;
+}
+
+enum Mode { IMP, IMM, ZP, ZPX, ZPY, ABS, ABSX, ABSY, IX, IY };
+
+enum Kind {
+    FALLBACK,
+    LOAD, STORE, LOGIC, COMPARE, INCMEM, DECMEM,
+    INCREG, DECREG, TRANSFER, TXS,
+    CLEARC, SETC, CLEARV, CLEARIDB, SETIDB, NOP,
+    PHA, PLA, PHP, PLP, BRANCH, JMPABS, JSR, RTS
+};
+
+struct NativeOp {
+    Kind kind;
+    Mode mode;
+    int reg;        // register operand, or destination for transfers
+    int src;        // transfer source; logic opcode; branch flag offset
+    Cond cc;        // branch taken when the flag test gives cc
+    Byte mask;      // branch flag tested with test (N) instead of cmp 0; I or D bit
+};
+
+// Which opcodes get native code, and how. Anything left FALLBACK calls its
+// block-engine handler.
+struct NativeTable {
+    NativeOp ops[256];
+
+    void set(Byte opcode, Kind kind, Mode mode, int reg = 0, int src = 0) { ops[opcode] = { kind, mode, reg, src, CC_E, 0 }; }
+    void branch(Byte opcode, int32_t flag, Cond cc, Byte mask = 0) { ops[opcode] = { BRANCH, IMP, 0, flag, cc, mask }; }
+    void flag(Byte opcode, Kind kind, Byte bit) { ops[opcode] = { kind, IMP, 0, 0, CC_E, bit }; }
+
+    NativeTable() {
+        for (NativeOp & op : ops)
+            op = { FALLBACK, IMP, 0, 0, CC_E, 0 };
+
+        set(0xA9, LOAD, IMM, REG_A); set(0xA5, LOAD, ZP, REG_A); set(0xB5, LOAD, ZPX, REG_A); set(0xAD, LOAD, ABS, REG_A);
+        set(0xBD, LOAD, ABSX, REG_A); set(0xB9, LOAD, ABSY, REG_A); set(0xA1, LOAD, IX, REG_A); set(0xB1, LOAD, IY, REG_A);
+        set(0xA2, LOAD, IMM, REG_X); set(0xA6, LOAD, ZP, REG_X); set(0xB6, LOAD, ZPY, REG_X); set(0xAE, LOAD, ABS, REG_X); set(0xBE, LOAD, ABSY, REG_X);
+        set(0xA0, LOAD, IMM, REG_Y); set(0xA4, LOAD, ZP, REG_Y); set(0xB4, LOAD, ZPX, REG_Y); set(0xAC, LOAD, ABS, REG_Y); set(0xBC, LOAD, ABSX, REG_Y);
+
+        set(0x85, STORE, ZP, REG_A); set(0x95, STORE, ZPX, REG_A); set(0x8D, STORE, ABS, REG_A); set(0x9D, STORE, ABSX, REG_A);
+        set(0x99, STORE, ABSY, REG_A); set(0x81, STORE, IX, REG_A); set(0x91, STORE, IY, REG_A);
+        set(0x86, STORE, ZP, REG_X); set(0x96, STORE, ZPY, REG_X); set(0x8E, STORE, ABS, REG_X);
+        set(0x84, STORE, ZP, REG_Y); set(0x94, STORE, ZPX, REG_Y); set(0x8C, STORE, ABS, REG_Y);
+
+        const Mode groupModes[8] = { IX, ZP, IMM, ABS, IY, ZPX, ABSY, ABSX };
+        const Byte groupBase[8] = { 0x01, 0x05, 0x09, 0x0D, 0x11, 0x15, 0x19, 0x1D };
+        for (int i = 0; i < 8; i++) {
+            set(groupBase[i] + 0x00, LOGIC, groupModes[i], REG_A, 0x0B);    // ORA
+            set(groupBase[i] + 0x20, LOGIC, groupModes[i], REG_A, 0x23);    // AND
+            set(groupBase[i] + 0x40, LOGIC, groupModes[i], REG_A, 0x33);    // EOR
+            set(groupBase[i] + 0xC0, COMPARE, groupModes[i], REG_A);        // CMP
+        }
+        set(0xE0, COMPARE, IMM, REG_X); set(0xE4, COMPARE, ZP, REG_X); set(0xEC, COMPARE, ABS, REG_X);
+        set(0xC0, COMPARE, IMM, REG_Y); set(0xC4, COMPARE, ZP, REG_Y); set(0xCC, COMPARE, ABS, REG_Y);
+
+        set(0xE6, INCMEM, ZP); set(0xF6, INCMEM, ZPX); set(0xEE, INCMEM, ABS); set(0xFE, INCMEM, ABSX);
+        set(0xC6, DECMEM, ZP); set(0xD6, DECMEM, ZPX); set(0xCE, DECMEM, ABS); set(0xDE, DECMEM, ABSX);
+
+        set(0xE8, INCREG, IMP, REG_X); set(0xC8, INCREG, IMP, REG_Y);
+        set(0xCA, DECREG, IMP, REG_X); set(0x88, DECREG, IMP, REG_Y);
+        set(0xAA, TRANSFER, IMP, REG_X, REG_A); set(0xA8, TRANSFER, IMP, REG_Y, REG_A);
+        set(0x8A, TRANSFER, IMP, REG_A, REG_X); set(0x98, TRANSFER, IMP, REG_A, REG_Y);
+        set(0xBA, TRANSFER, IMP, REG_X, REG_SP); set(0x9A, TXS, IMP);
+
+        set(0x18, CLEARC, IMP); set(0x38, SETC, IMP); set(0xB8, CLEARV, IMP); set(0xEA, NOP, IMP);
+        flag(0x58, CLEARIDB, 0x04); flag(0x78, SETIDB, 0x04); flag(0xD8, CLEARIDB, 0x08); flag(0xF8, SETIDB, 0x08);
+        set(0x48, PHA, IMP); set(0x68, PLA, IMP); set(0x08, PHP, IMP); set(0x28, PLP, IMP);
+
+        branch(0x10, OFF_N, CC_E, 0x80); branch(0x30, OFF_N, CC_NE, 0x80);
+        branch(0x50, OFF_V, CC_E); branch(0x70, OFF_V, CC_NE);
+        branch(0x90, OFF_C, CC_E); branch(0xB0, OFF_C, CC_NE);
+        branch(0xD0, OFF_Z, CC_NE); branch(0xF0, OFF_Z, CC_E);
+
+        set(0x4C, JMPABS, IMP); set(0x20, JSR, IMP); set(0x60, RTS, IMP);
+    }
+};
+
+const NativeTable nativeTable;
+
+// Translates one Block. Static cycles are summed as ops are emitted and
+// charged at whichever exit is taken.
+class Translator
+{
+public:
+    Translator(Byte * at, BlockCache & cache)
+        : e(at)
+        , cache(cache)
+        , m(*cache.mem)
+        , codePageOffset(int32_t(m.codePage - m.mem))
+    {}
+
+    Emitter e;
+    Byte * body = nullptr;  // entry for blocks chaining in, past the prologue
+
+    void translate(const Block & block) {
+        chain = !block.loops;
+        prologue();
+        body = e.p;
+        bool ended = false;
+        for (const DecodedOp & op : block.ops)
+            ended = translate(op, &op == &block.ops.back());
+        if (!ended)
+            exitTo(block.ops.back().next);
+        epilogue();
+    }
+
+private:
+    BlockCache & cache;
+    Memory & m;
+    int32_t codePageOffset;
+    long long running = 0;
+    std::vector<Byte *> exits;
+    bool chain = true;
+
+    static Mem state(int32_t offset) { return { STATE, -1, offset }; }
+
+    void prologue() {
+        e.push(RBX); e.push(RBP); e.push(R12); e.push(R13); e.push(R14); e.push(R15);
+        e.byte(0x48); e.byte(0x83); e.byte(0xEC); e.byte(0x08);     // sub rsp, 8: realign for calls
+        e.movq(STATE, RDI);
+        e.movImm64(MEM, reinterpret_cast<uint64_t>(m.mem));
+        reload();
+    }
+
+    void epilogue() {
+        for (Byte * at : exits)
+            e.bind(at);
+        spill();
+        e.byte(0x48); e.byte(0x83); e.byte(0xC4); e.byte(0x08);     // add rsp, 8
+        e.pop(R15); e.pop(R14); e.pop(R13); e.pop(R12); e.pop(RBP); e.pop(RBX);
+        e.ret();
+    }
+
+    void spill() {
+        e.storeb(state(OFF_A), REG_A);
+        e.storeb(state(OFF_X), REG_X);
+        e.storeb(state(OFF_Y), REG_Y);
+        e.storeb(state(OFF_SP), REG_SP);
+    }
+
+    void reload() {
+        e.movzxb(REG_A, state(OFF_A));
+        e.movzxb(REG_X, state(OFF_X));
+        e.movzxb(REG_Y, state(OFF_Y));
+        e.movzxb(REG_SP, state(OFF_SP));
+    }
+
+    // Leaves the block; pc < 0 when the state already holds the next PC
+    void exit(int pc) {
+        if (pc >= 0)
+            e.storewImm(state(OFF_PC), pc);
+        if (running)
+            e.addqImm(state(OFF_CYC), int32_t(running));
+        exits.push_back(e.jmp());
+    }
+
+    // Leaves for a known PC, chaining straight into its translated code when
+    // there is some and the budget allows. checkDirty covers stores that did
+    // not leave the block themselves. A candidate idle loop never chains, so
+    // one call runs exactly one pass of it for runIdleCandidate() to judge.
+    void exitTo(Word pc, bool checkDirty = false) {
+        if (!chain) {
+            exit(pc);
+            return;
+        }
+        if (running)
+            e.addqImm(state(OFF_CYC), int32_t(running));
+        e.movImm64(RAX, reinterpret_cast<uint64_t>(&cache.nativeEntry[pc]));
+        e.loadq(RAX, { RAX, -1, 0 });
+        e.testq(RAX, RAX);
+        Byte * untranslated = e.jccShort(CC_E);
+        Byte * dirty = nullptr;
+        if (checkDirty) {
+            e.movImm64(RCX, reinterpret_cast<uint64_t>(&m.codeDirty));
+            e.cmpbImm({ RCX, -1, 0 }, 0);
+            dirty = e.jccShort(CC_NE);
+        }
+        e.loadq(RCX, state(OFF_CYC));
+        e.addqImm(RCX, MaxBlockCycles);
+        e.cmpq(RCX, state(OFF_LIMIT));
+        Byte * budget = e.jccShort(CC_G);
+        e.jmpRax();
+        e.bindShort(untranslated);
+        if (dirty)
+            e.bindShort(dirty);
+        e.bindShort(budget);
+        e.storewImm(state(OFF_PC), pc);
+        exits.push_back(e.jmp());
+    }
+
+    // Jump or branch to itself: stop the run there, like the other engines
+    void trap(Word pc) {
+        e.storedImm(state(OFF_STOP), uint32_t(CPU::StopReason::Trap));
+        exit(pc);
+    }
+
+    void penalty() { e.addqImm(state(OFF_CYC), 1); }
+
+    // Effective address, returned as a constant or left in ESI
+    struct Ea {
+        bool inRsi;
+        Word addr;
+    };
+
+    Mem guest(Ea ea) const { return ea.inRsi ? Mem { MEM, RSI, 0 } : Mem { MEM, -1, ea.addr }; }
+
+    void indexed(int reg, Word operand) {
+        e.lea(RSI, { reg, -1, operand });
+        e.movzxw(RSI, RSI);
+        if (operand & 0xFF) {
+            e.aluImm(7, reg, 0xFF - (operand & 0xFF));
+            Byte * same = e.jccShort(CC_BE);
+            penalty();
+            e.bindShort(same);
+        }
+    }
+
+    Ea address(Mode mode, Word operand) {
+        switch (mode) {
+        case ZPX:
+        case ZPY:
+            e.lea(RSI, { mode == ZPX ? REG_X : REG_Y, -1, operand });
+            e.movzxb(RSI, RSI);
+            return { true, 0 };
+        case ABSX:
+            indexed(REG_X, operand);
+            return { true, 0 };
+        case ABSY:
+            indexed(REG_Y, operand);
+            return { true, 0 };
+        case IX:
+            // The pointer's high byte comes from zp + 1 without wrapping, as in CPU::indexedIndirect
+            e.lea(RSI, { REG_X, -1, operand });
+            e.movzxb(RSI, RSI);
+            e.movzxw(RSI, { MEM, RSI, 0 });
+            return { true, 0 };
+        case IY: {
+            e.movzxw(RSI, { MEM, -1, operand });
+            e.alu(0x03, RSI, REG_Y);
+            e.movzxw(RSI, RSI);
+            e.aluImm(7, RSI, 0xFF);
+            Byte * zeroPage = e.jccShort(CC_BE);
+            penalty();
+            e.bindShort(zeroPage);
+            return { true, 0 };
+        }
+        default:
+            // IMM: the block decoder left the address of the immediate byte
+            return { false, operand };
+        }
+    }
+
+    void readOperand(Mode mode, Word operand) { e.movzxb(RCX, guest(address(mode, operand))); }
+
+    void setNZ(int reg) {
+        e.storeb(state(OFF_N), reg);
+        e.storeb(state(OFF_Z), reg);
+    }
+
+    // Memory::write's code check, after the store itself. Stores that rewrite
+    // decoded code leave the block so the engine can re-decode it.
+    void checkWrite(Ea ea, const DecodedOp & op, bool leave) {
+        if (ea.inRsi) {
+            e.mov(RAX, RSI);
+            e.shiftImm(5, RAX, 8);
+            e.cmpbImm({ MEM, RAX, codePageOffset }, 0);
+        } else {
+            e.cmpbImm({ MEM, -1, codePageOffset + (ea.addr >> 8) }, 0);
+        }
+        Byte * noCode = e.jcc(CC_E);
+        e.movImm64(RDI, reinterpret_cast<uint64_t>(&m));
+        if (!ea.inRsi)
+            e.movImm(RSI, ea.addr);
+        e.movImm64(RAX, reinterpret_cast<uint64_t>(&markCodeDirty));
+        e.callRax();
+        if (leave) {
+            e.testb(RAX, RAX);
+            Byte * clean = e.jcc(CC_E);
+            exit(op.next);
+            e.bind(clean);
+        }
+        e.bind(noCode);
+    }
+
+    void push(int reg, const DecodedOp & op, bool leave) {
+        e.lea(RSI, { REG_SP, -1, 0x100 });
+        e.storeb({ MEM, RSI, 0 }, reg);
+        e.aluImm(5, REG_SP, 1);
+        e.aluImm(4, REG_SP, 0xFF);
+        checkWrite({ true, 0 }, op, leave);
+    }
+
+    void pull(int reg) {
+        e.aluImm(0, REG_SP, 1);
+        e.aluImm(4, REG_SP, 0xFF);
+        e.movzxb(reg, { MEM, REG_SP, 0x100 });
+    }
+
+    // P into EAX as PHP pushes it, B and bit 5 set
+    void packFlags() {
+        e.movzxb(RAX, state(OFF_N));
+        e.aluImm(4, RAX, 0x80);
+        e.movzxb(RCX, state(OFF_V));
+        e.alu(0x0B, RAX, RCX);
+        e.movzxb(RCX, state(OFF_IDB));
+        e.alu(0x0B, RAX, RCX);
+        e.movzxb(RCX, state(OFF_C));
+        e.alu(0x0B, RAX, RCX);
+        e.cmpbImm(state(OFF_Z), 0);
+        e.setcc(CC_E, RCX);
+        e.movzxb(RCX, RCX);
+        e.alu(0x03, RCX, RCX);
+        e.alu(0x0B, RAX, RCX);
+        e.aluImm(1, RAX, 0x30);
+    }
+
+    // P in EAX back into the lazy flags, as unpackFlags()
+    void unpackFlags() {
+        e.storeb(state(OFF_N), RAX);
+        e.mov(RCX, RAX);
+        e.shiftImm(5, RCX, 1);
+        e.aluImm(4, RCX, 1);
+        e.aluImm(6, RCX, 1);
+        e.storeb(state(OFF_Z), RCX);
+        const int32_t fields[3] = { OFF_C, OFF_V, OFF_IDB };
+        const Byte masks[3] = { 0x01, 0x40, 0x3C };
+        for (int i = 0; i < 3; i++) {
+            e.mov(RCX, RAX);
+            e.aluImm(4, RCX, masks[i]);
+            e.storeb(state(fields[i]), RCX);
+        }
+    }
+
+    void fallback(const DecodedOp & op, bool ends) {
+        if (ends || op.writes)
+            e.storewImm(state(OFF_PC), op.next);
+        spill();
+        e.movq(RDI, STATE);
+        e.movImm64(RSI, reinterpret_cast<uint64_t>(&op));
+        e.movImm64(RAX, reinterpret_cast<uint64_t>(op.handler));
+        e.callRax();
+        reload();
+        if (ends) {
+            exit(-1);
+        } else if (op.writes) {
+            e.movImm64(RAX, reinterpret_cast<uint64_t>(&m.codeDirty));
+            e.cmpbImm({ RAX, -1, 0 }, 0);
+            Byte * clean = e.jcc(CC_E);
+            exit(-1);
+            e.bind(clean);
+        }
+    }
+
+    // Emits one op; true if it ended the block
+    bool translate(const DecodedOp & op, bool last) {
+        const NativeOp & n = nativeTable.ops[m.read(op.pc)];
+        running += op.cycles;
+
+        switch (n.kind) {
+        case LOAD:
+            readOperand(n.mode, op.operand);
+            e.mov(n.reg, RCX);
+            setNZ(n.reg);
+            return false;
+        case STORE: {
+            Ea ea = address(n.mode, op.operand);
+            e.storeb(guest(ea), n.reg);
+            checkWrite(ea, op, true);
+            return false;
+        }
+        case LOGIC:
+            readOperand(n.mode, op.operand);
+            e.alu(Byte(n.src), REG_A, RCX);
+            setNZ(REG_A);
+            return false;
+        case COMPARE:
+            readOperand(n.mode, op.operand);
+            e.mov(RAX, n.reg);
+            e.alu(0x2B, RAX, RCX);
+            e.setcc(CC_AE, RDX);
+            setNZ(RAX);
+            e.storeb(state(OFF_C), RDX);
+            return false;
+        case INCMEM:
+        case DECMEM: {
+            Ea ea = address(n.mode, op.operand);
+            e.movzxb(RCX, guest(ea));
+            e.aluImm(n.kind == INCMEM ? 0 : 5, RCX, 1);
+            e.storeb(guest(ea), RCX);
+            setNZ(RCX);
+            checkWrite(ea, op, true);
+            return false;
+        }
+        case INCREG:
+        case DECREG:
+            e.aluImm(n.kind == INCREG ? 0 : 5, n.reg, 1);
+            e.aluImm(4, n.reg, 0xFF);
+            setNZ(n.reg);
+            return false;
+        case TRANSFER:
+            e.mov(n.reg, n.src);
+            setNZ(n.reg);
+            return false;
+        case TXS:
+            e.mov(REG_SP, REG_X);
+            return false;
+        case CLEARC:
+            e.storebImm(state(OFF_C), 0);
+            return false;
+        case SETC:
+            e.storebImm(state(OFF_C), 1);
+            return false;
+        case CLEARV:
+            e.storebImm(state(OFF_V), 0);
+            return false;
+        case CLEARIDB:
+            e.andbImm(state(OFF_IDB), Byte(~n.mask));
+            return false;
+        case SETIDB:
+            e.orbImm(state(OFF_IDB), n.mask);
+            return false;
+        case NOP:
+            return false;
+        case PHA:
+            push(REG_A, op, true);
+            return false;
+        case PLA:
+            pull(REG_A);
+            setNZ(REG_A);
+            return false;
+        case PHP:
+            packFlags();
+            push(RAX, op, true);
+            return false;
+        case PLP:
+            pull(RAX);
+            unpackFlags();
+            return false;
+        case BRANCH: {
+            if (n.mask)
+                e.testbImm(state(n.src), n.mask);
+            else
+                e.cmpbImm(state(n.src), 0);
+            Byte * taken = e.jcc(n.cc);
+            exitTo(op.next);
+            e.bind(taken);
+            running += branchTakenPenalty(op.next, op.operand);
+            if (op.operand == op.pc)
+                trap(op.pc);
+            else
+                exitTo(op.operand);
+            return true;
+        }
+        case JMPABS:
+            if (op.operand == op.pc)
+                trap(op.pc);
+            else
+                exitTo(op.operand);
+            return true;
+        case JSR: {
+            Word ret = op.pc + 2;
+            e.movImm(RCX, ret >> 8);
+            push(RCX, op, false);
+            e.movImm(RCX, ret & 0xFF);
+            push(RCX, op, false);
+            exitTo(op.operand, true);
+            return true;
+        }
+        case RTS:
+            pull(RAX);
+            pull(RCX);
+            e.shiftImm(4, RCX, 8);
+            e.alu(0x0B, RAX, RCX);
+            e.aluImm(0, RAX, 1);
+            e.storew(state(OFF_PC), RAX);
+            exit(-1);
+            return true;
+        case FALLBACK:
+            break;
+        }
+
+        // The last op of a block may be control flow, so let its handler set PC
+        fallback(op, last);
+        return last;
+    }
+};
+
+#endif
+
+}
+
+Jit::Jit(Memory * _mem): mem(_mem) {
+#if CPU_JIT_X86_64
+    void * p = mmap(nullptr, CodeSize, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p != MAP_FAILED)
+        code = static_cast<Byte *>(p);
+#endif
+}
+
+Jit::~Jit()
+{
+#if CPU_JIT_X86_64
+    if (code)
+        munmap(code, CodeSize);
+#endif
+}
+
+bool Jit::available() const
+{
+    return code != nullptr;
+}
+
+bool Jit::compile(BlockCache & cache, Block & block)
+{
+#if CPU_JIT_X86_64
+    if (!code || used + MaxBlockCode > CodeSize)
+        return false;
+    Translator t(code + used, cache);
+    t.translate(block);
+    block.native = reinterpret_cast<NativeBlock>(code + used);
+    // A candidate idle loop is neither chained into nor out of, so the engine
+    // loop sees every pass; a candidate delay loop is not chained into, so it
+    // sees the entry
+    if (!block.loops && !block.counted)
+        cache.nativeEntry[block.start] = t.body;
+    used += (t.e.size() + 15) & ~size_t(15);
+    compiled++;
+    return true;
+#else
+    (void)cache;
+    (void)block;
+    return false;
+#endif
+}
+
+void Jit::reset()
+{
+    used = 0;
+    compiled = 0;
+}
+
+CPU::StopReason runJit(CPU & cpu, long long cycleLimit)
+{
+    if (!cpu.blockCache || cpu.blockCache->mem != cpu.mem)
+        cpu.blockCache.reset(new BlockCache(cpu.mem));
+    if (!cpu.jit || cpu.jit->mem != cpu.mem) {
+        // Drop blocks still pointing into another translator's code
+        cpu.blockCache->flush();
+        cpu.jit.reset(new Jit(cpu.mem));
+    }
+    BlockCache & cache = *cpu.blockCache;
+    Jit & jit = *cpu.jit;
+    Memory & m = *cpu.mem;
+
+    BlockState s { &m, cpu.PC, cpu.A, cpu.X, cpu.Y, cpu.SP, unpackFlags(cpu.P), cpu.cycles, CPU::StopReason::Budget, cycleLimit };
+
+    while (s.stop == CPU::StopReason::Budget) {
+        if (m.codeDirty)
+            cache.flushDirty();
+        Block & block = cache.lookup(s.pc);
+        if (block.counted && cpu.skipDelayLoops && runDelayLoop(s, block, cycleLimit))
+            continue;
+        if (!block.native && block.hits++ >= cpu.jitThreshold && jit.available() && !jit.compile(cache, block)) {
+            // Code buffer full: start over
+            cache.flush();
+            jit.reset();
+            continue;
+        }
+        bool idleCandidate = block.loops && cpu.skipIdleLoops;
+        if (block.native && s.cyc + block.maxCycles <= cycleLimit) {
+            if (idleCandidate)
+                runIdleCandidate(s, cycleLimit, [&] { block.native(&s); return true; });
+            else
+                block.native(&s);
+            continue;
+        }
+        if (idleCandidate) {
+            if (!runIdleCandidate(s, cycleLimit, [&] { return runBlock(s, block, cycleLimit); }))
+                break;
+            continue;
+        }
+        if (!runBlock(s, block, cycleLimit))
+            break;
+    }
+
+    cpu.PC = s.pc;
+    cpu.A = s.a;
+    cpu.X = s.x;
+    cpu.Y = s.y;
+    cpu.SP = s.sp;
+    cpu.P = packFlags(s.f);
+    cpu.cycles = s.cyc;
+    return s.stop;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "blockcache.h"
+
+#include <cstddef>
+
+// x86-64 translator behind CPU::Engine::Jit.
+//
+// The JIT engine runs the block cache and translates a Block to native code
+// once it has executed CPU::jitThreshold times. Translated code keeps A, X, Y
+// and SP in callee-saved host registers for the whole block, adds the static
+// cycle cost at each exit and only the page-cross and branch penalties
+// inline. N/Z/C/V stay lazy in BlockState::f, as in the other engines.
+// Opcodes without a native translation call their block-engine handler.
+//
+// A block exits back to the engine loop at its end and after any store that
+// rewrites decoded code, so the cache can drop and rebuild what changed. The
+// engine only enters native code when the whole block fits in the remaining
+// budget; otherwise it steps the block through the handlers. Candidate idle
+// loops (Block::loops) always return to the engine loop after each pass so
+// it can fast-forward them, and candidate delay loops (Block::counted) are
+// entered from it so it can run them in closed form.
+//
+// Only System V x86-64 hosts get native code; elsewhere Engine::Jit runs the
+// plain block engine.
+
+class Jit
+{
+public:
+    explicit Jit(Memory *);
+    ~Jit();
+
+    // False when no executable memory could be had, or on non-x86-64 hosts
+    bool available() const;
+
+    // Translates block and publishes it in cache.nativeEntry; false when the code buffer is full
+    bool compile(BlockCache & cache, Block & block);
+    // Translates block; false when the code buffer is full
+    bool compile(Block & block);
+    // Forgets all translated code. Blocks still pointing into it must be dropped first.
+    void reset();
+    size_t compiledBlocks() const { return compiled; }
+
+    Memory * mem;
+
+private:
+    static const size_t CodeSize = 16 * 1024 * 1024;
+    static const size_t MaxBlockCode = 8 * 1024;
+
+    Byte * code = nullptr;
+    size_t used = 0;
+    size_t compiled = 0;
+};
@@ -1,7 +1,9 @@
 #include "memory.h"
 
+#include<algorithm>
 #include<iostream>
 #include<chrono>
+#include<utility>
 
 // Memory accessors are now defined inline in memory.h for performance (inlining eliminates call overhead in the hot path).
 // Definitions moved to header to allow compiler to optimize reads/writes directly.
@@ -10,6 +12,89 @@
 Memory::Memory() {
     for(int i=0; i<MEMORY_SIZE; i++)
         mem[i] = 0;
+    mapRam(0, 256);
+}
+
+Memory::Memory(const Memory & other) {
+    *this = other;
+}
+
+Memory & Memory::operator=(const Memory & other)
+{
+    if (this == &other)
+        return *this;
+    std::copy(other.mem, other.mem + MEMORY_SIZE, mem);
+    std::copy(other.codePage, other.codePage + 256, codePage);
+    codeBytes = other.codeBytes;
+    codeDirty = other.codeDirty;
+    dirtyCode = other.dirtyCode;
+    // Pages over the other memory's mem[] move to this one's
+    auto rebase = [&](auto * page) -> decltype(page) {
+        if (page && page >= other.mem && page < other.mem + MEMORY_SIZE)
+            return mem + (page - other.mem);
+        return page;
+    };
+    for (int page = 0; page < 256; page++) {
+        readPage[page] = rebase(other.readPage[page]);
+        writePage[page] = rebase(other.writePage[page]);
+    }
+    std::copy(other.pageDevice, other.pageDevice + 256, pageDevice);
+    devices = other.devices;
+    return *this;
+}
+
+void Memory::mapRam(Byte firstPage, int pages, Byte * host)
+{
+    for (int i = 0; i < pages && firstPage + i < 256; i++) {
+        int page = firstPage + i;
+        Byte * bytes = host ? host + i * 256 : mem + page * 256;
+        readPage[page] = bytes;
+        writePage[page] = bytes;
+        pageDevice[page] = 0;
+    }
+}
+
+void Memory::mapRom(Byte firstPage, int pages, const Byte * host)
+{
+    for (int i = 0; i < pages && firstPage + i < 256; i++) {
+        int page = firstPage + i;
+        readPage[page] = host ? host + i * 256 : mem + page * 256;
+        writePage[page] = nullptr;
+        pageDevice[page] = 0;
+    }
+}
+
+void Memory::mapDevice(Byte firstPage, int pages, Device device)
+{
+    devices.push_back(std::move(device));
+    for (int i = 0; i < pages && firstPage + i < 256; i++) {
+        int page = firstPage + i;
+        readPage[page] = nullptr;
+        writePage[page] = nullptr;
+        pageDevice[page] = devices.size();
+    }
+}
+
+Byte Memory::deviceRead(Word addr)
+{
+    const Device & device = devices[pageDevice[addr >> 8] - 1];
+    return device.read ? device.read(addr) : 0;
+}
+
+void Memory::deviceWrite(Word addr, Byte value)
+{
+    const Device & device = devices[pageDevice[addr >> 8] - 1];
+    if (device.write)
+        device.write(addr, value);
+}
+
+void Memory::markCodeDirty(Word addr)
+{
+    // Data sharing a page with code is common; only stores to decoded bytes count
+    if (!codeBytes[addr])
+        return;
+    dirtyCode.push_back(addr);
+    codeDirty = true;
 }
 
 Memory Memory::randomMemory()
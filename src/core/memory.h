@@ -3,18 +3,68 @@
 #define MEMORY_SIZE 65536
 
 #include "types.h"
+#include <bitset>
 #include <cstddef>  // for size_t
+#include <functional>
+#include <vector>
+
+// A memory-mapped device, called for the accesses to its pages
+struct Device {
+    std::function<Byte(Word)> read;
+    std::function<void(Word, Byte)> write;
+};
 
 class Memory
 {
 public:
     Memory();
+    Memory(const Memory &);
+    Memory & operator=(const Memory &);
     static Memory randomMemory();
 
 public:
     Byte mem[MEMORY_SIZE];
     inline Byte read(Word addr) const { return mem[addr]; }
     inline Word read16(Word addr) const { Byte low = mem[addr]; Byte high = mem[(addr + 1) & 0xFFFF]; return static_cast<Word>((high << 8) | low); }
-    inline void write(Word addr, Byte value) { mem[addr] = value; }
-    inline void writeBlock(Word startAddr, const Byte* data, size_t length) { for (size_t i = 0; i < length && (startAddr + i) < MEMORY_SIZE; ++i) mem[startAddr + i] = data[i]; }
+    inline void write(Word addr, Byte value) { mem[addr] = value; if (codePage[addr >> 8]) markCodeDirty(addr); }
+    inline void writeBlock(Word startAddr, const Byte* data, size_t length) { for (size_t i = 0; i < length && (startAddr + i) < MEMORY_SIZE; ++i) write(startAddr + i, data[i]); }
+
+    // Pages and bytes holding pre-decoded blocks. Writes through write() to a code
+    // byte are recorded here for the block cache to invalidate; direct mem[] stores are not.
+    Byte codePage[256] = {};
+    std::bitset<MEMORY_SIZE> codeBytes;
+    bool codeDirty = false;
+    std::vector<Word> dirtyCode;
+    void markCodeDirty(Word addr);
+
+    // Page table, seen only by cores on PagedBus (policies.h); read() and
+    // write() above stay flat. A RAM or ROM page reads, and a RAM page
+    // writes, 256 host bytes inline, by default its own bytes of mem[]; host
+    // may point elsewhere, say at a ROM bank. Writes to a ROM page are
+    // dropped. Device pages call their device's handlers, and ignore the
+    // accesses it has none for. Every page starts as RAM over mem[].
+    void mapRam(Byte firstPage, int pages, Byte * host = nullptr);
+    void mapRom(Byte firstPage, int pages, const Byte * host = nullptr);
+    void mapDevice(Byte firstPage, int pages, Device device);
+
+    inline Byte busRead(Word addr) {
+        const Byte * page = readPage[addr >> 8];
+        return page ? page[addr & 0xFF] : deviceRead(addr);
+    }
+    inline void busWrite(Word addr, Byte value) {
+        Byte * page = writePage[addr >> 8];
+        if (page)
+            page[addr & 0xFF] = value;
+        else if (pageDevice[addr >> 8])
+            deviceWrite(addr, value);
+    }
+
+    const Byte * readPage[256];
+    Byte * writePage[256];
+    Word pageDevice[256] = {};  // index into devices plus one, 0 for RAM and ROM
+    std::vector<Device> devices;
+
+private:
+    Byte deviceRead(Word addr);
+    void deviceWrite(Word addr, Byte value);
 };
@@ -0,0 +1,93 @@
+#include "perfcounters.h"
+
+#if defined(__linux__)
+#define CPU_PERF_EVENTS 1
+#include <cstdint>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#define CPU_PERF_EVENTS 0
+#endif
+
+const char * PerfCounters::name(Event event)
+{
+    static const char * const names[eventCount] = {
+        "cycles", "instructions", "branch-misses", "L1-dcache-load-misses", "L1-icache-load-misses"
+    };
+    return names[event];
+}
+
+PerfCounters::~PerfCounters()
+{
+#if CPU_PERF_EVENTS
+    for (int fd : fds)
+        if (fd >= 0)
+            close(fd);
+#endif
+}
+
+bool PerfCounters::open()
+{
+#if CPU_PERF_EVENTS
+    const uint64_t cacheMiss = (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    const struct { uint32_t type; uint64_t config; } events[eventCount] = {
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+        { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | cacheMiss },
+        { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1I | cacheMiss },
+    };
+    int leader = -1;
+    for (int event = 0; event < eventCount; event++) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = events[event].type;
+        attr.config = events[event].config;
+        attr.disabled = leader < 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        fds[event] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0));
+        if (leader < 0)
+            leader = fds[event];
+    }
+    return leader >= 0;
+#else
+    return false;
+#endif
+}
+
+void PerfCounters::start()
+{
+#if CPU_PERF_EVENTS
+    for (int fd : fds) {
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+            break;
+        }
+    }
+#endif
+}
+
+void PerfCounters::stop()
+{
+#if CPU_PERF_EVENTS
+    for (int fd : fds) {
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+            break;
+        }
+    }
+    for (int event = 0; event < eventCount; event++) {
+        uint64_t values[3];  // count, time enabled, time running
+        if (fds[event] < 0 || read(fds[event], values, sizeof(values)) != sizeof(values) || !values[2])
+            continue;
+        totals[event] += double(values[0]) * values[1] / values[2];
+    }
+#endif
+}
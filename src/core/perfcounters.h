@@ -0,0 +1,33 @@
+#pragma once
+
+// Host hardware counters for the calling thread, through Linux's
+// perf_event_open: core cycles, retired instructions, branch mispredictions
+// and L1 data and instruction cache read misses, user space only. The
+// counters open as one group so they count over the same intervals; any
+// the CPU, kernel or perf_event_paranoid refuses are left out, and open()
+// fails only when none is left. Counts accumulate over every start/stop
+// pair and are scaled up if the kernel had to multiplex them. Elsewhere
+// open() fails.
+
+class PerfCounters
+{
+public:
+    enum Event { Cycles, Instructions, BranchMisses, L1dMisses, L1iMisses };
+    static constexpr int eventCount = 5;
+    static const char * name(Event event);
+
+    PerfCounters() = default;
+    ~PerfCounters();
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters & operator=(const PerfCounters &) = delete;
+
+    bool open();
+    bool available(Event event) const { return fds[event] >= 0; }
+    void start();
+    void stop();
+    double count(Event event) const { return totals[event]; }
+
+private:
+    int fds[eventCount] = { -1, -1, -1, -1, -1 };
+    double totals[eventCount] = {};
+};
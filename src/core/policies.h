@@ -0,0 +1,91 @@
+#pragma once
+
+#include "types.h"
+#include "memory.h"
+
+#include <functional>
+
+// Compile-time policies for BasicCPU (see cpu.h). Each policy is a set of
+// static or inline no-op-able hooks, so a feature that is switched off
+// compiles to nothing in both the table core and the dispatch loop.
+
+// Cycle policies: how CPU::cycles advances.
+
+// Counts every bus cycle, exactly as the table handlers always have
+struct CycleCount {
+    static inline void cycle(long long & cycles, long long n = 1) { cycles += n; }
+    static inline void instruction(long long &, long long = 1) {}
+};
+
+// Instruction-accurate only: cycles counts instructions, so budgets passed to
+// run() are instruction counts
+struct InstructionCount {
+    static inline void cycle(long long &, long long = 1) {}
+    static inline void instruction(long long & cycles, long long n = 1) { cycles += n; }
+};
+
+// Bus policies: how the core reaches Memory. On a flat bus memory only
+// changes through the core's own stores, which idle and delay loops rely on.
+
+// Through Memory::read/write, which track stores to pre-decoded code
+struct MemoryBus {
+    static constexpr bool flat = true;
+    static inline Byte read(const Memory & m, Word addr) { return m.read(addr); }
+    static inline void write(Memory & m, Word addr, Byte value) { m.write(addr, value); }
+};
+
+// Straight to Memory::mem. Stores are not tracked for the block cache, JIT or
+// AOT engines, so a core with this bus always runs the dispatch loop.
+struct DirectBus {
+    static constexpr bool flat = true;
+    static inline Byte read(const Memory & m, Word addr) { return m.mem[addr]; }
+    static inline void write(Memory & m, Word addr, Byte value) { m.mem[addr] = value; }
+};
+
+// Through Memory's page table: RAM and ROM pages inline, device pages
+// through their handlers. Stores are not tracked, as on DirectBus, and a
+// device can change what a load sees at any time, so idle and delay loops
+// are always stepped.
+struct PagedBus {
+    static constexpr bool flat = false;
+    static inline Byte read(Memory & m, Word addr) { return m.busRead(addr); }
+    static inline void write(Memory & m, Word addr, Byte value) { m.busWrite(addr, value); }
+};
+
+// Hook policies: what the core reports while it runs. attach() is given the
+// core's Memory once, as the core is constructed.
+
+// Registers as an instruction is about to execute
+struct CPUTrace {
+    Word pc;
+    Byte a, x, y, sp, p;
+    long long cycles;
+};
+
+// A jump through the stack, reported once the instruction or interrupt
+// entry has pushed or pulled: JSR is a Call, BRK, IRQ and NMI entry are
+// Interrupts, RTS and RTI are Returns. The hook is given the new PC, the
+// new SP and the cycle count, which includes the JSR, BRK, RTS or RTI but
+// not yet the cost of an interrupt entry.
+enum class Transfer { Call, Interrupt, Return };
+
+struct NoHooks {
+    inline void attach(Memory *) {}
+    inline void instruction(const CPUTrace &) {}
+    inline void read(Word, Byte) {}
+    inline void write(Word, Byte) {}
+    inline void transfer(Transfer, Word, Byte, long long) {}
+};
+
+// Calls whichever callbacks are set. Reads include opcode and operand fetches.
+struct TraceHooks {
+    std::function<void(const CPUTrace &)> onInstruction;
+    std::function<void(Word, Byte)> onRead;
+    std::function<void(Word, Byte)> onWrite;
+
+    inline void attach(Memory *) {}
+    inline void instruction(const CPUTrace & trace) { if (onInstruction) onInstruction(trace); }
+    inline void read(Word addr, Byte value) { if (onRead) onRead(addr, value); }
+    inline void write(Word addr, Byte value) { if (onWrite) onWrite(addr, value); }
+    inline void transfer(Transfer, Word, Byte, long long) {}
+};
@@ -0,0 +1,305 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cstdio>
+#include <istream>
+#include <ostream>
+
+namespace {
+
+// Mnemonics of the documented opcodes, "???" for the rest
+const char * const mnemonics[256] = {
+    //        0      1      2      3      4      5      6      7      8      9      A      B      C      D      E      F
+    /*0*/ "BRK", "ORA", "???", "???", "???", "ORA", "ASL", "???", "PHP", "ORA", "ASL", "???", "???", "ORA", "ASL", "???",
+    /*1*/ "BPL", "ORA", "???", "???", "???", "ORA", "ASL", "???", "CLC", "ORA", "???", "???", "???", "ORA", "ASL", "???",
+    /*2*/ "JSR", "AND", "???", "???", "BIT", "AND", "ROL", "???", "PLP", "AND", "ROL", "???", "BIT", "AND", "ROL", "???",
+    /*3*/ "BMI", "AND", "???", "???", "???", "AND", "ROL", "???", "SEC", "AND", "???", "???", "???", "AND", "ROL", "???",
+    /*4*/ "RTI", "EOR", "???", "???", "???", "EOR", "LSR", "???", "PHA", "EOR", "LSR", "???", "JMP", "EOR", "LSR", "???",
+    /*5*/ "BVC", "EOR", "???", "???", "???", "EOR", "LSR", "???", "CLI", "EOR", "???", "???", "???", "EOR", "LSR", "???",
+    /*6*/ "RTS", "ADC", "???", "???", "???", "ADC", "ROR", "???", "PLA", "ADC", "ROR", "???", "JMP", "ADC", "ROR", "???",
+    /*7*/ "BVS", "ADC", "???", "???", "???", "ADC", "ROR", "???", "SEI", "ADC", "???", "???", "???", "ADC", "ROR", "???",
+    /*8*/ "???", "STA", "???", "???", "STY", "STA", "STX", "???", "DEY", "???", "TXA", "???", "STY", "STA", "STX", "???",
+    /*9*/ "BCC", "STA", "???", "???", "STY", "STA", "STX", "???", "TYA", "STA", "TXS", "???", "???", "STA", "???", "???",
+    /*A*/ "LDY", "LDA", "LDX", "???", "LDY", "LDA", "LDX", "???", "TAY", "LDA", "TAX", "???", "LDY", "LDA", "LDX", "???",
+    /*B*/ "BCS", "LDA", "???", "???", "LDY", "LDA", "LDX", "???", "CLV", "LDA", "TSX", "???", "LDY", "LDA", "LDX", "???",
+    /*C*/ "CPY", "CMP", "???", "???", "CPY", "CMP", "DEC", "???", "INY", "CMP", "DEX", "???", "CPY", "CMP", "DEC", "???",
+    /*D*/ "BNE", "CMP", "???", "???", "???", "CMP", "DEC", "???", "CLD", "CMP", "???", "???", "???", "CMP", "DEC", "???",
+    /*E*/ "CPX", "SBC", "???", "???", "CPX", "SBC", "INC", "???", "INX", "SBC", "NOP", "???", "CPX", "SBC", "INC", "???",
+    /*F*/ "BEQ", "SBC", "???", "???", "???", "SBC", "INC", "???", "SED", "SBC", "???", "???", "???", "SBC", "INC", "???",
+};
+
+// Indices of the nonzero entries among the first size, hottest first, at
+// most top of them
+template <class Counts>
+std::vector<size_t> hottest(const Counts & counts, size_t size, size_t top) {
+    std::vector<size_t> order;
+    for (size_t i = 0; i < size; i++)
+        if (counts[i].executions)
+            order.push_back(i);
+    std::sort(order.begin(), order.end(), [&](size_t l, size_t r) {
+        return counts[l].cycles > counts[r].cycles || (counts[l].cycles == counts[r].cycles && l < r);
+    });
+    if (order.size() > top)
+        order.resize(top);
+    return order;
+}
+
+// The nearest label at or below addr, plus the offset from it
+std::string labelFor(Word addr, const std::map<Word, std::string> * labels) {
+    if (!labels || labels->empty())
+        return std::string();
+    auto at = labels->upper_bound(addr);
+    if (at == labels->begin())
+        return std::string();
+    --at;
+    if (at->first == addr)
+        return at->second;
+    return at->second + "+" + std::to_string(addr - at->first);
+}
+
+// A call-tree node's routine, by label where there is one
+std::string routineName(const ProfileHooks & profile, uint32_t node, const std::map<Word, std::string> * labels) {
+    if (node == 0)
+        return "[top]";
+    Word routine = profile.calls[node].routine;
+    std::string label = labelFor(routine, labels);
+    if (!label.empty())
+        return label;
+    char hex[8];
+    std::snprintf(hex, sizeof(hex), "$%04X", unsigned(routine));
+    return hex;
+}
+
+}
+
+void ProfileHooks::transfer(Transfer kind, Word target, Byte sp, long long cycles)
+{
+    chargeCall(cycles);
+    if (kind == Transfer::Return) {
+        leave(sp, cycles);
+        return;
+    }
+    // Frames whose return address the push just overwrote are gone too
+    leave(sp + (kind == Transfer::Call ? 2 : 3), cycles);
+    uint32_t parent = stack.empty() ? 0 : stack.back().node;
+    auto found = children.emplace(std::make_pair(parent, target), uint32_t(calls.size()));
+    if (found.second) {
+        CallNode node;
+        node.routine = target;
+        node.parent = parent;
+        calls.push_back(node);
+    }
+    uint32_t node = found.first->second;
+    calls[node].calls++;
+    bool recorded = entered++ < eventLimit;
+    if (recorded)
+        events.push_back(CallEvent { cycles, node, true });
+    stack.push_back(Frame { node, sp, recorded });
+}
+
+void ProfileHooks::chargeCall(long long now)
+{
+    // Verifying a native routine winds the count back over it (hle.h)
+    if (now > callStarted)
+        calls[stack.empty() ? 0 : stack.back().node].cycles += now - callStarted;
+    callStarted = now;
+}
+
+void ProfileHooks::leave(int sp, long long now)
+{
+    while (!stack.empty() && stack.back().sp < sp) {
+        if (stack.back().recorded)
+            events.push_back(CallEvent { now, stack.back().node, false });
+        stack.pop_back();
+    }
+}
+
+void ProfileHooks::finish(long long cycles)
+{
+    charge(cycles);
+    last = &pcs[MEMORY_SIZE];
+    chargeCall(cycles);
+    leave(INT_MAX, cycles);
+}
+
+void ProfileHooks::clear()
+{
+    std::fill(pcs.begin(), pcs.end(), ProfileCount());
+    last = &pcs[MEMORY_SIZE];
+    started = 0;
+    calls.assign(1, CallNode());
+    events.clear();
+    stack.clear();
+    children.clear();
+    callStarted = 0;
+    entered = 0;
+}
+
+std::array<ProfileCount, 256> ProfileHooks::opcodes() const
+{
+    std::array<ProfileCount, 256> counts {};
+    for (size_t pc = 0; pc < MEMORY_SIZE; pc++) {
+        counts[code[pc]].executions += pcs[pc].executions;
+        counts[code[pc]].cycles += pcs[pc].cycles;
+    }
+    return counts;
+}
+
+std::vector<RoutineCount> ProfileHooks::routines() const
+{
+    // Children are created after their parents, so one backward pass sums
+    // every subtree
+    std::vector<uint64_t> inclusive(calls.size());
+    for (size_t node = calls.size(); node-- > 0;) {
+        inclusive[node] += calls[node].cycles;
+        if (node)
+            inclusive[calls[node].parent] += inclusive[node];
+    }
+
+    std::map<Word, RoutineCount> byRoutine;
+    for (size_t node = 1; node < calls.size(); node++) {
+        RoutineCount & count = byRoutine[calls[node].routine];
+        count.routine = calls[node].routine;
+        count.calls += calls[node].calls;
+        count.exclusive += calls[node].cycles;
+        // A recursive call's cycles are already in its outermost caller's
+        bool nested = false;
+        for (uint32_t up = calls[node].parent; up && !nested; up = calls[up].parent)
+            nested = calls[up].routine == calls[node].routine;
+        if (!nested)
+            count.inclusive += inclusive[node];
+    }
+
+    std::vector<RoutineCount> result;
+    for (const auto & entry : byRoutine)
+        result.push_back(entry.second);
+    std::sort(result.begin(), result.end(), [](const RoutineCount & l, const RoutineCount & r) {
+        return l.inclusive > r.inclusive || (l.inclusive == r.inclusive && l.routine < r.routine);
+    });
+    return result;
+}
+
+uint64_t ProfileHooks::totalExecutions() const
+{
+    uint64_t total = 0;
+    for (size_t pc = 0; pc < MEMORY_SIZE; pc++)
+        total += pcs[pc].executions;
+    return total;
+}
+
+uint64_t ProfileHooks::totalCycles() const
+{
+    uint64_t total = 0;
+    for (size_t pc = 0; pc < MEMORY_SIZE; pc++)
+        total += pcs[pc].cycles;
+    return total;
+}
+
+std::map<Word, std::string> readListingLabels(std::istream & listing)
+{
+    // "040e :                  psb_bwok": a hex address, " : ", then the
+    // label column, where instructions and macro lines leave a blank
+    const size_t labelColumn = 24;
+    std::map<Word, std::string> labels;
+    std::string line;
+    while (std::getline(listing, line)) {
+        if (line.size() <= labelColumn || line.compare(4, 3, " : ") != 0)
+            continue;
+        if (!std::all_of(line.begin(), line.begin() + 4, [](char c) { return std::isxdigit(static_cast<unsigned char>(c)); }))
+            continue;
+        char first = line[labelColumn];
+        if (line[labelColumn - 1] != ' ' || !(std::isalpha(static_cast<unsigned char>(first)) || first == '_' || first == '.'))
+            continue;
+        size_t end = line.find_first_of(" \t\r", labelColumn);
+        Word address = static_cast<Word>(std::stoul(line.substr(0, 4), nullptr, 16));
+        labels.emplace(address, line.substr(labelColumn, end - labelColumn));
+    }
+    return labels;
+}
+
+void writeProfile(std::ostream & out, const ProfileHooks & profile,
+                  const std::map<Word, std::string> * labels, size_t top)
+{
+    uint64_t executions = profile.totalExecutions();
+    uint64_t cycles = profile.totalCycles();
+    double share = cycles ? 100.0 / cycles : 0;
+    char line[160];
+
+    std::snprintf(line, sizeof(line), "%llu instructions, %llu cycles\n",
+                  static_cast<unsigned long long>(executions), static_cast<unsigned long long>(cycles));
+    out << line;
+
+    std::array<ProfileCount, 256> opcodes = profile.opcodes();
+    out << "\nopcode         executions          cycles   share  cycles/op\n";
+    for (size_t op : hottest(opcodes, opcodes.size(), top)) {
+        const ProfileCount & count = opcodes[op];
+        std::snprintf(line, sizeof(line), "%02X %-5s %18llu %15llu %6.2f%% %10.2f\n", unsigned(op), mnemonics[op],
+                      static_cast<unsigned long long>(count.executions), static_cast<unsigned long long>(count.cycles),
+                      count.cycles * share, double(count.cycles) / count.executions);
+        out << line;
+    }
+
+    out << "\npc             executions          cycles   share  label\n";
+    for (size_t pc : hottest(profile.pcs, MEMORY_SIZE, top)) {
+        const ProfileCount & count = profile.pcs[pc];
+        std::snprintf(line, sizeof(line), "%04X     %18llu %15llu %6.2f%%  ", unsigned(pc),
+                      static_cast<unsigned long long>(count.executions), static_cast<unsigned long long>(count.cycles),
+                      count.cycles * share);
+        out << line << labelFor(Word(pc), labels) << "\n";
+    }
+
+    std::vector<RoutineCount> routines = profile.routines();
+    if (routines.empty())
+        return;
+    if (routines.size() > top)
+        routines.resize(top);
+    out << "\nroutine             calls       inclusive       exclusive   share  label\n";
+    for (const RoutineCount & count : routines) {
+        std::snprintf(line, sizeof(line), "%04X     %14llu %15llu %15llu %6.2f%%  ", unsigned(count.routine),
+                      static_cast<unsigned long long>(count.calls), static_cast<unsigned long long>(count.inclusive),
+                      static_cast<unsigned long long>(count.exclusive), count.inclusive * share);
+        out << line << labelFor(count.routine, labels) << "\n";
+    }
+}
+
+void writeFoldedStacks(std::ostream & out, const ProfileHooks & profile,
+                       const std::map<Word, std::string> * labels)
+{
+    std::vector<std::string> names(profile.calls.size());
+    for (uint32_t node = 0; node < profile.calls.size(); node++)
+        names[node] = routineName(profile, node, labels);
+
+    std::vector<uint32_t> path;
+    for (uint32_t node = 0; node < profile.calls.size(); node++) {
+        if (!profile.calls[node].cycles)
+            continue;
+        path.clear();
+        for (uint32_t up = node; up; up = profile.calls[up].parent)
+            path.push_back(up);
+        out << names[0];
+        for (auto at = path.rbegin(); at != path.rend(); ++at)
+            out << ';' << names[*at];
+        out << ' ' << profile.calls[node].cycles << '\n';
+    }
+}
+
+void writeChromeTrace(std::ostream & out, const ProfileHooks & profile,
+                      const std::map<Word, std::string> * labels)
+{
+    out << "{\"traceEvents\":[";
+    const char * separator = "\n";
+    for (const CallEvent & event : profile.events) {
+        std::string name;
+        for (char c : routineName(profile, event.node, labels)) {
+            if (c == '"' || c == '\\')
+                name += '\\';
+            name += c;
+        }
+        out << separator << "{\"name\":\"" << name << "\",\"ph\":\"" << (event.begin ? 'B' : 'E')
+            << "\",\"ts\":" << event.cycles << ",\"pid\":1,\"tid\":1}";
+        separator = ",\n";
+    }
+    out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+}
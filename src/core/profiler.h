@@ -0,0 +1,139 @@
+#pragma once
+
+#include "types.h"
+#include "memory.h"
+#include "policies.h"
+
+#include <array>
+#include <cstdint>
+#include <iosfwd>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Execution profile for ProfilingCPU (cpu.h): executions and cycles per PC,
+// and per opcode. Each instruction is charged the cycles from its own start
+// to the next one's, so penalties for page crossings, taken branches and
+// decimal mode are included, as are those of an interrupt taken just after
+// it. Call finish() after the last run() to charge the last instruction.
+//
+// Profiling is a hook policy, so CPU and the other cores carry none of it.
+// ProfilingCPU always runs the dispatch loop and steps idle and delay
+// loops, like TracingCPU. Per instruction the hook only bumps the counts of
+// the previous one and remembers where it is: the per-opcode table is
+// folded from the per-PC counts on demand, by the opcode at each PC then,
+// so code that rewrites its own opcodes (not just operands) is charged to
+// the last of them.
+//
+// Calls are followed on a shadow stack driven by transfer() (policies.h):
+// JSR, BRK, IRQ and NMI push a frame for their target, remembering SP after
+// the push. A frame is dropped as soon as its return address is no longer
+// on the stack, that is once SP has risen above it, whether by its RTS or
+// RTI, a return from an outer frame, or a TXS or PLAs discarding it. An RTS
+// to an address the code pushed itself leaves SP at or below the frame and
+// counts as a jump, as does a JMP into another routine. Cycles between two
+// transfers are charged to the call-tree node on top of the stack, which
+// gives exclusive cycles per call path; inclusive cycles per routine add up
+// the subtrees, counting recursion once.
+
+struct ProfileCount {
+    uint64_t executions = 0;
+    uint64_t cycles = 0;
+};
+
+// A routine reached through the calls above it; node 0 is the top level
+struct CallNode {
+    Word routine = 0;
+    uint32_t parent = 0;
+    uint64_t calls = 0;
+    uint64_t cycles = 0;  // exclusive
+};
+
+// Totals per routine entry address
+struct RoutineCount {
+    Word routine = 0;
+    uint64_t calls = 0;
+    uint64_t inclusive = 0;
+    uint64_t exclusive = 0;
+};
+
+// A frame entered (begin) or left, for timelines
+struct CallEvent {
+    long long cycles;
+    uint32_t node;
+    bool begin;
+};
+
+struct ProfileHooks {
+    // By PC; one spare entry at the end stands for "no instruction yet"
+    std::vector<ProfileCount> pcs = std::vector<ProfileCount>(MEMORY_SIZE + 1);
+    std::vector<CallNode> calls = std::vector<CallNode>(1);
+    // Frames entered and left are recorded while fewer than eventLimit
+    // frames have been; frames entered before then are still closed
+    std::vector<CallEvent> events;
+    size_t eventLimit = 0;
+
+    inline void attach(Memory * mem) { code = mem->mem; }
+    inline void instruction(const CPUTrace & trace) {
+        charge(trace.cycles);
+        last = &pcs[trace.pc];
+    }
+    inline void read(Word, Byte) {}
+    inline void write(Word, Byte) {}
+    void transfer(Transfer kind, Word target, Byte sp, long long cycles);
+
+    // Charges the last instruction and leaves every frame
+    void finish(long long cycles);
+    // Forgets everything, for a run from cycle 0
+    void clear();
+
+    std::array<ProfileCount, 256> opcodes() const;
+    std::vector<RoutineCount> routines() const;
+    uint64_t totalExecutions() const;
+    uint64_t totalCycles() const;
+    bool eventsTruncated() const { return eventLimit && entered > eventLimit; }
+
+private:
+    struct Frame {
+        uint32_t node;
+        int sp;
+        bool recorded;
+    };
+
+    inline void charge(long long now) {
+        last->executions++;
+        last->cycles += now - started;
+        started = now;
+    }
+    void chargeCall(long long now);
+    void leave(int sp, long long now);
+
+    const Byte * code = nullptr;
+    ProfileCount * last = &pcs[MEMORY_SIZE];
+    long long started = 0;
+    std::vector<Frame> stack;
+    std::map<std::pair<uint32_t, Word>, uint32_t> children;
+    long long callStarted = 0;
+    size_t entered = 0;
+};
+
+// Labels by address from an AS65 listing, such as
+// test_programs/6502_functional_test.lst: lines holding an address and a
+// name in the label column
+std::map<Word, std::string> readListingLabels(std::istream & listing);
+
+// The top opcodes and PCs by cycles, with their share of the run. PCs are
+// annotated as the nearest label at or below them, if labels are given.
+void writeProfile(std::ostream & out, const ProfileHooks & profile,
+                  const std::map<Word, std::string> * labels = nullptr, size_t top = 20);
+
+// Every call path with its exclusive cycles, one "[top];outer;inner cycles"
+// line each, as flamegraph.pl and speedscope read
+void writeFoldedStacks(std::ostream & out, const ProfileHooks & profile,
+                       const std::map<Word, std::string> * labels = nullptr);
+
+// The recorded events as Chrome trace-event JSON (chrome://tracing,
+// Perfetto). Timestamps are cycles, so microseconds of a 1 MHz 6502.
+void writeChromeTrace(std::ostream & out, const ProfileHooks & profile,
+                      const std::map<Word, std::string> * labels = nullptr);
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+// Fixed-size ring shared by exactly one producer thread and one consumer
+// thread, without locks. Each side owns one index and publishes it with a
+// release store; the other side's index is only re-read when the cached
+// copy says the ring is full (producer) or empty (consumer), so in steady
+// state the two threads do not touch each other's cache line.
+template <class T, size_t Capacity>
+class SpscRing
+{
+    static_assert(Capacity && !(Capacity & (Capacity - 1)), "Capacity must be a power of two");
+
+public:
+    // Producer side; false when full
+    bool push(const T & value) {
+        const size_t t = tail.load(std::memory_order_relaxed);
+        if (t - headCache == Capacity) {
+            headCache = head.load(std::memory_order_acquire);
+            if (t - headCache == Capacity)
+                return false;
+        }
+        slots[t & (Capacity - 1)] = value;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side; false when empty
+    bool pop(T & value) {
+        const size_t h = head.load(std::memory_order_relaxed);
+        if (h == tailCache) {
+            tailCache = tail.load(std::memory_order_acquire);
+            if (h == tailCache)
+                return false;
+        }
+        value = slots[h & (Capacity - 1)];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Either side; exact only when the other side is idle
+    size_t size() const { return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire); }
+    bool empty() const { return size() == 0; }
+    static constexpr size_t capacity() { return Capacity; }
+
+private:
+    alignas(64) std::atomic<size_t> head { 0 };  // written by the consumer
+    size_t tailCache = 0;                        // consumer's copy of tail
+    alignas(64) std::atomic<size_t> tail { 0 };  // written by the producer
+    size_t headCache = 0;                        // producer's copy of head
+    alignas(64) T slots[Capacity] {};
+};
@@ -0,0 +1,38 @@
+#include "scheduler.h"
+#include "cpu.h"
+
+#include <algorithm>
+#include <utility>
+
+Scheduler::EventId Scheduler::at(long long cycle, Callback callback)
+{
+    EventId id = nextId++;
+    heap.push_back(Event { cycle, id, std::move(callback) });
+    std::push_heap(heap.begin(), heap.end(), later);
+    return id;
+}
+
+bool Scheduler::cancel(EventId id)
+{
+    auto found = std::find_if(heap.begin(), heap.end(), [id](const Event & e) { return e.id == id; });
+    if (found == heap.end())
+        return false;
+    heap.erase(found);
+    std::make_heap(heap.begin(), heap.end(), later);
+    return true;
+}
+
+void Scheduler::clear()
+{
+    heap.clear();
+}
+
+void Scheduler::fire(CPUState & cpu)
+{
+    while (!heap.empty() && heap.front().when <= cpu.cycles) {
+        std::pop_heap(heap.begin(), heap.end(), later);
+        Event event = std::move(heap.back());
+        heap.pop_back();
+        event.callback(cpu);
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <climits>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+class CPUState;
+
+// Events keyed on the emulated cycle count, for timers, raster lines and
+// interrupts in machine models.
+//
+// CPU::run() never polls devices: it runs the engine with its budget cut
+// short at the earliest deadline, fires the events that are due where the
+// engine stops, and carries on. Like any budget, a deadline is met at the
+// first instruction boundary at or past it, so an event sees cycles >= its
+// deadline. Events due on the same cycle fire in the order they were
+// scheduled, and an event may schedule or cancel others, itself included;
+// one it schedules for a cycle already reached fires in the same round.
+// Idle loops fast-forward up to the next deadline rather than the end of
+// the budget, so a guest waiting for a timer gets there at once. On
+// MappedCPU a device may schedule an event from inside an access, so that
+// core checks the deadline after every instruction as well.
+//
+// On a FastCPU cycles counts instructions, and so do the deadlines.
+
+class Scheduler
+{
+public:
+    typedef std::function<void(CPUState &)> Callback;
+    typedef uint64_t EventId;
+
+    // Schedules callback for the first instruction boundary at or past cycle
+    EventId at(long long cycle, Callback callback);
+    // Drops a pending event; false when it already fired or was cancelled
+    bool cancel(EventId id);
+    void clear();
+
+    bool empty() const { return heap.empty(); }
+    size_t size() const { return heap.size(); }
+    // Cycle of the earliest event, LLONG_MAX with none pending
+    long long deadline() const { return heap.empty() ? LLONG_MAX : heap.front().when; }
+
+    // Fires, in order, every event due by cpu.cycles
+    void fire(CPUState & cpu);
+
+private:
+    struct Event {
+        long long when;
+        EventId id;
+        Callback callback;
+    };
+    // Min-heap on (when, id)
+    static bool later(const Event & l, const Event & r) { return l.when != r.when ? l.when > r.when : l.id > r.id; }
+
+    std::vector<Event> heap;
+    EventId nextId = 1;
+};
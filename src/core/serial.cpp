@@ -0,0 +1,131 @@
+#include "serial.h"
+
+#include <algorithm>
+
+#if !defined(_WIN32)
+#define CPU_HOST_SERIAL 1
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#else
+#define CPU_HOST_SERIAL 0
+#endif
+
+HostSerial::HostSerial(Acia6551 & acia, int inFd, int outFd, bool owned)
+    : acia(acia), inFd(inFd), outFd(outFd), owned(owned)
+{
+#if CPU_HOST_SERIAL
+    thread = std::thread([this]() { run(); });
+#endif
+}
+
+HostSerial::~HostSerial()
+{
+    stopping = true;
+    if (thread.joinable())
+        thread.join();
+#if CPU_HOST_SERIAL
+    if (owned) {
+        if (inFd >= 0)
+            close(inFd);
+        if (outFd >= 0 && outFd != inFd)
+            close(outFd);
+    }
+#endif
+}
+
+std::unique_ptr<HostSerial> HostSerial::stdio(Acia6551 & acia)
+{
+#if CPU_HOST_SERIAL
+    return std::unique_ptr<HostSerial>(new HostSerial(acia, STDIN_FILENO, STDOUT_FILENO));
+#else
+    (void)acia;
+    return nullptr;
+#endif
+}
+
+std::unique_ptr<HostSerial> HostSerial::unixSocket(Acia6551 & acia, const std::string & path)
+{
+#if CPU_HOST_SERIAL
+    sockaddr_un address {};
+    if (path.size() >= sizeof(address.sun_path))
+        return nullptr;
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return nullptr;
+    if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+        close(fd);
+        return nullptr;
+    }
+    return std::unique_ptr<HostSerial>(new HostSerial(acia, fd, fd, true));
+#else
+    (void)acia;
+    (void)path;
+    return nullptr;
+#endif
+}
+
+std::unique_ptr<HostSerial> HostSerial::files(Acia6551 & acia, const std::string & input, const std::string & output)
+{
+#if CPU_HOST_SERIAL
+    // Read-write, so that opening a FIFO does not wait for the other end
+    int in = open(input.c_str(), O_RDWR);
+    if (in < 0)
+        return nullptr;
+    int out = open(output.c_str(), O_RDWR);
+    if (out < 0) {
+        close(in);
+        return nullptr;
+    }
+    return std::unique_ptr<HostSerial>(new HostSerial(acia, in, out, true));
+#else
+    (void)acia;
+    (void)input;
+    (void)output;
+    return nullptr;
+#endif
+}
+
+void HostSerial::run()
+{
+#if CPU_HOST_SERIAL
+    Byte buffer[256];
+    int input = inFd;
+    while (!stopping.load(std::memory_order_relaxed)) {
+        // Guest output first, so that a full rx never holds it up
+        size_t pending = 0;
+        while (pending < sizeof(buffer) && acia.tx.pop(buffer[pending]))
+            pending++;
+        for (size_t done = 0; done < pending; ) {
+            ssize_t n = write(outFd, buffer + done, pending - done);
+            if (n <= 0)
+                break;
+            done += n;
+        }
+        if (pending == sizeof(buffer))
+            continue;
+
+        // Host input, as much as rx has room for
+        size_t room = acia.rx.capacity() - acia.rx.size();
+        pollfd fd { input, POLLIN, 0 };
+        bool reading = input >= 0 && room > 0;
+        if (poll(&fd, reading ? 1 : 0, 1) <= 0 || !(fd.revents & (POLLIN | POLLHUP)))
+            continue;
+        ssize_t n = read(input, buffer, std::min(room, sizeof(buffer)));
+        if (n <= 0) {
+            input = -1;  // end of input
+            continue;
+        }
+        for (ssize_t i = 0; i < n; i++)
+            acia.rx.push(buffer[i]);
+    }
+    // What the guest sent last
+    Byte value;
+    while (acia.tx.pop(value) && write(outFd, &value, 1) == 1) {}
+#endif
+}
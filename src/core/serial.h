@@ -0,0 +1,42 @@
+#pragma once
+
+#include "acia.h"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+
+// Host end of an Acia6551: a thread that reads the input descriptor into
+// the ACIA's rx ring and writes its tx ring to the output descriptor, until
+// destroyed. The emulation thread never waits on it. When rx is full the
+// thread stops reading, leaving the host to buffer, and it wakes every
+// millisecond to look for guest output. POSIX hosts only; elsewhere the
+// factories return nullptr.
+
+class HostSerial
+{
+public:
+    // Services inFd and outFd, closing them when destroyed if owned
+    HostSerial(Acia6551 & acia, int inFd, int outFd, bool owned = false);
+    ~HostSerial();
+    HostSerial(const HostSerial &) = delete;
+    HostSerial & operator=(const HostSerial &) = delete;
+
+    // The console
+    static std::unique_ptr<HostSerial> stdio(Acia6551 & acia);
+    // A client of the Unix socket listening at path
+    static std::unique_ptr<HostSerial> unixSocket(Acia6551 & acia, const std::string & path);
+    // Named pipes or other files, opened for reading and for writing
+    static std::unique_ptr<HostSerial> files(Acia6551 & acia, const std::string & input, const std::string & output);
+
+private:
+    void run();
+
+    Acia6551 & acia;
+    int inFd;
+    int outFd;
+    bool owned;
+    std::atomic<bool> stopping { false };
+    std::thread thread;
+};
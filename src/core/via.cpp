@@ -0,0 +1,337 @@
+#include "via.h"
+#include "cpu.h"
+
+#include <climits>
+
+Via6522::Via6522(CPUState & cpu, unsigned irqSource) : cpu(cpu), irqSource(irqSource)
+{
+}
+
+Via6522::~Via6522()
+{
+    if (event)
+        cpu.events.cancel(event);
+    cpu.setIRQ(false, irqSource);
+}
+
+void Via6522::map(Memory & mem, Byte firstPage, int pages)
+{
+    mem.mapDevice(firstPage, pages, Device {
+        [this](Word addr) { return read(addr); },
+        [this](Word addr, Byte value) { write(addr, value); } });
+}
+
+void Via6522::reset()
+{
+    // Timers, latches and the shift register keep their contents
+    ora = orb = ddra = ddrb = 0;
+    acr = pcr = ifr = ier = 0;
+    t1Armed = t2Armed = shifting = false;
+    t1Pb7 = true;
+    updateIrq();
+    schedule();
+}
+
+Byte Via6522::read(Word addr)
+{
+    update();
+    Byte value = 0;
+    switch (addr & 0x0F) {
+    case ORB: {
+        Byte pins = ports.readB ? ports.readB() : 0xFF;
+        value = (orb & ddrb) | (pins & ~ddrb);
+        if (acr & 0x80)
+            value = (value & 0x7F) | (t1Pb7 << 7);
+        ifr &= ~(IrqCB1 | ((pcr & 0xA0) == 0x20 ? 0 : IrqCB2));
+        break;
+    }
+    case ORA:
+        ifr &= ~(IrqCA1 | ((pcr & 0x0A) == 0x02 ? 0 : IrqCA2));
+        // fall through
+    case ORANoHandshake: {
+        Byte pins = ports.readA ? ports.readA() : 0xFF;
+        value = (ora & ddra) | (pins & ~ddra);
+        break;
+    }
+    case DDRB: value = ddrb; break;
+    case DDRA: value = ddra; break;
+    case T1CL: value = timer1() & 0xFF; ifr &= ~IrqT1; break;
+    case T1CH: value = timer1() >> 8; break;
+    case T1LL: value = t1Latch & 0xFF; break;
+    case T1LH: value = t1Latch >> 8; break;
+    case T2CL: value = timer2() & 0xFF; ifr &= ~IrqT2; break;
+    case T2CH: value = timer2() >> 8; break;
+    case SR: value = sr; startShift(); break;
+    case ACR: value = acr; break;
+    case PCR: value = pcr; break;
+    case IFR: value = interruptFlags(); break;
+    case IER: value = ier | 0x80; break;
+    }
+    updateIrq();
+    schedule();
+    return value;
+}
+
+void Via6522::write(Word addr, Byte value)
+{
+    update();
+    const long long now = cpu.cycles;
+    switch (addr & 0x0F) {
+    case ORB:
+        orb = value;
+        ifr &= ~(IrqCB1 | ((pcr & 0xA0) == 0x20 ? 0 : IrqCB2));
+        if (ports.writeB)
+            ports.writeB((orb & ddrb) | ~ddrb);
+        break;
+    case ORA:
+        ifr &= ~(IrqCA1 | ((pcr & 0x0A) == 0x02 ? 0 : IrqCA2));
+        // fall through
+    case ORANoHandshake:
+        ora = value;
+        if (ports.writeA)
+            ports.writeA((ora & ddra) | ~ddra);
+        break;
+    case DDRB:
+        ddrb = value;
+        if (ports.writeB)
+            ports.writeB((orb & ddrb) | ~ddrb);
+        break;
+    case DDRA:
+        ddra = value;
+        if (ports.writeA)
+            ports.writeA((ora & ddra) | ~ddra);
+        break;
+    case T1CL:
+    case T1LL:
+        t1Latch = (t1Latch & 0xFF00) | value;
+        break;
+    case T1CH:
+        t1Latch = (t1Latch & 0x00FF) | (value << 8);
+        t1Start = t1Latch;
+        t1Base = now;
+        t1Next = now + t1Latch + 1;
+        t1Armed = true;
+        t1Pb7 = false;
+        ifr &= ~IrqT1;
+        break;
+    case T1LH:
+        t1Latch = (t1Latch & 0x00FF) | (value << 8);
+        ifr &= ~IrqT1;
+        break;
+    case T2CL:
+        t2LatchLow = value;
+        break;
+    case T2CH:
+        t2Start = t2LatchLow | (value << 8);
+        t2Base = now;
+        t2Next = now + t2Start + 1;
+        t2Count = t2Start;
+        t2Armed = true;
+        ifr &= ~IrqT2;
+        break;
+    case SR:
+        sr = value;
+        startShift();
+        break;
+    case ACR: {
+        // T2 switching between timing and counting pulses carries its count over
+        Word t2 = timer2();
+        bool counted = t2CountsPulses();
+        acr = value;
+        if (counted && !t2CountsPulses()) {
+            t2Start = t2;
+            t2Base = now;
+            t2Next = now + t2 + 1;
+        } else if (!counted && t2CountsPulses()) {
+            t2Count = t2;
+        }
+        if (!shiftMode())
+            shifting = false;
+        break;
+    }
+    case PCR: pcr = value; break;
+    case IFR: ifr &= ~(value & 0x7F); break;
+    case IER:
+        if (value & 0x80)
+            ier |= value & 0x7F;
+        else
+            ier &= ~value;
+        break;
+    }
+    updateIrq();
+    schedule();
+}
+
+void Via6522::setCA1(bool level)
+{
+    update();
+    if (controlEdge(ca1, level, pcr & 0x01))
+        ifr |= IrqCA1;
+    ca1 = level;
+    updateIrq();
+}
+
+void Via6522::setCA2(bool level)
+{
+    update();
+    if (!(pcr & 0x08) && controlEdge(ca2, level, pcr & 0x04))
+        ifr |= IrqCA2;
+    ca2 = level;
+    updateIrq();
+}
+
+void Via6522::setCB1(bool level)
+{
+    update();
+    if (controlEdge(cb1, level, pcr & 0x10))
+        ifr |= IrqCB1;
+    cb1 = level;
+    updateIrq();
+}
+
+void Via6522::setCB2(bool level)
+{
+    update();
+    if (!(pcr & 0x80) && controlEdge(cb2, level, pcr & 0x40))
+        ifr |= IrqCB2;
+    cb2 = level;
+    updateIrq();
+}
+
+void Via6522::pulseB6()
+{
+    update();
+    if (!t2CountsPulses())
+        return;
+    if (--t2Count == 0 && t2Armed) {
+        ifr |= IrqT2;
+        t2Armed = false;
+        updateIrq();
+    }
+}
+
+void Via6522::shiftExternal()
+{
+    update();
+    if (shifting && (shiftMode() == 3 || shiftMode() == 7)) {
+        finishShift();
+        updateIrq();
+    }
+}
+
+Word Via6522::timer1()
+{
+    update();
+    long long elapsed = cpu.cycles - t1Base;
+    // The cycle between a free-running timeout and the reload reads $FFFF
+    return elapsed < 0 ? 0xFFFF : Word(t1Start - elapsed);
+}
+
+Word Via6522::timer2()
+{
+    update();
+    if (t2CountsPulses())
+        return t2Count;
+    return Word(t2Start - (cpu.cycles - t2Base));
+}
+
+Byte Via6522::interruptFlags()
+{
+    update();
+    return ifr | ((ifr & ier & 0x7F) ? IrqAny : 0);
+}
+
+bool Via6522::pb7()
+{
+    update();
+    return t1Pb7;
+}
+
+void Via6522::update()
+{
+    const long long now = cpu.cycles;
+    if (t1Armed && now >= t1Next) {
+        ifr |= IrqT1;
+        if (acr & 0x40) {
+            // Every timeout up to now at once, PB7 toggling on each
+            const long long period = t1Latch + 2;
+            const long long timeouts = (now - t1Next) / period + 1;
+            t1Next += timeouts * period;
+            t1Base = t1Next - t1Latch - 1;
+            t1Start = t1Latch;
+            t1Pb7 ^= timeouts & 1;
+        } else {
+            t1Armed = false;
+            t1Pb7 = true;
+        }
+    }
+    if (t2Armed && !t2CountsPulses() && now >= t2Next) {
+        ifr |= IrqT2;
+        t2Armed = false;
+    }
+    if (shifting && now >= srDone)
+        finishShift();
+}
+
+void Via6522::updateIrq()
+{
+    cpu.setIRQ(ifr & ier & 0x7F, irqSource);
+}
+
+void Via6522::schedule()
+{
+    // The earliest timeout that would raise IRQ; the others wait for an access
+    long long when = LLONG_MAX;
+    if (t1Armed && (ier & IrqT1) && !(ifr & IrqT1))
+        when = t1Next;
+    if (t2Armed && !t2CountsPulses() && (ier & IrqT2) && !(ifr & IrqT2) && t2Next < when)
+        when = t2Next;
+    if (shifting && shiftMode() != 4 && (ier & IrqSR) && !(ifr & IrqSR) && srDone < when)
+        when = srDone;
+    if (event && when == eventAt)
+        return;
+    if (event)
+        cpu.events.cancel(event);
+    event = 0;
+    if (when == LLONG_MAX)
+        return;
+    eventAt = when;
+    event = cpu.events.at(when, [this](CPUState &) {
+        event = 0;
+        update();
+        updateIrq();
+        schedule();
+    });
+}
+
+void Via6522::startShift()
+{
+    ifr &= ~IrqSR;
+    switch (shiftMode()) {
+    case 0:
+        shifting = false;
+        return;
+    case 2: case 6:
+        srDone = cpu.cycles + 16;
+        break;
+    case 1: case 4: case 5:
+        srDone = cpu.cycles + 16 * (t2LatchLow + 2);
+        break;
+    default:
+        srDone = LLONG_MAX;  // clocked by CB1
+        break;
+    }
+    shifting = true;
+}
+
+void Via6522::finishShift()
+{
+    shifting = false;
+    if (shiftMode() < 4)
+        sr = ports.shiftIn ? ports.shiftIn() : 0xFF;
+    else if (ports.shiftOut)
+        ports.shiftOut(sr);
+    // Free-running output never interrupts
+    if (shiftMode() != 4)
+        ifr |= IrqSR;
+}
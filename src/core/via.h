@@ -0,0 +1,135 @@
+#pragma once
+
+#include "types.h"
+#include "memory.h"
+#include "scheduler.h"
+
+#include <functional>
+
+class CPUState;
+
+// MOS 6522 Versatile Interface Adapter: two 16-bit timers, a shift register,
+// two 8-bit ports with CA1/CA2 and CB1/CB2 control lines, and the IFR/IER
+// interrupt logic, driving the CPU's IRQ line.
+//
+// Nothing ticks. A timer remembers the cycle it was loaded on and the value
+// it was loaded with, and every register access first brings the chip up
+// to CPUState::cycles in closed form: counters, timeouts, PB7 toggles and
+// completed shifts included. Timeouts reach the IRQ line through a single
+// scheduled event, and only while one could raise it, that is while its
+// source is enabled in IER and its IFR bit is clear; a free-running T1 the
+// guest only polls costs nothing between accesses.
+//
+// Registers repeat every 16 bytes over the pages given to map(), which need
+// a core on PagedBus (MappedCPU). Counts are in CPUState::cycles, so the
+// core must count cycles, not instructions. A device access sees the cycles
+// of the instruction charged so far, which includes its base cost: counters
+// read a few cycles later in the instruction than on hardware, the same
+// for every access.
+//
+// T1 reads its latch N, N-1, ... 0, then $FFFF as the timeout sets IFR;
+// free-running it reloads from the latch after that, every N+2 cycles, and
+// one-shot it keeps counting down. T2 behaves like one-shot T1, or counts
+// pulseB6() calls with ACR bit 5 set. The shift register moves a byte per
+// transfer: under Phi2 in 16 cycles, under T2 in 16 times the T2 low latch
+// plus two, and under CB1 when the embedder calls shiftExternal(). Bytes
+// shifted in come from Ports::shiftIn and bytes shifted out go to
+// Ports::shiftOut; free-running output (mode 4) sends its byte once and
+// never interrupts. CA2 and CB2 only work as inputs, and PB7 toggling under
+// T1 shows in ORB reads and pb7() but is not sent to Ports::writeB.
+
+class Via6522
+{
+public:
+    // The embedder's side of the chip. Unset inputs read as pulled up,
+    // unset outputs go nowhere.
+    struct Ports {
+        std::function<Byte()> readA;
+        std::function<Byte()> readB;
+        std::function<void(Byte)> writeA;  // pins, outputs from ORA and inputs high
+        std::function<void(Byte)> writeB;
+        std::function<Byte()> shiftIn;
+        std::function<void(Byte)> shiftOut;
+    };
+
+    enum Register : Byte {
+        ORB, ORA, DDRB, DDRA, T1CL, T1CH, T1LL, T1LH,
+        T2CL, T2CH, SR, ACR, PCR, IFR, IER, ORANoHandshake
+    };
+
+    enum Interrupt : Byte {
+        IrqCA2 = 0x01, IrqCA1 = 0x02, IrqSR = 0x04, IrqCB2 = 0x08,
+        IrqCB1 = 0x10, IrqT2 = 0x20, IrqT1 = 0x40, IrqAny = 0x80
+    };
+
+    // irqSource is this chip's bit in CPUState::setIRQ()
+    Via6522(CPUState & cpu, unsigned irqSource = 1);
+    ~Via6522();
+    Via6522(const Via6522 &) = delete;
+    Via6522 & operator=(const Via6522 &) = delete;
+
+    Ports ports;
+
+    // Maps the registers over pages in mem
+    void map(Memory & mem, Byte firstPage, int pages = 1);
+    Byte read(Word addr);
+    void write(Word addr, Byte value);
+    void reset();
+
+    // Control line inputs; an edge the PCR selects sets its IFR bit
+    void setCA1(bool level);
+    void setCA2(bool level);
+    void setCB1(bool level);
+    void setCB2(bool level);
+    // A falling edge on PB6, counted by T2 in pulse-counting mode
+    void pulseB6();
+    // Completes a transfer clocked by CB1 (ACR shift modes 3 and 7)
+    void shiftExternal();
+
+    // Current state without the side effects of reading the registers
+    Word timer1();
+    Word timer2();
+    Byte interruptFlags();
+    bool pb7();
+
+private:
+    void update();
+    void updateIrq();
+    void schedule();
+    void startShift();
+    void finishShift();
+    bool controlEdge(bool before, bool after, bool positive) const { return positive ? !before && after : before && !after; }
+    Byte shiftMode() const { return (acr >> 2) & 7; }
+    bool t2CountsPulses() const { return acr & 0x20; }
+
+    CPUState & cpu;
+    unsigned irqSource;
+
+    Byte ora = 0, orb = 0, ddra = 0, ddrb = 0;
+    Byte acr = 0, pcr = 0, ifr = 0, ier = 0;
+    Byte sr = 0;
+    bool ca1 = true, ca2 = true, cb1 = true, cb2 = true;
+
+    // T1 reads t1Start - (cycles - t1Base), and times out at t1Next
+    Word t1Latch = 0;
+    Word t1Start = 0;
+    long long t1Base = 0;
+    long long t1Next = 0;
+    bool t1Armed = false;
+    bool t1Pb7 = true;
+
+    // T2 counts the same way, or holds t2Count while counting pulses
+    Byte t2LatchLow = 0;
+    Word t2Start = 0;
+    long long t2Base = 0;
+    long long t2Next = 0;
+    bool t2Armed = false;
+    Word t2Count = 0;
+
+    // The shift in progress completes at srDone
+    bool shifting = false;
+    long long srDone = 0;
+
+    Scheduler::EventId event = 0;
+    long long eventAt = 0;
+};
@@ -1,56 +1,59 @@
 #include "cpu.h"
 
-#define CYCL cpu->cycl();
-
-void Branch(CPU * cpu, bool condition) {
-    CYCL
-    signed char offset = cpu->mem->read(cpu->PC++);
+template <class C>
+void Branch(C * cpu, bool condition) {
+    signed char offset = cpu->read(cpu->PC++);
     if (condition) {
-        CYCL
         Word newPC = cpu->PC + offset;
-        if ((newPC & 0xFF00) != (cpu->PC & 0xFF00)) {
-            CYCL  // Page boundary crossed
-        }
+        cpu->cycl(branchTakenPenalty(cpu->PC, newPC));
         cpu->PC = newPC;
     }
 }
 
 // BCC - Branch if Carry Clear (0x90)
-void BCC(CPU * cpu) {
+template <class C>
+void BCC(C * cpu) {
     Branch(cpu, !cpu->C());
 }
 
 // BCS - Branch if Carry Set (0xB0)
-void BCS(CPU * cpu) {
+template <class C>
+void BCS(C * cpu) {
     Branch(cpu, cpu->C());
 }
 
 // BEQ - Branch if Equal (Zero Set) (0xF0)
-void BEQ(CPU * cpu) {
+template <class C>
+void BEQ(C * cpu) {
     Branch(cpu, cpu->Z());
 }
 
 // BNE - Branch if Not Equal (Zero Clear) (0xD0)
-void BNE(CPU * cpu) {
+template <class C>
+void BNE(C * cpu) {
     Branch(cpu, !cpu->Z());
 }
 
 // BMI - Branch if Minus (Negative Set) (0x30)
-void BMI(CPU * cpu) {
+template <class C>
+void BMI(C * cpu) {
     Branch(cpu, cpu->N());
 }
 
 // BPL - Branch if Plus (Negative Clear) (0x10)
-void BPL(CPU * cpu) {
+template <class C>
+void BPL(C * cpu) {
     Branch(cpu, !cpu->N());
 }
 
 // BVC - Branch if Overflow Clear (0x50)
-void BVC(CPU * cpu) {
+template <class C>
+void BVC(C * cpu) {
     Branch(cpu, !cpu->V());
 }
 
 // BVS - Branch if Overflow Set (0x70)
-void BVS(CPU * cpu) {
+template <class C>
+void BVS(C * cpu) {
     Branch(cpu, cpu->V());
 }
@@ -1,8 +1,7 @@
 #include "cpu.h"
 
-#define CYCL cpu->cycl();
-
-void CompareFlags(CPU * cpu, Byte reg, Byte value) {
+template <class C>
+void CompareFlags(C * cpu, Byte reg, Byte value) {
     Byte result = reg - value;
     cpu->setZ(reg == value);
     cpu->setN((result & 0x80) > 0);
@@ -10,88 +9,88 @@ void CompareFlags(CPU * cpu, Byte reg, Byte value) {
 }
 
 // CMP - Compare Accumulator
-void CMPI(CPU * cpu) {
-    CYCL
-    Byte value = cpu->mem->read(cpu->immediate());
+template <class C>
+void CMPI(C * cpu) {
+    Byte value = cpu->read(cpu->immediate());
     CompareFlags(cpu, cpu->A, value);
 }
 
-void CMPZP(CPU * cpu) {
-    CYCL
-    Byte value = cpu->mem->read(cpu->zeroPage());
+template <class C>
+void CMPZP(C * cpu) {
+    Byte value = cpu->read(cpu->zeroPage());
     CompareFlags(cpu, cpu->A, value);
 }
 
-void CMPZPX(CPU * cpu) {
-    CYCL
-    Byte value = cpu->mem->read(cpu->zeroPageX());
+template <class C>
+void CMPZPX(C * cpu) {
+    Byte value = cpu->read(cpu->zeroPageX());
     CompareFlags(cpu, cpu->A, value);
 }
 
-void CMPA(CPU * cpu) {
-    CYCL
-    Byte value = cpu->mem->read(cpu->absolute());
+template <class C>
+void CMPA(C * cpu) {
+    Byte value = cpu->read(cpu->absolute());
     CompareFlags(cpu, cpu->A, value);
 }
 
-void CMPAX(CPU * cpu) {
-    CYCL
-    Byte value = cpu->mem->read(cpu->absoluteX());
+template <class C>
+void CMPAX(C * cpu) {
+    Byte value = cpu->read(cpu->absoluteX());
     CompareFlags(cpu, cpu->A, value);
 }
 
-void CMPAY(CPU * cpu) {
-    CYCL
-    Byte value = cpu->mem->read(cpu->absoluteY());
+template <class C>
+void CMPAY(C * cpu) {
+    Byte value = cpu->read(cpu->absoluteY());
     CompareFlags(cpu, cpu->A, value);
 }
 
-void CMPIX(CPU * cpu) {
-    CYCL
-    Byte value = cpu->mem->read(cpu->indirectX());
+template <class C>
+void CMPIX(C * cpu) {
+    Byte value = cpu->read(cpu->indirectX());
     CompareFlags(cpu, cpu->A, value);
 }
 
-void CMPIY(CPU * cpu) {
-    CYCL
-    Byte value = cpu->mem->read(cpu->indirectY());
+template <class C>
+void CMPIY(C * cpu) {
+    Byte value = cpu->read(cpu->indirectY());
     CompareFlags(cpu, cpu->A, value);
 }
 
 // CPX - Compare X Register
-void CPXI(CPU * cpu) {
-    CYCL
-    Byte value = cpu->mem->read(cpu->immediate());
+template <class C>
+void CPXI(C * cpu) {
+    Byte value = cpu->read(cpu->immediate());
     CompareFlags(cpu, cpu->X, value);
 }
 
-void CPXZP(CPU * cpu) {
-    CYCL
-    Byte value = cpu->mem->read(cpu->zeroPage());
+template <class C>
+void CPXZP(C * cpu) {
+    Byte value = cpu->read(cpu->zeroPage());
     CompareFlags(cpu, cpu->X, value);
 }
 
-void CPXA(CPU * cpu) {
-    CYCL
-    Byte value = cpu->mem->read(cpu->absolute());
+template <class C>
+void CPXA(C * cpu) {
+    Byte value = cpu->read(cpu->absolute());
     CompareFlags(cpu, cpu->X, value);
 }
 
 // CPY - Compare Y Register
-void CPYI(CPU * cpu) {
-    CYCL
-    Byte value = cpu->mem->read(cpu->immediate());
+template <class C>
+void CPYI(C * cpu) {
+    Byte value = cpu->read(cpu->immediate());
     CompareFlags(cpu, cpu->Y, value);
 }
 
-void CPYZP(CPU * cpu) {
-    CYCL
-    Byte value = cpu->mem->read(cpu->zeroPage());
+template <class C>
+void CPYZP(C * cpu) {
+    Byte value = cpu->read(cpu->zeroPage());
     CompareFlags(cpu, cpu->Y, value);
 }
 
-void CPYA(CPU * cpu) {
-    CYCL
-    Byte value = cpu->mem->read(cpu->absolute());
+template <class C>
+void CPYA(C * cpu) {
+    Byte value = cpu->read(cpu->absolute());
     CompareFlags(cpu, cpu->Y, value);
 }
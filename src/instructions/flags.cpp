@@ -1,45 +1,43 @@
 #include "cpu.h"
 
-#define CYCL cpu->cycl();
-
 // CLC - Clear Carry Flag (0x18)
-void CLC(CPU * cpu) {
-    CYCL
+template <class C>
+void CLC(C * cpu) {
     cpu->setC(false);
 }
 
 // SEC - Set Carry Flag (0x38)
-void SEC(CPU * cpu) {
-    CYCL
+template <class C>
+void SEC(C * cpu) {
     cpu->setC(true);
 }
 
 // CLI - Clear Interrupt Disable (0x58)
-void CLI(CPU * cpu) {
-    CYCL
+template <class C>
+void CLI(C * cpu) {
     cpu->setI(false);
 }
 
 // SEI - Set Interrupt Disable (0x78)
-void SEI(CPU * cpu) {
-    CYCL
+template <class C>
+void SEI(C * cpu) {
     cpu->setI(true);
 }
 
 // CLV - Clear Overflow Flag (0xB8)
-void CLV(CPU * cpu) {
-    CYCL
+template <class C>
+void CLV(C * cpu) {
     cpu->setV(false);
 }
 
 // CLD - Clear Decimal Mode (0xD8)
-void CLD(CPU * cpu) {
-    CYCL
+template <class C>
+void CLD(C * cpu) {
     cpu->setD(false);
 }
 
 // SED - Set Decimal Mode (0xF8)
-void SED(CPU * cpu) {
-    CYCL
+template <class C>
+void SED(C * cpu) {
     cpu->setD(true);
 }
@@ -1,123 +1,105 @@
 #include "cpu.h"
 
-#define CYCL cpu->cycl();
-
-void SetNZ(CPU * cpu, Byte reg);
+template <class C> void SetNZ(C * cpu, Byte reg);
 
 // INX - Increment X Register (0xE8)
-void INX(CPU * cpu) {
-    CYCL
+template <class C>
+void INX(C * cpu) {
     cpu->X++;
     SetNZ(cpu, cpu->X);
 }
 
 // INY - Increment Y Register (0xC8)
-void INY(CPU * cpu) {
-    CYCL
+template <class C>
+void INY(C * cpu) {
     cpu->Y++;
     SetNZ(cpu, cpu->Y);
 }
 
 // DEX - Decrement X Register (0xCA)
-void DEX(CPU * cpu) {
-    CYCL
+template <class C>
+void DEX(C * cpu) {
     cpu->X--;
     SetNZ(cpu, cpu->X);
 }
 
 // DEY - Decrement Y Register (0x88)
-void DEY(CPU * cpu) {
-    CYCL
+template <class C>
+void DEY(C * cpu) {
     cpu->Y--;
     SetNZ(cpu, cpu->Y);
 }
 
 // INC - Increment Memory
-void INCZP(CPU * cpu) {
+template <class C>
+void INCZP(C * cpu) {
     Byte addr = cpu->zeroPage();
-    CYCL
-    Byte value = cpu->mem->read(addr);
-    CYCL
+    Byte value = cpu->read(addr);
     value++;
-    cpu->mem->write(addr, value);
-    CYCL
+    cpu->write(addr, value);
     SetNZ(cpu, value);
 }
 
-void INCZPX(CPU * cpu) {
+template <class C>
+void INCZPX(C * cpu) {
     Byte addr = cpu->zeroPageX();
-    CYCL
-    Byte value = cpu->mem->read(addr);
-    CYCL
+    Byte value = cpu->read(addr);
     value++;
-    cpu->mem->write(addr, value);
-    CYCL
+    cpu->write(addr, value);
     SetNZ(cpu, value);
 }
 
-void INCA(CPU * cpu) {
+template <class C>
+void INCA(C * cpu) {
     Word addr = cpu->absolute();
-    CYCL
-    Byte value = cpu->mem->read(addr);
-    CYCL
+    Byte value = cpu->read(addr);
     value++;
-    cpu->mem->write(addr, value);
-    CYCL
+    cpu->write(addr, value);
     SetNZ(cpu, value);
 }
 
-void INCAX(CPU * cpu) {
+template <class C>
+void INCAX(C * cpu) {
     Word addr = cpu->absoluteX();
-    CYCL
-    Byte value = cpu->mem->read(addr);
-    CYCL
+    Byte value = cpu->read(addr);
     value++;
-    cpu->mem->write(addr, value);
-    CYCL
+    cpu->write(addr, value);
     SetNZ(cpu, value);
 }
 
 // DEC - Decrement Memory
-void DECZP(CPU * cpu) {
+template <class C>
+void DECZP(C * cpu) {
     Byte addr = cpu->zeroPage();
-    CYCL
-    Byte value = cpu->mem->read(addr);
-    CYCL
+    Byte value = cpu->read(addr);
     value--;
-    cpu->mem->write(addr, value);
-    CYCL
+    cpu->write(addr, value);
     SetNZ(cpu, value);
 }
 
-void DECZPX(CPU * cpu) {
+template <class C>
+void DECZPX(C * cpu) {
     Byte addr = cpu->zeroPageX();
-    CYCL
-    Byte value = cpu->mem->read(addr);
-    CYCL
+    Byte value = cpu->read(addr);
     value--;
-    cpu->mem->write(addr, value);
-    CYCL
+    cpu->write(addr, value);
     SetNZ(cpu, value);
 }
 
-void DECA(CPU * cpu) {
+template <class C>
+void DECA(C * cpu) {
     Word addr = cpu->absolute();
-    CYCL
-    Byte value = cpu->mem->read(addr);
-    CYCL
+    Byte value = cpu->read(addr);
     value--;
-    cpu->mem->write(addr, value);
-    CYCL
+    cpu->write(addr, value);
     SetNZ(cpu, value);
 }
 
-void DECAX(CPU * cpu) {
+template <class C>
+void DECAX(C * cpu) {
     Word addr = cpu->absoluteX();
-    CYCL
-    Byte value = cpu->mem->read(addr);
-    CYCL
+    Byte value = cpu->read(addr);
     value--;
-    cpu->mem->write(addr, value);
-    CYCL
+    cpu->write(addr, value);
     SetNZ(cpu, value);
 }
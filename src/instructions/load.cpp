@@ -1,116 +1,115 @@
 #include "cpu.h"
 
-#define CYCL cpu->cycl();
-
-void LDFlags(CPU * cpu, Byte reg) {
+template <class C>
+void LDFlags(C * cpu, Byte reg) {
     cpu->setZ( reg == 0);
     cpu->setN((reg & 0b10000000) > 0);
 }
 
-void LDAI(CPU * cpu) {
-    CYCL
-    cpu->A = cpu->mem->read(cpu->immediate());
+template <class C>
+void LDAI(C * cpu) {
+    cpu->A = cpu->read(cpu->immediate());
     LDFlags(cpu, cpu->A);
 }
 
-void LDAZ(CPU * cpu) {
-    CYCL
-    cpu->A = cpu->mem->read(cpu->zeroPage());
+template <class C>
+void LDAZ(C * cpu) {
+    cpu->A = cpu->read(cpu->zeroPage());
     LDFlags(cpu, cpu->A);
 }
 
-void LDAZX(CPU * cpu) {
-    CYCL
-    cpu->A = cpu->mem->read(cpu->zeroPageX());
+template <class C>
+void LDAZX(C * cpu) {
+    cpu->A = cpu->read(cpu->zeroPageX());
     LDFlags(cpu, cpu->A);
 }
 
-void LDAA(CPU * cpu) {
-    CYCL
-    cpu->A = cpu->mem->read(cpu->absolute());
+template <class C>
+void LDAA(C * cpu) {
+    cpu->A = cpu->read(cpu->absolute());
     LDFlags(cpu, cpu->A);
 }
 
-void LDAAX(CPU * cpu) {
-    CYCL
-    cpu->A = cpu->mem->read(cpu->absoluteX());
+template <class C>
+void LDAAX(C * cpu) {
+    cpu->A = cpu->read(cpu->absoluteX());
     LDFlags(cpu, cpu->A);
 }
 
-void LDAAY(CPU * cpu) {
-    CYCL
-    cpu->A = cpu->mem->read(cpu->absoluteY());
+template <class C>
+void LDAAY(C * cpu) {
+    cpu->A = cpu->read(cpu->absoluteY());
     LDFlags(cpu, cpu->A);
 }
 
-void LDAIX(CPU * cpu) {
-    CYCL
-    cpu->A = cpu->mem->read(cpu->indirectX());
+template <class C>
+void LDAIX(C * cpu) {
+    cpu->A = cpu->read(cpu->indirectX());
     LDFlags(cpu, cpu->A);
 }
 
-void LDAIY(CPU * cpu) {
-    CYCL
-    cpu->A = cpu->mem->read(cpu->indirectY());
+template <class C>
+void LDAIY(C * cpu) {
+    cpu->A = cpu->read(cpu->indirectY());
     LDFlags(cpu, cpu->A);
 }
 
-void LDXI(CPU * cpu) {
-    CYCL
-    cpu->X = cpu->mem->read(cpu->immediate());
+template <class C>
+void LDXI(C * cpu) {
+    cpu->X = cpu->read(cpu->immediate());
     LDFlags(cpu, cpu->X);
 }
 
-void LDXZP(CPU * cpu) {
-    CYCL
-    cpu->X = cpu->mem->read(cpu->zeroPage());
+template <class C>
+void LDXZP(C * cpu) {
+    cpu->X = cpu->read(cpu->zeroPage());
     LDFlags(cpu, cpu->X);
 }
 
-void LDXZPY(CPU * cpu) {
-    CYCL
-    cpu->X = cpu->mem->read(cpu->zeroPageY());
+template <class C>
+void LDXZPY(C * cpu) {
+    cpu->X = cpu->read(cpu->zeroPageY());
     LDFlags(cpu, cpu->X);
 }
 
-void LDXA(CPU * cpu) {
-    CYCL
-    cpu->X = cpu->mem->read(cpu->absolute());
+template <class C>
+void LDXA(C * cpu) {
+    cpu->X = cpu->read(cpu->absolute());
     LDFlags(cpu, cpu->X);
 }
 
-void LDXAY(CPU * cpu) {
-    CYCL
-    cpu->X = cpu->mem->read(cpu->absoluteY());
+template <class C>
+void LDXAY(C * cpu) {
+    cpu->X = cpu->read(cpu->absoluteY());
     LDFlags(cpu, cpu->X);
 }
 
-void LDYI(CPU * cpu) {
-    CYCL
-    cpu->Y = cpu->mem->read(cpu->immediate());
+template <class C>
+void LDYI(C * cpu) {
+    cpu->Y = cpu->read(cpu->immediate());
     LDFlags(cpu, cpu->Y);
 }
 
-void LDYZP(CPU * cpu) {
-    CYCL
-    cpu->Y = cpu->mem->read(cpu->zeroPage());
+template <class C>
+void LDYZP(C * cpu) {
+    cpu->Y = cpu->read(cpu->zeroPage());
     LDFlags(cpu, cpu->Y);
 }
 
-void LDYZPY(CPU * cpu) {
-    CYCL
-    cpu->Y = cpu->mem->read(cpu->zeroPageX());
+template <class C>
+void LDYZPY(C * cpu) {
+    cpu->Y = cpu->read(cpu->zeroPageX());
     LDFlags(cpu, cpu->Y);
 }
 
-void LDYA(CPU * cpu) {
-    CYCL
-    cpu->Y = cpu->mem->read(cpu->absolute());
+template <class C>
+void LDYA(C * cpu) {
+    cpu->Y = cpu->read(cpu->absolute());
     LDFlags(cpu, cpu->Y);
 }
 
-void LDYAY(CPU * cpu) {
-    CYCL
-    cpu->Y = cpu->mem->read(cpu->absoluteX());
+template <class C>
+void LDYAY(C * cpu) {
+    cpu->Y = cpu->read(cpu->absoluteX());
     LDFlags(cpu, cpu->Y);
 }
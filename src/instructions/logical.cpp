@@ -1,152 +1,150 @@
 #include "cpu.h"
 
-#define CYCL cpu->cycl();
-
-void SetNZ(CPU * cpu, Byte reg);
+template <class C> void SetNZ(C * cpu, Byte reg);
 
 // AND - Logical AND with Accumulator
-void ANDI(CPU * cpu) {
-    CYCL
-    cpu->A &= cpu->mem->read(cpu->immediate());
+template <class C>
+void ANDI(C * cpu) {
+    cpu->A &= cpu->read(cpu->immediate());
     SetNZ(cpu, cpu->A);
 }
 
-void ANDZP(CPU * cpu) {
-    CYCL
-    cpu->A &= cpu->mem->read(cpu->zeroPage());
+template <class C>
+void ANDZP(C * cpu) {
+    cpu->A &= cpu->read(cpu->zeroPage());
     SetNZ(cpu, cpu->A);
 }
 
-void ANDZPX(CPU * cpu) {
-    CYCL
-    cpu->A &= cpu->mem->read(cpu->zeroPageX());
+template <class C>
+void ANDZPX(C * cpu) {
+    cpu->A &= cpu->read(cpu->zeroPageX());
     SetNZ(cpu, cpu->A);
 }
 
-void ANDA(CPU * cpu) {
-    CYCL
-    cpu->A &= cpu->mem->read(cpu->absolute());
+template <class C>
+void ANDA(C * cpu) {
+    cpu->A &= cpu->read(cpu->absolute());
     SetNZ(cpu, cpu->A);
 }
 
-void ANDAX(CPU * cpu) {
-    CYCL
-    cpu->A &= cpu->mem->read(cpu->absoluteX());
+template <class C>
+void ANDAX(C * cpu) {
+    cpu->A &= cpu->read(cpu->absoluteX());
     SetNZ(cpu, cpu->A);
 }
 
-void ANDAY(CPU * cpu) {
-    CYCL
-    cpu->A &= cpu->mem->read(cpu->absoluteY());
+template <class C>
+void ANDAY(C * cpu) {
+    cpu->A &= cpu->read(cpu->absoluteY());
     SetNZ(cpu, cpu->A);
 }
 
-void ANDIX(CPU * cpu) {
-    CYCL
-    cpu->A &= cpu->mem->read(cpu->indirectX());
+template <class C>
+void ANDIX(C * cpu) {
+    cpu->A &= cpu->read(cpu->indirectX());
     SetNZ(cpu, cpu->A);
 }
 
-void ANDIY(CPU * cpu) {
-    CYCL
-    cpu->A &= cpu->mem->read(cpu->indirectY());
+template <class C>
+void ANDIY(C * cpu) {
+    cpu->A &= cpu->read(cpu->indirectY());
     SetNZ(cpu, cpu->A);
 }
 
 // ORA - Logical OR with Accumulator
-void ORAI(CPU * cpu) {
-    CYCL
-    cpu->A |= cpu->mem->read(cpu->immediate());
+template <class C>
+void ORAI(C * cpu) {
+    cpu->A |= cpu->read(cpu->immediate());
     SetNZ(cpu, cpu->A);
 }
 
-void ORAZP(CPU * cpu) {
-    CYCL
-    cpu->A |= cpu->mem->read(cpu->zeroPage());
+template <class C>
+void ORAZP(C * cpu) {
+    cpu->A |= cpu->read(cpu->zeroPage());
     SetNZ(cpu, cpu->A);
 }
 
-void ORAZPX(CPU * cpu) {
-    CYCL
-    cpu->A |= cpu->mem->read(cpu->zeroPageX());
+template <class C>
+void ORAZPX(C * cpu) {
+    cpu->A |= cpu->read(cpu->zeroPageX());
     SetNZ(cpu, cpu->A);
 }
 
-void ORAA(CPU * cpu) {
-    CYCL
-    cpu->A |= cpu->mem->read(cpu->absolute());
+template <class C>
+void ORAA(C * cpu) {
+    cpu->A |= cpu->read(cpu->absolute());
     SetNZ(cpu, cpu->A);
 }
 
-void ORAAX(CPU * cpu) {
-    CYCL
-    cpu->A |= cpu->mem->read(cpu->absoluteX());
+template <class C>
+void ORAAX(C * cpu) {
+    cpu->A |= cpu->read(cpu->absoluteX());
     SetNZ(cpu, cpu->A);
 }
 
-void ORAAY(CPU * cpu) {
-    CYCL
-    cpu->A |= cpu->mem->read(cpu->absoluteY());
+template <class C>
+void ORAAY(C * cpu) {
+    cpu->A |= cpu->read(cpu->absoluteY());
     SetNZ(cpu, cpu->A);
 }
 
-void ORAIX(CPU * cpu) {
-    CYCL
-    cpu->A |= cpu->mem->read(cpu->indirectX());
+template <class C>
+void ORAIX(C * cpu) {
+    cpu->A |= cpu->read(cpu->indirectX());
     SetNZ(cpu, cpu->A);
 }
 
-void ORAIY(CPU * cpu) {
-    CYCL
-    cpu->A |= cpu->mem->read(cpu->indirectY());
+template <class C>
+void ORAIY(C * cpu) {
+    cpu->A |= cpu->read(cpu->indirectY());
     SetNZ(cpu, cpu->A);
 }
 
 // EOR - Logical Exclusive OR with Accumulator
-void EORI(CPU * cpu) {
-    CYCL
-    cpu->A ^= cpu->mem->read(cpu->immediate());
+template <class C>
+void EORI(C * cpu) {
+    cpu->A ^= cpu->read(cpu->immediate());
     SetNZ(cpu, cpu->A);
 }
 
-void EORZP(CPU * cpu) {
-    CYCL
-    cpu->A ^= cpu->mem->read(cpu->zeroPage());
+template <class C>
+void EORZP(C * cpu) {
+    cpu->A ^= cpu->read(cpu->zeroPage());
     SetNZ(cpu, cpu->A);
 }
 
-void EORZPX(CPU * cpu) {
-    CYCL
-    cpu->A ^= cpu->mem->read(cpu->zeroPageX());
+template <class C>
+void EORZPX(C * cpu) {
+    cpu->A ^= cpu->read(cpu->zeroPageX());
     SetNZ(cpu, cpu->A);
 }
 
-void EORA(CPU * cpu) {
-    CYCL
-    cpu->A ^= cpu->mem->read(cpu->absolute());
+template <class C>
+void EORA(C * cpu) {
+    cpu->A ^= cpu->read(cpu->absolute());
     SetNZ(cpu, cpu->A);
 }
 
-void EORAX(CPU * cpu) {
-    CYCL
-    cpu->A ^= cpu->mem->read(cpu->absoluteX());
+template <class C>
+void EORAX(C * cpu) {
+    cpu->A ^= cpu->read(cpu->absoluteX());
     SetNZ(cpu, cpu->A);
 }
 
-void EORAY(CPU * cpu) {
-    CYCL
-    cpu->A ^= cpu->mem->read(cpu->absoluteY());
+template <class C>
+void EORAY(C * cpu) {
+    cpu->A ^= cpu->read(cpu->absoluteY());
     SetNZ(cpu, cpu->A);
 }
 
-void EORIX(CPU * cpu) {
-    CYCL
-    cpu->A ^= cpu->mem->read(cpu->indirectX());
+template <class C>
+void EORIX(C * cpu) {
+    cpu->A ^= cpu->read(cpu->indirectX());
     SetNZ(cpu, cpu->A);
 }
 
-void EORIY(CPU * cpu) {
-    CYCL
-    cpu->A ^= cpu->mem->read(cpu->indirectY());
+template <class C>
+void EORIY(C * cpu) {
+    cpu->A ^= cpu->read(cpu->indirectY());
     SetNZ(cpu, cpu->A);
 }
@@ -1,87 +1,81 @@
 #include "cpu.h"
 
-#define CYCL cpu->cycl();
-
 // NOP - No Operation (0xEA)
-void NOP(CPU * cpu) {
-    CYCL
+template <class C>
+void NOP(C *) {
+}
+
+// A JSR or JMP that lands on a hooked routine runs it (hle.h)
+template <class C>
+void CallRoutine(C * cpu) {
+    if (cpu->routinePages[cpu->PC >> 8])
+        cpu->callRoutine();
 }
 
 // JMP - Jump (0x4C absolute, 0x6C indirect)
-void JMPABS(CPU * cpu) {
-    CYCL
-    cpu->PC = cpu->mem->read16(cpu->PC);
-    CYCL
+template <class C>
+void JMPABS(C * cpu) {
+    cpu->PC = cpu->read16(cpu->PC);
+    CallRoutine(cpu);
 }
 
-void JMPIND(CPU * cpu) {
-    CYCL
-    Word addr = cpu->mem->read16(cpu->PC);
-    CYCL
-    CYCL
-    cpu->PC = cpu->mem->read16(addr);
-    CYCL
+template <class C>
+void JMPIND(C * cpu) {
+    Word addr = cpu->read16(cpu->PC);
+    cpu->PC = cpu->read16(addr);
+    CallRoutine(cpu);
 }
 
 // JSR - Jump to Subroutine (0x20)
-void JSR(CPU * cpu) {
-    CYCL
-    Word addr = cpu->mem->read16(cpu->PC);
-    CYCL
+template <class C>
+void JSR(C * cpu) {
+    Word addr = cpu->read16(cpu->PC);
     cpu->PC++;  // PC now points to next instruction - 1
-    CYCL
     cpu->push(cpu->PC >> 8);
-    CYCL
     cpu->push(cpu->PC & 0xFF);
-    CYCL
     cpu->PC = addr;
+    cpu->hooks.transfer(Transfer::Call, cpu->PC, cpu->SP, cpu->cycles);
+    CallRoutine(cpu);
 }
 
 // RTS - Return from Subroutine (0x60)
-void RTS(CPU * cpu) {
-    CYCL
-    CYCL
+template <class C>
+void RTS(C * cpu) {
     cpu->SP++;
-    Byte lo = cpu->mem->read(0x100 + cpu->SP);
-    CYCL
+    Byte lo = cpu->read(0x100 + cpu->SP);
     cpu->SP++;
-    Byte hi = cpu->mem->read(0x100 + cpu->SP);
-    CYCL
+    Byte hi = cpu->read(0x100 + cpu->SP);
     cpu->PC = (hi << 8) | lo;
-    CYCL
     cpu->PC++;
+    cpu->hooks.transfer(Transfer::Return, cpu->PC, cpu->SP, cpu->cycles);
 }
 
 // RTI - Return from Interrupt (0x40)
-void RTI(CPU * cpu) {
-    CYCL
-    CYCL
+template <class C>
+void RTI(C * cpu) {
     cpu->SP++;
-    cpu->P = cpu->mem->read(0x100 + cpu->SP);
-    CYCL
+    cpu->P = cpu->read(0x100 + cpu->SP);
     cpu->SP++;
-    Byte lo = cpu->mem->read(0x100 + cpu->SP);
-    CYCL
+    Byte lo = cpu->read(0x100 + cpu->SP);
     cpu->SP++;
-    Byte hi = cpu->mem->read(0x100 + cpu->SP);
-    CYCL
+    Byte hi = cpu->read(0x100 + cpu->SP);
     cpu->PC = (hi << 8) | lo;
-    CYCL
+    cpu->hooks.transfer(Transfer::Return, cpu->PC, cpu->SP, cpu->cycles);
 }
 
 // BIT - Test Bits (0x24 zeropage, 0x2C absolute)
-void BITZP(CPU * cpu) {
-    CYCL
-    Byte value = cpu->mem->read(cpu->zeroPage());
+template <class C>
+void BITZP(C * cpu) {
+    Byte value = cpu->read(cpu->zeroPage());
     Byte result = cpu->A & value;
     cpu->setZ(result == 0);
     cpu->setN((value & 0x80) > 0);
     cpu->setV((value & 0x40) > 0);
 }
 
-void BITABS(CPU * cpu) {
-    CYCL
-    Byte value = cpu->mem->read(cpu->absolute());
+template <class C>
+void BITABS(C * cpu) {
+    Byte value = cpu->read(cpu->absolute());
     Byte result = cpu->A & value;
     cpu->setZ(result == 0);
     cpu->setN((value & 0x80) > 0);
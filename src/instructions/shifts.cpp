@@ -1,239 +1,205 @@
 #include "cpu.h"
 
-#define CYCL cpu->cycl();
-
-void SetNZ(CPU * cpu, Byte reg);
+template <class C> void SetNZ(C * cpu, Byte reg);
 
 // ASL - Arithmetic Shift Left
-void ASLA(CPU * cpu) {
-    CYCL
+template <class C>
+void ASLA(C * cpu) {
     cpu->setC((cpu->A & 0x80) > 0);
     cpu->A <<= 1;
     SetNZ(cpu, cpu->A);
 }
 
-void ASLZP(CPU * cpu) {
+template <class C>
+void ASLZP(C * cpu) {
     Byte addr = cpu->zeroPage();
-    CYCL
-    Byte value = cpu->mem->read(addr);
-    CYCL
+    Byte value = cpu->read(addr);
     cpu->setC((value & 0x80) > 0);
     value <<= 1;
-    cpu->mem->write(addr, value);
-    CYCL
+    cpu->write(addr, value);
     SetNZ(cpu, value);
 }
 
-void ASLZPX(CPU * cpu) {
+template <class C>
+void ASLZPX(C * cpu) {
     Byte addr = cpu->zeroPageX();
-    CYCL
-    Byte value = cpu->mem->read(addr);
-    CYCL
+    Byte value = cpu->read(addr);
     cpu->setC((value & 0x80) > 0);
     value <<= 1;
-    cpu->mem->write(addr, value);
-    CYCL
+    cpu->write(addr, value);
     SetNZ(cpu, value);
 }
 
-void ASLABS(CPU * cpu) {
+template <class C>
+void ASLABS(C * cpu) {
     Word addr = cpu->absolute();
-    CYCL
-    Byte value = cpu->mem->read(addr);
-    CYCL
+    Byte value = cpu->read(addr);
     cpu->setC((value & 0x80) > 0);
     value <<= 1;
-    cpu->mem->write(addr, value);
-    CYCL
+    cpu->write(addr, value);
     SetNZ(cpu, value);
 }
 
-void ASLABSX(CPU * cpu) {
+template <class C>
+void ASLABSX(C * cpu) {
     Word addr = cpu->absoluteX();
-    CYCL
-    Byte value = cpu->mem->read(addr);
-    CYCL
+    Byte value = cpu->read(addr);
     cpu->setC((value & 0x80) > 0);
     value <<= 1;
-    cpu->mem->write(addr, value);
-    CYCL
+    cpu->write(addr, value);
     SetNZ(cpu, value);
 }
 
 // LSR - Logical Shift Right
-void LSRA(CPU * cpu) {
-    CYCL
+template <class C>
+void LSRA(C * cpu) {
     cpu->setC((cpu->A & 0x01) > 0);
     cpu->A >>= 1;
     SetNZ(cpu, cpu->A);
 }
 
-void LSRZP(CPU * cpu) {
+template <class C>
+void LSRZP(C * cpu) {
     Byte addr = cpu->zeroPage();
-    CYCL
-    Byte value = cpu->mem->read(addr);
-    CYCL
+    Byte value = cpu->read(addr);
     cpu->setC((value & 0x01) > 0);
     value >>= 1;
-    cpu->mem->write(addr, value);
-    CYCL
+    cpu->write(addr, value);
     SetNZ(cpu, value);
 }
 
-void LSRZPX(CPU * cpu) {
+template <class C>
+void LSRZPX(C * cpu) {
     Byte addr = cpu->zeroPageX();
-    CYCL
-    Byte value = cpu->mem->read(addr);
-    CYCL
+    Byte value = cpu->read(addr);
     cpu->setC((value & 0x01) > 0);
     value >>= 1;
-    cpu->mem->write(addr, value);
-    CYCL
+    cpu->write(addr, value);
     SetNZ(cpu, value);
 }
 
-void LSRABS(CPU * cpu) {
+template <class C>
+void LSRABS(C * cpu) {
     Word addr = cpu->absolute();
-    CYCL
-    Byte value = cpu->mem->read(addr);
-    CYCL
+    Byte value = cpu->read(addr);
     cpu->setC((value & 0x01) > 0);
     value >>= 1;
-    cpu->mem->write(addr, value);
-    CYCL
+    cpu->write(addr, value);
     SetNZ(cpu, value);
 }
 
-void LSRABSX(CPU * cpu) {
+template <class C>
+void LSRABSX(C * cpu) {
     Word addr = cpu->absoluteX();
-    CYCL
-    Byte value = cpu->mem->read(addr);
-    CYCL
+    Byte value = cpu->read(addr);
     cpu->setC((value & 0x01) > 0);
     value >>= 1;
-    cpu->mem->write(addr, value);
-    CYCL
+    cpu->write(addr, value);
     SetNZ(cpu, value);
 }
 
 // ROL - Rotate Left
-void ROLA(CPU * cpu) {
-    CYCL
+template <class C>
+void ROLA(C * cpu) {
     bool oldCarry = cpu->C();
     cpu->setC((cpu->A & 0x80) > 0);
     cpu->A = (cpu->A << 1) | (oldCarry ? 1 : 0);
     SetNZ(cpu, cpu->A);
 }
 
-void ROLZP(CPU * cpu) {
+template <class C>
+void ROLZP(C * cpu) {
     Byte addr = cpu->zeroPage();
-    CYCL
-    Byte value = cpu->mem->read(addr);
-    CYCL
+    Byte value = cpu->read(addr);
     bool oldCarry = cpu->C();
     cpu->setC((value & 0x80) > 0);
     value = (value << 1) | (oldCarry ? 1 : 0);
-    cpu->mem->write(addr, value);
-    CYCL
+    cpu->write(addr, value);
     SetNZ(cpu, value);
 }
 
-void ROLZPX(CPU * cpu) {
+template <class C>
+void ROLZPX(C * cpu) {
     Byte addr = cpu->zeroPageX();
-    CYCL
-    Byte value = cpu->mem->read(addr);
-    CYCL
+    Byte value = cpu->read(addr);
     bool oldCarry = cpu->C();
     cpu->setC((value & 0x80) > 0);
     value = (value << 1) | (oldCarry ? 1 : 0);
-    cpu->mem->write(addr, value);
-    CYCL
+    cpu->write(addr, value);
     SetNZ(cpu, value);
 }
 
-void ROLABS(CPU * cpu) {
+template <class C>
+void ROLABS(C * cpu) {
     Word addr = cpu->absolute();
-    CYCL
-    Byte value = cpu->mem->read(addr);
-    CYCL
+    Byte value = cpu->read(addr);
     bool oldCarry = cpu->C();
     cpu->setC((value & 0x80) > 0);
     value = (value << 1) | (oldCarry ? 1 : 0);
-    cpu->mem->write(addr, value);
-    CYCL
+    cpu->write(addr, value);
     SetNZ(cpu, value);
 }
 
-void ROLABSX(CPU * cpu) {
+template <class C>
+void ROLABSX(C * cpu) {
     Word addr = cpu->absoluteX();
-    CYCL
-    Byte value = cpu->mem->read(addr);
-    CYCL
+    Byte value = cpu->read(addr);
     bool oldCarry = cpu->C();
     cpu->setC((value & 0x80) > 0);
     value = (value << 1) | (oldCarry ? 1 : 0);
-    cpu->mem->write(addr, value);
-    CYCL
+    cpu->write(addr, value);
     SetNZ(cpu, value);
 }
 
 // ROR - Rotate Right
-void RORA(CPU * cpu) {
-    CYCL
+template <class C>
+void RORA(C * cpu) {
     bool oldCarry = cpu->C();
     cpu->setC((cpu->A & 0x01) > 0);
     cpu->A = (cpu->A >> 1) | (oldCarry ? 0x80 : 0);
     SetNZ(cpu, cpu->A);
 }
 
-void RORZP(CPU * cpu) {
+template <class C>
+void RORZP(C * cpu) {
     Byte addr = cpu->zeroPage();
-    CYCL
-    Byte value = cpu->mem->read(addr);
-    CYCL
+    Byte value = cpu->read(addr);
     bool oldCarry = cpu->C();
     cpu->setC((value & 0x01) > 0);
     value = (value >> 1) | (oldCarry ? 0x80 : 0);
-    cpu->mem->write(addr, value);
-    CYCL
+    cpu->write(addr, value);
     SetNZ(cpu, value);
 }
 
-void RORZPX(CPU * cpu) {
+template <class C>
+void RORZPX(C * cpu) {
     Byte addr = cpu->zeroPageX();
-    CYCL
-    Byte value = cpu->mem->read(addr);
-    CYCL
+    Byte value = cpu->read(addr);
     bool oldCarry = cpu->C();
     cpu->setC((value & 0x01) > 0);
     value = (value >> 1) | (oldCarry ? 0x80 : 0);
-    cpu->mem->write(addr, value);
-    CYCL
+    cpu->write(addr, value);
     SetNZ(cpu, value);
 }
 
-void RORABS(CPU * cpu) {
+template <class C>
+void RORABS(C * cpu) {
     Word addr = cpu->absolute();
-    CYCL
-    Byte value = cpu->mem->read(addr);
-    CYCL
+    Byte value = cpu->read(addr);
     bool oldCarry = cpu->C();
     cpu->setC((value & 0x01) > 0);
     value = (value >> 1) | (oldCarry ? 0x80 : 0);
-    cpu->mem->write(addr, value);
-    CYCL
+    cpu->write(addr, value);
     SetNZ(cpu, value);
 }
 
-void RORABSX(CPU * cpu) {
+template <class C>
+void RORABSX(C * cpu) {
     Word addr = cpu->absoluteX();
-    CYCL
-    Byte value = cpu->mem->read(addr);
-    CYCL
+    Byte value = cpu->read(addr);
     bool oldCarry = cpu->C();
     cpu->setC((value & 0x01) > 0);
     value = (value >> 1) | (oldCarry ? 0x80 : 0);
-    cpu->mem->write(addr, value);
-    CYCL
+    cpu->write(addr, value);
     SetNZ(cpu, value);
 }
@@ -1,38 +1,30 @@
 #include "cpu.h"
 
-#define CYCL cpu->cycl();
-
-void SetNZ(CPU * cpu, Byte reg);
+template <class C> void SetNZ(C * cpu, Byte reg);
 
 // PHA - Push Accumulator (0x48)
-void PHA(CPU * cpu) {
-    CYCL
+template <class C>
+void PHA(C * cpu) {
     cpu->push(cpu->A);
-    CYCL
 }
 
 // PLA - Pull Accumulator (0x68)
-void PLA(CPU * cpu) {
-    CYCL
-    CYCL
+template <class C>
+void PLA(C * cpu) {
     cpu->SP++;
-    cpu->A = cpu->mem->read(0x100 + cpu->SP);
-    CYCL
+    cpu->A = cpu->read(0x100 + cpu->SP);
     SetNZ(cpu, cpu->A);
 }
 
 // PHP - Push Processor Status (0x08)
-void PHP(CPU * cpu) {
-    CYCL
+template <class C>
+void PHP(C * cpu) {
     cpu->push(cpu->P | 0x30);  // B flag and unused flag (bits 4 & 5) are set when pushed
-    CYCL
 }
 
 // PLP - Pull Processor Status (0x28)
-void PLP(CPU * cpu) {
-    CYCL
-    CYCL
+template <class C>
+void PLP(C * cpu) {
     cpu->SP++;
-    cpu->P = cpu->mem->read(0x100 + cpu->SP);
-    CYCL
+    cpu->P = cpu->read(0x100 + cpu->SP);
 }
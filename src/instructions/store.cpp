@@ -1,68 +1,66 @@
 #include "cpu.h"
 
-#define CYCL cpu->cycl();
-
-void STAZ(CPU * cpu) {
-    CYCL
-    cpu->mem->write(cpu->zeroPage(), cpu->A);
+template <class C>
+void STAZ(C * cpu) {
+    cpu->write(cpu->zeroPage(), cpu->A);
 }
 
-void STAZX(CPU * cpu) {
-    CYCL
-    cpu->mem->write(cpu->zeroPageX(), cpu->A);
+template <class C>
+void STAZX(C * cpu) {
+    cpu->write(cpu->zeroPageX(), cpu->A);
 }
 
-void STAA(CPU * cpu) {
-    CYCL
-    cpu->mem->write(cpu->absolute(), cpu->A);
+template <class C>
+void STAA(C * cpu) {
+    cpu->write(cpu->absolute(), cpu->A);
 }
 
-void STAAX(CPU * cpu) {
-    CYCL
-    cpu->mem->write(cpu->absoluteX(), cpu->A);
+template <class C>
+void STAAX(C * cpu) {
+    cpu->write(cpu->absoluteX(), cpu->A);
 }
 
-void STAAY(CPU * cpu) {
-    CYCL
-    cpu->mem->write(cpu->absoluteY(), cpu->A);
+template <class C>
+void STAAY(C * cpu) {
+    cpu->write(cpu->absoluteY(), cpu->A);
 }
 
-void STAIX(CPU * cpu) {
-    CYCL
-    cpu->mem->write(cpu->indirectX(), cpu->A);
+template <class C>
+void STAIX(C * cpu) {
+    cpu->write(cpu->indirectX(), cpu->A);
 }
 
-void STAIY(CPU * cpu) {
-    CYCL
-    cpu->mem->write(cpu->indirectY(), cpu->A);
+template <class C>
+void STAIY(C * cpu) {
+    cpu->write(cpu->indirectY(), cpu->A);
 }
 
-void STXZP(CPU * cpu) {
-    CYCL
-    cpu->mem->write(cpu->zeroPage(), cpu->X);
+template <class C>
+void STXZP(C * cpu) {
+    cpu->write(cpu->zeroPage(), cpu->X);
 }
 
-void STXZPY(CPU * cpu) {
-    CYCL
-    cpu->mem->write(cpu->zeroPageY(), cpu->X);
+template <class C>
+void STXZPY(C * cpu) {
+    cpu->write(cpu->zeroPageY(), cpu->X);
 }
 
-void STXA(CPU * cpu) {
-    CYCL
-    cpu->mem->write(cpu->absolute(), cpu->X);
+template <class C>
+void STXA(C * cpu) {
+    cpu->write(cpu->absolute(), cpu->X);
 }
 
-void STYZP(CPU * cpu) {
-    CYCL
-    cpu->mem->write(cpu->zeroPage(), cpu->Y);
+template <class C>
+void STYZP(C * cpu) {
+    cpu->write(cpu->zeroPage(), cpu->Y);
 }
 
-void STYZPX(CPU * cpu) {
-    CYCL
-    cpu->mem->write(cpu->zeroPageX(), cpu->Y);
+template <class C>
+void STYZPX(C * cpu) {
+    cpu->write(cpu->zeroPageX(), cpu->Y);
 }
 
-void STYA(CPU * cpu) {
-    CYCL
-    cpu->mem->write(cpu->absolute(), cpu->Y);
+template <class C>
+void STYA(C * cpu) {
+    cpu->write(cpu->absolute(), cpu->Y);
 }
@@ -1,49 +1,28 @@
 #include "cpu.h"
+#include "alu.h"
 
-#define CYCL cpu->cycl();
 
-Word binarySubtract(CPU * cpu, Byte memValue) {
+template <class C>
+Word binarySubtract(C * cpu, Byte memValue) {
     // Perform binary subtraction: A - M - (1 - C)
     // Note: On 6502, carry flag acts as "NOT borrow" for subtraction
     return cpu->A - memValue - (cpu->C() ? 0 : 1);
 }
 
-Word decimalSubtract(CPU * cpu, Byte memValue) {
-    // BCD (Binary Coded Decimal) subtraction
-    // Each nibble represents a decimal digit (0-9)
-    Byte a = cpu->A;
-    Byte b = memValue;
-    Byte borrow = cpu->C() ? 0 : 1;  // On 6502, carry flag acts as "NOT borrow"
-    
-    // Subtract low nibble (ones place)
-    int lowNibble = (a & 0x0F) - (b & 0x0F) - borrow;
-    int lowBorrow = 0;
-    if (lowNibble < 0) {
-        lowNibble += 10;  // Borrow from high nibble
-        lowBorrow = 1;
-    }
-    
-    // Subtract high nibble (tens place) with borrow from low nibble
-    int highNibble = (a >> 4) - (b >> 4) - lowBorrow;
-    int highBorrow = 0;
-    if (highNibble < 0) {
-        highNibble += 10;  // Underflow
-        highBorrow = 1;
-    }
-    
-    // Combine nibbles
-    Word result = ((highNibble & 0x0F) << 4) | (lowNibble & 0x0F);
-    
-    // Set bit 8 if there was a borrow (for carry flag detection)
-    if (highBorrow) {
-        result |= 0x100;
-    }
-    
-    return result;
-} 
+template <class C>
+void decimalSubtract(C * cpu, Byte memValue) {
+    // Decimal mode: result, C and V in one load from the BCD table
+    Word entry = decimalTables.sbc[cpu->C()][cpu->A][memValue];
+    cpu->A = entry & 0xFF;
+    cpu->setC(entry & DecimalCarry);
+    cpu->setV(entry & DecimalOverflow);
+    cpu->setZ(cpu->A == 0);
+    cpu->setN((cpu->A & 0x80) > 0);
+}
 
-void SBCFlags(CPU * cpu, Word binary, Word decimal, Byte memValue) {
-    Byte result = cpu->D() ? (decimal & 0xFF) : (binary & 0xFF);
+template <class C>
+void SBCFlags(C * cpu, Word binary, Byte memValue) {
+    Byte result = binary & 0xFF;
     
     // Set overflow flag: overflow occurs when A and operand have different signs,
     // and the result has a different sign from A
@@ -53,92 +32,111 @@ void SBCFlags(CPU * cpu, Word binary, Word decimal, Byte memValue) {
     cpu->setZ(result == 0);
     cpu->setN((result & 0x80) > 0);
     
-    if (cpu->D()) {
-        // In decimal mode, carry is set if NO borrow occurred (result >= 0)
-        cpu->setC(!(decimal & 0x100));
-    } else {
-        // In binary mode, carry is set when NO borrow (i.e., result is non-negative)
-        cpu->setC(!(binary & 0x100));
-    }
+    // In binary mode, carry is set when NO borrow (i.e., result is non-negative)
+    cpu->setC(!(binary & 0x100));
 }
 
 // SBC - Subtract with Carry
-void SBCIX(CPU * cpu) {
+template <class C>
+void SBCIX(C * cpu) {
     Word addr = cpu->indirectX();
-    CYCL
-    Byte memValue = cpu->mem->read(addr);
+    Byte memValue = cpu->read(addr);
+    if (cpu->D()) {
+        decimalSubtract(cpu, memValue);
+        return;
+    }
     Word binary = binarySubtract(cpu, memValue);
-    Word decimal = decimalSubtract(cpu, memValue);
-    SBCFlags(cpu, binary, decimal, memValue);
-    cpu->A = cpu->D() ? decimal : binary & 0xFF;
+    SBCFlags(cpu, binary, memValue);
+    cpu->A = binary & 0xFF;
 }
 
-void SBCZP(CPU * cpu) {
+template <class C>
+void SBCZP(C * cpu) {
     Word addr = cpu->zeroPage();
-    CYCL
-    Byte memValue = cpu->mem->read(addr);
+    Byte memValue = cpu->read(addr);
+    if (cpu->D()) {
+        decimalSubtract(cpu, memValue);
+        return;
+    }
     Word binary = binarySubtract(cpu, memValue);
-    Word decimal = decimalSubtract(cpu, memValue);
-    SBCFlags(cpu, binary, decimal, memValue);
-    cpu->A = cpu->D() ? decimal : binary & 0xFF;
+    SBCFlags(cpu, binary, memValue);
+    cpu->A = binary & 0xFF;
 }
 
-void SBCI(CPU * cpu) {
+template <class C>
+void SBCI(C * cpu) {
     Word addr = cpu->immediate();
-    CYCL
-    Byte memValue = cpu->mem->read(addr);
+    Byte memValue = cpu->read(addr);
+    if (cpu->D()) {
+        decimalSubtract(cpu, memValue);
+        return;
+    }
     Word binary = binarySubtract(cpu, memValue);
-    Word decimal = decimalSubtract(cpu, memValue);
-    SBCFlags(cpu, binary, decimal, memValue);
-    cpu->A = cpu->D() ? decimal : binary & 0xFF;
+    SBCFlags(cpu, binary, memValue);
+    cpu->A = binary & 0xFF;
 }
 
-void SBCA(CPU * cpu) {
+template <class C>
+void SBCA(C * cpu) {
     Word addr = cpu->absolute();
-    CYCL
-    Byte memValue = cpu->mem->read(addr);
+    Byte memValue = cpu->read(addr);
+    if (cpu->D()) {
+        decimalSubtract(cpu, memValue);
+        return;
+    }
     Word binary = binarySubtract(cpu, memValue);
-    Word decimal = decimalSubtract(cpu, memValue);
-    SBCFlags(cpu, binary, decimal, memValue);
-    cpu->A = cpu->D() ? decimal : binary & 0xFF;
+    SBCFlags(cpu, binary, memValue);
+    cpu->A = binary & 0xFF;
 }
 
-void SBCIY(CPU * cpu) {
+template <class C>
+void SBCIY(C * cpu) {
     Word addr = cpu->indirectY();
-    CYCL
-    Byte memValue = cpu->mem->read(addr);
+    Byte memValue = cpu->read(addr);
+    if (cpu->D()) {
+        decimalSubtract(cpu, memValue);
+        return;
+    }
     Word binary = binarySubtract(cpu, memValue);
-    Word decimal = decimalSubtract(cpu, memValue);
-    SBCFlags(cpu, binary, decimal, memValue);
-    cpu->A = cpu->D() ? decimal : binary & 0xFF;
+    SBCFlags(cpu, binary, memValue);
+    cpu->A = binary & 0xFF;
 }
 
-void SBCZPX(CPU * cpu) {
+template <class C>
+void SBCZPX(C * cpu) {
     Word addr = cpu->zeroPageX();
-    CYCL
-    Byte memValue = cpu->mem->read(addr);
+    Byte memValue = cpu->read(addr);
+    if (cpu->D()) {
+        decimalSubtract(cpu, memValue);
+        return;
+    }
     Word binary = binarySubtract(cpu, memValue);
-    Word decimal = decimalSubtract(cpu, memValue);
-    SBCFlags(cpu, binary, decimal, memValue);
-    cpu->A = cpu->D() ? decimal : binary & 0xFF;
+    SBCFlags(cpu, binary, memValue);
+    cpu->A = binary & 0xFF;
 }
 
-void SBCAY(CPU * cpu) {
+template <class C>
+void SBCAY(C * cpu) {
     Word addr = cpu->absoluteY();
-    CYCL
-    Byte memValue = cpu->mem->read(addr);
+    Byte memValue = cpu->read(addr);
+    if (cpu->D()) {
+        decimalSubtract(cpu, memValue);
+        return;
+    }
     Word binary = binarySubtract(cpu, memValue);
-    Word decimal = decimalSubtract(cpu, memValue);
-    SBCFlags(cpu, binary, decimal, memValue);
-    cpu->A = cpu->D() ? decimal : binary & 0xFF;
+    SBCFlags(cpu, binary, memValue);
+    cpu->A = binary & 0xFF;
 }
 
-void SBCAX(CPU * cpu) {
+template <class C>
+void SBCAX(C * cpu) {
     Word addr = cpu->absoluteX();
-    CYCL
-    Byte memValue = cpu->mem->read(addr);
+    Byte memValue = cpu->read(addr);
+    if (cpu->D()) {
+        decimalSubtract(cpu, memValue);
+        return;
+    }
     Word binary = binarySubtract(cpu, memValue);
-    Word decimal = decimalSubtract(cpu, memValue);
-    SBCFlags(cpu, binary, decimal, memValue);
-    cpu->A = cpu->D() ? decimal : binary & 0xFF;
+    SBCFlags(cpu, binary, memValue);
+    cpu->A = binary & 0xFF;
 }
@@ -1,48 +1,46 @@
 #include "cpu.h"
 
-#define CYCL cpu->cycl();
-
 // Forward declaration
-void SetNZ(CPU * cpu, Byte reg);
+template <class C> void SetNZ(C * cpu, Byte reg);
 
 // TAX - Transfer Accumulator to X (0xAA)
-void TAX(CPU * cpu) {
-    CYCL
+template <class C>
+void TAX(C * cpu) {
     cpu->X = cpu->A;
     SetNZ(cpu, cpu->X);
 }
 
 // TAY - Transfer Accumulator to Y (0xA8)
-void TAY(CPU * cpu) {
-    CYCL
+template <class C>
+void TAY(C * cpu) {
     cpu->Y = cpu->A;
     SetNZ(cpu, cpu->Y);
 }
 
 // TXA - Transfer X to Accumulator (0x8A)
-void TXA(CPU * cpu) {
-    CYCL
+template <class C>
+void TXA(C * cpu) {
     cpu->A = cpu->X;
     SetNZ(cpu, cpu->A);
 }
 
 // TYA - Transfer Y to Accumulator (0x98)
-void TYA(CPU * cpu) {
-    CYCL
+template <class C>
+void TYA(C * cpu) {
     cpu->A = cpu->Y;
     SetNZ(cpu, cpu->A);
 }
 
 // TSX - Transfer Stack Pointer to X (0xBA)
-void TSX(CPU * cpu) {
-    CYCL
+template <class C>
+void TSX(C * cpu) {
     cpu->X = cpu->SP;
     SetNZ(cpu, cpu->X);
 }
 
 // TXS - Transfer X to Stack Pointer (0x9A)
-void TXS(CPU * cpu) {
-    CYCL
+template <class C>
+void TXS(C * cpu) {
     cpu->SP = cpu->X;
     // Note: TXS does not affect any flags (unlike other transfer instructions)
 }
@@ -1,11 +1,31 @@
 #include "memory.h"
 #include "cpu.h"
+#include "aot.h"
+#include "perfcounters.h"
 #include <iostream>
 #include <fstream>
 #include <vector>
 #include <string>
 #include <cstdlib>
 #include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <utility>
+#include <map>
+#include <memory>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define HOST_TICKS 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HOST_TICKS 1
+#else
+#define HOST_TICKS 0
+#endif
+
+// Calls -chrome records before the trace would grow past a few hundred MB
+const size_t chromeFrameLimit = 1000000;
 
 void printUsage(const char* progName) {
     std::cout << "Usage: " << progName << " [options]\n"
@@ -14,10 +34,24 @@ void printUsage(const char* progName) {
               << "  -a <address>    Address to load program at (default: 0x0000, hex format)\n"
               << "  -pc <address>   Set program counter (default: from reset vector, hex format)\n"
               << "  -m <cycles>     Maximum cycles to execute (default: 100000000)\n"
+              << "  -e <engine>     Execution engine: dispatch, blocks, jit or aot (default: dispatch)\n"
+              << "  -aot <name>     Program recompiled by 6502_aot to run with -e aot (default: the first linked in)\n"
+              << "  -noidle         Step idle loops instead of fast-forwarding them to the cycle limit\n"
+              << "  -nodelay        Step counted delay loops instead of running them in closed form\n"
+              << "  -hostcall <op>  Serve host calls on unimplemented opcode <op> (hex): A=0 exit,\n"
+              << "                  A=1 print the character in X, A=2 print the string at Y:X\n"
+              << "  -bench <runs>   Time <runs> runs from a fresh copy of the program and report statistics\n"
+              << "  -warmup <runs>  Untimed runs before -bench's (default: 1)\n"
+              << "  -json           Report -bench's statistics as JSON\n"
+              << "  -perf           Add host hardware counters per emulated instruction to -bench (Linux)\n"
+              << "  -profile        Count executions and cycles per opcode and PC, and report the hottest\n"
+              << "  -labels <file>  Name -profile's PCs and routines after the labels of an AS65 listing\n"
+              << "  -folded <file>  Profile and write cycles per call path as folded stacks for flamegraphs\n"
+              << "  -chrome <file>  Profile and write calls as Chrome trace-event JSON\n"
               << "  -h              Show this help message\n";
 }
 
-bool loadBinary(Memory& mem, const std::string& filename, Word startAddr = 0x0000) {
+bool loadBinary(Memory& mem, const std::string& filename, Word startAddr = 0x0000, bool quiet = false) {
     std::ifstream file(filename, std::ios::binary);
     if (!file) {
         std::cerr << "Error: Could not open file " << filename << std::endl;
@@ -41,8 +75,10 @@ bool loadBinary(Memory& mem, const std::string& filename, Word startAddr = 0x000
         return false;
     }
     
-    std::cout << "Loading " << filename << " (" << size << " bytes) at 0x"
-              << std::hex << startAddr << std::dec << std::endl;
+    if (!quiet) {
+        std::cout << "Loading " << filename << " (" << size << " bytes) at 0x"
+                  << std::hex << startAddr << std::dec << std::endl;
+    }
     
     std::vector<Byte> buffer(size);
     if (size > 0) {
@@ -59,6 +95,259 @@ bool loadBinary(Memory& mem, const std::string& filename, Word startAddr = 0x000
     return true;
 }
 
+// Console services for -hostcall: the service number in A, a character or
+// the address of a zero-terminated string in Y:X
+bool consoleHostCall(CPUState & cpu) {
+    switch (cpu.A) {
+    case 0x00:
+        return false;
+    case 0x01:
+        std::cout.put(static_cast<char>(cpu.X));
+        break;
+    case 0x02:
+        for (Word addr = cpu.X | (cpu.Y << 8); cpu.mem->mem[addr]; addr++)
+            std::cout.put(static_cast<char>(cpu.mem->mem[addr]));
+        break;
+    }
+    return true;
+}
+
+const char* engineName(CPU::Engine engine) {
+    switch (engine) {
+    case CPU::Engine::Dispatch: return "dispatch";
+    case CPU::Engine::Blocks: return "blocks";
+    case CPU::Engine::Jit: return "jit";
+    case CPU::Engine::Aot: return "aot";
+    }
+    return "";
+}
+
+const char* stopReasonName(CPU::StopReason reason) {
+    switch (reason) {
+    case CPU::StopReason::Budget: return "budget";
+    case CPU::StopReason::Trap: return "trap";
+    case CPU::StopReason::Breakpoint: return "breakpoint";
+    case CPU::StopReason::Halt: return "halt";
+    case CPU::StopReason::Mismatch: return "mismatch";
+    case CPU::StopReason::Exit: return "exit";
+    }
+    return "";
+}
+
+// Host clock ticks: the time-stamp counter on x86, which runs at the
+// nominal clock rate whatever the core's current frequency
+unsigned long long hostTicks() {
+#if HOST_TICKS
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// The host calls of -hostcall without the console output, for -bench
+bool silentHostCall(CPUState & cpu) {
+    return cpu.A != 0x00;
+}
+
+// The command line's settings and starting registers, for another core
+template <class Core>
+void copySetup(const CPU & setup, Core & cpu) {
+    cpu.engine = setup.engine;
+    cpu.aotProgram = setup.aotProgram;
+    cpu.skipIdleLoops = setup.skipIdleLoops;
+    cpu.skipDelayLoops = setup.skipDelayLoops;
+    cpu.hostCallOpcode = setup.hostCallOpcode;
+    cpu.hostCall = setup.hostCall;
+    cpu.PC = setup.PC;
+    cpu.SP = setup.SP;
+    cpu.A = setup.A;
+    cpu.X = setup.X;
+    cpu.Y = setup.Y;
+    cpu.P = setup.P;
+    cpu.cycles = setup.cycles;
+}
+
+struct BenchOptions {
+    int runs = 0;
+    int warmup = 1;
+    bool json = false;
+    bool perf = false;
+};
+
+// -bench: runs the program from a fresh copy of its memory and a fresh core
+// each time, so that every run translates and caches the same way, and
+// reports the spread of the timed runs. The cycle-counting cores don't count
+// instructions; a TracingCPU counts them in one extra run, stepping the idle
+// and delay loops that the timed runs may fast-forward. With -perf the host's
+// hardware counters are summed over the timed runs and divided by the
+// instructions they emulated.
+int runBenchmark(const CPU & setup, const Memory & image, unsigned long long budget,
+                 const BenchOptions & options, const std::string & programFile) {
+    auto prepare = [&](auto & cpu) {
+        copySetup(setup, cpu);
+        if (setup.hostCall)
+            cpu.hostCall = silentHostCall;
+    };
+
+    long long instructions = 0;
+    {
+        Memory mem = image;
+        TracingCPU counter(&mem);
+        prepare(counter);
+        counter.hooks.onInstruction = [&](const CPUTrace &) { instructions++; };
+        counter.run(budget);
+    }
+
+    PerfCounters perf;
+    bool counting = options.perf && perf.open();
+    if (options.perf && !counting)
+        std::cerr << "Warning: perf_event_open is unavailable, so no host counters are reported" << std::endl;
+
+    std::vector<double> times;
+    std::vector<double> ticks;
+    long long cycles = 0;
+    CPU::StopReason reason = CPU::StopReason::Budget;
+    Word finalPC = 0;
+    for (int run = 0; run < options.warmup + options.runs; run++) {
+        Memory mem = image;
+        CPU cpu(&mem);
+        prepare(cpu);
+        auto startTime = std::chrono::steady_clock::now();
+        bool timed = run >= options.warmup;
+        if (counting && timed)
+            perf.start();
+        unsigned long long startTicks = hostTicks();
+        CPU::StopReason stopped = cpu.run(budget);
+        unsigned long long endTicks = hostTicks();
+        if (counting && timed)
+            perf.stop();
+        auto endTime = std::chrono::steady_clock::now();
+
+        long long ran = cpu.cycles - setup.cycles;
+        if (run > 0 && (ran != cycles || stopped != reason || cpu.PC != finalPC)) {
+            std::cerr << "Error: Benchmark runs ended differently" << std::endl;
+            return 1;
+        }
+        cycles = ran;
+        reason = stopped;
+        finalPC = cpu.PC;
+        if (timed) {
+            times.push_back(std::chrono::duration<double, std::nano>(endTime - startTime).count());
+            ticks.push_back(double(endTicks - startTicks));
+        }
+    }
+
+    // Nearest-rank percentiles over the sorted times
+    std::vector<double> sorted = times;
+    std::sort(sorted.begin(), sorted.end());
+    std::sort(ticks.begin(), ticks.end());
+    size_t n = sorted.size();
+    double minimum = sorted.front();
+    double median = n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+    double p99 = sorted[std::max<size_t>(1, (n * 99 + 99) / 100) - 1];
+    double medianTicks = n % 2 ? ticks[n / 2] : (ticks[n / 2 - 1] + ticks[n / 2]) / 2;
+    double mhz = median > 0 ? cycles * 1e3 / median : 0;
+    double perSecond = median > 0 ? instructions * 1e9 / median : 0;
+    // TSC ticks, not core cycles: the counter keeps its rate as the core's
+    // clock scales
+    double ticksPerInstruction = HOST_TICKS && instructions ? medianTicks / instructions : 0;
+
+    // Host counts per emulated instruction, for the counters the host provides
+    std::vector<std::pair<const char*, double>> perInstruction;
+    double ipc = 0;
+    if (counting && instructions) {
+        double emulated = double(instructions) * options.runs;
+        for (int event = 0; event < PerfCounters::eventCount; event++) {
+            if (perf.available(PerfCounters::Event(event))) {
+                perInstruction.push_back({ PerfCounters::name(PerfCounters::Event(event)),
+                                           perf.count(PerfCounters::Event(event)) / emulated });
+            }
+        }
+        if (perf.available(PerfCounters::Cycles) && perf.available(PerfCounters::Instructions) && perf.count(PerfCounters::Cycles) > 0)
+            ipc = perf.count(PerfCounters::Instructions) / perf.count(PerfCounters::Cycles);
+    }
+
+    if (options.json) {
+        char line[256];
+        std::cout << "{\n";
+        std::cout << "  \"program\": \"";
+        for (char c : programFile) {
+            if (c == '"' || c == '\\')
+                std::cout << '\\';
+            std::cout << c;
+        }
+        std::cout << "\",\n";
+        std::cout << "  \"engine\": \"" << engineName(setup.engine) << "\",\n";
+        std::cout << "  \"runs\": " << options.runs << ",\n";
+        std::cout << "  \"warmup\": " << options.warmup << ",\n";
+        std::cout << "  \"stop\": \"" << stopReasonName(reason) << "\",\n";
+        std::cout << "  \"final_pc\": " << finalPC << ",\n";
+        std::cout << "  \"cycles\": " << cycles << ",\n";
+        std::cout << "  \"instructions\": " << instructions << ",\n";
+        std::cout << "  \"instructions_counted_by\": \"separate TracingCPU run\",\n";
+        std::snprintf(line, sizeof(line), "  \"time_ns\": { \"min\": %.0f, \"median\": %.0f, \"p99\": %.0f },\n",
+                      minimum, median, p99);
+        std::cout << line;
+        std::snprintf(line, sizeof(line), "  \"emulated_mhz\": %.3f,\n  \"instructions_per_second\": %.0f,\n",
+                      mhz, perSecond);
+        std::cout << line;
+        if (HOST_TICKS)
+            std::snprintf(line, sizeof(line), "  \"tsc_ticks_per_instruction\": %.3f,\n", ticksPerInstruction);
+        else
+            std::snprintf(line, sizeof(line), "  \"tsc_ticks_per_instruction\": null,\n");
+        std::cout << line;
+        if (counting) {
+            std::cout << "  \"perf\": {";
+            for (const auto& counter : perInstruction) {
+                std::snprintf(line, sizeof(line), " \"%s\": %.4f,", counter.first, counter.second);
+                std::cout << line;
+            }
+            if (ipc > 0)
+                std::snprintf(line, sizeof(line), " \"ipc\": %.3f },\n", ipc);
+            else
+                std::snprintf(line, sizeof(line), " \"ipc\": null },\n");
+            std::cout << line;
+        } else if (options.perf) {
+            std::cout << "  \"perf\": null,\n";
+        }
+        std::cout << "  \"times_ns\": [";
+        for (size_t i = 0; i < times.size(); i++) {
+            std::snprintf(line, sizeof(line), "%s%.0f", i ? ", " : "", times[i]);
+            std::cout << line;
+        }
+        std::cout << "]\n}" << std::endl;
+        return 0;
+    }
+
+    char line[256];
+    std::cout << "\nBenchmark: " << options.runs << " runs after " << options.warmup << " warmup, engine "
+              << engineName(setup.engine) << std::endl;
+    std::cout << "  Stopped: " << stopReasonName(reason) << " at PC=0x" << std::hex << finalPC << std::dec << std::endl;
+    std::cout << "  Cycles: " << cycles << std::endl;
+    std::cout << "  Instructions: " << instructions << " (counted by a separate TracingCPU run)" << std::endl;
+    std::snprintf(line, sizeof(line), "  Time: min %.3f ms, median %.3f ms, p99 %.3f ms\n",
+                  minimum / 1e6, median / 1e6, p99 / 1e6);
+    std::cout << line;
+    std::snprintf(line, sizeof(line), "  Emulated clock: %.2f MHz\n  Instructions/s: %.0f\n", mhz, perSecond);
+    std::cout << line;
+    if (HOST_TICKS) {
+        std::snprintf(line, sizeof(line), "  TSC ticks/instruction: %.2f\n", ticksPerInstruction);
+        std::cout << line;
+    }
+    if (counting) {
+        std::cout << "  Host counters per instruction:" << std::endl;
+        for (const auto& counter : perInstruction) {
+            std::snprintf(line, sizeof(line), "    %-22s %.4f\n", counter.first, counter.second);
+            std::cout << line;
+        }
+        if (ipc > 0) {
+            std::snprintf(line, sizeof(line), "  Host IPC: %.2f\n", ipc);
+            std::cout << line;
+        }
+    }
+    return 0;
+}
+
 int main(int argc, char* argv[]) {
     Memory mem;
     CPU cpu(&mem);
@@ -68,6 +357,12 @@ int main(int argc, char* argv[]) {
     Word programCounter = 0xFFFF;  // Use reset vector by default
     unsigned long long maxCycles = 100000000;
     bool hasCustomPC = false;
+    std::string aotName;
+    BenchOptions bench;
+    bool profile = false;
+    std::string labelFile;
+    std::string foldedFile;
+    std::string chromeFile;
     
     // Parse command-line arguments
     for (int i = 1; i < argc; i++) {
@@ -85,6 +380,48 @@ int main(int argc, char* argv[]) {
             hasCustomPC = true;
         } else if (arg == "-m" && i + 1 < argc) {
             maxCycles = std::stoull(argv[++i], nullptr, 0);
+        } else if (arg == "-e" && i + 1 < argc) {
+            std::string engine = argv[++i];
+            if (engine == "dispatch") {
+                cpu.engine = CPU::Engine::Dispatch;
+            } else if (engine == "blocks") {
+                cpu.engine = CPU::Engine::Blocks;
+            } else if (engine == "jit") {
+                cpu.engine = CPU::Engine::Jit;
+            } else if (engine == "aot") {
+                cpu.engine = CPU::Engine::Aot;
+            } else {
+                std::cerr << "Unknown engine: " << engine << std::endl;
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "-aot" && i + 1 < argc) {
+            aotName = argv[++i];
+        } else if (arg == "-noidle") {
+            cpu.skipIdleLoops = false;
+        } else if (arg == "-nodelay") {
+            cpu.skipDelayLoops = false;
+        } else if ((arg == "-bench" || arg == "--bench") && i + 1 < argc) {
+            bench.runs = std::stoi(argv[++i]);
+        } else if (arg == "-warmup" && i + 1 < argc) {
+            bench.warmup = std::max(0, std::stoi(argv[++i]));
+        } else if (arg == "-json") {
+            bench.json = true;
+        } else if (arg == "-perf") {
+            bench.perf = true;
+        } else if (arg == "-profile") {
+            profile = true;
+        } else if (arg == "-labels" && i + 1 < argc) {
+            labelFile = argv[++i];
+        } else if (arg == "-folded" && i + 1 < argc) {
+            foldedFile = argv[++i];
+            profile = true;
+        } else if (arg == "-chrome" && i + 1 < argc) {
+            chromeFile = argv[++i];
+            profile = true;
+        } else if (arg == "-hostcall" && i + 1 < argc) {
+            cpu.hostCallOpcode = static_cast<Byte>(std::stoul(argv[++i], nullptr, 16));
+            cpu.hostCall = consoleHostCall;
         } else {
             std::cerr << "Unknown option: " << arg << std::endl;
             printUsage(argv[0]);
@@ -92,9 +429,23 @@ int main(int argc, char* argv[]) {
         }
     }
     
+    if (cpu.engine == CPU::Engine::Aot) {
+        for (const AotProgram * program : aotPrograms()) {
+            if (aotName.empty() || aotName == program->name) {
+                cpu.aotProgram = program;
+                break;
+            }
+        }
+        if (!cpu.aotProgram) {
+            std::cerr << "Error: No recompiled program" << (aotName.empty() ? "" : " named " + aotName)
+                      << " in this build" << std::endl;
+            return 1;
+        }
+    }
+    
     // Load program if specified
     if (!programFile.empty()) {
-        if (!loadBinary(mem, programFile, loadAddr)) {
+        if (!loadBinary(mem, programFile, loadAddr, bench.json)) {
             return 1;
         }
     }
@@ -110,27 +461,41 @@ int main(int argc, char* argv[]) {
         cpu.PC = loadAddr;
     }
     
+    if (bench.runs > 0) {
+        unsigned long long budget = static_cast<unsigned long long>(cpu.cycles) < maxCycles ? maxCycles - cpu.cycles : 0;
+        return runBenchmark(cpu, mem, budget, bench, programFile);
+    }
+    
     std::cout << "Starting execution at PC=0x" << std::hex << cpu.PC << std::dec << std::endl;
     
     auto startTime = std::chrono::high_resolution_clock::now();
-    Word prevPC = cpu.PC;
-    Word sameCount = 0;
     
-    // Execute until max cycles or infinite loop detected
-    while (cpu.cycles < maxCycles) {
-        cpu.execute();
-        
-        // Detect infinite loops (PC not changing for multiple iterations)
-        if (cpu.PC == prevPC) {
-            sameCount++;
-            if (sameCount > 5) {
-                std::cout << "\nInfinite loop detected at PC=0x" << std::hex << cpu.PC << std::dec << std::endl;
-                break;
-            }
-        } else {
-            sameCount = 0;
-            prevPC = cpu.PC;
+    // Execute until max cycles, a jump-to-self trap, an unimplemented opcode or a host-call exit
+    CPU::StopReason reason = CPU::StopReason::Budget;
+    std::unique_ptr<ProfilingCPU> profiler;
+    if (profile) {
+        // The same run on the profiling core, whose results stand in for cpu's
+        profiler.reset(new ProfilingCPU(&mem));
+        copySetup(cpu, *profiler);
+        if (!chromeFile.empty())
+            profiler->hooks.eventLimit = chromeFrameLimit;
+        if (static_cast<unsigned long long>(profiler->cycles) < maxCycles) {
+            reason = profiler->run(maxCycles - profiler->cycles);
         }
+        profiler->hooks.finish(profiler->cycles);
+        cpu.PC = profiler->PC;
+        cpu.cycles = profiler->cycles;
+    } else if (static_cast<unsigned long long>(cpu.cycles) < maxCycles) {
+        reason = cpu.run(maxCycles - cpu.cycles);
+    }
+    
+    if (reason == CPU::StopReason::Trap) {
+        std::cout << "\nInfinite loop detected at PC=0x" << std::hex << cpu.PC << std::dec << std::endl;
+    } else if (reason == CPU::StopReason::Exit) {
+        std::cout << "\nProgram exited through a host call at PC=0x" << std::hex << (cpu.PC - 1) << std::dec << std::endl;
+    } else if (reason == CPU::StopReason::Halt) {
+        std::cout << "\nUnimplemented opcode 0x" << std::hex << static_cast<int>(mem.read(cpu.PC))
+                  << " at PC=0x" << cpu.PC << std::dec << std::endl;
     }
     
     auto endTime = std::chrono::high_resolution_clock::now();
@@ -141,5 +506,38 @@ int main(int argc, char* argv[]) {
     std::cout << "  Final PC: 0x" << std::hex << cpu.PC << std::dec << std::endl;
     std::cout << "  Time: " << duration.count() << " ms" << std::endl;
     
+    if (profiler) {
+        std::map<Word, std::string> labels;
+        if (!labelFile.empty()) {
+            std::ifstream listing(labelFile);
+            if (!listing) {
+                std::cerr << "Error: Could not open listing " << labelFile << std::endl;
+                return 1;
+            }
+            labels = readListingLabels(listing);
+        }
+        const std::map<Word, std::string> * named = labels.empty() ? nullptr : &labels;
+        std::cout << "\nProfile: ";
+        writeProfile(std::cout, profiler->hooks, named);
+        if (!foldedFile.empty()) {
+            std::ofstream folded(foldedFile);
+            writeFoldedStacks(folded, profiler->hooks, named);
+            if (!folded) {
+                std::cerr << "Error: Could not write " << foldedFile << std::endl;
+                return 1;
+            }
+        }
+        if (!chromeFile.empty()) {
+            std::ofstream chrome(chromeFile);
+            writeChromeTrace(chrome, profiler->hooks, named);
+            if (!chrome) {
+                std::cerr << "Error: Could not write " << chromeFile << std::endl;
+                return 1;
+            }
+            if (profiler->hooks.eventsTruncated())
+                std::cout << "\nChrome trace holds the first " << chromeFrameLimit << " calls only" << std::endl;
+        }
+    }
+    
     return 0;
 }
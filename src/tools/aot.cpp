@@ -0,0 +1,571 @@
+#include "memory.h"
+#include "cycles.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <initializer_list>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// 6502_aot: ahead-of-time recompiler for CPU::Engine::Aot.
+//
+// Loads a binary image, follows control flow from the given entry points (and
+// the reset, NMI and IRQ vectors when the image covers them) and writes a C++
+// translation unit with one basic block per label. Jump and branch targets,
+// fall-through paths and the return addresses of JSR and BRK start new
+// blocks. Targets only known at run time (RTS, RTI, JMP (ind), BRK) go
+// through a switch over the block starts; anything else falls back to the
+// interpreter. The output only depends on src/core/aot.h and alu.h.
+
+namespace {
+
+enum class Mode { Imp, Imm, Zp, Zpx, Zpy, Abs, Absx, Absy, Ix, Iy, Rel };
+
+enum class Flow {
+    Next,       // falls through to the next instruction
+    Branch,
+    Jump,       // JMP abs
+    JumpInd,    // JMP (ind)
+    Call,       // JSR
+    Return,     // RTS, RTI
+    Break       // BRK
+};
+
+struct OpInfo {
+    const char * name = nullptr;    // null for unimplemented opcodes
+    Mode mode = Mode::Imp;
+    Flow flow = Flow::Next;
+    const char * body = "";         // C++ statements, EA stands for the effective address
+    bool writes = false;
+};
+
+Byte modeBytes(Mode mode) {
+    switch (mode) {
+    case Mode::Imp: return 1;
+    case Mode::Abs: case Mode::Absx: case Mode::Absy: return 3;
+    default: return 2;
+    }
+}
+
+struct OpTable {
+    OpInfo ops[256];
+
+    void read(Byte opcode, const char * name, Mode mode, const char * body) { ops[opcode] = { name, mode, Flow::Next, body, false }; }
+    void write(Byte opcode, const char * name, Mode mode, const char * body) { ops[opcode] = { name, mode, Flow::Next, body, true }; }
+    void rmw(Byte opcode, const char * name, Mode mode, const char * body) { ops[opcode] = { name, mode, Flow::Next, body, true }; }
+    void op(Byte opcode, const char * name, const char * body, bool writes = false) { ops[opcode] = { name, Mode::Imp, Flow::Next, body, writes }; }
+    void branch(Byte opcode, const char * name, const char * cond) { ops[opcode] = { name, Mode::Rel, Flow::Branch, cond, false }; }
+    void flow(Byte opcode, const char * name, Mode mode, Flow flow, bool writes = false) { ops[opcode] = { name, mode, flow, "", writes }; }
+
+    void reads(const char * name, const char * body, std::initializer_list<std::pair<Byte, Mode>> opcodes) {
+        for (auto & entry : opcodes) read(entry.first, name, entry.second, body);
+    }
+    void writes(const char * name, const char * body, std::initializer_list<std::pair<Byte, Mode>> opcodes) {
+        for (auto & entry : opcodes) write(entry.first, name, entry.second, body);
+    }
+    void rmws(const char * name, const char * body, std::initializer_list<std::pair<Byte, Mode>> opcodes) {
+        for (auto & entry : opcodes) rmw(entry.first, name, entry.second, body);
+    }
+
+    OpTable() {
+        reads("LDA", "a = m.read(EA); f.n = f.z = a;", { {0xA9, Mode::Imm}, {0xA5, Mode::Zp}, {0xB5, Mode::Zpx}, {0xAD, Mode::Abs}, {0xBD, Mode::Absx}, {0xB9, Mode::Absy}, {0xA1, Mode::Ix}, {0xB1, Mode::Iy} });
+        reads("LDX", "x = m.read(EA); f.n = f.z = x;", { {0xA2, Mode::Imm}, {0xA6, Mode::Zp}, {0xB6, Mode::Zpy}, {0xAE, Mode::Abs}, {0xBE, Mode::Absy} });
+        reads("LDY", "y = m.read(EA); f.n = f.z = y;", { {0xA0, Mode::Imm}, {0xA4, Mode::Zp}, {0xB4, Mode::Zpx}, {0xAC, Mode::Abs}, {0xBC, Mode::Absx} });
+
+        writes("STA", "m.write(EA, a);", { {0x85, Mode::Zp}, {0x95, Mode::Zpx}, {0x8D, Mode::Abs}, {0x9D, Mode::Absx}, {0x99, Mode::Absy}, {0x81, Mode::Ix}, {0x91, Mode::Iy} });
+        writes("STX", "m.write(EA, x);", { {0x86, Mode::Zp}, {0x96, Mode::Zpy}, {0x8E, Mode::Abs} });
+        writes("STY", "m.write(EA, y);", { {0x84, Mode::Zp}, {0x94, Mode::Zpx}, {0x8C, Mode::Abs} });
+
+        reads("ADC", "adc(a, f, m.read(EA));", { {0x69, Mode::Imm}, {0x65, Mode::Zp}, {0x75, Mode::Zpx}, {0x6D, Mode::Abs}, {0x7D, Mode::Absx}, {0x79, Mode::Absy}, {0x61, Mode::Ix}, {0x71, Mode::Iy} });
+        reads("SBC", "sbc(a, f, m.read(EA));", { {0xE9, Mode::Imm}, {0xE5, Mode::Zp}, {0xF5, Mode::Zpx}, {0xED, Mode::Abs}, {0xFD, Mode::Absx}, {0xF9, Mode::Absy}, {0xE1, Mode::Ix}, {0xF1, Mode::Iy} });
+        reads("AND", "a &= m.read(EA); f.n = f.z = a;", { {0x29, Mode::Imm}, {0x25, Mode::Zp}, {0x35, Mode::Zpx}, {0x2D, Mode::Abs}, {0x3D, Mode::Absx}, {0x39, Mode::Absy}, {0x21, Mode::Ix}, {0x31, Mode::Iy} });
+        reads("ORA", "a |= m.read(EA); f.n = f.z = a;", { {0x09, Mode::Imm}, {0x05, Mode::Zp}, {0x15, Mode::Zpx}, {0x0D, Mode::Abs}, {0x1D, Mode::Absx}, {0x19, Mode::Absy}, {0x01, Mode::Ix}, {0x11, Mode::Iy} });
+        reads("EOR", "a ^= m.read(EA); f.n = f.z = a;", { {0x49, Mode::Imm}, {0x45, Mode::Zp}, {0x55, Mode::Zpx}, {0x4D, Mode::Abs}, {0x5D, Mode::Absx}, {0x59, Mode::Absy}, {0x41, Mode::Ix}, {0x51, Mode::Iy} });
+        reads("CMP", "compare(f, a, m.read(EA));", { {0xC9, Mode::Imm}, {0xC5, Mode::Zp}, {0xD5, Mode::Zpx}, {0xCD, Mode::Abs}, {0xDD, Mode::Absx}, {0xD9, Mode::Absy}, {0xC1, Mode::Ix}, {0xD1, Mode::Iy} });
+        reads("CPX", "compare(f, x, m.read(EA));", { {0xE0, Mode::Imm}, {0xE4, Mode::Zp}, {0xEC, Mode::Abs} });
+        reads("CPY", "compare(f, y, m.read(EA));", { {0xC0, Mode::Imm}, {0xC4, Mode::Zp}, {0xCC, Mode::Abs} });
+        reads("BIT", "Byte v = m.read(EA); f.n = v; f.z = a & v; f.v = v & 0x40;", { {0x24, Mode::Zp}, {0x2C, Mode::Abs} });
+
+        rmws("INC", "Word ea = EA; Byte v = m.read(ea) + 1; m.write(ea, v); f.n = f.z = v;", { {0xE6, Mode::Zp}, {0xF6, Mode::Zpx}, {0xEE, Mode::Abs}, {0xFE, Mode::Absx} });
+        rmws("DEC", "Word ea = EA; Byte v = m.read(ea) - 1; m.write(ea, v); f.n = f.z = v;", { {0xC6, Mode::Zp}, {0xD6, Mode::Zpx}, {0xCE, Mode::Abs}, {0xDE, Mode::Absx} });
+        rmws("ASL", "Word ea = EA; m.write(ea, asl(f, m.read(ea)));", { {0x06, Mode::Zp}, {0x16, Mode::Zpx}, {0x0E, Mode::Abs}, {0x1E, Mode::Absx} });
+        rmws("LSR", "Word ea = EA; m.write(ea, lsr(f, m.read(ea)));", { {0x46, Mode::Zp}, {0x56, Mode::Zpx}, {0x4E, Mode::Abs}, {0x5E, Mode::Absx} });
+        rmws("ROL", "Word ea = EA; m.write(ea, rol(f, m.read(ea)));", { {0x26, Mode::Zp}, {0x36, Mode::Zpx}, {0x2E, Mode::Abs}, {0x3E, Mode::Absx} });
+        rmws("ROR", "Word ea = EA; m.write(ea, ror(f, m.read(ea)));", { {0x66, Mode::Zp}, {0x76, Mode::Zpx}, {0x6E, Mode::Abs}, {0x7E, Mode::Absx} });
+        op(0x0A, "ASL", "a = asl(f, a);");
+        op(0x4A, "LSR", "a = lsr(f, a);");
+        op(0x2A, "ROL", "a = rol(f, a);");
+        op(0x6A, "ROR", "a = ror(f, a);");
+
+        op(0xE8, "INX", "x++; f.n = f.z = x;");
+        op(0xC8, "INY", "y++; f.n = f.z = y;");
+        op(0xCA, "DEX", "x--; f.n = f.z = x;");
+        op(0x88, "DEY", "y--; f.n = f.z = y;");
+        op(0xAA, "TAX", "x = a; f.n = f.z = x;");
+        op(0xA8, "TAY", "y = a; f.n = f.z = y;");
+        op(0x8A, "TXA", "a = x; f.n = f.z = a;");
+        op(0x98, "TYA", "a = y; f.n = f.z = a;");
+        op(0xBA, "TSX", "x = sp; f.n = f.z = x;");
+        op(0x9A, "TXS", "sp = x;");
+        op(0x48, "PHA", "m.write(0x100 + sp--, a);", true);
+        op(0x08, "PHP", "m.write(0x100 + sp--, packFlags(f) | 0x30);", true);
+        op(0x68, "PLA", "a = m.read(0x100 + ++sp); f.n = f.z = a;");
+        op(0x28, "PLP", "f = unpackFlags(m.read(0x100 + ++sp));");
+        op(0x18, "CLC", "f.c = 0;");
+        op(0x38, "SEC", "f.c = 1;");
+        op(0x58, "CLI", "f.idb &= ~0x04;");
+        op(0x78, "SEI", "f.idb |= 0x04;");
+        op(0xB8, "CLV", "f.v = 0;");
+        op(0xD8, "CLD", "f.idb &= ~0x08;");
+        op(0xF8, "SED", "f.idb |= 0x08;");
+        op(0xEA, "NOP", "");
+
+        branch(0x10, "BPL", "!(f.n & 0x80)");
+        branch(0x30, "BMI", "f.n & 0x80");
+        branch(0x50, "BVC", "!f.v");
+        branch(0x70, "BVS", "f.v");
+        branch(0x90, "BCC", "!f.c");
+        branch(0xB0, "BCS", "f.c");
+        branch(0xD0, "BNE", "f.z");
+        branch(0xF0, "BEQ", "!f.z");
+
+        flow(0x4C, "JMP", Mode::Abs, Flow::Jump);
+        flow(0x6C, "JMP", Mode::Abs, Flow::JumpInd);
+        flow(0x20, "JSR", Mode::Abs, Flow::Call, true);
+        flow(0x60, "RTS", Mode::Imp, Flow::Return);
+        flow(0x40, "RTI", Mode::Imp, Flow::Return);
+        flow(0x00, "BRK", Mode::Zp, Flow::Break, true);   // two bytes, the second is skipped
+    }
+};
+
+const OpTable opTable;
+
+struct Image {
+    std::vector<Byte> bytes;
+    Word load = 0;
+
+    bool contains(Word addr, unsigned length = 1) const {
+        return addr >= load && size_t(addr - load) + length <= bytes.size();
+    }
+    Byte at(Word addr) const { return bytes[addr - load]; }
+    Word at16(Word addr) const { return at(addr) | (at(addr + 1) << 8); }
+};
+
+struct Instruction {
+    Word pc;
+    Byte opcode;
+    const OpInfo * info;
+    Word operand;   // effective static operand: address, zero page byte or branch target
+    Word next;
+};
+
+struct BasicBlock {
+    Word start;
+    std::vector<Instruction> ops;
+    Word length = 0;
+    unsigned maxCycles = 0;
+};
+
+// Decodes the instruction at pc, or returns false if the image does not hold
+// a whole implemented instruction there
+bool decode(const Image & image, Word pc, Instruction & op) {
+    if (!image.contains(pc))
+        return false;
+    op.pc = pc;
+    op.opcode = image.at(pc);
+    op.info = &opTable.ops[op.opcode];
+    if (!op.info->name)
+        return false;
+    Byte bytes = modeBytes(op.info->mode);
+    if (!image.contains(pc, bytes))
+        return false;
+    op.next = pc + bytes;
+    if (op.info->mode == Mode::Rel)
+        op.operand = op.next + static_cast<signed char>(image.at(pc + 1));
+    else if (bytes == 3)
+        op.operand = image.at16(pc + 1);
+    else if (bytes == 2)
+        op.operand = image.at(pc + 1);
+    else
+        op.operand = 0;
+    return true;
+}
+
+// Follows every statically known successor from the entry points and returns
+// the set of addresses that start a basic block
+std::set<Word> findLeaders(const Image & image, const std::vector<Word> & entries) {
+    std::set<Word> leaders;
+    std::set<Word> visited;
+    std::vector<Word> work(entries.begin(), entries.end());
+    for (Word entry : entries)
+        leaders.insert(entry);
+
+    while (!work.empty()) {
+        Word pc = work.back();
+        work.pop_back();
+        while (visited.insert(pc).second) {
+            Instruction op;
+            if (!decode(image, pc, op))
+                break;
+            Flow flow = op.info->flow;
+            if (flow == Flow::Branch || flow == Flow::Jump || flow == Flow::Call) {
+                leaders.insert(op.operand);
+                work.push_back(op.operand);
+            }
+            if (flow == Flow::JumpInd && image.contains(op.operand, 2)) {
+                // Guess the pointer keeps its value in the image. The jump
+                // still goes wherever it points at run time.
+                Word target = image.at16(op.operand);
+                leaders.insert(target);
+                work.push_back(target);
+            }
+            if (flow == Flow::Branch || flow == Flow::Call || flow == Flow::Break) {
+                // Not taken, or back from the subroutine or interrupt handler
+                leaders.insert(op.next);
+                work.push_back(op.next);
+            }
+            if (flow != Flow::Next)
+                break;
+            pc = op.next;
+        }
+    }
+    return leaders;
+}
+
+std::vector<BasicBlock> buildBlocks(const Image & image, const std::set<Word> & leaders) {
+    std::vector<BasicBlock> blocks;
+    for (Word start : leaders) {
+        BasicBlock block;
+        block.start = start;
+        Word pc = start;
+        Instruction op;
+        while (decode(image, pc, op)) {
+            block.ops.push_back(op);
+            block.maxCycles += opcodeCycles[op.opcode] + maxPenaltyCycles;
+            pc = op.next;
+            if (op.info->flow != Flow::Next || leaders.count(pc))
+                break;
+        }
+        if (block.ops.empty())
+            continue;
+        block.length = pc - start;
+        blocks.push_back(block);
+    }
+    return blocks;
+}
+
+std::string hex(unsigned value, int digits) {
+    char text[16];
+    std::snprintf(text, sizeof(text), "0x%0*X", digits, value);
+    return text;
+}
+
+std::string label(Word pc) {
+    char text[16];
+    std::snprintf(text, sizeof(text), "b_%04X", pc);
+    return text;
+}
+
+std::string effectiveAddress(const Instruction & op) {
+    std::string operand = hex(op.operand, op.info->mode == Mode::Abs || op.info->mode == Mode::Absx || op.info->mode == Mode::Absy ? 4 : 2);
+    switch (op.info->mode) {
+    case Mode::Imm:  return "Word(" + hex(Word(op.pc + 1), 4) + ")";
+    case Mode::Zp:   return "Word(" + operand + ")";
+    case Mode::Zpx:  return "Word(Byte(" + operand + " + x))";
+    case Mode::Zpy:  return "Word(Byte(" + operand + " + y))";
+    case Mode::Abs:  return "Word(" + operand + ")";
+    case Mode::Absx: return "aotAbsoluteIndexed(" + operand + ", x, cyc)";
+    case Mode::Absy: return "aotAbsoluteIndexed(" + operand + ", y, cyc)";
+    case Mode::Ix:   return "aotIndexedIndirect(m, " + operand + ", x)";
+    case Mode::Iy:   return "aotIndirectIndexed(m, " + operand + ", y, cyc)";
+    default:         return "";
+    }
+}
+
+std::string replaceAll(std::string text, const std::string & from, const std::string & to) {
+    for (size_t at = text.find(from); at != std::string::npos; at = text.find(from, at + to.size()))
+        text.replace(at, from.size(), to);
+    return text;
+}
+
+class Emitter
+{
+public:
+    Emitter(const std::vector<BasicBlock> & _blocks): blocks(_blocks) {
+        for (size_t i = 0; i < blocks.size(); i++)
+            index[blocks[i].start] = i;
+    }
+
+    std::string goTo(Word pc) const {
+        auto target = index.find(pc);
+        if (target != index.end() && target->second / FunctionBlocks == current)
+            return "goto " + label(pc) + ";";
+        return "{ pc = " + hex(pc, 4) + "; goto leave; }";
+    }
+
+    // Leaves to the engine loop when a store just rewrote compiled code
+    std::string dirtyCheck(const std::string & pc) const {
+        return " if (m.codeDirty) { pc = " + pc + "; goto leave; }";
+    }
+
+    void instruction(std::ostream & out, const Instruction & op, bool last) const {
+        const OpInfo & info = *op.info;
+        out << "    /* " << hex(op.pc, 4).substr(2) << " " << info.name << " */ ";
+        std::string self = hex(op.pc, 4);
+        std::string next = hex(op.next, 4);
+        switch (info.flow) {
+        case Flow::Next:
+            out << "{ " << (info.body[0] ? replaceAll(info.body, "EA", effectiveAddress(op)) + " " : "")
+                << "cyc += " << int(opcodeCycles[op.opcode]) << "; }";
+            if (info.writes)
+                out << dirtyCheck(next);
+            if (last)
+                out << "\n    " << goTo(op.next);
+            break;
+        case Flow::Branch: {
+            out << "cyc += " << int(opcodeCycles[op.opcode]) << "; if (" << info.body << ") { cyc += "
+                << branchTakenPenalty(op.next, op.operand) << "; ";
+            if (op.operand == op.pc)
+                out << "pc = " << self << "; stop = CPU::StopReason::Trap; goto leave; }";
+            else
+                out << goTo(op.operand) << " }";
+            out << "\n    " << goTo(op.next);
+            break;
+        }
+        case Flow::Jump:
+            out << "cyc += " << int(opcodeCycles[op.opcode]) << "; ";
+            if (op.operand == op.pc)
+                out << "pc = " << self << "; stop = CPU::StopReason::Trap; goto leave;";
+            else
+                out << goTo(op.operand);
+            break;
+        case Flow::JumpInd:
+            out << "pc = m.read16(" << hex(op.operand, 4) << "); cyc += " << int(opcodeCycles[op.opcode]) << "; "
+                << "if (pc == " << self << ") { stop = CPU::StopReason::Trap; goto leave; } goto next;";
+            break;
+        case Flow::Call:
+            out << "m.write(0x100 + sp--, " << hex(Word(op.pc + 2) >> 8, 2) << "); "
+                << "m.write(0x100 + sp--, " << hex(Word(op.pc + 2) & 0xFF, 2) << "); cyc += " << int(opcodeCycles[op.opcode]) << ";"
+                << dirtyCheck(hex(op.operand, 4)) << " " << goTo(op.operand);
+            break;
+        case Flow::Return:
+            if (op.opcode == 0x60)
+                out << "{ Byte lo = m.read(0x100 + ++sp); Byte hi = m.read(0x100 + ++sp); pc = ((hi << 8) | lo) + 1; cyc += " << int(opcodeCycles[op.opcode]) << "; } goto next;";
+            else
+                out << "{ f = unpackFlags(m.read(0x100 + ++sp)); Byte lo = m.read(0x100 + ++sp); Byte hi = m.read(0x100 + ++sp); pc = (hi << 8) | lo; cyc += " << int(opcodeCycles[op.opcode]) << "; } goto next;";
+            break;
+        case Flow::Break:
+            out << "m.write(0x100 + sp--, " << hex(Word(op.pc + 2) >> 8, 2) << "); "
+                << "m.write(0x100 + sp--, " << hex(Word(op.pc + 2) & 0xFF, 2) << "); "
+                << "m.write(0x100 + sp--, packFlags(f) | 0x30); pc = m.read16(0xFFFE); f.idb |= 0x04;"
+                << " if (m.codeDirty) goto leave; goto next;";
+            break;
+        }
+        out << "\n";
+    }
+
+    // Blocks [first, first + FunctionBlocks) as one function. Keeping functions
+    // small keeps the host compiler fast; leaving one costs a trip through runAot().
+    void function(std::ostream & out, size_t number) {
+        size_t first = number * FunctionBlocks;
+        size_t last = std::min(first + FunctionBlocks, blocks.size());
+        current = number;
+
+        std::ostringstream body;
+        for (size_t i = first; i < last; i++) {
+            const BasicBlock & block = blocks[i];
+            body << "\n" << label(block.start) << ":\n"
+                 << "    if (!valid[" << i << "] || cyc + " << block.maxCycles << " > limit) { pc = "
+                 << hex(block.start, 4) << "; goto leave; }\n";
+            for (size_t k = 0; k < block.ops.size(); k++)
+                instruction(body, block.ops[k], k + 1 == block.ops.size());
+        }
+
+        out << "\nvoid run" << number << "(BlockState & s, const Byte * valid)\n"
+            << "{\n"
+            << "    Memory & m = *s.m;\n"
+            << "    Word pc = s.pc;\n"
+            << "    Byte a = s.a, x = s.x, y = s.y, sp = s.sp;\n"
+            << "    Flags f = s.f;\n"
+            << "    long long cyc = s.cyc;\n"
+            << "    const long long limit = s.limit;\n"
+            << "    CPU::StopReason stop = CPU::StopReason::Budget;\n\n";
+        // Entry, and targets only known at run time
+        if (body.str().find("goto next;") != std::string::npos)
+            out << "next:\n";
+        out << "    switch (pc) {\n";
+        for (size_t i = first; i < last; i++)
+            out << "    case " << hex(blocks[i].start, 4) << ": goto " << label(blocks[i].start) << ";\n";
+        out << "    default: goto leave;\n"
+            << "    }\n"
+            << body.str()
+            << "\nleave:\n"
+            << "    s.pc = pc;\n"
+            << "    s.a = a;\n"
+            << "    s.x = x;\n"
+            << "    s.y = y;\n"
+            << "    s.sp = sp;\n"
+            << "    s.f = f;\n"
+            << "    s.cyc = cyc;\n"
+            << "    s.stop = stop;\n"
+            << "}\n";
+    }
+
+    void write(std::ostream & out, const std::string & name, const Image & image) {
+        out << "// Generated by 6502_aot from a " << image.bytes.size() << " byte image loaded at "
+            << hex(image.load, 4) << ". Do not edit.\n\n"
+            << "#include \"aot.h\"\n\n"
+            << "namespace {\n\n";
+
+        size_t functions = (blocks.size() + FunctionBlocks - 1) / FunctionBlocks;
+        for (size_t i = 0; i < functions; i++)
+            out << "void run" << i << "(BlockState & s, const Byte * valid);\n";
+        out << "\n";
+
+        // Bytes each block was compiled from, and the immediate operands left out of the check
+        std::vector<Byte> code;
+        std::set<Word> immediates, fixed;
+        out << "const AotBlock blocks[] = {\n";
+        for (size_t i = 0; i < blocks.size(); i++) {
+            const BasicBlock & block = blocks[i];
+            out << "    { " << hex(block.start, 4) << ", " << block.length << ", " << block.maxCycles << ", "
+                << code.size() << ", &run" << i / FunctionBlocks << " },\n";
+            for (Word k = 0; k < block.length; k++)
+                code.push_back(image.at(block.start + k));
+            for (const Instruction & op : block.ops) {
+                for (Word addr = op.pc; addr != op.next; addr++) {
+                    if (op.info->mode == Mode::Imm && addr == Word(op.pc + 1))
+                        immediates.insert(addr);
+                    else
+                        fixed.insert(addr);
+                }
+            }
+        }
+        out << "};\n\n";
+
+        out << "const Byte code[] = {";
+        for (size_t i = 0; i < code.size(); i++)
+            out << (i % 16 ? " " : "\n    ") << hex(code[i], 2) << ",";
+        out << "\n};\n\n";
+
+        out << "const Word immediates[] = {";
+        size_t immediateCount = 0;
+        for (Word addr : immediates) {
+            // A byte that is also compiled in as an opcode or address must stay checked
+            if (fixed.count(addr))
+                continue;
+            out << (immediateCount++ % 8 ? " " : "\n    ") << hex(addr, 4) << ",";
+        }
+        if (!immediateCount)
+            out << "\n    0,";
+        out << "\n};\n";
+
+        for (size_t i = 0; i < functions; i++)
+            function(out, i);
+
+        out << "\nconst AotProgram program = { \"" << name << "\", blocks, " << blocks.size()
+            << ", code, immediates, " << immediateCount << " };\n"
+            << "const AotRegistration registration(program);\n\n"
+            << "}\n";
+    }
+
+private:
+    static const size_t FunctionBlocks = 128;
+
+    const std::vector<BasicBlock> & blocks;
+    std::map<Word, size_t> index;
+    size_t current = 0;     // function being written
+};
+
+void printUsage(const char * progName) {
+    std::cout << "Usage: " << progName << " [options]\n"
+              << "Options:\n"
+              << "  -f <file>       Binary image to recompile\n"
+              << "  -a <address>    Address the image is loaded at (default: 0x0000, hex format)\n"
+              << "  -e <address>    Entry point (hex format, repeatable; vectors in the image are added)\n"
+              << "  -n <name>       Program name, as selected with 6502_emu -aot (default: aot)\n"
+              << "  -o <file>       Output C++ file (default: standard output)\n"
+              << "  -h              Show this help message\n";
+}
+
+}
+
+int main(int argc, char * argv[]) {
+    std::string inputFile, outputFile, name = "aot";
+    Image image;
+    std::vector<Word> entries;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            printUsage(argv[0]);
+            return 0;
+        } else if (arg == "-f" && i + 1 < argc) {
+            inputFile = argv[++i];
+        } else if (arg == "-a" && i + 1 < argc) {
+            image.load = static_cast<Word>(std::stoul(argv[++i], nullptr, 16));
+        } else if (arg == "-e" && i + 1 < argc) {
+            entries.push_back(static_cast<Word>(std::stoul(argv[++i], nullptr, 16)));
+        } else if (arg == "-n" && i + 1 < argc) {
+            name = argv[++i];
+        } else if (arg == "-o" && i + 1 < argc) {
+            outputFile = argv[++i];
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (inputFile.empty()) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    std::ifstream file(inputFile, std::ios::binary);
+    if (!file) {
+        std::cerr << "Error: Could not open file " << inputFile << std::endl;
+        return 1;
+    }
+    image.bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    if (size_t(image.load) + image.bytes.size() > size_t(MEMORY_SIZE)) {
+        std::cerr << "Error: Binary " << inputFile << " does not fit in memory at 0x"
+                  << std::hex << image.load << std::dec << std::endl;
+        return 1;
+    }
+
+    for (Word vector : { Word(0xFFFA), Word(0xFFFC), Word(0xFFFE) })
+        if (image.contains(vector, 2))
+            entries.push_back(image.at16(vector));
+    if (entries.empty()) {
+        std::cerr << "Error: No entry points given and the image holds no vectors" << std::endl;
+        return 1;
+    }
+
+    std::vector<BasicBlock> blocks = buildBlocks(image, findLeaders(image, entries));
+    if (blocks.empty()) {
+        std::cerr << "Error: No code found at the entry points" << std::endl;
+        return 1;
+    }
+    Emitter emitter(blocks);
+
+    if (outputFile.empty()) {
+        emitter.write(std::cout, name, image);
+    } else {
+        std::ofstream out(outputFile);
+        emitter.write(out, name, image);
+        if (!out) {
+            std::cerr << "Error: Could not write " << outputFile << std::endl;
+            return 1;
+        }
+    }
+    std::cerr << blocks.size() << " blocks from " << entries.size() << " entry points" << std::endl;
+    return 0;
+}
@@ -0,0 +1,124 @@
+#include "memory.h"
+#include "cpu.h"
+#include "blockcache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// 6502_pairs: opcode-pair profile for tuning the block engine's fusion set.
+//
+// Runs a binary image on TracingCPU and counts each pair of opcodes executed
+// back to back, then prints the most frequent pairs with their share of all
+// pairs and whether the block engine fuses them (see FusionTable in
+// src/core/blockcache.cpp). A pair across a jump or a taken branch is
+// counted too, but only straight-line pairs can be fused.
+
+namespace {
+
+void printUsage(const char * progName) {
+    std::cout << "Usage: " << progName << " [options]\n"
+              << "Options:\n"
+              << "  -f <file>       Binary image to run\n"
+              << "  -a <address>    Address the image is loaded at (default: 0x0000, hex format)\n"
+              << "  -pc <address>   Program counter to start at (default: the load address, hex format)\n"
+              << "  -m <cycles>     Maximum cycles to execute (default: 100000000)\n"
+              << "  -n <count>      Number of pairs to report (default: 20)\n"
+              << "  -h              Show this help message\n";
+}
+
+}
+
+int main(int argc, char * argv[]) {
+    std::string inputFile;
+    Word loadAddr = 0x0000;
+    Word programCounter = 0;
+    bool hasCustomPC = false;
+    unsigned long long maxCycles = 100000000;
+    size_t top = 20;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            printUsage(argv[0]);
+            return 0;
+        } else if (arg == "-f" && i + 1 < argc) {
+            inputFile = argv[++i];
+        } else if (arg == "-a" && i + 1 < argc) {
+            loadAddr = static_cast<Word>(std::stoul(argv[++i], nullptr, 16));
+        } else if (arg == "-pc" && i + 1 < argc) {
+            programCounter = static_cast<Word>(std::stoul(argv[++i], nullptr, 16));
+            hasCustomPC = true;
+        } else if (arg == "-m" && i + 1 < argc) {
+            maxCycles = std::stoull(argv[++i], nullptr, 0);
+        } else if (arg == "-n" && i + 1 < argc) {
+            top = std::stoul(argv[++i]);
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (inputFile.empty()) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    std::ifstream file(inputFile, std::ios::binary);
+    if (!file) {
+        std::cerr << "Error: Could not open file " << inputFile << std::endl;
+        return 1;
+    }
+    std::vector<Byte> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (size_t(loadAddr) + bytes.size() > size_t(MEMORY_SIZE)) {
+        std::cerr << "Error: Binary " << inputFile << " does not fit in memory at 0x"
+                  << std::hex << loadAddr << std::dec << std::endl;
+        return 1;
+    }
+
+    Memory mem;
+    mem.writeBlock(loadAddr, bytes.data(), bytes.size());
+    TracingCPU cpu(&mem);
+    cpu.reset();
+    cpu.PC = hasCustomPC ? programCounter : loadAddr;
+
+    // counts[first << 8 | second]
+    std::vector<unsigned long long> counts(0x10000);
+    int previous = -1;
+    cpu.hooks.onInstruction = [&](const CPUTrace & trace) {
+        Byte opcode = mem.mem[trace.pc];
+        if (previous >= 0)
+            counts[(previous << 8) | opcode]++;
+        previous = opcode;
+    };
+
+    CPU::StopReason reason = CPU::StopReason::Budget;
+    if (static_cast<unsigned long long>(cpu.cycles) < maxCycles)
+        reason = cpu.run(maxCycles - cpu.cycles);
+
+    std::vector<int> order;
+    unsigned long long total = 0;
+    for (int pair = 0; pair < 0x10000; pair++) {
+        total += counts[pair];
+        if (counts[pair])
+            order.push_back(pair);
+    }
+    std::sort(order.begin(), order.end(), [&](int l, int r) { return counts[l] > counts[r] || (counts[l] == counts[r] && l < r); });
+    if (order.size() > top)
+        order.resize(top);
+
+    std::cout << total << " pairs in " << static_cast<unsigned long long>(cpu.cycles) << " cycles, stopped at PC=0x"
+              << std::hex << cpu.PC << std::dec << (reason == CPU::StopReason::Budget ? " (budget)" : "") << std::endl;
+    std::cout << "pair       count      share  fused" << std::endl;
+    for (int pair : order) {
+        char line[64];
+        std::snprintf(line, sizeof(line), "%02X %02X %12llu %8.2f%%  %s", pair >> 8, pair & 0xFF, counts[pair],
+                      100.0 * counts[pair] / total, fusesPair(pair >> 8, pair & 0xFF) ? "yes" : "no");
+        std::cout << line << std::endl;
+    }
+    return 0;
+}
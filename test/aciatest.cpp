@@ -0,0 +1,235 @@
+#include <gtest/gtest.h>
+#include "cpu.h"
+#include "memory.h"
+#include "acia.h"
+#include "ringbuffer.h"
+#include "serial.h"
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <cstring>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+// Checks the lock-free ring across two threads, the 6551 ACIA's baud-rate
+// pacing and interrupts against cycle counts, and a MappedCPU guest echoing
+// bytes through a HostSerial over pipes and a Unix socket.
+
+class AciaTest : public ::testing::Test {
+protected:
+    Memory mem;
+    MappedCPU cpu;
+    Acia6551 acia;
+
+    AciaTest() : mem(), cpu(&mem), acia(cpu) {
+        cpu.cycles = 0;
+        // 9600 baud, 8 data bits, 1 stop bit: 10 bits of 1e6 / 9600 cycles
+        acia.write(Acia6551::Control, 0x1E);
+    }
+    ~AciaTest(){};
+
+    void at(long long cycle) { cpu.cycles = cycle; }
+
+    // Polls RDRF and sends every byte back, at $D000
+    void loadEcho() {
+        // LDA #$1E / STA CTRL / LDA #$0B / STA CMD
+        // loop: LDA STATUS / AND #$08 / BEQ loop / LDA DATA / STA DATA / JMP loop
+        const std::vector<Byte> program = { 0xA9, 0x1E, 0x8D, 0x03, 0xD0, 0xA9, 0x0B, 0x8D, 0x02, 0xD0,
+                                            0xAD, 0x01, 0xD0, 0x29, 0x08, 0xF0, 0xF9,
+                                            0xAD, 0x00, 0xD0, 0x8D, 0x00, 0xD0, 0x4C, 0x0A, 0x02 };
+        mem.writeBlock(0x0200, program.data(), program.size());
+        acia.map(mem, 0xD0);
+        cpu.PC = 0x0200;
+    }
+
+    // Runs the guest until n bytes come back on fd, or a few seconds pass
+    std::string runUntil(int fd, size_t n) {
+        std::string got;
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (got.size() < n && std::chrono::steady_clock::now() < deadline) {
+            cpu.run(100000);
+            char buffer[64];
+            ssize_t r = read(fd, buffer, sizeof(buffer));
+            if (r > 0)
+                got.append(buffer, r);
+            else
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return got;
+    }
+};
+
+TEST_F(AciaTest, ring) {
+    SpscRing<int, 8> ring;
+    int value;
+    EXPECT_FALSE(ring.pop(value));
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < 8; i++)
+            EXPECT_TRUE(ring.push(round * 8 + i));
+        EXPECT_FALSE(ring.push(99));
+        EXPECT_EQ(8u, ring.size());
+        for (int i = 0; i < 8; i++) {
+            EXPECT_TRUE(ring.pop(value));
+            EXPECT_EQ(round * 8 + i, value);
+        }
+        EXPECT_TRUE(ring.empty());
+    }
+}
+
+TEST_F(AciaTest, ringAcrossThreads) {
+    static SpscRing<unsigned, 64> ring;
+    const unsigned count = 200000;
+    // Yielding when stuck, so that one core is enough
+    std::thread producer([&]() {
+        for (unsigned i = 0; i < count; ) {
+            if (ring.push(i))
+                i++;
+            else
+                std::this_thread::yield();
+        }
+    });
+    unsigned expected = 0;
+    bool inOrder = true;
+    while (expected < count) {
+        unsigned value;
+        if (ring.pop(value))
+            inOrder &= value == expected++;
+        else
+            std::this_thread::yield();
+    }
+    producer.join();
+    EXPECT_TRUE(inOrder);
+    EXPECT_TRUE(ring.empty());
+}
+
+TEST_F(AciaTest, transmitTakesACharacterTime) {
+    EXPECT_EQ(1041, acia.characterCycles());
+    acia.write(Acia6551::Command, 0x0B);
+    at(100);
+    acia.write(Acia6551::Data, 'A');
+    EXPECT_FALSE(acia.read(Acia6551::Status) & Acia6551::TxEmpty);
+    EXPECT_TRUE(acia.tx.empty());
+    // Sent by an event even if the guest looks away
+    EXPECT_EQ(1141, cpu.events.deadline());
+    at(1141);
+    cpu.events.fire(cpu);
+    Byte sent;
+    EXPECT_TRUE(acia.tx.pop(sent));
+    EXPECT_EQ('A', sent);
+    EXPECT_TRUE(acia.read(Acia6551::Status) & Acia6551::TxEmpty);
+    EXPECT_TRUE(cpu.events.empty());
+
+    // Seven data bits, parity and two stop bits at 300 baud
+    acia.write(Acia6551::Control, 0x80 | 0x20 | 0x06);
+    acia.write(Acia6551::Command, 0x2B);
+    EXPECT_EQ(1000000LL * 11 / 300, acia.characterCycles());
+}
+
+TEST_F(AciaTest, receivePacedByBaudRate) {
+    acia.write(Acia6551::Command, 0x0B);
+    for (char c : std::string("AB"))
+        acia.rx.push(c);
+    EXPECT_TRUE(acia.read(Acia6551::Status) & Acia6551::RxFull);
+    EXPECT_EQ('A', acia.read(Acia6551::Data));
+    EXPECT_FALSE(acia.read(Acia6551::Status) & Acia6551::RxFull);
+    at(1040);
+    EXPECT_FALSE(acia.read(Acia6551::Status) & Acia6551::RxFull);
+    at(1041);
+    EXPECT_TRUE(acia.read(Acia6551::Status) & Acia6551::RxFull);
+    EXPECT_EQ('B', acia.read(Acia6551::Data));
+    // A polling guest schedules nothing
+    EXPECT_TRUE(cpu.events.empty());
+
+    // The receiver is off without DTR
+    acia.write(Acia6551::Command, 0x0A);
+    acia.rx.push('C');
+    at(100000);
+    EXPECT_FALSE(acia.read(Acia6551::Status) & Acia6551::RxFull);
+}
+
+TEST_F(AciaTest, interrupts) {
+    // Receive interrupts on: rx is looked at once per character time
+    acia.write(Acia6551::Command, 0x09);
+    EXPECT_EQ(1041, cpu.events.deadline());
+    at(1041);
+    cpu.events.fire(cpu);
+    EXPECT_EQ(0, cpu.interrupts);
+    EXPECT_EQ(2082, cpu.events.deadline());
+    acia.rx.push('x');
+    at(2082);
+    cpu.events.fire(cpu);
+    EXPECT_EQ(CPUState::IrqAsserted, cpu.interrupts);
+    // Reading status acknowledges it
+    EXPECT_EQ(Acia6551::Irq | Acia6551::RxFull | Acia6551::TxEmpty, acia.read(Acia6551::Status));
+    EXPECT_EQ(0, cpu.interrupts);
+    EXPECT_EQ('x', acia.read(Acia6551::Data));
+
+    // Transmit interrupts when TDRE is set
+    acia.write(Acia6551::Command, 0x07);
+    EXPECT_EQ(CPUState::IrqAsserted, cpu.interrupts);
+    acia.read(Acia6551::Status);
+    acia.write(Acia6551::Data, 'y');
+    EXPECT_EQ(0, cpu.interrupts);
+    at(2082 + 1041);
+    cpu.events.fire(cpu);
+    EXPECT_EQ(CPUState::IrqAsserted, cpu.interrupts);
+    // Programmed reset clears it
+    acia.write(Acia6551::Status, 0);
+    EXPECT_EQ(0, cpu.interrupts);
+    EXPECT_EQ(0, acia.read(Acia6551::Command));
+}
+
+#if !defined(_WIN32)
+
+TEST_F(AciaTest, echoThroughPipes) {
+    int toGuest[2], fromGuest[2];
+    ASSERT_EQ(0, pipe(toGuest));
+    ASSERT_EQ(0, pipe(fromGuest));
+    fcntl(fromGuest[0], F_SETFL, O_NONBLOCK);
+    loadEcho();
+    {
+        HostSerial serial(acia, toGuest[0], fromGuest[1]);
+        const std::string message = "hello, 6551";
+        ASSERT_EQ(ssize_t(message.size()), write(toGuest[1], message.data(), message.size()));
+        EXPECT_EQ(message, runUntil(fromGuest[0], message.size()));
+        // At 9600 baud, no faster than a character time each
+        EXPECT_GE(cpu.cycles, acia.characterCycles() * static_cast<long long>(message.size() - 1));
+    }
+    for (int fd : { toGuest[0], toGuest[1], fromGuest[0], fromGuest[1] })
+        close(fd);
+}
+
+TEST_F(AciaTest, echoThroughUnixSocket) {
+    std::string path = "/tmp/6502_acia_test_" + std::to_string(getpid());
+    unlink(path.c_str());
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    ASSERT_GE(listener, 0);
+    sockaddr_un address {};
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    ASSERT_EQ(0, bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)));
+    ASSERT_EQ(0, listen(listener, 1));
+    loadEcho();
+    {
+        std::unique_ptr<HostSerial> serial = HostSerial::unixSocket(acia, path);
+        ASSERT_TRUE(serial);
+        int peer = accept(listener, nullptr, nullptr);
+        ASSERT_GE(peer, 0);
+        fcntl(peer, F_SETFL, O_NONBLOCK);
+        ASSERT_EQ(3, write(peer, "abc", 3));
+        EXPECT_EQ("abc", runUntil(peer, 3));
+        serial.reset();
+        close(peer);
+    }
+    close(listener);
+    unlink(path.c_str());
+    EXPECT_FALSE(HostSerial::unixSocket(acia, path));
+}
+
+#endif
@@ -0,0 +1,124 @@
+#include <gtest/gtest.h>
+#include "cpu.h"
+#include "memory.h"
+#include "aot.h"
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+// Checks the Klaus functional test, recompiled by 6502_aot at build time,
+// against the dispatch loop, including the interpreter fallback for code the
+// recompiled program does not hold.
+
+class AotTest : public ::testing::Test {
+protected:
+    Memory dispatchMem;
+    Memory aotMem;
+    CPU dispatchCpu;
+    CPU aotCpu;
+
+    AotTest()
+        : dispatchMem()
+        , aotMem()
+        , dispatchCpu(&dispatchMem)
+        , aotCpu(&aotMem)
+    {
+        aotCpu.engine = CPU::Engine::Aot;
+        for (const AotProgram * program : aotPrograms())
+            if (std::string(program->name) == "klaus")
+                aotCpu.aotProgram = program;
+    };
+    ~AotTest(){};
+
+    void loadKlaus() {
+        std::ifstream file(TEST_PROGRAMS_DIR "/6502_functional_test.bin", std::ios::binary);
+        ASSERT_TRUE(file.good());
+        std::vector<Byte> image((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        ASSERT_EQ((size_t)MEMORY_SIZE, image.size());
+        dispatchMem.writeBlock(0, image.data(), image.size());
+        aotMem.writeBlock(0, image.data(), image.size());
+        dispatchCpu.reset();
+        aotCpu.reset();
+        dispatchCpu.PC = aotCpu.PC = 0x0400;
+    }
+
+    void expectSameState() {
+        EXPECT_EQ(dispatchCpu.PC, aotCpu.PC);
+        EXPECT_EQ(dispatchCpu.A, aotCpu.A);
+        EXPECT_EQ(dispatchCpu.X, aotCpu.X);
+        EXPECT_EQ(dispatchCpu.Y, aotCpu.Y);
+        EXPECT_EQ(dispatchCpu.SP, aotCpu.SP);
+        EXPECT_EQ(dispatchCpu.P, aotCpu.P);
+        EXPECT_EQ(dispatchCpu.cycles, aotCpu.cycles);
+        EXPECT_EQ(0, std::memcmp(dispatchMem.mem, aotMem.mem, MEMORY_SIZE));
+    }
+};
+
+TEST_F(AotTest, registersRecompiledProgram) {
+    ASSERT_NE(nullptr, aotCpu.aotProgram);
+    EXPECT_GT(aotCpu.aotProgram->blockCount, 0u);
+}
+
+TEST_F(AotTest, runsFunctionalTestLikeDispatch) {
+    ASSERT_NE(nullptr, aotCpu.aotProgram);
+    loadKlaus();
+    EXPECT_EQ(CPU::StopReason::Trap, dispatchCpu.run(100000000));
+    EXPECT_EQ(CPU::StopReason::Trap, aotCpu.run(100000000));
+    EXPECT_EQ(0x3469, aotCpu.PC);
+    EXPECT_EQ(65897225, aotCpu.cycles);
+    expectSameState();
+    // The relative branch range test patches the offset of the branch at $04E5,
+    // which drops its block; every other block stays compiled
+    EXPECT_EQ(aotCpu.aotProgram->blockCount - 1, aotCpu.aotRuntime->validBlocks());
+}
+
+TEST_F(AotTest, matchesDispatchInSmallBudgetSteps) {
+    ASSERT_NE(nullptr, aotCpu.aotProgram);
+    loadKlaus();
+    for (int step = 0; step < 2000; step++) {
+        EXPECT_EQ(dispatchCpu.run(37), aotCpu.run(37));
+        expectSameState();
+        if (HasFailure())
+            return;
+    }
+}
+
+TEST_F(AotTest, dropsBlockRewrittenAfterStart) {
+    ASSERT_NE(nullptr, aotCpu.aotProgram);
+    loadKlaus();
+    EXPECT_EQ(CPU::StopReason::Budget, dispatchCpu.run(1000));
+    EXPECT_EQ(CPU::StopReason::Budget, aotCpu.run(1000));
+    size_t valid = aotCpu.aotRuntime->validBlocks();
+
+    // CLD at the entry point becomes NOP; run it again from there
+    dispatchMem.write(0x0400, 0xEA);
+    aotMem.write(0x0400, 0xEA);
+    dispatchCpu.PC = aotCpu.PC = 0x0400;
+    EXPECT_EQ(CPU::StopReason::Budget, dispatchCpu.run(5000));
+    EXPECT_EQ(CPU::StopReason::Budget, aotCpu.run(5000));
+    expectSameState();
+    EXPECT_EQ(valid - 1, aotCpu.aotRuntime->validBlocks());
+}
+
+TEST_F(AotTest, fallsBackToDispatchForOtherCode) {
+    ASSERT_NE(nullptr, aotCpu.aotProgram);
+    // Random memory: hardly any block matches the image, the rest is interpreted
+    std::mt19937 rng(6502);
+    for (int trial = 0; trial < 20; trial++) {
+        SCOPED_TRACE(testing::Message() << "trial " << trial);
+        for (int i = 0; i < MEMORY_SIZE; i++)
+            dispatchMem.write(i, rng());
+        std::memcpy(aotMem.mem, dispatchMem.mem, MEMORY_SIZE);
+        aotCpu.aotRuntime.reset();
+        dispatchCpu.PC = aotCpu.PC = rng();
+        dispatchCpu.SP = aotCpu.SP = rng();
+        dispatchCpu.P = aotCpu.P = rng();
+        EXPECT_EQ(dispatchCpu.run(500), aotCpu.run(500));
+        expectSameState();
+        if (HasFailure())
+            return;
+    }
+}
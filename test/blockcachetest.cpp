@@ -0,0 +1,139 @@
+#include <gtest/gtest.h>
+#include "cpu.h"
+#include "memory.h"
+#include "blockcache.h"
+#include <cstring>
+#include <random>
+
+// Checks the pre-decoded block engine against the dispatch loop from random
+// states, then covers invalidation when code is rewritten under it.
+
+class BlockCacheTest : public ::testing::Test {
+protected:
+    Memory dispatchMem;
+    Memory blockMem;
+    CPU dispatchCpu;
+    CPU blockCpu;
+    std::mt19937 rng;
+
+    BlockCacheTest()
+        : dispatchMem()
+        , blockMem()
+        , dispatchCpu(&dispatchMem)
+        , blockCpu(&blockMem)
+        , rng(6502)
+    {
+        blockCpu.engine = CPU::Engine::Blocks;
+    };
+    ~BlockCacheTest(){};
+
+    void randomState() {
+        for (int i = 0; i < MEMORY_SIZE; i++)
+            dispatchMem.write(i, rng());
+
+        dispatchCpu.PC = rng();
+        dispatchCpu.A = rng();
+        dispatchCpu.X = rng();
+        dispatchCpu.Y = rng();
+        dispatchCpu.SP = rng();
+        dispatchCpu.P = rng();
+        dispatchCpu.cycles = rng() % 1000;
+
+        std::memcpy(blockMem.mem, dispatchMem.mem, MEMORY_SIZE);
+        blockCpu.PC = dispatchCpu.PC;
+        blockCpu.A = dispatchCpu.A;
+        blockCpu.X = dispatchCpu.X;
+        blockCpu.Y = dispatchCpu.Y;
+        blockCpu.SP = dispatchCpu.SP;
+        blockCpu.P = dispatchCpu.P;
+        blockCpu.cycles = dispatchCpu.cycles;
+    }
+
+    void expectSameState() {
+        EXPECT_EQ(dispatchCpu.PC, blockCpu.PC);
+        EXPECT_EQ(dispatchCpu.A, blockCpu.A);
+        EXPECT_EQ(dispatchCpu.X, blockCpu.X);
+        EXPECT_EQ(dispatchCpu.Y, blockCpu.Y);
+        EXPECT_EQ(dispatchCpu.SP, blockCpu.SP);
+        EXPECT_EQ(dispatchCpu.P, blockCpu.P);
+        EXPECT_EQ(dispatchCpu.cycles, blockCpu.cycles);
+        EXPECT_EQ(0, std::memcmp(dispatchMem.mem, blockMem.mem, MEMORY_SIZE));
+    }
+};
+
+TEST_F(BlockCacheTest, matchesDispatchFromRandomStates) {
+    for (int trial = 0; trial < 200; trial++) {
+        SCOPED_TRACE(testing::Message() << "trial " << trial);
+        randomState();
+        uint64_t budget = 1 + rng() % 500;
+        EXPECT_EQ(dispatchCpu.run(budget), blockCpu.run(budget));
+        expectSameState();
+        if (HasFailure())
+            return;
+    }
+}
+
+TEST_F(BlockCacheTest, matchesDispatchInSmallBudgetSteps) {
+    randomState();
+    for (int step = 0; step < 200; step++) {
+        CPU::StopReason expected = dispatchCpu.run(3);
+        EXPECT_EQ(expected, blockCpu.run(3));
+        expectSameState();
+        if (HasFailure() || expected != CPU::StopReason::Budget)
+            return;
+    }
+}
+
+TEST_F(BlockCacheTest, reDecodesOpcodeRewrittenInsideBlock) {
+    // LDA #$E8 / STA $0205 / NOP / unimplemented
+    // The store turns the NOP at $0205 into INX after the block was decoded
+    const Byte program[] = { 0xA9, 0xE8, 0x8D, 0x05, 0x02, 0xEA, 0x02 };
+    blockMem.writeBlock(0x0200, program, sizeof(program));
+    blockCpu.PC = 0x0200;
+    blockCpu.X = 0;
+    EXPECT_EQ(CPU::StopReason::Halt, blockCpu.run(1000));
+    EXPECT_EQ(0x0206, blockCpu.PC);
+    EXPECT_EQ((Byte)1, blockCpu.X);
+}
+
+TEST_F(BlockCacheTest, readsPatchedImmediateOperand) {
+    // loop: LDA #$00 / CLC / ADC #$01 / STA $0201 / CMP #$03 / BNE loop / unimplemented
+    const Byte program[] = { 0xA9, 0x00, 0x18, 0x69, 0x01, 0x8D, 0x01, 0x02, 0xC9, 0x03, 0xD0, 0xF4, 0x02 };
+    blockMem.writeBlock(0x0200, program, sizeof(program));
+    blockCpu.PC = 0x0200;
+    blockCpu.P = 0;
+    EXPECT_EQ(CPU::StopReason::Halt, blockCpu.run(1000));
+    EXPECT_EQ(0x020C, blockCpu.PC);
+    EXPECT_EQ((Byte)3, blockCpu.A);
+    EXPECT_EQ((Byte)3, blockMem.read(0x0201));
+}
+
+TEST_F(BlockCacheTest, dropsBlocksAfterExternalWrite) {
+    // INX / unimplemented, run once to decode it
+    blockMem.write(0x0200, 0xE8);
+    blockMem.write(0x0201, 0x02);
+    blockCpu.PC = 0x0200;
+    blockCpu.X = 0;
+    EXPECT_EQ(CPU::StopReason::Halt, blockCpu.run(1000));
+    EXPECT_EQ((Byte)1, blockCpu.X);
+    EXPECT_EQ(1u, blockCpu.blockCache->size());
+
+    // Loader rewrites the code between runs: DEX
+    blockMem.write(0x0200, 0xCA);
+    blockCpu.PC = 0x0200;
+    EXPECT_EQ(CPU::StopReason::Halt, blockCpu.run(1000));
+    EXPECT_EQ((Byte)0, blockCpu.X);
+}
+
+TEST_F(BlockCacheTest, keepsBlocksOnDataWritesToCodePage) {
+    // loop: INC $0280 / BNE loop / unimplemented, with the counter on the code page
+    const Byte program[] = { 0xEE, 0x80, 0x02, 0xD0, 0xFB, 0x02 };
+    blockMem.writeBlock(0x0200, program, sizeof(program));
+    blockMem.write(0x0280, 0xF0);
+    blockCpu.PC = 0x0200;
+    EXPECT_EQ(CPU::StopReason::Halt, blockCpu.run(10000));
+    EXPECT_EQ(0x0205, blockCpu.PC);
+    EXPECT_EQ((Byte)0, blockMem.read(0x0280));
+    EXPECT_FALSE(blockMem.codeDirty);
+    EXPECT_EQ(2u, blockCpu.blockCache->size());
+}
@@ -0,0 +1,173 @@
+#include <gtest/gtest.h>
+#include "cpu.h"
+#include "memory.h"
+#include "blockdev.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <unistd.h>
+
+// Checks the block device against a 16-sector image file whose sector n is
+// filled with n: DMA reads and write-back through the mapping, cycle costs,
+// error cases, wrapping at the top of memory, and code overwritten by DMA
+// being dropped from the block cache.
+
+class BlockDeviceTest : public ::testing::Test {
+protected:
+    std::string path;
+    Memory mem;
+    MappedCPU cpu;
+    BlockDevice disk;
+
+    BlockDeviceTest() : mem(), cpu(&mem), disk(cpu) {
+        path = "/tmp/6502_blockdev_test_" + std::to_string(getpid());
+        std::ofstream file(path, std::ios::binary);
+        for (int sector = 0; sector < 16; sector++)
+            file << std::string(BlockDevice::sectorSize, char(sector));
+        cpu.cycles = 0;
+    }
+    ~BlockDeviceTest() {
+        disk.close();
+        std::remove(path.c_str());
+    }
+
+    void setup(unsigned sector, Word address, Byte count) {
+        disk.write(BlockDevice::Sector0, sector & 0xFF);
+        disk.write(BlockDevice::Sector1, sector >> 8);
+        disk.write(BlockDevice::Sector2, sector >> 16);
+        disk.write(BlockDevice::AddressLow, address & 0xFF);
+        disk.write(BlockDevice::AddressHigh, address >> 8);
+        disk.write(BlockDevice::Count, count);
+    }
+
+    Byte status() { return disk.read(BlockDevice::Command); }
+};
+
+TEST_F(BlockDeviceTest, open) {
+    EXPECT_EQ(0, status());
+    disk.write(BlockDevice::Command, BlockDevice::Read);
+    EXPECT_EQ(BlockDevice::Error, status());
+    EXPECT_FALSE(disk.open(path + ".missing"));
+    ASSERT_TRUE(disk.open(path));
+    EXPECT_EQ(BlockDevice::Ready, status());
+    EXPECT_EQ(16u, disk.sectors());
+    ASSERT_TRUE(disk.open(path, true));
+    EXPECT_EQ(BlockDevice::Ready | BlockDevice::ReadOnly, status());
+}
+
+TEST_F(BlockDeviceTest, guestReadsSectors) {
+    ASSERT_TRUE(disk.open(path));
+    // Sector 3, 2 sectors to $3000: LDA #3 / STA SEC0 / LDA #$30 / STA ADDRH / LDA #2 / STA COUNT
+    // LDA #1 / STA CMD / LDA CMD / STA $0300 / JMP *
+    const std::vector<Byte> program = { 0xA9, 0x03, 0x8D, 0x01, 0xD0, 0xA9, 0x30, 0x8D, 0x05, 0xD0,
+                                        0xA9, 0x02, 0x8D, 0x06, 0xD0, 0xA9, 0x01, 0x8D, 0x00, 0xD0,
+                                        0xAD, 0x00, 0xD0, 0x8D, 0x00, 0x03, 0x4C, 0x1A, 0x02 };
+    mem.writeBlock(0x0200, program.data(), program.size());
+    disk.map(mem, 0xD0);
+    long long free = 0;
+    for (long long setup : { 0, 100 }) {
+        disk.setupCycles = setup;
+        disk.cyclesPerSector = setup ? 256 : 0;
+        cpu.PC = 0x0200;
+        cpu.cycles = 0;
+        std::fill(mem.mem + 0x3000, mem.mem + 0x3201, 0xEE);
+        EXPECT_EQ(CPU::StopReason::Trap, cpu.run(100000));
+        EXPECT_EQ(BlockDevice::Ready, mem.mem[0x0300]);
+        for (Word addr = 0x3000; addr < 0x3200; addr++)
+            ASSERT_EQ(addr < 0x3100 ? 3 : 4, mem.mem[addr]) << std::hex << addr;
+        EXPECT_EQ(0xEE, mem.mem[0x3200]);
+        if (!setup)
+            free = cpu.cycles;
+    }
+    EXPECT_EQ(free + 100 + 2 * 256, cpu.cycles);
+}
+
+TEST_F(BlockDeviceTest, writeBack) {
+    ASSERT_TRUE(disk.open(path));
+    for (int i = 0; i < 512; i++)
+        mem.mem[0x4000 + i] = Byte(i * 7);
+    setup(14, 0x4000, 2);
+    disk.write(BlockDevice::Command, BlockDevice::Write);
+    EXPECT_EQ(BlockDevice::Ready, status());
+    disk.write(BlockDevice::Command, BlockDevice::Flush);
+    EXPECT_EQ(BlockDevice::Ready, status());
+    disk.close();
+
+    std::ifstream file(path, std::ios::binary);
+    std::vector<char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    ASSERT_EQ(16u * 256, bytes.size());
+    EXPECT_EQ(13, bytes[14 * 256 - 1]);
+    for (int i = 0; i < 512; i++)
+        ASSERT_EQ(Byte(i * 7), Byte(bytes[14 * 256 + i])) << i;
+}
+
+TEST_F(BlockDeviceTest, errors) {
+    ASSERT_TRUE(disk.open(path, true));
+    std::fill(mem.mem + 0x5000, mem.mem + 0x5300, 0xEE);
+    // Past the end, or 256 sectors for a count of 0
+    for (Byte count : { 2, 0 }) {
+        setup(15, 0x5000, count);
+        disk.write(BlockDevice::Command, BlockDevice::Read);
+        EXPECT_TRUE(status() & BlockDevice::Error);
+        EXPECT_EQ(0xEE, mem.mem[0x5000]);
+    }
+    setup(15, 0x5000, 1);
+    disk.write(BlockDevice::Command, BlockDevice::Read);
+    EXPECT_FALSE(status() & BlockDevice::Error);
+    EXPECT_EQ(15, mem.mem[0x50FF]);
+    EXPECT_EQ(0xEE, mem.mem[0x5100]);
+    // Read-only, or no such command
+    disk.write(BlockDevice::Command, BlockDevice::Write);
+    EXPECT_TRUE(status() & BlockDevice::Error);
+    disk.write(BlockDevice::Command, 0x7F);
+    EXPECT_TRUE(status() & BlockDevice::Error);
+    // The registers keep their values
+    EXPECT_EQ(15, disk.read(BlockDevice::Sector0));
+    EXPECT_EQ(0x50, disk.read(BlockDevice::AddressHigh));
+}
+
+TEST_F(BlockDeviceTest, wrapsAtTopOfMemory) {
+    ASSERT_TRUE(disk.open(path));
+    setup(9, 0xFF80, 1);
+    disk.write(BlockDevice::Command, BlockDevice::Read);
+    EXPECT_EQ(BlockDevice::Ready, status());
+    EXPECT_EQ(9, mem.mem[0xFF80]);
+    EXPECT_EQ(9, mem.mem[0xFFFF]);
+    EXPECT_EQ(9, mem.mem[0x007F]);
+    EXPECT_EQ(0, mem.mem[0x0080]);
+}
+
+TEST_F(BlockDeviceTest, overwrittenCodeIsRetranslated) {
+    // LDA #1 / STA $0300 / JMP *
+    const std::vector<Byte> first = { 0xA9, 0x01, 0x8D, 0x00, 0x03, 0x4C, 0x05, 0x02 };
+    Memory flat;
+    flat.writeBlock(0x0200, first.data(), first.size());
+    CPU blocks(&flat);
+    blocks.engine = CPU::Engine::Blocks;
+    blocks.PC = 0x0200;
+    EXPECT_EQ(CPU::StopReason::Trap, blocks.run(1000));
+    EXPECT_EQ(1, flat.mem[0x0300]);
+
+    // The same program loading 2 instead, DMAed over the first
+    {
+        std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(6 * 256);
+        file.write("\xA9\x02\x8D\x00\x03\x4C\x05\x02", 8);
+    }
+    BlockDevice flatDisk(blocks);
+    ASSERT_TRUE(flatDisk.open(path));
+    flatDisk.write(BlockDevice::Sector0, 6);
+    flatDisk.write(BlockDevice::AddressHigh, 0x02);
+    flatDisk.write(BlockDevice::Count, 1);
+    flatDisk.write(BlockDevice::Command, BlockDevice::Read);
+    EXPECT_EQ(BlockDevice::Ready, flatDisk.read(BlockDevice::Command));
+    blocks.PC = 0x0200;
+    EXPECT_EQ(CPU::StopReason::Trap, blocks.run(1000));
+    EXPECT_EQ(2, flat.mem[0x0300]);
+}
+
+#endif
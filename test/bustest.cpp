@@ -0,0 +1,116 @@
+#include <gtest/gtest.h>
+#include "cpu.h"
+#include "memory.h"
+#include <vector>
+
+// Checks Memory's page table as MappedCPU sees it: RAM, ROM over mem[] or
+// host bytes, and device pages, on the dispatch loop and the table core.
+
+class BusTest : public ::testing::Test {
+protected:
+    Memory mem;
+
+    BusTest() : mem() {}
+    ~BusTest(){};
+
+    void load(Word addr, const std::vector<Byte> & program) {
+        mem.writeBlock(addr, program.data(), program.size());
+    }
+};
+
+TEST_F(BusTest, ramByDefault) {
+    mem.busWrite(0x1234, 0x56);
+    EXPECT_EQ(0x56, mem.mem[0x1234]);
+    EXPECT_EQ(0x56, mem.busRead(0x1234));
+    mem.write(0xFFFF, 0x78);
+    EXPECT_EQ(0x78, mem.busRead(0xFFFF));
+}
+
+TEST_F(BusTest, romPages) {
+    mem.write(0xE000, 0x11);
+    mem.mapRom(0xE0, 0x20);
+    mem.busWrite(0xE000, 0x22);
+    EXPECT_EQ(0x11, mem.busRead(0xE000));
+    // The flat accessors are not mapped
+    mem.write(0xE000, 0x33);
+    EXPECT_EQ(0x33, mem.busRead(0xE000));
+
+    // A bank of host bytes, and switching back to RAM
+    std::vector<Byte> bank(0x200, 0xAB);
+    mem.mapRom(0xA0, 2, bank.data());
+    EXPECT_EQ(0xAB, mem.busRead(0xA1FF));
+    mem.busWrite(0xA1FF, 0);
+    EXPECT_EQ(0xAB, bank[0x1FF]);
+    EXPECT_EQ(0, mem.mem[0xA1FF]);
+    mem.mapRam(0xA0, 2);
+    EXPECT_EQ(0, mem.busRead(0xA1FF));
+}
+
+TEST_F(BusTest, devicePages) {
+    std::vector<std::pair<Word, Byte>> writes;
+    int reads = 0;
+    mem.mapDevice(0xD0, 1, Device { [&](Word addr) { reads++; return Byte(addr & 0xFF); },
+                                    [&](Word addr, Byte value) { writes.push_back({ addr, value }); } });
+    EXPECT_EQ(0x12, mem.busRead(0xD012));
+    mem.busWrite(0xD020, 0x05);
+    EXPECT_EQ(1, reads);
+    EXPECT_EQ((std::vector<std::pair<Word, Byte>> { { 0xD020, 0x05 } }), writes);
+    EXPECT_EQ(0, mem.mem[0xD020]);
+
+    // A device without a read handler reads 0, one without a write handler drops stores
+    mem.mapDevice(0xD4, 1, Device {});
+    EXPECT_EQ(0, mem.busRead(0xD400));
+    mem.busWrite(0xD400, 1);
+    EXPECT_EQ(0, mem.mem[0xD400]);
+}
+
+TEST_F(BusTest, copiesKeepTheirOwnPages) {
+    std::vector<Byte> bank(0x100, 0x42);
+    mem.mapRom(0x80, 1, bank.data());
+    mem.mapRom(0xF0, 1);
+    Memory copy = mem;
+    copy.busWrite(0x1000, 0x99);
+    EXPECT_EQ(0x99, copy.mem[0x1000]);
+    EXPECT_EQ(0, mem.mem[0x1000]);
+    EXPECT_EQ(0x42, copy.busRead(0x8000));
+    copy.write(0xF000, 0x07);
+    EXPECT_EQ(0x07, copy.busRead(0xF000));
+    EXPECT_EQ(0, mem.busRead(0xF000));
+}
+
+TEST_F(BusTest, mappedCpuPollsDevice) {
+    // loop: LDA $D011 / BPL loop / STA $0300 / JMP *
+    load(0x0200, { 0xAD, 0x11, 0xD0, 0x10, 0xFB, 0x8D, 0x00, 0x03, 0x4C, 0x08, 0x02 });
+    // The register sets bit 7 on its 1000th read, which no idle-loop skip may jump over
+    int reads = 0;
+    mem.mapDevice(0xD0, 1, Device { [&](Word) { return Byte(++reads == 1000 ? 0x80 : 0x00); }, nullptr });
+    Memory tableMem = mem;
+    MappedCPU cpu(&mem);
+    cpu.PC = 0x0200;
+    cpu.cycles = 0;
+    EXPECT_EQ(CPU::StopReason::Trap, cpu.run(100000000));
+    EXPECT_EQ(1000, reads);
+    EXPECT_EQ(0x80, mem.mem[0x0300]);
+    EXPECT_EQ(0x0208, cpu.PC);
+
+    reads = 0;
+    MappedCPU table(&tableMem);
+    table.PC = 0x0200;
+    table.cycles = 0;
+    while (table.PC != 0x0208)
+        table.execute();
+    EXPECT_EQ(1000, reads);
+    EXPECT_EQ(cpu.cycles - opcodeCycles[0x4C], table.cycles);
+}
+
+TEST_F(BusTest, romProtectedFromTheCpu) {
+    // LDA #$55 / STA $F000 / LDA $F000 / JMP *
+    load(0x0200, { 0xA9, 0x55, 0x8D, 0x00, 0xF0, 0xAD, 0x00, 0xF0, 0x4C, 0x08, 0x02 });
+    mem.write(0xF000, 0xAA);
+    mem.mapRom(0xF0, 0x10);
+    MappedCPU cpu(&mem);
+    cpu.PC = 0x0200;
+    EXPECT_EQ(CPU::StopReason::Trap, cpu.run(1000));
+    EXPECT_EQ(0xAA, cpu.A);
+    EXPECT_EQ(0xAA, mem.mem[0xF000]);
+}
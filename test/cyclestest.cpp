@@ -0,0 +1,150 @@
+#include <gtest/gtest.h>
+#include "cpu.h"
+#include "memory.h"
+#include "cycles.h"
+#include "opcodes.h"
+#include <algorithm>
+#include <iterator>
+#include <vector>
+
+// Checks opcodeCycles and the penalty helpers in cycles.h against the cycles
+// the table core, the dispatch loop and the block engine charge, and all of
+// them against literal counts.
+
+// What the instruction handlers charged before opcodeCycles replaced their
+// cycl() calls, taken from them opcode by opcode: operand fetches and memory
+// accesses counted, the opcode fetch not, no penalties
+static const int handlerCycles[256] = {
+    0, 5, 0, 0, 0, 2, 4, 0, 2, 1, 1, 0, 0, 3, 5, 0,
+    1, 5, 0, 0, 0, 3, 5, 0, 1, 3, 0, 0, 0, 3, 5, 0,
+    5, 5, 0, 0, 2, 2, 4, 0, 3, 1, 1, 0, 3, 3, 5, 0,
+    1, 5, 0, 0, 0, 3, 5, 0, 1, 3, 0, 0, 0, 3, 5, 0,
+    6, 5, 0, 0, 0, 2, 4, 0, 2, 1, 1, 0, 2, 3, 5, 0,
+    1, 5, 0, 0, 0, 3, 5, 0, 1, 3, 0, 0, 0, 3, 5, 0,
+    5, 5, 0, 0, 0, 2, 4, 0, 3, 1, 1, 0, 4, 3, 5, 0,
+    1, 5, 0, 0, 0, 3, 5, 0, 1, 3, 0, 0, 0, 3, 5, 0,
+    0, 5, 0, 0, 2, 2, 2, 0, 1, 0, 1, 0, 3, 3, 3, 0,
+    1, 5, 0, 0, 3, 3, 3, 0, 1, 3, 1, 0, 0, 3, 0, 0,
+    1, 5, 1, 0, 2, 2, 2, 0, 1, 1, 1, 0, 3, 3, 3, 0,
+    1, 5, 0, 0, 3, 3, 3, 0, 1, 3, 1, 0, 3, 3, 3, 0,
+    1, 5, 0, 0, 2, 2, 4, 0, 1, 1, 1, 0, 3, 3, 5, 0,
+    1, 5, 0, 0, 0, 3, 5, 0, 1, 3, 0, 0, 0, 3, 5, 0,
+    1, 5, 0, 0, 2, 2, 4, 0, 1, 1, 1, 0, 3, 3, 5, 0,
+    1, 5, 0, 0, 0, 3, 5, 0, 1, 3, 0, 0, 0, 3, 5, 0
+};
+
+class CyclesTest : public ::testing::Test {
+protected:
+    Memory tableMem;
+    Memory dispatchMem;
+    Memory blocksMem;
+    CPU tableCpu;
+    CPU dispatchCpu;
+    CPU blocksCpu;
+
+    CyclesTest()
+        : tableMem()
+        , dispatchMem()
+        , blocksMem()
+        , tableCpu(&tableMem)
+        , dispatchCpu(&dispatchMem)
+        , blocksCpu(&blocksMem)
+    {
+        blocksCpu.engine = CPU::Engine::Blocks;
+    };
+    ~CyclesTest(){};
+
+    // Loads one instruction at $0200 on every core. Memory is otherwise zero,
+    // so operands and pointers stay in the zero page unless the test says so.
+    void load(const std::vector<Byte> & program, Byte x = 0, Byte y = 0, Byte p = 0) {
+        for (CPU * cpu : { &tableCpu, &dispatchCpu, &blocksCpu }) {
+            cpu->mem->writeBlock(0x0200, program.data(), program.size());
+            // BRK lands on a NOP, so a budget of one cycle stops after it
+            cpu->mem->write(0xFFFE, 0x00);
+            cpu->mem->write(0xFFFF, 0x03);
+            cpu->mem->write(0x0300, 0xEA);
+            cpu->PC = 0x0200;
+            cpu->SP = 0xFF;
+            cpu->X = x;
+            cpu->Y = y;
+            cpu->P = p;
+            cpu->cycles = 0;
+        }
+    }
+
+    // Runs the instruction on every core and checks each charged `expected`
+    void expectCycles(long long expected) {
+        tableCpu.execute();
+        EXPECT_EQ(expected, tableCpu.cycles);
+        // Every instruction but BRK costs at least a cycle, so a budget of one
+        // runs exactly one of them; after BRK that is the NOP, one more
+        long long extra = tableMem.read(0x0200) == 0x00 ? 1 : 0;
+        dispatchCpu.run(1);
+        EXPECT_EQ(expected + extra, dispatchCpu.cycles);
+        blocksCpu.run(1);
+        EXPECT_EQ(expected + extra, blocksCpu.cycles);
+    }
+};
+
+TEST_F(CyclesTest, tableCoversDocumentedOpcodes) {
+    EXPECT_EQ(151u, sizeof(documentedOpcodes));
+    for (int op = 0; op < 256; op++) {
+        bool documented = std::find(std::begin(documentedOpcodes), std::end(documentedOpcodes), op) != std::end(documentedOpcodes);
+        // BRK is the only documented instruction without a cost of its own
+        EXPECT_EQ(documented && op != 0x00, opcodeCycles[op] > 0) << "opcode " << std::hex << op;
+    }
+}
+
+TEST_F(CyclesTest, handlersChargeTableWithoutPenalties) {
+    for (Byte op : documentedOpcodes) {
+        SCOPED_TRACE(testing::Message() << "opcode " << std::hex << int(op));
+        // Flags that leave every branch not taken: BPL/BVC/BCC/BNE test set
+        // N/V/C/Z, the others clear ones
+        bool branchOnClear = op == 0x10 || op == 0x50 || op == 0x90 || op == 0xD0;
+        load({ op, 0x10, 0x00 }, 0, 0, branchOnClear ? 0xC3 : 0x00);
+        EXPECT_EQ(handlerCycles[op], opcodeCycles[op]);
+        expectCycles(handlerCycles[op]);
+    }
+}
+
+TEST_F(CyclesTest, absoluteIndexedChargesPageCross) {
+    // LDA $12F0,X with X = $0F stays on the page, with X = $10 crosses it
+    load({ 0xBD, 0xF0, 0x12 }, 0x0F);
+    expectCycles(3);
+    EXPECT_EQ(0, absoluteIndexedPenalty(0x12F0, 0x0F));
+
+    load({ 0xBD, 0xF0, 0x12 }, 0x10);
+    expectCycles(4);
+    EXPECT_EQ(1, absoluteIndexedPenalty(0x12F0, 0x10));
+
+    // STA $12F0,Y
+    load({ 0x99, 0xF0, 0x12 }, 0, 0x10);
+    expectCycles(4);
+}
+
+TEST_F(CyclesTest, indirectIndexedChargesOutsideZeroPage) {
+    // LDA ($40),Y with the pointer at $0040 = $0080, then = $0180
+    load({ 0xB1, 0x40 }, 0, 0x10);
+    for (Memory * m : { &tableMem, &dispatchMem, &blocksMem })
+        m->write(0x40, 0x80);
+    expectCycles(5);
+    EXPECT_EQ(0, indirectIndexedPenalty(0x0090));
+
+    load({ 0xB1, 0x40 }, 0, 0x10);
+    for (Memory * m : { &tableMem, &dispatchMem, &blocksMem })
+        m->write(0x41, 0x01);
+    expectCycles(6);
+    EXPECT_EQ(1, indirectIndexedPenalty(0x0190));
+}
+
+TEST_F(CyclesTest, takenBranchChargesPageCross) {
+    // BEQ +$10 from $0200 stays on the page
+    load({ 0xF0, 0x10 }, 0, 0, 0x02);
+    expectCycles(2);
+    EXPECT_EQ(1, branchTakenPenalty(0x0202, 0x0212));
+
+    // BEQ -$10 leaves it
+    load({ 0xF0, 0xF0 }, 0, 0, 0x02);
+    expectCycles(3);
+    EXPECT_EQ(2, branchTakenPenalty(0x0202, 0x01F2));
+}
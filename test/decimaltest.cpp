@@ -0,0 +1,95 @@
+#include <gtest/gtest.h>
+#include "cpu.h"
+#include "memory.h"
+#include "alu.h"
+
+// Checks the decimal-mode ADC/SBC tables exhaustively, through alu.h and the
+// table handlers, against the nibble-by-nibble BCD arithmetic they replaced.
+
+namespace {
+
+struct Expected {
+    Byte a;
+    bool n, z, c, v;
+};
+
+// The decimal paths of adc()/sbc() before the tables
+Expected referenceAdc(Byte a, Byte v, Byte carry) {
+    Word decimal = bcdAdd(a, v, carry);
+    Byte result = decimal & 0xFF;
+    return { result, (result & 0x80) != 0, result == 0, decimal > 0xFF, ((~(a ^ v)) & (a ^ result) & 0x80) != 0 };
+}
+
+Expected referenceSbc(Byte a, Byte v, Byte carry) {
+    Word decimal = bcdSubtract(a, v, carry ? 0 : 1);
+    Byte result = decimal & 0xFF;
+    return { result, (result & 0x80) != 0, result == 0, !(decimal & 0x100), ((a ^ v) & (a ^ result) & 0x80) != 0 };
+}
+
+}
+
+class DecimalTest : public ::testing::Test {
+protected:
+    Memory mem;
+    CPU cpu;
+
+    DecimalTest(): mem(), cpu(&mem) {};
+    ~DecimalTest(){};
+
+    template <class Reference, class Operation>
+    void checkEveryInput(Byte opcode, Reference reference, Operation operation) {
+        for (int carry = 0; carry < 2; carry++) {
+            for (int a = 0; a < 256; a++) {
+                for (int v = 0; v < 256; v++) {
+                    Expected expected = reference(a, v, carry);
+
+                    Byte accumulator = a;
+                    Flags f = unpackFlags(0x08 | carry);
+                    operation(accumulator, f, Byte(v));
+                    Byte p = packFlags(f);
+
+                    // The same instruction, immediate, through the table handlers
+                    mem.write(0x0200, opcode);
+                    mem.write(0x0201, v);
+                    cpu.PC = 0x0200;
+                    cpu.A = a;
+                    cpu.P = 0x08 | carry;
+                    cpu.execute();
+
+                    if (expected.a != accumulator || expected.a != cpu.A
+                        || expected.n != ((p & 0x80) != 0) || expected.n != bool(cpu.N())
+                        || expected.z != ((p & 0x02) != 0) || expected.z != bool(cpu.Z())
+                        || expected.c != ((p & 0x01) != 0) || expected.c != bool(cpu.C())
+                        || expected.v != ((p & 0x40) != 0) || expected.v != bool(cpu.V())) {
+                        FAIL() << "A=" << a << " operand=" << v << " C=" << carry
+                               << ": expected A=" << int(expected.a) << ", alu.h A=" << int(accumulator)
+                               << " P=" << int(p) << ", table core A=" << int(cpu.A) << " P=" << int(cpu.P);
+                    }
+                }
+            }
+        }
+    }
+};
+
+TEST_F(DecimalTest, adcMatchesBcdArithmeticForEveryInput) {
+    checkEveryInput(0x69, referenceAdc, [](Byte & a, Flags & f, Byte v) { adc(a, f, v); });
+}
+
+TEST_F(DecimalTest, sbcMatchesBcdArithmeticForEveryInput) {
+    checkEveryInput(0xE9, referenceSbc, [](Byte & a, Flags & f, Byte v) { sbc(a, f, v); });
+}
+
+TEST_F(DecimalTest, binaryModeIgnoresTables) {
+    // 0x58 + 0x46 + 1 is 0x9F in binary, 0x05 with carry in decimal
+    Byte a = 0x58;
+    Flags f = unpackFlags(0x01);
+    adc(a, f, 0x46);
+    EXPECT_EQ(0x9F, a);
+    EXPECT_EQ(0, f.c);
+
+    a = 0x58;
+    f = unpackFlags(0x09);
+    adc(a, f, 0x46);
+    EXPECT_EQ(0x05, a);
+    EXPECT_EQ(1, f.c);
+}
@@ -0,0 +1,128 @@
+#include <gtest/gtest.h>
+#include "cpu.h"
+#include "memory.h"
+#include "delay.h"
+#include "enginecompare.h"
+#include <cstring>
+#include <vector>
+
+// Checks counted delay loops run in closed form against stepping them, on
+// every engine and with budgets that end inside a loop.
+
+class DelayTest : public EngineCompareTest {
+protected:
+    DelayTest() {}
+    ~DelayTest(){};
+
+    // Idle-loop fast-forward stays off, so stepping really steps
+    void shortcut(CPU & cpu, bool on) override {
+        cpu.skipDelayLoops = on;
+        cpu.skipIdleLoops = false;
+    }
+
+    // Runs to the trap in steps of every budget
+    void expectTrapsLikeStepping(std::initializer_list<uint64_t> budgets = { 1, 2, 3, 5, 8, 13, 100, 1000000 }) {
+        for (uint64_t budget : budgets)
+            EXPECT_EQ(CPU::StopReason::Trap, expectMatchesStepping(budget, 1000000).reason);
+    }
+};
+
+TEST_F(DelayTest, delayLoop) {
+    // loop: DEX / BNE loop
+    load(0x0200, { 0xCA, 0xD0, 0xFD });
+    DelayLoop loop = delayLoop(image, 0x0200, 0x0201, 5, 0);
+    EXPECT_EQ(5, loop.passes);
+    EXPECT_EQ(0x0203, loop.exit);
+    // DEX 1 and BNE 1 per pass, the taken branch 1 more on all but the last
+    EXPECT_EQ(5 * 2 + 4, loop.cycles);
+    EXPECT_EQ(256, delayLoop(image, 0x0200, 0x0201, 0, 0).passes);
+    // Not the BNE of this loop
+    EXPECT_EQ(0, delayLoop(image, 0x0200, 0x0202, 5, 0).passes);
+
+    // loop: INY / BNE loop
+    load(0x0300, { 0xC8, 0xD0, 0xFD });
+    EXPECT_EQ(16, delayLoop(image, 0x0300, 0x0301, 0, 0xF0).passes);
+
+    // loop: INC $0310 / BNE loop
+    load(0x0310, { 0xEE, 0x10, 0x03, 0xD0, 0xFB });
+    EXPECT_EQ(0, delayLoop(image, 0x0310, 0x0313, 0, 0).passes);
+    // loop: DEC $10 / BNE loop
+    load(0x0320, { 0xC6, 0x10, 0xD0, 0xFC });
+    image.write(0x10, 3);
+    EXPECT_EQ(3, delayLoop(image, 0x0320, 0x0322, 0, 0).passes);
+}
+
+TEST_F(DelayTest, registerLoops) {
+    // LDX #$07 / DEX / BNE / LDY #$F0 / INY / BNE / LDX #$00 / INX / BNE / JMP *
+    load(0x0200, { 0xA2, 0x07, 0xCA, 0xD0, 0xFD, 0xA0, 0xF0, 0xC8, 0xD0, 0xFD,
+                   0xA2, 0x00, 0xE8, 0xD0, 0xFD, 0x4C, 0x0F, 0x02 });
+    expectTrapsLikeStepping();
+}
+
+TEST_F(DelayTest, memoryLoops) {
+    // LDA #$09 / STA $10 / DEC $10 / BNE / INC $0300 / BNE / JMP *
+    load(0x0200, { 0xA9, 0x09, 0x85, 0x10, 0xC6, 0x10, 0xD0, 0xFC, 0xEE, 0x00, 0x03, 0xD0, 0xFB, 0x4C, 0x0D, 0x02 });
+    image.write(0x0300, 0xE0);
+    expectTrapsLikeStepping();
+}
+
+TEST_F(DelayTest, nestedLoops) {
+    // LDX #$00 / outer: LDY #$00 / inner: DEY / BNE inner / DEX / BNE outer / JMP *
+    load(0x0200, { 0xA2, 0x00, 0xA0, 0x00, 0x88, 0xD0, 0xFD, 0xCA, 0xD0, 0xF8, 0x4C, 0x0A, 0x02 });
+    expectTrapsLikeStepping({ 1, 7, 1000, 100000 });
+}
+
+TEST_F(DelayTest, loopAcrossPage) {
+    // JMP loop / loop at $02FE: DEX / BNE loop, taken across a page
+    load(0x0200, { 0xA2, 0x30, 0x4C, 0xFE, 0x02 });
+    load(0x02FE, { 0xCA, 0xD0, 0xFD, 0x4C, 0x01, 0x03 });
+    expectTrapsLikeStepping();
+}
+
+TEST_F(DelayTest, counterInsideLoop) {
+    // loop: DEC $0201 / BNE loop: the counter is the DEC's own operand
+    load(0x0200, { 0xCE, 0x01, 0x02, 0xD0, 0xFB, 0x4C, 0x05, 0x02 });
+    Memory mem = image;
+    EXPECT_EQ(0, delayLoop(mem, 0x0200, 0x0203, 0, 0).passes);
+}
+
+TEST_F(DelayTest, breakpointInsideLoop) {
+    // LDX #$40 / loop: DEX / BNE loop / JMP *
+    load(0x0200, { 0xA2, 0x40, 0xCA, 0xD0, 0xFD, 0x4C, 0x05, 0x02 });
+    Memory mem = image;
+    CPU cpu(&mem);
+    cpu.PC = 0x0200;
+    cpu.cycles = 0;
+    cpu.setBreakpoint(0x0202);
+    int stops = 0;
+    while (cpu.run(1000000) == CPU::StopReason::Breakpoint)
+        stops++;
+    EXPECT_EQ(0x40, stops);
+    EXPECT_EQ(0x0205, cpu.PC);
+}
+
+TEST_F(DelayTest, fastCpu) {
+    // LDX #$00 / outer: LDY #$00 / inner: DEY / BNE inner / DEX / BNE outer / JMP *
+    load(0x0200, { 0xA2, 0x00, 0xA0, 0x00, 0x88, 0xD0, 0xFD, 0xCA, 0xD0, 0xF8, 0x4C, 0x0A, 0x02 });
+    Memory stepped = image;
+    Memory skipped = image;
+    FastCPU expected(&stepped);
+    FastCPU cpu(&skipped);
+    expected.skipDelayLoops = false;
+    for (FastCPU * c : { &expected, &cpu }) {
+        c->PC = 0x0200;
+        c->cycles = 0;
+    }
+    for (int step = 0; step < 100; step++) {
+        CPU::StopReason reason = expected.run(9973);
+        ASSERT_EQ(reason, cpu.run(9973));
+        ASSERT_EQ(expected.PC, cpu.PC);
+        ASSERT_EQ(expected.X, cpu.X);
+        ASSERT_EQ(expected.Y, cpu.Y);
+        ASSERT_EQ(expected.P, cpu.P);
+        ASSERT_EQ(expected.cycles, cpu.cycles);
+        if (reason != CPU::StopReason::Budget)
+            break;
+    }
+    EXPECT_EQ(0x020A, cpu.PC);
+}
@@ -0,0 +1,200 @@
+#include <gtest/gtest.h>
+#include "cpu.h"
+#include "memory.h"
+#include "opcodes.h"
+#include <cstring>
+#include <random>
+
+// Runs every documented opcode through both CPU::execute() and the dispatch
+// loop behind CPU::run() from identical random states and checks that the
+// results match exactly, then covers the run() stop reasons.
+
+class DispatchTest : public ::testing::Test {
+protected:
+    Memory tableMem;
+    Memory dispatchMem;
+    CPU tableCpu;
+    CPU dispatchCpu;
+    std::mt19937 rng;
+
+    DispatchTest()
+        : tableMem()
+        , dispatchMem()
+        , tableCpu(&tableMem)
+        , dispatchCpu(&dispatchMem)
+        , rng(6502)
+    {};
+    ~DispatchTest(){};
+
+    void randomState(Byte opcode) {
+        for (int i = 0; i < MEMORY_SIZE; i++)
+            tableMem.write(i, rng());
+
+        tableCpu.PC = 0x0200 + rng() % 0x7D00;
+        tableCpu.A = rng();
+        tableCpu.X = rng();
+        tableCpu.Y = rng();
+        tableCpu.SP = rng();
+        tableCpu.P = rng();
+        tableCpu.cycles = rng() % 1000;
+        tableMem.write(tableCpu.PC, opcode);
+
+        // BRK takes no cycles, so give it a NOP to land on
+        Word vector = tableCpu.PC ^ 0x8000;
+        tableMem.write(0xFFFE, vector & 0xFF);
+        tableMem.write(0xFFFF, vector >> 8);
+        tableMem.write(vector, 0xEA);
+
+        std::memcpy(dispatchMem.mem, tableMem.mem, MEMORY_SIZE);
+        dispatchCpu.PC = tableCpu.PC;
+        dispatchCpu.A = tableCpu.A;
+        dispatchCpu.X = tableCpu.X;
+        dispatchCpu.Y = tableCpu.Y;
+        dispatchCpu.SP = tableCpu.SP;
+        dispatchCpu.P = tableCpu.P;
+        dispatchCpu.cycles = tableCpu.cycles;
+    }
+
+    void expectSameState(Byte opcode) {
+        SCOPED_TRACE(testing::Message() << "opcode 0x" << std::hex << int(opcode));
+        EXPECT_EQ(tableCpu.PC, dispatchCpu.PC);
+        EXPECT_EQ(tableCpu.A, dispatchCpu.A);
+        EXPECT_EQ(tableCpu.X, dispatchCpu.X);
+        EXPECT_EQ(tableCpu.Y, dispatchCpu.Y);
+        EXPECT_EQ(tableCpu.SP, dispatchCpu.SP);
+        EXPECT_EQ(tableCpu.P, dispatchCpu.P);
+        EXPECT_EQ(tableCpu.cycles, dispatchCpu.cycles);
+        EXPECT_EQ(0, std::memcmp(tableMem.mem, dispatchMem.mem, MEMORY_SIZE));
+    }
+};
+
+TEST_F(DispatchTest, matchesTableForAllDocumentedOpcodes) {
+    for (Byte opcode : documentedOpcodes) {
+        for (int trial = 0; trial < 16; trial++) {
+            randomState(opcode);
+
+            long long limit = tableCpu.cycles + 1;
+            while (tableCpu.cycles < limit)
+                tableCpu.execute();
+            dispatchCpu.run(1);
+
+            expectSameState(opcode);
+            if (HasFailure())
+                return;
+        }
+    }
+}
+
+TEST_F(DispatchTest, stopsOnUnimplementedOpcode) {
+    dispatchMem.write(0x0200, 0xE8); // INX
+    dispatchMem.write(0x0201, 0x02); // unimplemented
+    dispatchCpu.PC = 0x0200;
+    dispatchCpu.X = 0;
+    dispatchCpu.cycles = 0;
+    EXPECT_EQ(CPU::StopReason::Halt, dispatchCpu.run(1000));
+    EXPECT_EQ(0x0201, dispatchCpu.PC);
+    EXPECT_EQ((Byte)1, dispatchCpu.X);
+    EXPECT_EQ(1, dispatchCpu.cycles);
+}
+
+TEST_F(DispatchTest, runsCountedLoop) {
+    // LDX #$05 / loop: DEX / BNE loop / unimplemented
+    dispatchMem.write(0x0200, 0xA2);
+    dispatchMem.write(0x0201, 0x05);
+    dispatchMem.write(0x0202, 0xCA);
+    dispatchMem.write(0x0203, 0xD0);
+    dispatchMem.write(0x0204, 0xFD);
+    dispatchMem.write(0x0205, 0x02);
+    dispatchCpu.PC = 0x0200;
+    dispatchCpu.P = 0;
+    dispatchCpu.cycles = 0;
+    EXPECT_EQ(CPU::StopReason::Halt, dispatchCpu.run(1000));
+    EXPECT_EQ(0x0205, dispatchCpu.PC);
+    EXPECT_EQ((Byte)0, dispatchCpu.X);
+    EXPECT_EQ((Byte)1, dispatchCpu.Z());
+    // LDX 1 + 5 * DEX 1 + 4 taken BNE 2 + final BNE 1
+    EXPECT_EQ(1 + 5 + 4 * 2 + 1, dispatchCpu.cycles);
+}
+
+TEST_F(DispatchTest, stopsWhenBudgetExhausted) {
+    // loop: INX / JMP loop
+    dispatchMem.write(0x0200, 0xE8);
+    dispatchMem.write(0x0201, 0x4C);
+    dispatchMem.write(0x0202, 0x00);
+    dispatchMem.write(0x0203, 0x02);
+    dispatchCpu.PC = 0x0200;
+    dispatchCpu.X = 0;
+    dispatchCpu.cycles = 0;
+    EXPECT_EQ(CPU::StopReason::Budget, dispatchCpu.run(30));
+    EXPECT_EQ(30, dispatchCpu.cycles);
+    EXPECT_EQ((Byte)10, dispatchCpu.X);
+    EXPECT_EQ(0x0200, dispatchCpu.PC);
+}
+
+TEST_F(DispatchTest, stopsOnJumpToSelf) {
+    dispatchMem.write(0x0200, 0xEA); // NOP
+    dispatchMem.write(0x0201, 0x4C); // JMP $0201
+    dispatchMem.write(0x0202, 0x01);
+    dispatchMem.write(0x0203, 0x02);
+    dispatchCpu.PC = 0x0200;
+    dispatchCpu.cycles = 0;
+    EXPECT_EQ(CPU::StopReason::Trap, dispatchCpu.run(1000));
+    EXPECT_EQ(0x0201, dispatchCpu.PC);
+    EXPECT_EQ(3, dispatchCpu.cycles);
+}
+
+TEST_F(DispatchTest, stopsOnBranchToSelf) {
+    dispatchMem.write(0x0200, 0x18); // CLC
+    dispatchMem.write(0x0201, 0x90); // BCC *
+    dispatchMem.write(0x0202, 0xFE);
+    dispatchCpu.PC = 0x0200;
+    dispatchCpu.P = 0;
+    dispatchCpu.cycles = 0;
+    EXPECT_EQ(CPU::StopReason::Trap, dispatchCpu.run(1000));
+    EXPECT_EQ(0x0201, dispatchCpu.PC);
+}
+
+TEST_F(DispatchTest, stopsAtBreakpointAndResumes) {
+    // INX / INX / INX / unimplemented
+    dispatchMem.write(0x0200, 0xE8);
+    dispatchMem.write(0x0201, 0xE8);
+    dispatchMem.write(0x0202, 0xE8);
+    dispatchMem.write(0x0203, 0x02);
+    dispatchCpu.PC = 0x0200;
+    dispatchCpu.X = 0;
+    dispatchCpu.setBreakpoint(0x0201);
+    dispatchCpu.setBreakpoint(0x0202);
+    EXPECT_EQ(CPU::StopReason::Breakpoint, dispatchCpu.run(1000));
+    EXPECT_EQ(0x0201, dispatchCpu.PC);
+    EXPECT_EQ(CPU::StopReason::Breakpoint, dispatchCpu.run(1000));
+    EXPECT_EQ(0x0202, dispatchCpu.PC);
+    dispatchCpu.clearBreakpoints();
+    EXPECT_EQ(CPU::StopReason::Halt, dispatchCpu.run(1000));
+    EXPECT_EQ((Byte)3, dispatchCpu.X);
+}
+
+TEST_F(DispatchTest, runUntilStopsAtAddress) {
+    dispatchMem.write(0x0200, 0xE8);
+    dispatchMem.write(0x0201, 0xE8);
+    dispatchMem.write(0x0202, 0x02);
+    dispatchCpu.PC = 0x0200;
+    dispatchCpu.X = 0;
+    EXPECT_EQ(CPU::StopReason::Breakpoint, dispatchCpu.runUntil(0x0201, 1000));
+    EXPECT_EQ(0x0201, dispatchCpu.PC);
+    EXPECT_EQ((Byte)1, dispatchCpu.X);
+    EXPECT_EQ(0, dispatchCpu.breakpointCount);
+}
+
+TEST_F(DispatchTest, phpMaterialisesLazyFlags) {
+    // SEC / LDA #$7F / ADC #$00 / PHP / unimplemented
+    const Byte program[] = { 0x38, 0xA9, 0x7F, 0x69, 0x00, 0x08, 0x02 };
+    dispatchMem.writeBlock(0x0200, program, sizeof(program));
+    dispatchCpu.PC = 0x0200;
+    dispatchCpu.SP = 0xFF;
+    dispatchCpu.P = 0;
+    EXPECT_EQ(CPU::StopReason::Halt, dispatchCpu.run(1000));
+    EXPECT_EQ((Byte)0x80, dispatchCpu.A);
+    // N and V set, Z and C clear, B and bit 5 forced on the pushed copy
+    EXPECT_EQ((Byte)0xF0, dispatchMem.read(0x01FF));
+    EXPECT_EQ((Byte)0xC0, dispatchCpu.P);
+}
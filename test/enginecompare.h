@@ -0,0 +1,74 @@
+#pragma once
+
+#include <gtest/gtest.h>
+#include "cpu.h"
+#include "memory.h"
+#include <vector>
+
+// Fixtures for suites that load a guest program once and run copies of it on
+// fresh CPUs, and for those checking an engine shortcut against stepping.
+
+class ImageTest : public ::testing::Test {
+protected:
+    Memory image;
+
+    ImageTest() : image() {}
+    ~ImageTest(){};
+
+    void load(Word addr, const std::vector<Byte> & program) {
+        image.writeBlock(addr, program.data(), program.size());
+    }
+};
+
+// Runs the image from $0200 with and without a shortcut that must not change
+// what the guest sees, such as idle-loop fast-forward; suites say which in
+// shortcut()
+class EngineCompareTest : public ImageTest {
+protected:
+    struct Result {
+        CPU::StopReason reason;
+        Word pc;
+        Byte a, x, y, sp, p;
+        long long cycles;
+        std::vector<Byte> mem;
+
+        bool operator==(const Result & o) const {
+            return reason == o.reason && pc == o.pc && a == o.a && x == o.x && y == o.y && sp == o.sp && p == o.p
+                && cycles == o.cycles && mem == o.mem;
+        }
+    };
+
+    // Turns the shortcut under test on or off
+    virtual void shortcut(CPU & cpu, bool on) = 0;
+
+    // Runs the image on a fresh CPU in steps of budget cycles, until a step
+    // stops for anything but the budget
+    Result run(CPU::Engine engine, bool on, uint64_t budget, int steps = 1) {
+        Memory mem = image;
+        CPU cpu(&mem);
+        cpu.engine = engine;
+        cpu.jitThreshold = 0;
+        shortcut(cpu, on);
+        cpu.PC = 0x0200;
+        cpu.A = cpu.X = cpu.Y = 0;
+        cpu.SP = 0xFF;
+        cpu.P = 0x20;
+        cpu.cycles = 0;
+        CPU::StopReason reason = CPU::StopReason::Budget;
+        for (int step = 0; step < steps && reason == CPU::StopReason::Budget; step++)
+            reason = cpu.run(budget);
+        return Result { reason, cpu.PC, cpu.A, cpu.X, cpu.Y, cpu.SP, cpu.P, cpu.cycles,
+                        std::vector<Byte>(mem.mem, mem.mem + MEMORY_SIZE) };
+    }
+
+    // Every engine with the shortcut against the dispatch loop without it;
+    // returns what the dispatch loop reached
+    Result expectMatchesStepping(uint64_t budget, int steps = 1) {
+        Result expected = run(CPU::Engine::Dispatch, false, budget, steps);
+        for (CPU::Engine engine : { CPU::Engine::Dispatch, CPU::Engine::Blocks, CPU::Engine::Jit }) {
+            SCOPED_TRACE(testing::Message() << "engine " << int(engine) << ", budget " << budget);
+            EXPECT_TRUE(expected == run(engine, true, budget, steps));
+        }
+        return expected;
+    }
+};
@@ -0,0 +1,169 @@
+#include <gtest/gtest.h>
+#include "cpu.h"
+#include "memory.h"
+#include "blockcache.h"
+#include <cstring>
+#include <vector>
+
+// Checks the block engine's fused opcode pairs against the dispatch loop,
+// with budgets small enough to stop between the two halves of a pair.
+
+class FusionTest : public ::testing::Test {
+protected:
+    Memory dispatchMem;
+    Memory blockMem;
+    CPU dispatchCpu;
+    CPU blockCpu;
+
+    FusionTest()
+        : dispatchMem()
+        , blockMem()
+        , dispatchCpu(&dispatchMem)
+        , blockCpu(&blockMem)
+    {
+        blockCpu.engine = CPU::Engine::Blocks;
+    };
+    ~FusionTest(){};
+
+    void load(const std::vector<Byte> & image) {
+        std::memcpy(dispatchMem.mem, image.data(), MEMORY_SIZE);
+        dispatchCpu.PC = 0x0200;
+        dispatchCpu.A = dispatchCpu.X = dispatchCpu.Y = 0;
+        dispatchCpu.SP = 0xFF;
+        dispatchCpu.P = 0x20;
+        dispatchCpu.cycles = 0;
+    }
+
+    // Runs both engines from the loaded state, in steps of budget cycles,
+    // until the program traps
+    void runInSteps(uint64_t budget) {
+        std::memcpy(blockMem.mem, dispatchMem.mem, MEMORY_SIZE);
+        blockCpu.blockCache.reset();
+        blockCpu.PC = dispatchCpu.PC;
+        blockCpu.A = dispatchCpu.A;
+        blockCpu.X = dispatchCpu.X;
+        blockCpu.Y = dispatchCpu.Y;
+        blockCpu.SP = dispatchCpu.SP;
+        blockCpu.P = dispatchCpu.P;
+        blockCpu.cycles = dispatchCpu.cycles;
+
+        for (int step = 0; step < 10000; step++) {
+            CPU::StopReason expected = dispatchCpu.run(budget);
+            ASSERT_EQ(expected, blockCpu.run(budget));
+            ASSERT_EQ(dispatchCpu.PC, blockCpu.PC);
+            ASSERT_EQ(dispatchCpu.A, blockCpu.A);
+            ASSERT_EQ(dispatchCpu.X, blockCpu.X);
+            ASSERT_EQ(dispatchCpu.Y, blockCpu.Y);
+            ASSERT_EQ(dispatchCpu.SP, blockCpu.SP);
+            ASSERT_EQ(dispatchCpu.P, blockCpu.P);
+            ASSERT_EQ(dispatchCpu.cycles, blockCpu.cycles);
+            ASSERT_EQ(0, std::memcmp(dispatchMem.mem, blockMem.mem, MEMORY_SIZE));
+            if (expected != CPU::StopReason::Budget)
+                return;
+        }
+        FAIL() << "program did not trap";
+    }
+
+    // Loads program at $0200 over whatever the test stored in dispatchMem
+    void expectMatchesDispatch(const Byte * program, size_t size) {
+        dispatchMem.writeBlock(0x0200, program, size);
+        std::vector<Byte> image(dispatchMem.mem, dispatchMem.mem + MEMORY_SIZE);
+        for (uint64_t budget : { 1, 2, 3, 4, 5, 7, 11, 1000000 }) {
+            SCOPED_TRACE(testing::Message() << "budget " << budget);
+            load(image);
+            runInSteps(budget);
+            if (HasFailure())
+                return;
+        }
+    }
+
+    // Whether entry index of the block at start is a superinstruction
+    bool fusedAt(Word start, size_t index) {
+        return blockCpu.blockCache->lookup(start).fused.at(index).second != nullptr;
+    }
+};
+
+TEST_F(FusionTest, fusionSet) {
+    EXPECT_TRUE(fusesPair(0xCA, 0xD0));     // DEX / BNE
+    EXPECT_TRUE(fusesPair(0x88, 0xD0));     // DEY / BNE
+    EXPECT_TRUE(fusesPair(0xA9, 0x85));     // LDA # / STA zp
+    EXPECT_TRUE(fusesPair(0xB1, 0x91));     // LDA (zp),Y / STA (zp),Y
+    EXPECT_TRUE(fusesPair(0xC9, 0xF0));     // CMP # / BEQ
+    EXPECT_TRUE(fusesPair(0xE6, 0xD0));     // INC zp / BNE
+    EXPECT_TRUE(fusesPair(0xEE, 0xD0));     // INC abs / BNE
+    EXPECT_FALSE(fusesPair(0xFE, 0xD0));    // INC abs,X / BNE
+    EXPECT_FALSE(fusesPair(0xD0, 0xCA));
+    EXPECT_FALSE(fusesPair(0xE8, 0xD0));
+}
+
+TEST_F(FusionTest, dexBne) {
+    // LDX #$05 / loop: DEX / BNE loop / JMP *
+    const Byte program[] = { 0xA2, 0x05, 0xCA, 0xD0, 0xFD, 0x4C, 0x05, 0x02 };
+    expectMatchesDispatch(program, sizeof(program));
+    EXPECT_TRUE(fusedAt(0x0202, 0));
+}
+
+TEST_F(FusionTest, deyBne) {
+    // LDY #$05 / loop: DEY / BNE loop / JMP *
+    const Byte program[] = { 0xA0, 0x05, 0x88, 0xD0, 0xFD, 0x4C, 0x05, 0x02 };
+    expectMatchesDispatch(program, sizeof(program));
+    EXPECT_TRUE(fusedAt(0x0202, 0));
+}
+
+TEST_F(FusionTest, indirectLoadStore) {
+    // LDY #$10 / loop: LDA ($10),Y / STA ($12),Y / DEY / BNE loop / JMP *
+    // ($10) -> $3000, ($12) -> $40F8, so the stores cross a page
+    dispatchMem.write(0x10, 0x00);
+    dispatchMem.write(0x11, 0x30);
+    dispatchMem.write(0x12, 0xF8);
+    dispatchMem.write(0x13, 0x40);
+    for (int i = 0; i < 0x20; i++)
+        dispatchMem.write(0x3000 + i, 0x80 + i);
+    const Byte program[] = { 0xA0, 0x10, 0xB1, 0x10, 0x91, 0x12, 0x88, 0xD0, 0xF9, 0x4C, 0x09, 0x02 };
+    expectMatchesDispatch(program, sizeof(program));
+    EXPECT_TRUE(fusedAt(0x0202, 0));
+    EXPECT_TRUE(fusedAt(0x0202, 1));
+    EXPECT_EQ((Byte)0x90, blockMem.read(0x4108));
+}
+
+TEST_F(FusionTest, immediateLoadStore) {
+    // LDA #$42 / STA $0300 / LDA #$00 / STA $10 / JMP *
+    const Byte program[] = { 0xA9, 0x42, 0x8D, 0x00, 0x03, 0xA9, 0x00, 0x85, 0x10, 0x4C, 0x09, 0x02 };
+    expectMatchesDispatch(program, sizeof(program));
+    EXPECT_TRUE(fusedAt(0x0200, 0));
+    EXPECT_TRUE(fusedAt(0x0200, 1));
+}
+
+TEST_F(FusionTest, loadStoreRewritingCode) {
+    // LDA #$E8 / STA $0205 / NOP / JMP *: the fused store turns the NOP into INX
+    const Byte program[] = { 0xA9, 0xE8, 0x8D, 0x05, 0x02, 0xEA, 0x4C, 0x06, 0x02 };
+    expectMatchesDispatch(program, sizeof(program));
+    EXPECT_EQ((Byte)1, blockCpu.X);
+}
+
+TEST_F(FusionTest, cmpBeq) {
+    // LDX #$00 / loop: INX / TXA / CMP #$08 / BEQ done / JMP loop / done: JMP *
+    const Byte program[] = { 0xA2, 0x00, 0xE8, 0x8A, 0xC9, 0x08, 0xF0, 0x03, 0x4C, 0x02, 0x02, 0x4C, 0x0B, 0x02 };
+    expectMatchesDispatch(program, sizeof(program));
+    EXPECT_TRUE(fusedAt(0x0202, 2));
+}
+
+TEST_F(FusionTest, incBne) {
+    // loop: INC $10 / BNE loop / INC $0300 / BNE loop / JMP *
+    const Byte program[] = { 0xE6, 0x10, 0xD0, 0xFC, 0xEE, 0x00, 0x03, 0xD0, 0xF7, 0x4C, 0x09, 0x02 };
+    dispatchMem.write(0x10, 0xF0);
+    dispatchMem.write(0x0300, 0xFD);
+    expectMatchesDispatch(program, sizeof(program));
+    EXPECT_TRUE(fusedAt(0x0200, 0));
+    EXPECT_TRUE(fusedAt(0x0204, 0));
+}
+
+TEST_F(FusionTest, incIntoBranchIsNotFused) {
+    // loop: INC $0204 / BNE loop: the INC rewrites the branch offset, so the
+    // second pass branches to $0201 and halts on its unimplemented opcode
+    const Byte program[] = { 0xEE, 0x04, 0x02, 0xD0, 0xFA };
+    expectMatchesDispatch(program, sizeof(program));
+    EXPECT_EQ(0x0201, blockCpu.PC);
+    blockCpu.blockCache->flushDirty();
+    EXPECT_FALSE(fusedAt(0x0200, 0));
+}
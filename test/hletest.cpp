@@ -0,0 +1,429 @@
+#include <gtest/gtest.h>
+#include "cpu.h"
+#include "memory.h"
+#include "enginecompare.h"
+#include <functional>
+#include <string>
+#include <vector>
+
+// Checks native routines hooked to guest addresses against the guest code
+// they replace, on every engine and on the table core, the verification
+// mode that runs both, and host-call traps.
+
+class HleTest : public ImageTest {
+protected:
+    struct Result {
+        CPU::StopReason reason;
+        Word pc;
+        Byte a, x, y, sp, p;
+        long long cycles;
+        std::vector<Byte> mem;
+    };
+
+    HleTest() {
+        // mul: $13:$12 = $10 * $11, shift and add; leaves X 0, Z set and C, V clear
+        load(0x0300, { 0xA9, 0x00,          // LDA #$00
+                       0xA2, 0x08,          // LDX #$08
+                       0x46, 0x10,          // loop: LSR $10
+                       0x90, 0x03,          // BCC skip
+                       0x18,                // CLC
+                       0x65, 0x11,          // ADC $11
+                       0x6A,                // skip: ROR A
+                       0x66, 0x12,          // ROR $12
+                       0xCA,                // DEX
+                       0xD0, 0xF3,          // BNE loop
+                       0x85, 0x13,          // STA $13
+                       0x18,                // CLC
+                       0xB8,                // CLV
+                       0x60 });             // RTS
+        // copy: $24 bytes (256 for 0) from ($20) to ($22)
+        load(0x0340, { 0xA0, 0x00,          // LDY #$00
+                       0xB1, 0x20,          // loop: LDA ($20),Y
+                       0x91, 0x22,          // STA ($22),Y
+                       0xC8,                // INY
+                       0xC4, 0x24,          // CPY $24
+                       0xD0, 0xF7,          // BNE loop
+                       0x60 });             // RTS
+        // tail: JMP mul
+        load(0x0360, { 0x4C, 0x00, 0x03 });
+        for (int i = 0; i < 256; i++)
+            image.write(0x0600 + i, Byte(i * 7 + 3));
+    }
+    ~HleTest(){};
+
+    static void mul(CPUState & cpu) {
+        Memory & m = *cpu.mem;
+        int product = m.read(0x10) * m.read(0x11);
+        m.write(0x10, 0);
+        m.write(0x12, product & 0xFF);
+        m.write(0x13, product >> 8);
+        cpu.A = product >> 8;
+        cpu.X = 0;
+        cpu.setN(false);
+        cpu.setZ(true);
+        cpu.setC(false);
+        cpu.setV(false);
+    }
+
+    static void copy(CPUState & cpu) {
+        Memory & m = *cpu.mem;
+        Word from = m.read16(0x20);
+        Word to = m.read16(0x22);
+        int length = m.read(0x24) ? m.read(0x24) : 256;
+        for (int i = 0; i < length; i++)
+            m.write(Word(to + i), m.read(Word(from + i)));
+        cpu.A = m.read(Word(from + length - 1));
+        cpu.Y = Byte(length);
+        cpu.setN(false);
+        cpu.setZ(true);
+        cpu.setC(true);
+    }
+
+    static void hookAll(CPUState & cpu) {
+        cpu.hookRoutine(0x0300, mul, 60);
+        cpu.hookRoutine(0x0340, copy, 40);
+    }
+
+    // mul 13 * 21, mul 255 * 255 through tail, copy 200 bytes, JMP *
+    void loadCaller() {
+        load(0x0200, { 0xA9, 0x0D, 0x85, 0x10, 0xA9, 0x15, 0x85, 0x11, 0x20, 0x00, 0x03,     // $0200
+                       0xA5, 0x12, 0x85, 0x30, 0xA5, 0x13, 0x85, 0x31,                         // $020B
+                       0xA9, 0xFF, 0x85, 0x10, 0x85, 0x11, 0x20, 0x60, 0x03,                   // $0213
+                       0xA9, 0x00, 0x85, 0x20, 0x85, 0x22, 0xA9, 0x06, 0x85, 0x21,             // $021C
+                       0xA9, 0x07, 0x85, 0x23, 0xA9, 0xC8, 0x85, 0x24, 0x20, 0x40, 0x03,       // $0226
+                       0x4C, 0x31, 0x02 });                                                    // $0231
+    }
+
+    static void start(CPUState & cpu) {
+        cpu.PC = 0x0200;
+        cpu.A = cpu.X = cpu.Y = 0;
+        cpu.SP = 0xFF;
+        cpu.P = 0x20;
+        cpu.cycles = 0;
+    }
+
+    Result run(CPU::Engine engine, bool hooked, bool verify, uint64_t budget = 1000000) {
+        Memory mem = image;
+        CPU cpu(&mem);
+        cpu.engine = engine;
+        cpu.jitThreshold = 0;
+        if (hooked)
+            hookAll(cpu);
+        cpu.verifyRoutines = verify;
+        start(cpu);
+        CPU::StopReason reason = CPU::StopReason::Budget;
+        for (int step = 0; step < 100000 && reason == CPU::StopReason::Budget; step++)
+            reason = cpu.run(budget);
+        return Result { reason, cpu.PC, cpu.A, cpu.X, cpu.Y, cpu.SP, cpu.P, cpu.cycles,
+                        std::vector<Byte>(mem.mem, mem.mem + MEMORY_SIZE) };
+    }
+
+    static void expectSameState(const Result & expected, const Result & actual) {
+        EXPECT_EQ(expected.reason, actual.reason);
+        EXPECT_EQ(expected.pc, actual.pc);
+        EXPECT_EQ(expected.a, actual.a);
+        EXPECT_EQ(expected.x, actual.x);
+        EXPECT_EQ(expected.y, actual.y);
+        EXPECT_EQ(expected.sp, actual.sp);
+        EXPECT_EQ(expected.p, actual.p);
+        EXPECT_TRUE(expected.mem == actual.mem);
+    }
+};
+
+TEST_F(HleTest, nativeMatchesGuest) {
+    loadCaller();
+    Result guest = run(CPU::Engine::Dispatch, false, false);
+    EXPECT_EQ(CPU::StopReason::Trap, guest.reason);
+    EXPECT_EQ(0x0231, guest.pc);
+    EXPECT_EQ(13 * 21, guest.mem[0x30] | (guest.mem[0x31] << 8));
+    EXPECT_EQ(255 * 255, guest.mem[0x12] | (guest.mem[0x13] << 8));
+    EXPECT_EQ(guest.mem[0x0600 + 199], guest.mem[0x0700 + 199]);
+
+    for (uint64_t budget : { 1, 7, 1000000 }) {
+        for (CPU::Engine engine : { CPU::Engine::Dispatch, CPU::Engine::Blocks, CPU::Engine::Jit }) {
+            SCOPED_TRACE(testing::Message() << "engine " << int(engine) << ", budget " << budget);
+            Result hooked = run(engine, true, false, budget);
+            expectSameState(guest, hooked);
+            EXPECT_LT(hooked.cycles, guest.cycles);
+        }
+    }
+}
+
+TEST_F(HleTest, tableCore) {
+    loadCaller();
+    Result guest = run(CPU::Engine::Dispatch, true, false);
+    Memory mem = image;
+    CPU cpu(&mem);
+    hookAll(cpu);
+    start(cpu);
+    for (int step = 0; step < 100000 && cpu.PC != 0x0231; step++)
+        cpu.execute();
+    EXPECT_EQ(0x0231, cpu.PC);
+    EXPECT_EQ(guest.a, cpu.A);
+    EXPECT_EQ(guest.y, cpu.Y);
+    EXPECT_EQ(guest.p, cpu.P);
+    EXPECT_TRUE(guest.mem == std::vector<Byte>(mem.mem, mem.mem + MEMORY_SIZE));
+    // The trap's own JMP is not charged yet
+    EXPECT_EQ(guest.cycles - opcodeCycles[0x4C], cpu.cycles);
+}
+
+TEST_F(HleTest, cyclesCharged) {
+    // JSR mul / JMP *
+    load(0x0200, { 0x20, 0x00, 0x03, 0x4C, 0x03, 0x02 });
+    Memory mem = image;
+    CPU cpu(&mem);
+    hookAll(cpu);
+    start(cpu);
+    // The routine is part of the JSR, which starts within the budget
+    EXPECT_EQ(CPU::StopReason::Budget, cpu.run(1));
+    EXPECT_EQ(0x0203, cpu.PC);
+    EXPECT_EQ(0xFF, cpu.SP);
+    EXPECT_EQ(opcodeCycles[0x20] + 60, cpu.cycles);
+    EXPECT_EQ(CPU::StopReason::Trap, cpu.run(1000));
+    EXPECT_EQ(opcodeCycles[0x20] + 60 + opcodeCycles[0x4C], cpu.cycles);
+
+    // FastCPU counts the routine as one instruction
+    Memory fastMem = image;
+    FastCPU fast(&fastMem);
+    hookAll(fast);
+    start(fast);
+    EXPECT_EQ(CPU::StopReason::Trap, fast.run(1000));
+    EXPECT_EQ(3, fast.cycles);
+}
+
+TEST_F(HleTest, registry) {
+    Memory mem = image;
+    CPU cpu(&mem);
+    EXPECT_FALSE(cpu.routinePages[0x03]);
+    hookAll(cpu);
+    EXPECT_TRUE(cpu.routinePages[0x03]);
+    EXPECT_EQ(2u, cpu.routines.size());
+    cpu.unhookRoutine(0x0300);
+    EXPECT_TRUE(cpu.routinePages[0x03]);
+    cpu.unhookRoutine(0x0340);
+    EXPECT_FALSE(cpu.routinePages[0x03]);
+    EXPECT_TRUE(cpu.routines.empty());
+    hookAll(cpu);
+    cpu.clearRoutines();
+    EXPECT_FALSE(cpu.routinePages[0x03]);
+    EXPECT_TRUE(cpu.routines.empty());
+}
+
+TEST_F(HleTest, unhookedAddressOnHookedPage) {
+    // JSR mul + 2 (LDX #$08 onwards, with A 0 already) / JMP *
+    load(0x0200, { 0x20, 0x02, 0x03, 0x4C, 0x03, 0x02 });
+    image.write(0x10, 6);
+    image.write(0x11, 7);
+    Memory mem = image;
+    CPU cpu(&mem);
+    int calls = 0;
+    cpu.hookRoutine(0x0300, [&](CPUState & c) { calls++; mul(c); }, 60);
+    start(cpu);
+    EXPECT_EQ(CPU::StopReason::Trap, cpu.run(1000000));
+    EXPECT_EQ(42, mem.read(0x12));
+    EXPECT_EQ(0, calls);
+}
+
+TEST_F(HleTest, breakpoints) {
+    // JSR mul / NOP / JMP *
+    load(0x0200, { 0x20, 0x00, 0x03, 0xEA, 0x4C, 0x04, 0x02 });
+    Memory mem = image;
+    CPU cpu(&mem);
+    hookAll(cpu);
+    start(cpu);
+    // The guest code at the entry never runs; the return address stops the run
+    cpu.setBreakpoint(0x0300);
+    cpu.setBreakpoint(0x0203);
+    EXPECT_EQ(CPU::StopReason::Breakpoint, cpu.run(1000000));
+    EXPECT_EQ(0x0203, cpu.PC);
+    EXPECT_EQ(opcodeCycles[0x20] + 60, cpu.cycles);
+    EXPECT_EQ(CPU::StopReason::Trap, cpu.run(1000000));
+    EXPECT_EQ(0x0204, cpu.PC);
+}
+
+TEST_F(HleTest, verifyMatches) {
+    loadCaller();
+    Result guest = run(CPU::Engine::Dispatch, false, false);
+    Result verified = run(CPU::Engine::Dispatch, true, true);
+    expectSameState(guest, verified);
+    // The guest's own results are kept, cycles included
+    EXPECT_EQ(guest.cycles, verified.cycles);
+}
+
+TEST_F(HleTest, verifyMismatch) {
+    loadCaller();
+    Result guest = run(CPU::Engine::Dispatch, false, false);
+    Memory mem = image;
+    CPU cpu(&mem);
+    hookAll(cpu);
+    // Off by one in the high byte of the product
+    cpu.hookRoutine(0x0300, [](CPUState & c) { mul(c); c.mem->write(0x13, c.mem->read(0x13) + 1); }, 60);
+    cpu.verifyRoutines = true;
+    start(cpu);
+    EXPECT_EQ(CPU::StopReason::Mismatch, cpu.run(1000000));
+    EXPECT_EQ(0x020B, cpu.PC);
+    EXPECT_EQ(1, cpu.routineMismatches);
+    // Resuming carries on from the guest's results
+    EXPECT_EQ(CPU::StopReason::Mismatch, cpu.run(1000000));
+    EXPECT_EQ(0x021C, cpu.PC);
+    EXPECT_EQ(CPU::StopReason::Trap, cpu.run(1000000));
+    EXPECT_EQ(2, cpu.routineMismatches);
+    EXPECT_EQ(guest.cycles, cpu.cycles);
+    EXPECT_TRUE(guest.mem == std::vector<Byte>(mem.mem, mem.mem + MEMORY_SIZE));
+
+    // The table core counts them too
+    Memory tableMem = image;
+    CPU table(&tableMem);
+    table.hookRoutine(0x0300, [](CPUState & c) { mul(c); c.A ^= 1; }, 60);
+    table.verifyRoutines = true;
+    start(table);
+    for (int step = 0; step < 100000 && table.PC != 0x0231; step++)
+        table.execute();
+    EXPECT_EQ(2, table.routineMismatches);
+    EXPECT_EQ(guest.cycles - opcodeCycles[0x4C], table.cycles);
+}
+
+TEST_F(HleTest, tracingCpu) {
+    loadCaller();
+    Result guest = run(CPU::Engine::Dispatch, false, false);
+    Memory mem = image;
+    TracingCPU cpu(&mem);
+    hookAll(cpu);
+    long long instructions = 0;
+    cpu.hooks.onInstruction = [&](const CPUTrace & trace) {
+        instructions++;
+        EXPECT_FALSE(trace.pc >= 0x0300 && trace.pc < 0x0360);
+    };
+    start(cpu);
+    EXPECT_EQ(CPU::StopReason::Trap, cpu.run(1000000));
+    EXPECT_EQ(guest.a, cpu.A);
+    EXPECT_TRUE(guest.mem == std::vector<Byte>(mem.mem, mem.mem + MEMORY_SIZE));
+    // The caller's 23, tail's JMP to mul and JMP *
+    EXPECT_EQ(25, instructions);
+}
+
+// Host calls
+
+class HostCallTest : public ImageTest {
+protected:
+    std::string output;
+
+    HostCallTest() {
+        // LDA #$01 / LDX #'A' / HCF / LDA #$02 / LDX #$00 / LDY #$03 / HCF / LDA #$00 / HCF / JMP *
+        load(0x0200, { 0xA9, 0x01, 0xA2, 0x41, 0x02, 0xA9, 0x02, 0xA2, 0x00, 0xA0, 0x03, 0x02,
+                       0xA9, 0x00, 0x02, 0x4C, 0x0F, 0x02 });
+        const char text[] = "Hello";
+        load(0x0300, std::vector<Byte>(text, text + sizeof(text)));
+    }
+    ~HostCallTest(){};
+
+    std::function<bool(CPUState &)> console() {
+        return [this](CPUState & cpu) {
+            if (cpu.A == 0)
+                return false;
+            if (cpu.A == 1)
+                output += char(cpu.X);
+            for (Word addr = cpu.X | (cpu.Y << 8); cpu.A == 2 && cpu.mem->read(addr); addr++)
+                output += char(cpu.mem->read(addr));
+            cpu.cycles += 10;
+            return true;
+        };
+    }
+};
+
+TEST_F(HostCallTest, everyEngine) {
+    for (uint64_t budget : { 1, 3, 1000 }) {
+        for (CPU::Engine engine : { CPU::Engine::Dispatch, CPU::Engine::Blocks, CPU::Engine::Jit }) {
+            SCOPED_TRACE(testing::Message() << "engine " << int(engine) << ", budget " << budget);
+            Memory mem = image;
+            CPU cpu(&mem);
+            cpu.engine = engine;
+            cpu.jitThreshold = 0;
+            cpu.hostCall = console();
+            cpu.PC = 0x0200;
+            cpu.cycles = 0;
+            output.clear();
+            CPU::StopReason reason = CPU::StopReason::Budget;
+            for (int step = 0; step < 1000 && reason == CPU::StopReason::Budget; step++)
+                reason = cpu.run(budget);
+            EXPECT_EQ(CPU::StopReason::Exit, reason);
+            EXPECT_EQ(0x020F, cpu.PC);
+            EXPECT_EQ("AHello", output);
+            // Six loads of 1 cycle, and 10 for each service that returns
+            EXPECT_EQ(6 + 20, cpu.cycles);
+        }
+    }
+}
+
+TEST_F(HostCallTest, withoutHandler) {
+    Memory mem = image;
+    CPU cpu(&mem);
+    cpu.PC = 0x0200;
+    EXPECT_EQ(CPU::StopReason::Halt, cpu.run(1000));
+    EXPECT_EQ(0x0204, cpu.PC);
+    // The table core leaves PC on it too
+    cpu.execute();
+    EXPECT_EQ(0x0204, cpu.PC);
+}
+
+TEST_F(HostCallTest, otherOpcode) {
+    Memory mem = image;
+    mem.write(0x0204, 0xFF);
+    CPU cpu(&mem);
+    cpu.hostCall = console();
+    cpu.PC = 0x0200;
+    EXPECT_EQ(CPU::StopReason::Halt, cpu.run(1000));
+    EXPECT_EQ(0x0204, cpu.PC);
+    cpu.hostCallOpcode = 0xFF;
+    cpu.PC = 0x0200;
+    EXPECT_EQ(CPU::StopReason::Halt, cpu.run(1000));
+    EXPECT_EQ(0x020B, cpu.PC);
+    EXPECT_EQ("A", output);
+}
+
+TEST_F(HostCallTest, tableCore) {
+    Memory mem = image;
+    CPU cpu(&mem);
+    cpu.hostCall = console();
+    cpu.PC = 0x0200;
+    cpu.cycles = 0;
+    for (int step = 0; step < 9; step++)
+        cpu.execute();
+    EXPECT_EQ(0x020F, cpu.PC);
+    EXPECT_EQ("AHello", output);
+    EXPECT_EQ(6 + 20, cpu.cycles);
+}
+
+TEST_F(HostCallTest, breakpointAfterCall) {
+    Memory mem = image;
+    CPU cpu(&mem);
+    cpu.hostCall = console();
+    cpu.PC = 0x0200;
+    cpu.setBreakpoint(0x0205);
+    EXPECT_EQ(CPU::StopReason::Breakpoint, cpu.run(1000));
+    EXPECT_EQ(0x0205, cpu.PC);
+    EXPECT_EQ("A", output);
+    EXPECT_EQ(CPU::StopReason::Exit, cpu.run(1000));
+}
+
+TEST_F(HostCallTest, fastAndTracingCpu) {
+    Memory fastMem = image;
+    FastCPU fast(&fastMem);
+    fast.hostCall = [this](CPUState & cpu) { output += char('0' + cpu.A); return cpu.A != 0; };
+    fast.PC = 0x0200;
+    fast.cycles = 0;
+    EXPECT_EQ(CPU::StopReason::Exit, fast.run(1000));
+    EXPECT_EQ("120", output);
+    EXPECT_EQ(9, fast.cycles);
+
+    Memory traceMem = image;
+    TracingCPU traced(&traceMem);
+    traced.hostCall = console();
+    std::vector<Word> pcs;
+    traced.hooks.onInstruction = [&](const CPUTrace & trace) { pcs.push_back(trace.pc); };
+    traced.PC = 0x0200;
+    output.clear();
+    EXPECT_EQ(CPU::StopReason::Exit, traced.run(1000));
+    EXPECT_EQ("AHello", output);
+    EXPECT_EQ(9u, pcs.size());
+}
@@ -0,0 +1,153 @@
+#include <gtest/gtest.h>
+#include "cpu.h"
+#include "memory.h"
+#include "idle.h"
+#include "enginecompare.h"
+#include <vector>
+
+// Checks idle-loop fast-forward: every engine must stop a run over an idle
+// loop with the registers and cycle count stepping reaches, and must get
+// through budgets far too large to step.
+
+class IdleTest : public EngineCompareTest {
+protected:
+    IdleTest() {}
+    ~IdleTest(){};
+
+    void shortcut(CPU & cpu, bool on) override { cpu.skipIdleLoops = on; }
+};
+
+TEST_F(IdleTest, idleSkip) {
+    EXPECT_EQ(0, idleSkip(100, 7, 100));
+    EXPECT_EQ(0, idleSkip(100, 7, 106));
+    EXPECT_EQ(7, idleSkip(100, 7, 107));
+    EXPECT_EQ(98, idleSkip(100, 7, 200));
+    EXPECT_EQ(0, idleSkip(100, 0, 200));
+}
+
+TEST_F(IdleTest, idleBody) {
+    // LDA $10 / AND #$80 / CMP $1234,X / BEQ
+    load(0x0200, { 0xA5, 0x10, 0x29, 0x80, 0xDD, 0x34, 0x12, 0xF0, 0xF7 });
+    EXPECT_TRUE(idleBody(image, 0x0200, 0x0207, nullptr));
+    // Must end exactly on the jump
+    EXPECT_FALSE(idleBody(image, 0x0200, 0x0206, nullptr));
+    std::bitset<MEMORY_SIZE> breakpoints;
+    breakpoints.set(0x0202);
+    EXPECT_FALSE(idleBody(image, 0x0200, 0x0207, &breakpoints));
+    // STA $10 / BEQ
+    load(0x0300, { 0x85, 0x10, 0xF0, 0xFC });
+    EXPECT_FALSE(idleBody(image, 0x0300, 0x0302, nullptr));
+    // PLA / BEQ
+    load(0x0310, { 0x68, 0xF0, 0xFD });
+    EXPECT_FALSE(idleBody(image, 0x0310, 0x0311, nullptr));
+}
+
+TEST_F(IdleTest, pollingLoop) {
+    // loop: LDA $10 / BPL loop: nothing will ever set bit 7 of $10
+    load(0x0200, { 0xA5, 0x10, 0x10, 0xFC });
+    for (uint64_t budget : { 1, 2, 5, 7, 8, 100, 1001, 100000 })
+        expectMatchesStepping(budget);
+    expectMatchesStepping(333, 50);
+}
+
+TEST_F(IdleTest, pollingLoopAcrossPage) {
+    // JMP loop / loop at $02FD: BIT $0310 / BVC loop, taken across a page
+    load(0x0200, { 0x4C, 0xFD, 0x02 });
+    load(0x02FD, { 0x2C, 0x10, 0x03, 0x50, 0xFB });
+    for (uint64_t budget : { 3, 10, 1000, 99999 })
+        expectMatchesStepping(budget);
+}
+
+TEST_F(IdleTest, jumpLoop) {
+    // LDX #$03 / loop: LDA $10 / CMP #$01 / NOP / JMP loop
+    load(0x0200, { 0xA2, 0x03, 0xA5, 0x10, 0xC9, 0x01, 0xEA, 0x4C, 0x02, 0x02 });
+    for (uint64_t budget : { 4, 12, 1000, 100003 })
+        expectMatchesStepping(budget);
+}
+
+TEST_F(IdleTest, workingLoops) {
+    // loop: INC $10 / LDA $10 / BNE loop / LDX #$00 / delay: DEX / BNE delay / JMP $0200
+    load(0x0200, { 0xE6, 0x10, 0xA5, 0x10, 0xD0, 0xFA, 0xA2, 0x00, 0xCA, 0xD0, 0xFD, 0x4C, 0x00, 0x02 });
+    for (uint64_t budget : { 1, 7, 1000, 100000 })
+        expectMatchesStepping(budget);
+}
+
+TEST_F(IdleTest, loopExitThatStores) {
+    // loop: LDA $10 / BEQ loop / INC $20 / LDA $10 / JMP loop. The loop
+    // block only reads, but its way out stores before jumping back to it
+    load(0x0200, { 0xA5, 0x10, 0xF0, 0xFC, 0xE6, 0x20, 0xA5, 0x10, 0x4C, 0x00, 0x02 });
+    load(0x0010, { 0x01 });
+    expectMatchesStepping(100000);
+}
+
+TEST_F(IdleTest, hugeBudget) {
+    load(0x0200, { 0xA5, 0x10, 0x10, 0xFC });
+    const uint64_t budget = 1000000000000ULL;
+    for (CPU::Engine engine : { CPU::Engine::Dispatch, CPU::Engine::Blocks, CPU::Engine::Jit }) {
+        SCOPED_TRACE(testing::Message() << "engine " << int(engine));
+        Result result = run(engine, true, budget);
+        EXPECT_EQ(CPU::StopReason::Budget, result.reason);
+        EXPECT_GE(result.cycles, (long long)budget);
+        EXPECT_LT(result.cycles, (long long)budget + 3);
+    }
+
+    Memory mem = image;
+    FastCPU fast(&mem);
+    fast.PC = 0x0200;
+    EXPECT_EQ(CPU::StopReason::Budget, fast.run(budget));
+    EXPECT_EQ((long long)budget, fast.cycles);
+    EXPECT_EQ(0x0200, fast.PC);
+}
+
+TEST_F(IdleTest, breakpoints) {
+    // LDX #$08 / delay: DEX / BNE delay / loop: LDA $10 / BPL loop
+    load(0x0200, { 0xA2, 0x08, 0xCA, 0xD0, 0xFD, 0xA5, 0x10, 0x10, 0xFC });
+    Memory stepped = image;
+    Memory skipped = image;
+    CPU expected(&stepped);
+    CPU cpu(&skipped);
+    expected.skipIdleLoops = false;
+    for (CPU * c : { &expected, &cpu }) {
+        c->PC = 0x0200;
+        c->cycles = 0;
+        c->setBreakpoint(0x0300);
+    }
+    // A breakpoint elsewhere leaves the loop idle
+    for (int step = 0; step < 20; step++) {
+        ASSERT_EQ(expected.run(99999), cpu.run(99999));
+        ASSERT_EQ(expected.PC, cpu.PC);
+        ASSERT_EQ(expected.cycles, cpu.cycles);
+    }
+    // One inside it stops the very next pass
+    expected.setBreakpoint(0x0207);
+    cpu.setBreakpoint(0x0207);
+    for (int step = 0; step < 3; step++) {
+        EXPECT_EQ(CPU::StopReason::Breakpoint, cpu.run(1000000));
+        EXPECT_EQ(expected.run(1000000), CPU::StopReason::Breakpoint);
+        EXPECT_EQ(0x0207, cpu.PC);
+        EXPECT_EQ(expected.cycles, cpu.cycles);
+    }
+}
+
+TEST_F(IdleTest, trapStillStops) {
+    // LDA $10 / JMP *
+    load(0x0200, { 0xA5, 0x10, 0x4C, 0x02, 0x02 });
+    for (CPU::Engine engine : { CPU::Engine::Dispatch, CPU::Engine::Blocks, CPU::Engine::Jit }) {
+        Result result = run(engine, true, 1000000);
+        EXPECT_EQ(CPU::StopReason::Trap, result.reason);
+        EXPECT_EQ(0x0202, result.pc);
+        EXPECT_EQ(4, result.cycles);
+    }
+}
+
+TEST_F(IdleTest, tracingSeesEveryPass) {
+    load(0x0200, { 0xA5, 0x10, 0x10, 0xFC });
+    Memory mem = image;
+    TracingCPU cpu(&mem);
+    cpu.PC = 0x0200;
+    long long instructions = 0;
+    cpu.hooks.onInstruction = [&](const CPUTrace &) { instructions++; };
+    cpu.run(60000);
+    // LDA zp and the taken BPL are 2 cycles each
+    EXPECT_EQ(30000, instructions);
+}
@@ -0,0 +1,215 @@
+#include <gtest/gtest.h>
+#include "cpu.h"
+#include "memory.h"
+#include "enginecompare.h"
+#include <vector>
+
+// Checks the IRQ and NMI inputs: what an interrupt pushes and costs, IRQ
+// masking and unmasking by CLI, PLP and RTI on every engine and the table
+// core, level re-triggering, NMI edges, and a device page raising NMI
+// mid-run on MappedCPU.
+
+class InterruptTest : public ImageTest {
+protected:
+    InterruptTest() {
+        // IRQ handler at $0400, NMI handler at $0480, both JMP * unless a test loads one
+        load(0xFFFA, { 0x80, 0x04, 0x00, 0x00, 0x00, 0x04 });
+        load(0x0400, { 0x4C, 0x00, 0x04 });
+        load(0x0480, { 0x4C, 0x80, 0x04 });
+    }
+    ~InterruptTest(){};
+
+    template <class C>
+    static void start(C & cpu, Byte p) {
+        cpu.PC = 0x0200;
+        cpu.SP = 0xFF;
+        cpu.A = cpu.X = cpu.Y = 0;
+        cpu.P = p;
+        cpu.cycles = 0;
+    }
+
+    static Word pushedPC(const Memory & mem, Byte sp) {
+        return mem.mem[0x100 + Byte(sp + 2)] | (mem.mem[0x100 + Byte(sp + 3)] << 8);
+    }
+};
+
+static const CPU::Engine engines[] = { CPU::Engine::Dispatch, CPU::Engine::Blocks, CPU::Engine::Jit };
+
+TEST_F(InterruptTest, entry) {
+    // NOP / NOP / JMP *
+    load(0x0200, { 0xEA, 0xEA, 0x4C, 0x02, 0x02 });
+    Memory mem = image;
+    CPU cpu(&mem);
+    start(cpu, 0x20 | 0x01 | 0x80);
+    cpu.setIRQ(true);
+    EXPECT_EQ(CPU::StopReason::Budget, cpu.run(1));
+    EXPECT_EQ(0x0400, cpu.PC);
+    EXPECT_EQ(interruptCycles, cpu.cycles);
+    EXPECT_EQ(0xFC, cpu.SP);
+    EXPECT_EQ(0x0200, pushedPC(mem, cpu.SP));
+    // B clear, bit 5 set, the other flags as they were
+    EXPECT_EQ(0x20 | 0x01 | 0x80, mem.mem[0x1FD]);
+    EXPECT_TRUE(cpu.I());
+    // Still asserted but masked now
+    EXPECT_EQ(CPU::StopReason::Trap, cpu.run(100));
+    EXPECT_EQ(0xFC, cpu.SP);
+}
+
+TEST_F(InterruptTest, sources) {
+    Memory mem;
+    CPU cpu(&mem);
+    cpu.setIRQ(true, 1);
+    cpu.setIRQ(true, 4);
+    cpu.setIRQ(false, 1);
+    EXPECT_EQ(CPUState::IrqAsserted, cpu.interrupts);
+    cpu.setIRQ(false, 4);
+    EXPECT_EQ(0, cpu.interrupts);
+    // NMI latches on the edge only
+    cpu.setNMI(true);
+    EXPECT_EQ(CPUState::NmiLatched, cpu.interrupts);
+    cpu.interrupts = 0;
+    cpu.setNMI(true);
+    EXPECT_EQ(0, cpu.interrupts);
+    cpu.setNMI(false);
+    cpu.setNMI(true);
+    EXPECT_EQ(CPUState::NmiLatched, cpu.interrupts);
+}
+
+TEST_F(InterruptTest, unmaskedByCliPlpAndRti) {
+    // CLI:  NOP / NOP / CLI / NOP / JMP *
+    // PLP:  LDA #$20 / PHA / PLP / NOP / JMP *
+    // RTI:  LDA #$02 / PHA / LDA #$34 / PHA / LDA #$20 / PHA / RTI, returning to $0234
+    struct Case { std::vector<Byte> program; Word unmasked; };
+    const Case cases[] = {
+        { { 0xEA, 0xEA, 0x58, 0xEA, 0x4C, 0x04, 0x02 }, 0x0203 },
+        { { 0xA9, 0x20, 0x48, 0x28, 0xEA, 0x4C, 0x05, 0x02 }, 0x0204 },
+        { { 0xA9, 0x02, 0x48, 0xA9, 0x34, 0x48, 0xA9, 0x20, 0x48, 0x40 }, 0x0234 },
+    };
+    for (const Case & c : cases) {
+        load(0x0200, c.program);
+        load(0x0234, { 0xEA, 0x4C, 0x35, 0x02 });
+        for (CPU::Engine engine : engines) {
+            SCOPED_TRACE(testing::Message() << "unmasked at " << c.unmasked << ", engine " << int(engine));
+            Memory mem = image;
+            CPU cpu(&mem);
+            cpu.engine = engine;
+            cpu.jitThreshold = 0;
+            start(cpu, 0x20 | 0x04);
+            cpu.setIRQ(true);
+            EXPECT_EQ(CPU::StopReason::Trap, cpu.run(1000));
+            EXPECT_EQ(0x0400, cpu.PC);
+            EXPECT_EQ(c.unmasked, pushedPC(mem, cpu.SP));
+            EXPECT_TRUE(cpu.I());
+        }
+
+        // The table core takes it at the same boundary
+        Memory mem = image;
+        CPU table(&mem);
+        start(table, 0x20 | 0x04);
+        table.setIRQ(true);
+        for (int step = 0; step < 100 && table.PC != 0x0400; step++)
+            table.execute();
+        EXPECT_EQ(0x0400, table.PC);
+        EXPECT_EQ(c.unmasked, pushedPC(mem, table.SP));
+    }
+}
+
+TEST_F(InterruptTest, levelRetriggers) {
+    // loop: INX / JMP loop; handler: INC $0300 / RTI
+    load(0x0200, { 0xE8, 0x4C, 0x00, 0x02 });
+    load(0x0400, { 0xEE, 0x00, 0x03, 0x40 });
+    for (CPU::Engine engine : engines) {
+        SCOPED_TRACE(testing::Message() << "engine " << int(engine));
+        Memory mem = image;
+        CPU cpu(&mem);
+        cpu.engine = engine;
+        cpu.jitThreshold = 0;
+        start(cpu, 0x20);
+        cpu.setIRQ(true);
+        EXPECT_EQ(CPU::StopReason::Budget, cpu.run(1000));
+        // The handler runs back to back while the line is held
+        EXPECT_EQ(0, cpu.X);
+        EXPECT_GE(mem.mem[0x0300], 1000 / (interruptCycles + opcodeCycles[0xEE] + opcodeCycles[0x40]));
+        cpu.setIRQ(false);
+        Byte handled = mem.mem[0x0300];
+        EXPECT_EQ(CPU::StopReason::Budget, cpu.run(1000));
+        EXPECT_NE(0, cpu.X);
+        EXPECT_GE(handled + 1, mem.mem[0x0300]);
+    }
+}
+
+TEST_F(InterruptTest, scheduledOnEveryEngine) {
+    // CLI / loop: INX / INC $0300 / JMP loop; handler: INC $0301 / RTI
+    load(0x0200, { 0x58, 0xE8, 0xEE, 0x00, 0x03, 0x4C, 0x01, 0x02 });
+    load(0x0400, { 0xEE, 0x01, 0x03, 0x40 });
+    for (uint64_t budget : { 1, 13, 100000 }) {
+        for (CPU::Engine engine : engines) {
+            SCOPED_TRACE(testing::Message() << "engine " << int(engine) << ", budget " << budget);
+            Memory mem = image;
+            CPU cpu(&mem);
+            cpu.engine = engine;
+            cpu.jitThreshold = 0;
+            start(cpu, 0x20 | 0x04);
+            // A device raising IRQ every 250 cycles and dropping it a cycle later,
+            // before the handler could return
+            std::function<void(CPUState &)> raise;
+            long long next = 250;
+            raise = [&](CPUState & c) {
+                c.setIRQ(true);
+                c.events.at(c.cycles + 1, [](CPUState & c) { c.setIRQ(false); });
+                next += 250;
+                if (next < 9000)
+                    c.events.at(next, raise);
+            };
+            cpu.events.at(next, raise);
+            while (cpu.cycles < 10000)
+                EXPECT_EQ(CPU::StopReason::Budget, cpu.run(budget));
+            EXPECT_EQ(35, mem.mem[0x0301]);
+            EXPECT_EQ(0xFF, cpu.SP);
+        }
+    }
+}
+
+TEST_F(InterruptTest, nmiIgnoresI) {
+    // loop: INX / JMP loop; NMI handler: INC $0300 / RTI
+    load(0x0200, { 0xE8, 0x4C, 0x00, 0x02 });
+    load(0x0480, { 0xEE, 0x00, 0x03, 0x40 });
+    for (CPU::Engine engine : engines) {
+        SCOPED_TRACE(testing::Message() << "engine " << int(engine));
+        Memory mem = image;
+        CPU cpu(&mem);
+        cpu.engine = engine;
+        cpu.jitThreshold = 0;
+        start(cpu, 0x20 | 0x04);
+        cpu.setNMI(true);
+        EXPECT_EQ(CPU::StopReason::Budget, cpu.run(1000));
+        // Taken once, though the line is still held
+        EXPECT_EQ(1, mem.mem[0x0300]);
+        EXPECT_TRUE(cpu.I());
+        cpu.setNMI(false);
+        cpu.setNMI(true);
+        EXPECT_EQ(CPU::StopReason::Budget, cpu.run(1000));
+        EXPECT_EQ(2, mem.mem[0x0300]);
+        EXPECT_EQ(0xFF, cpu.SP);
+    }
+}
+
+TEST_F(InterruptTest, deviceRaisesNmi) {
+    // loop: INX / STA $D000 / JMP loop
+    load(0x0200, { 0xE8, 0x8D, 0x00, 0xD0, 0x4C, 0x00, 0x02 });
+    Memory mem = image;
+    MappedCPU cpu(&mem);
+    int stores = 0;
+    mem.mapDevice(0xD0, 1, Device { nullptr, [&](Word, Byte) {
+        if (++stores == 100) {
+            cpu.setNMI(true);
+            cpu.setNMI(false);
+        }
+    } });
+    start(cpu, 0x20 | 0x04);
+    EXPECT_EQ(CPU::StopReason::Trap, cpu.run(100000));
+    EXPECT_EQ(0x0480, cpu.PC);
+    EXPECT_EQ(100, cpu.X);
+    // Taken at the boundary right after the store
+    EXPECT_EQ(0x0204, pushedPC(mem, cpu.SP));
+}
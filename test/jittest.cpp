@@ -0,0 +1,174 @@
+#include <gtest/gtest.h>
+#include "cpu.h"
+#include "memory.h"
+#include "jit.h"
+#include "opcodes.h"
+#include <cstring>
+#include <random>
+
+// Checks translated blocks against the dispatch loop. jitThreshold is 0 so
+// every block is translated the first time it runs.
+
+class JitTest : public ::testing::Test {
+protected:
+    Memory dispatchMem;
+    Memory jitMem;
+    CPU dispatchCpu;
+    CPU jitCpu;
+    std::mt19937 rng;
+
+    JitTest()
+        : dispatchMem()
+        , jitMem()
+        , dispatchCpu(&dispatchMem)
+        , jitCpu(&jitMem)
+        , rng(6502)
+    {
+        jitCpu.engine = CPU::Engine::Jit;
+        jitCpu.jitThreshold = 0;
+    };
+    ~JitTest(){};
+
+    void randomState() {
+        for (int i = 0; i < MEMORY_SIZE; i++)
+            dispatchMem.write(i, rng());
+
+        dispatchCpu.PC = rng();
+        dispatchCpu.A = rng();
+        dispatchCpu.X = rng();
+        dispatchCpu.Y = rng();
+        dispatchCpu.SP = rng();
+        dispatchCpu.P = rng();
+        dispatchCpu.cycles = rng() % 1000;
+    }
+
+    void copyState() {
+        std::memcpy(jitMem.mem, dispatchMem.mem, MEMORY_SIZE);
+        jitCpu.PC = dispatchCpu.PC;
+        jitCpu.A = dispatchCpu.A;
+        jitCpu.X = dispatchCpu.X;
+        jitCpu.Y = dispatchCpu.Y;
+        jitCpu.SP = dispatchCpu.SP;
+        jitCpu.P = dispatchCpu.P;
+        jitCpu.cycles = dispatchCpu.cycles;
+        // Loading memory behind the engine's back: start from an empty cache
+        if (jitCpu.blockCache)
+            jitCpu.blockCache->flush();
+    }
+
+    void expectSameState() {
+        EXPECT_EQ(dispatchCpu.PC, jitCpu.PC);
+        EXPECT_EQ(dispatchCpu.A, jitCpu.A);
+        EXPECT_EQ(dispatchCpu.X, jitCpu.X);
+        EXPECT_EQ(dispatchCpu.Y, jitCpu.Y);
+        EXPECT_EQ(dispatchCpu.SP, jitCpu.SP);
+        EXPECT_EQ(dispatchCpu.P, jitCpu.P);
+        EXPECT_EQ(dispatchCpu.cycles, jitCpu.cycles);
+        EXPECT_EQ(0, std::memcmp(dispatchMem.mem, jitMem.mem, MEMORY_SIZE));
+    }
+
+    void load(Word address, const Byte * program, size_t length) {
+        dispatchMem.writeBlock(address, program, length);
+        jitMem.writeBlock(address, program, length);
+        dispatchCpu.PC = jitCpu.PC = address;
+    }
+};
+
+TEST_F(JitTest, matchesDispatchForAllDocumentedOpcodes) {
+    for (Byte opcode : documentedOpcodes) {
+        for (int trial = 0; trial < 16; trial++) {
+            SCOPED_TRACE(testing::Message() << "opcode 0x" << std::hex << int(opcode) << " trial " << std::dec << trial);
+            randomState();
+            dispatchMem.write(dispatchCpu.PC, opcode);
+            copyState();
+            EXPECT_EQ(dispatchCpu.run(500), jitCpu.run(500));
+            expectSameState();
+            if (HasFailure())
+                return;
+        }
+    }
+}
+
+TEST_F(JitTest, matchesDispatchInSmallBudgetSteps) {
+    for (int trial = 0; trial < 20; trial++) {
+        SCOPED_TRACE(testing::Message() << "trial " << trial);
+        randomState();
+        copyState();
+        for (int step = 0; step < 50; step++) {
+            CPU::StopReason expected = dispatchCpu.run(7);
+            EXPECT_EQ(expected, jitCpu.run(7));
+            expectSameState();
+            if (HasFailure())
+                return;
+            if (expected != CPU::StopReason::Budget)
+                break;
+        }
+    }
+}
+
+TEST_F(JitTest, runsHotLoopAndStopsOnBudget) {
+    // loop: INX / BNE loop / INY / JMP loop, with the default threshold
+    const Byte program[] = { 0xE8, 0xD0, 0xFD, 0xC8, 0x4C, 0x00, 0x02 };
+    load(0x0200, program, sizeof(program));
+    jitCpu.jitThreshold = 16;
+    dispatchCpu.X = jitCpu.X = 0;
+    dispatchCpu.Y = jitCpu.Y = 0;
+    dispatchCpu.cycles = jitCpu.cycles = 0;
+
+    for (int step = 0; step < 20; step++) {
+        EXPECT_EQ(CPU::StopReason::Budget, dispatchCpu.run(1001));
+        EXPECT_EQ(CPU::StopReason::Budget, jitCpu.run(1001));
+        expectSameState();
+    }
+    if (jitCpu.jit->available()) {
+        EXPECT_GT(jitCpu.jit->compiledBlocks(), 0u);
+    }
+}
+
+TEST_F(JitTest, reDecodesOpcodeRewrittenByTranslatedStore) {
+    // LDA #$E8 / STA $0206 / NOP / NOP / unimplemented
+    // The store turns the second NOP, later in the same block, into INX
+    const Byte program[] = { 0xA9, 0xE8, 0x8D, 0x06, 0x02, 0xEA, 0xEA, 0x02 };
+    load(0x0200, program, sizeof(program));
+    dispatchCpu.X = jitCpu.X = 0;
+    EXPECT_EQ(CPU::StopReason::Halt, jitCpu.run(1000));
+    EXPECT_EQ((Byte)1, jitCpu.X);
+    EXPECT_EQ(CPU::StopReason::Halt, dispatchCpu.run(1000));
+    expectSameState();
+}
+
+TEST_F(JitTest, readsPatchedImmediateOperand) {
+    // loop: LDA #$00 / CLC / ADC #$01 / STA $0201 / CMP #$10 / BNE loop / unimplemented
+    const Byte program[] = { 0xA9, 0x00, 0x18, 0x69, 0x01, 0x8D, 0x01, 0x02, 0xC9, 0x10, 0xD0, 0xF4, 0x02 };
+    load(0x0200, program, sizeof(program));
+    dispatchCpu.P = jitCpu.P = 0;
+    EXPECT_EQ(CPU::StopReason::Halt, jitCpu.run(10000));
+    EXPECT_EQ(0x020C, jitCpu.PC);
+    EXPECT_EQ((Byte)0x10, jitCpu.A);
+    EXPECT_EQ(CPU::StopReason::Halt, dispatchCpu.run(10000));
+    expectSameState();
+}
+
+TEST_F(JitTest, stopsOnBranchToSelf) {
+    // LDX #$00 / loop: INX / CPX #$20 / BNE loop / BEQ *
+    const Byte program[] = { 0xA2, 0x00, 0xE8, 0xE0, 0x20, 0xD0, 0xFB, 0xF0, 0xFE };
+    load(0x0200, program, sizeof(program));
+    dispatchCpu.cycles = jitCpu.cycles = 0;
+    EXPECT_EQ(CPU::StopReason::Trap, dispatchCpu.run(10000));
+    EXPECT_EQ(CPU::StopReason::Trap, jitCpu.run(10000));
+    EXPECT_EQ(0x0207, jitCpu.PC);
+    expectSameState();
+}
+
+TEST_F(JitTest, callsAndReturnsThroughStack) {
+    // loop: JSR sub / DEY / BNE loop / unimplemented; sub: PHP / INX / PLP / RTS
+    const Byte program[] = { 0x20, 0x07, 0x02, 0x88, 0xD0, 0xFA, 0x02, 0x08, 0xE8, 0x28, 0x60 };
+    load(0x0200, program, sizeof(program));
+    dispatchCpu.SP = jitCpu.SP = 0xFF;
+    dispatchCpu.X = jitCpu.X = 0;
+    dispatchCpu.Y = jitCpu.Y = 40;
+    EXPECT_EQ(CPU::StopReason::Halt, dispatchCpu.run(100000));
+    EXPECT_EQ(CPU::StopReason::Halt, jitCpu.run(100000));
+    EXPECT_EQ((Byte)40, jitCpu.X);
+    expectSameState();
+}
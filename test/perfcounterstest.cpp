@@ -0,0 +1,33 @@
+#include <gtest/gtest.h>
+#include "perfcounters.h"
+
+// Checks the host counters over a loop of known length, where the host lets
+// this process count; the CPU or the kernel may refuse any of them.
+
+TEST(PerfCountersTest, countsALoop) {
+    PerfCounters perf;
+    if (!perf.open())
+        GTEST_SKIP() << "perf_event_open unavailable";
+    EXPECT_EQ(0, perf.count(PerfCounters::Instructions));
+
+    volatile unsigned sum = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        perf.start();
+        for (unsigned i = 0; i < 1000000; i++)
+            sum += i;
+        perf.stop();
+    }
+    // Both passes, a load, an add and a store for each of 2000000 iterations
+    if (perf.available(PerfCounters::Instructions)) {
+        EXPECT_GT(perf.count(PerfCounters::Instructions), 2000000 * 3);
+    }
+    if (perf.available(PerfCounters::Cycles)) {
+        EXPECT_GT(perf.count(PerfCounters::Cycles), 0);
+    }
+    for (int event = 0; event < PerfCounters::eventCount; event++) {
+        if (!perf.available(PerfCounters::Event(event))) {
+            EXPECT_EQ(0, perf.count(PerfCounters::Event(event)));
+        }
+    }
+    EXPECT_STREQ("branch-misses", PerfCounters::name(PerfCounters::BranchMisses));
+}
@@ -0,0 +1,118 @@
+#include <gtest/gtest.h>
+#include "cpu.h"
+#include "memory.h"
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+// Checks the FastCPU, TracingCPU and MappedCPU policy sets against CPU, on
+// single table handlers and on the Klaus functional test through the
+// dispatch loop.
+
+class PolicyTest : public ::testing::Test {
+protected:
+    Memory mem;
+    Memory fastMem;
+    Memory tracingMem;
+    Memory mappedMem;
+    CPU cpu;
+    FastCPU fastCpu;
+    TracingCPU tracingCpu;
+    MappedCPU mappedCpu;
+
+    PolicyTest()
+        : mem()
+        , fastMem()
+        , tracingMem()
+        , mappedMem()
+        , cpu(&mem)
+        , fastCpu(&fastMem)
+        , tracingCpu(&tracingMem)
+        , mappedCpu(&mappedMem)
+    {
+    };
+    ~PolicyTest(){};
+
+    void load(Word address, const std::vector<Byte> & program) {
+        mem.writeBlock(address, program.data(), program.size());
+        fastMem.writeBlock(address, program.data(), program.size());
+        tracingMem.writeBlock(address, program.data(), program.size());
+        mappedMem.writeBlock(address, program.data(), program.size());
+        cpu.PC = fastCpu.PC = tracingCpu.PC = mappedCpu.PC = address;
+        cpu.cycles = fastCpu.cycles = tracingCpu.cycles = mappedCpu.cycles = 0;
+    }
+
+    template <class C>
+    void expectSameRegisters(const C & other) {
+        EXPECT_EQ(cpu.PC, other.PC);
+        EXPECT_EQ(cpu.A, other.A);
+        EXPECT_EQ(cpu.X, other.X);
+        EXPECT_EQ(cpu.Y, other.Y);
+        EXPECT_EQ(cpu.SP, other.SP);
+        EXPECT_EQ(cpu.P, other.P);
+    }
+};
+
+TEST_F(PolicyTest, fastCoreCountsInstructions) {
+    // LDX #$FF / LDA $12F0,X (page cross) / STA $0300
+    load(0x0200, { 0xA2, 0xFF, 0xBD, 0xF0, 0x12, 0x8D, 0x00, 0x03 });
+    for (int i = 0; i < 3; i++) {
+        cpu.execute();
+        fastCpu.execute();
+    }
+    expectSameRegisters(fastCpu);
+    EXPECT_EQ(1 + 4 + 3, cpu.cycles);
+    EXPECT_EQ(3, fastCpu.cycles);
+    EXPECT_EQ(mem.read(0x0300), fastMem.read(0x0300));
+}
+
+TEST_F(PolicyTest, tracingCoreReportsInstructionsAndAccesses) {
+    std::vector<Word> pcs;
+    std::vector<std::pair<Word, Byte>> writes;
+    int reads = 0;
+    tracingCpu.hooks.onInstruction = [&](const CPUTrace & trace) { pcs.push_back(trace.pc); };
+    tracingCpu.hooks.onRead = [&](Word, Byte) { reads++; };
+    tracingCpu.hooks.onWrite = [&](Word addr, Byte value) { writes.push_back({ addr, value }); };
+
+    // LDA #$42 / STA $0300 / PHA
+    load(0x0200, { 0xA9, 0x42, 0x8D, 0x00, 0x03, 0x48 });
+    tracingCpu.SP = 0xFF;
+    for (int i = 0; i < 3; i++)
+        tracingCpu.execute();
+
+    EXPECT_EQ((std::vector<Word> { 0x0200, 0x0202, 0x0205 }), pcs);
+    EXPECT_EQ((std::vector<std::pair<Word, Byte>> { { 0x0300, 0x42 }, { 0x01FF, 0x42 } }), writes);
+    // Opcodes and operands: 2 + 3 + 1
+    EXPECT_EQ(6, reads);
+    EXPECT_EQ(1 + 3 + 2, tracingCpu.cycles);
+}
+
+TEST_F(PolicyTest, runsFunctionalTestOnEveryCore) {
+    std::ifstream file(TEST_PROGRAMS_DIR "/6502_functional_test.bin", std::ios::binary);
+    ASSERT_TRUE(file.good());
+    std::vector<Byte> image((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    load(0x0000, image);
+    cpu.PC = fastCpu.PC = tracingCpu.PC = mappedCpu.PC = 0x0400;
+
+    long long instructions = 0;
+    tracingCpu.hooks.onInstruction = [&](const CPUTrace &) { instructions++; };
+
+    EXPECT_EQ(CPU::StopReason::Trap, cpu.run(100000000));
+    EXPECT_EQ(CPU::StopReason::Trap, fastCpu.run(100000000));
+    EXPECT_EQ(CPU::StopReason::Trap, tracingCpu.run(100000000));
+    EXPECT_EQ(CPU::StopReason::Trap, mappedCpu.run(100000000));
+    EXPECT_EQ(0x3469, cpu.PC);
+    // 65897225 as 6502_emu reports it, less the seven cycles of its reset
+    EXPECT_EQ(65897218, cpu.cycles);
+
+    expectSameRegisters(fastCpu);
+    expectSameRegisters(tracingCpu);
+    expectSameRegisters(mappedCpu);
+    EXPECT_EQ(0, std::memcmp(mem.mem, fastMem.mem, MEMORY_SIZE));
+    EXPECT_EQ(0, std::memcmp(mem.mem, tracingMem.mem, MEMORY_SIZE));
+    EXPECT_EQ(0, std::memcmp(mem.mem, mappedMem.mem, MEMORY_SIZE));
+    EXPECT_EQ(cpu.cycles, tracingCpu.cycles);
+    EXPECT_EQ(cpu.cycles, mappedCpu.cycles);
+    EXPECT_EQ(instructions, fastCpu.cycles);
+}
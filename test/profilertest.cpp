@@ -0,0 +1,259 @@
+#include <gtest/gtest.h>
+#include "cpu.h"
+#include "memory.h"
+#include "profiler.h"
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <vector>
+
+// ProfilingCPU's counts per PC and opcode over a loop of known cycles and
+// on the Klaus functional test, its call tree through nested, recursive and
+// interrupt calls and stack tricks, the folded-stack and Chrome trace
+// exports, and labels read from an AS65 listing.
+
+class ProfilerTest : public ::testing::Test {
+protected:
+    Memory mem;
+    ProfilingCPU cpu;
+
+    ProfilerTest()
+        : mem()
+        , cpu(&mem)
+    {
+    };
+    ~ProfilerTest(){};
+
+    void load(Word address, const std::vector<Byte> & program) {
+        mem.writeBlock(address, program.data(), program.size());
+        cpu.PC = address;
+        cpu.SP = 0xFF;
+        cpu.cycles = 0;
+    }
+
+    // Up to the JMP * at trap, one instruction at a time or in one run()
+    void runToTrap(Word trap, bool step) {
+        if (step) {
+            for (int i = 0; i < 1000 && cpu.PC != trap; i++)
+                cpu.execute();
+        } else {
+            EXPECT_EQ(CPU::StopReason::Trap, cpu.run(100000));
+        }
+        EXPECT_EQ(trap, cpu.PC);
+        cpu.hooks.finish(cpu.cycles);
+    }
+
+    const RoutineCount * routine(const std::vector<RoutineCount> & routines, Word entry) {
+        for (const RoutineCount & count : routines) {
+            if (count.routine == entry)
+                return &count;
+        }
+        return nullptr;
+    }
+};
+
+TEST_F(ProfilerTest, countsExecutionsAndCyclesPerPc) {
+    // loop: LDA #$01 / STA $0300 / JMP loop, 1 + 3 + 2 cycles
+    load(0x0200, { 0xA9, 0x01, 0x8D, 0x00, 0x03, 0x4C, 0x00, 0x02 });
+    for (int i = 0; i < 30; i++)
+        cpu.execute();
+    cpu.hooks.finish(cpu.cycles);
+
+    EXPECT_EQ(10u, cpu.hooks.pcs[0x0200].executions);
+    EXPECT_EQ(10u, cpu.hooks.pcs[0x0200].cycles);
+    EXPECT_EQ(10u, cpu.hooks.pcs[0x0202].executions);
+    EXPECT_EQ(30u, cpu.hooks.pcs[0x0202].cycles);
+    EXPECT_EQ(10u, cpu.hooks.pcs[0x0205].executions);
+    EXPECT_EQ(20u, cpu.hooks.pcs[0x0205].cycles);
+    EXPECT_EQ(30u, cpu.hooks.totalExecutions());
+    EXPECT_EQ(60u, cpu.hooks.totalCycles());
+
+    std::array<ProfileCount, 256> opcodes = cpu.hooks.opcodes();
+    EXPECT_EQ(10u, opcodes[0xA9].executions);
+    EXPECT_EQ(30u, opcodes[0x8D].cycles);
+    EXPECT_EQ(20u, opcodes[0x4C].cycles);
+    EXPECT_EQ(0u, opcodes[0xEA].executions);
+
+    cpu.hooks.clear();
+    EXPECT_EQ(0u, cpu.hooks.totalExecutions());
+}
+
+TEST_F(ProfilerTest, chargesPenaltiesToTheirInstruction) {
+    // LDX #$FF / loop: LDA $12F0,X (page cross) / BNE loop (taken)
+    load(0x0200, { 0xA2, 0xFF, 0xBD, 0xF0, 0x12, 0xD0, 0xFB });
+    mem.mem[0x13EF] = 0x01;
+    cpu.execute();
+    for (int i = 0; i < 8; i++)
+        cpu.run(1);
+    cpu.hooks.finish(cpu.cycles);
+
+    ASSERT_LT(0u, cpu.hooks.pcs[0x0205].executions);
+    EXPECT_EQ(4u * cpu.hooks.pcs[0x0202].executions, cpu.hooks.pcs[0x0202].cycles);
+    EXPECT_EQ(2u * cpu.hooks.pcs[0x0205].executions, cpu.hooks.pcs[0x0205].cycles);
+    EXPECT_EQ(uint64_t(cpu.cycles), cpu.hooks.totalCycles());
+}
+
+TEST_F(ProfilerTest, profilesFunctionalTest) {
+    std::ifstream file(TEST_PROGRAMS_DIR "/6502_functional_test.bin", std::ios::binary);
+    ASSERT_TRUE(file.good());
+    std::vector<Byte> image((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    load(0x0000, image);
+    cpu.PC = 0x0400;
+
+    Memory plainMem;
+    CPU plain(&plainMem);
+    plainMem.writeBlock(0x0000, image.data(), image.size());
+    plain.PC = 0x0400;
+    plain.cycles = 0;
+
+    EXPECT_EQ(CPU::StopReason::Trap, cpu.run(100000000));
+    EXPECT_EQ(CPU::StopReason::Trap, plain.run(100000000));
+    cpu.hooks.finish(cpu.cycles);
+
+    EXPECT_EQ(plain.cycles, cpu.cycles);
+    EXPECT_EQ(uint64_t(cpu.cycles), cpu.hooks.totalCycles());
+    // The trap at $3469 is entered once and then stopped on
+    EXPECT_EQ(1u, cpu.hooks.pcs[0x3469].executions);
+
+    std::ostringstream report;
+    writeProfile(report, cpu.hooks, nullptr, 5);
+    EXPECT_NE(std::string::npos, report.str().find("instructions"));
+}
+
+TEST_F(ProfilerTest, attributesNestedCalls) {
+    for (bool step : { false, true }) {
+        SCOPED_TRACE(step ? "table core" : "dispatch loop");
+        cpu.hooks.clear();
+        // outer: JSR inner / JSR inner / RTS
+        load(0x0210, { 0x20, 0x20, 0x02, 0x20, 0x20, 0x02, 0x60 });
+        // inner: NOP / NOP / RTS
+        load(0x0220, { 0xEA, 0xEA, 0x60 });
+        // JSR outer / JMP *
+        load(0x0200, { 0x20, 0x10, 0x02, 0x4C, 0x03, 0x02 });
+        runToTrap(0x0203, step);
+
+        std::vector<RoutineCount> routines = cpu.hooks.routines();
+        ASSERT_EQ(2u, routines.size());
+        // Each JSR is the caller's, each RTS the callee's: 5 + 5 + 5 and
+        // twice 1 + 1 + 5
+        EXPECT_EQ(0x0210, routines[0].routine);
+        EXPECT_EQ(1u, routines[0].calls);
+        EXPECT_EQ(15u + 14u, routines[0].inclusive);
+        EXPECT_EQ(15u, routines[0].exclusive);
+        EXPECT_EQ(0x0220, routines[1].routine);
+        EXPECT_EQ(2u, routines[1].calls);
+        EXPECT_EQ(14u, routines[1].inclusive);
+        EXPECT_EQ(14u, routines[1].exclusive);
+        EXPECT_EQ(uint64_t(cpu.cycles) - 29u, cpu.hooks.calls[0].cycles);
+    }
+}
+
+TEST_F(ProfilerTest, countsRecursionOnce) {
+    // rec: DEX / BEQ done / JSR rec / done: RTS
+    load(0x0210, { 0xCA, 0xF0, 0x03, 0x20, 0x10, 0x02, 0x60 });
+    // LDX #3 / JSR rec / JMP *
+    load(0x0200, { 0xA2, 0x03, 0x20, 0x10, 0x02, 0x4C, 0x05, 0x02 });
+    runToTrap(0x0205, false);
+
+    std::vector<RoutineCount> routines = cpu.hooks.routines();
+    ASSERT_EQ(1u, routines.size());
+    EXPECT_EQ(3u, routines[0].calls);
+    EXPECT_EQ(routines[0].exclusive, routines[0].inclusive);
+    EXPECT_EQ(uint64_t(cpu.cycles), routines[0].inclusive + cpu.hooks.calls[0].cycles);
+
+    std::ostringstream folded;
+    writeFoldedStacks(folded, cpu.hooks);
+    EXPECT_NE(std::string::npos, folded.str().find("\n[top];$0210;$0210;$0210 "));
+}
+
+TEST_F(ProfilerTest, followsStackTricks) {
+    // a: LDA #$02 / PHA / LDA #$1F / PHA / RTS, a jump to b at $0220
+    load(0x0210, { 0xA9, 0x02, 0x48, 0xA9, 0x1F, 0x48, 0x60 });
+    // b: JSR c / RTS, never reached
+    load(0x0220, { 0x20, 0x30, 0x02, 0x60 });
+    // c: PLA / PLA / RTS, dropping its own return address to return from a
+    load(0x0230, { 0x68, 0x68, 0x60 });
+    // JSR a / JMP *
+    load(0x0200, { 0x20, 0x10, 0x02, 0x4C, 0x03, 0x02 });
+    cpu.hooks.eventLimit = 100;
+    runToTrap(0x0203, false);
+
+    ASSERT_EQ(3u, cpu.hooks.calls.size());
+    EXPECT_EQ(0x0210, cpu.hooks.calls[1].routine);
+    EXPECT_EQ(0u, cpu.hooks.calls[1].parent);
+    EXPECT_EQ(0x0230, cpu.hooks.calls[2].routine);
+    EXPECT_EQ(1u, cpu.hooks.calls[2].parent);
+
+    // a and c are left together by the one RTS
+    ASSERT_EQ(4u, cpu.hooks.events.size());
+    EXPECT_TRUE(cpu.hooks.events[1].begin);
+    EXPECT_EQ(2u, cpu.hooks.events[2].node);
+    EXPECT_FALSE(cpu.hooks.events[2].begin);
+    EXPECT_EQ(1u, cpu.hooks.events[3].node);
+    EXPECT_EQ(cpu.hooks.events[2].cycles, cpu.hooks.events[3].cycles);
+    EXPECT_FALSE(cpu.hooks.eventsTruncated());
+}
+
+TEST_F(ProfilerTest, followsInterrupts) {
+    // NMI to $0480, BRK to $0400: NOP / RTI each
+    load(0xFFFA, { 0x80, 0x04, 0x00, 0x00, 0x00, 0x04 });
+    load(0x0400, { 0xEA, 0x40 });
+    load(0x0480, { 0xEA, 0x40 });
+    // NOP / BRK / JMP *
+    load(0x0200, { 0xEA, 0x00, 0x00, 0x4C, 0x03, 0x02 });
+    cpu.P = 0x24;
+    cpu.setNMI(true);
+    cpu.hooks.eventLimit = 1;
+    runToTrap(0x0203, false);
+
+    std::vector<RoutineCount> routines = cpu.hooks.routines();
+    ASSERT_EQ(2u, routines.size());
+    const RoutineCount * nmi = routine(routines, 0x0480);
+    const RoutineCount * brk = routine(routines, 0x0400);
+    ASSERT_TRUE(nmi && brk);
+    EXPECT_EQ(1u, nmi->calls);
+    EXPECT_EQ(1u, brk->calls);
+    // The entry is the handler's: NOP and RTI after it
+    EXPECT_EQ(uint64_t(interruptCycles) + 1 + 6, nmi->inclusive);
+    EXPECT_EQ(1u + 6u, brk->inclusive);
+
+    // Only the NMI handler fits under the limit
+    ASSERT_EQ(2u, cpu.hooks.events.size());
+    EXPECT_TRUE(cpu.hooks.eventsTruncated());
+    std::ostringstream trace;
+    writeChromeTrace(trace, cpu.hooks);
+    EXPECT_EQ("{\"traceEvents\":[\n"
+              "{\"name\":\"$0480\",\"ph\":\"B\",\"ts\":0,\"pid\":1,\"tid\":1},\n"
+              "{\"name\":\"$0480\",\"ph\":\"E\",\"ts\":" + std::to_string(cpu.hooks.events[1].cycles)
+              + ",\"pid\":1,\"tid\":1}\n],\"displayTimeUnit\":\"ms\"}\n", trace.str());
+}
+
+TEST(ProfilerLabels, readsListingLabels) {
+    std::istringstream listing(
+        "                        ;label column\n"
+        "0400 :                  start\n"
+        "0400 : d8                       cld\n"
+        "040e :                  psb_bwok\n"
+        "040e : a9 00                    lda #0\n"
+        "0000 =                  zero_page = $a\n");
+    std::map<Word, std::string> labels = readListingLabels(listing);
+
+    ASSERT_EQ(2u, labels.size());
+    EXPECT_EQ("start", labels[0x0400]);
+    EXPECT_EQ("psb_bwok", labels[0x040E]);
+
+    ProfileHooks profile;
+    Memory code;
+    profile.attach(&code);
+    profile.pcs[0x0410].executions = 1;
+    profile.pcs[0x0410].cycles = 2;
+    std::ostringstream report;
+    writeProfile(report, profile, &labels);
+    EXPECT_NE(std::string::npos, report.str().find("psb_bwok+2"));
+
+    profile.transfer(Transfer::Call, 0x0400, 0xFD, 10);
+    profile.transfer(Transfer::Return, 0x0203, 0xFF, 25);
+    std::ostringstream folded;
+    writeFoldedStacks(folded, profile, &labels);
+    EXPECT_EQ("[top] 10\n[top];start 15\n", folded.str());
+}
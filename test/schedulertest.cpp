@@ -0,0 +1,154 @@
+#include <gtest/gtest.h>
+#include "cpu.h"
+#include "memory.h"
+#include "scheduler.h"
+#include "enginecompare.h"
+#include <vector>
+
+// Checks the event scheduler on its own and driving CPU::run(): events fire
+// at the first instruction boundary past their deadline on every engine,
+// whatever the budget, and idle loops waiting for one get there at once.
+
+class SchedulerTest : public ImageTest {
+protected:
+    SchedulerTest() {}
+    ~SchedulerTest(){};
+};
+
+TEST_F(SchedulerTest, order) {
+    Memory mem;
+    CPU cpu(&mem);
+    Scheduler & events = cpu.events;
+    std::vector<int> fired;
+    EXPECT_EQ(LLONG_MAX, events.deadline());
+    events.at(30, [&](CPUState &) { fired.push_back(3); });
+    events.at(10, [&](CPUState &) { fired.push_back(1); });
+    Scheduler::EventId dropped = events.at(20, [&](CPUState &) { fired.push_back(0); });
+    events.at(20, [&](CPUState &) { fired.push_back(2); });
+    events.at(10, [&](CPUState &) { fired.push_back(11); });
+    EXPECT_EQ(10, events.deadline());
+    EXPECT_TRUE(events.cancel(dropped));
+    EXPECT_FALSE(events.cancel(dropped));
+
+    cpu.cycles = 9;
+    events.fire(cpu);
+    EXPECT_TRUE(fired.empty());
+    cpu.cycles = 25;
+    events.fire(cpu);
+    EXPECT_EQ((std::vector<int> { 1, 11, 2 }), fired);
+    EXPECT_EQ(30, events.deadline());
+    EXPECT_EQ(1u, events.size());
+    events.clear();
+    EXPECT_TRUE(events.empty());
+}
+
+TEST_F(SchedulerTest, eventsScheduleEvents) {
+    Memory mem;
+    CPU cpu(&mem);
+    std::vector<long long> fired;
+    // One due at once fires in the same round, a later one waits
+    cpu.events.at(5, [&](CPUState & c) {
+        fired.push_back(5);
+        c.events.at(4, [&](CPUState &) { fired.push_back(4); });
+        c.events.at(50, [&](CPUState &) { fired.push_back(50); });
+    });
+    cpu.cycles = 5;
+    cpu.events.fire(cpu);
+    EXPECT_EQ((std::vector<long long> { 5, 4 }), fired);
+    EXPECT_EQ(50, cpu.events.deadline());
+}
+
+TEST_F(SchedulerTest, deadlinesOnEveryEngine) {
+    // loop: INX / INC $0300 / JMP loop
+    load(0x0200, { 0xE8, 0xEE, 0x00, 0x03, 0x4C, 0x00, 0x02 });
+    for (uint64_t budget : { 1, 7, 1000, 100000 }) {
+        for (CPU::Engine engine : { CPU::Engine::Dispatch, CPU::Engine::Blocks, CPU::Engine::Jit }) {
+            SCOPED_TRACE(testing::Message() << "engine " << int(engine) << ", budget " << budget);
+            Memory mem = image;
+            CPU cpu(&mem);
+            cpu.engine = engine;
+            cpu.jitThreshold = 0;
+            cpu.PC = 0x0200;
+            cpu.cycles = 0;
+            // A timer every 97 cycles, recording when it fired
+            std::vector<long long> late;
+            std::function<void(CPUState &)> tick;
+            long long next = 97;
+            tick = [&](CPUState & c) {
+                late.push_back(c.cycles - next);
+                next += 97;
+                c.events.at(next, tick);
+            };
+            cpu.events.at(next, tick);
+            while (cpu.cycles < 10000)
+                EXPECT_EQ(CPU::StopReason::Budget, cpu.run(budget));
+            EXPECT_EQ(size_t(cpu.cycles / 97), late.size());
+            // At the first boundary past the deadline: within the 5 cycles of INC abs
+            for (long long l : late) {
+                EXPECT_GE(l, 0);
+                EXPECT_LT(l, 5);
+            }
+        }
+    }
+}
+
+TEST_F(SchedulerTest, idleLoopWaitsForEvent) {
+    // loop: LDA $10 / BEQ loop / STA $0300 / JMP *
+    load(0x0200, { 0xA5, 0x10, 0xF0, 0xFC, 0x8D, 0x00, 0x03, 0x4C, 0x07, 0x02 });
+    std::vector<long long> stopped;
+    for (bool skipIdle : { false, true }) {
+        for (CPU::Engine engine : { CPU::Engine::Dispatch, CPU::Engine::Blocks, CPU::Engine::Jit }) {
+            SCOPED_TRACE(testing::Message() << "engine " << int(engine) << ", skipIdle " << skipIdle);
+            Memory mem = image;
+            CPU cpu(&mem);
+            cpu.engine = engine;
+            cpu.jitThreshold = 0;
+            cpu.skipIdleLoops = skipIdle;
+            cpu.PC = 0x0200;
+            cpu.cycles = 0;
+            cpu.events.at(1000003, [](CPUState & c) { c.mem->write(0x10, 0x5A); });
+            EXPECT_EQ(CPU::StopReason::Trap, cpu.run(100000000));
+            EXPECT_EQ(0x5A, mem.read(0x0300));
+            stopped.push_back(cpu.cycles);
+        }
+    }
+    for (long long cycles : stopped)
+        EXPECT_EQ(stopped.front(), cycles);
+}
+
+TEST_F(SchedulerTest, breakpoints) {
+    // NOP / NOP / NOP / JMP *
+    load(0x0200, { 0xEA, 0xEA, 0xEA, 0x4C, 0x03, 0x02 });
+    Memory mem = image;
+    CPU cpu(&mem);
+    cpu.PC = 0x0200;
+    cpu.cycles = 0;
+    int fired = 0;
+    // Due before the first instruction, with a breakpoint under PC
+    cpu.events.at(0, [&](CPUState &) { fired++; });
+    cpu.setBreakpoint(0x0200);
+    cpu.setBreakpoint(0x0202);
+    EXPECT_EQ(CPU::StopReason::Breakpoint, cpu.run(100));
+    EXPECT_EQ(1, fired);
+    EXPECT_EQ(0x0202, cpu.PC);
+    // Due on reaching the next breakpoint, which the engine stops at for the deadline
+    cpu.events.at(cpu.cycles + 1, [&](CPUState &) { fired++; });
+    cpu.PC = 0x0201;
+    EXPECT_EQ(CPU::StopReason::Breakpoint, cpu.run(100));
+    EXPECT_EQ(0x0202, cpu.PC);
+    EXPECT_EQ(2, fired);
+    EXPECT_EQ(CPU::StopReason::Trap, cpu.run(100));
+}
+
+TEST_F(SchedulerTest, fastCpuCountsInstructions) {
+    // loop: NOP / JMP loop
+    load(0x0200, { 0xEA, 0x4C, 0x00, 0x02 });
+    Memory mem = image;
+    FastCPU cpu(&mem);
+    cpu.PC = 0x0200;
+    cpu.cycles = 0;
+    long long when = -1;
+    cpu.events.at(501, [&](CPUState & c) { when = c.cycles; });
+    EXPECT_EQ(CPU::StopReason::Budget, cpu.run(1000));
+    EXPECT_EQ(501, when);
+}
@@ -0,0 +1,253 @@
+#include <gtest/gtest.h>
+#include "cpu.h"
+#include "memory.h"
+#include "via.h"
+#include <vector>
+
+// Checks the 6522 VIA: timer counts and timeouts computed from the cycle
+// count, IFR/IER and the IRQ line, ports and control lines, the shift
+// register, and a MappedCPU guest taking T1 interrupts with no events
+// scheduled while it only polls.
+
+class ViaTest : public ::testing::Test {
+protected:
+    Memory mem;
+    MappedCPU cpu;
+    Via6522 via;
+
+    ViaTest() : mem(), cpu(&mem), via(cpu) {
+        cpu.cycles = 0;
+    }
+    ~ViaTest(){};
+
+    void at(long long cycle) { cpu.cycles = cycle; }
+};
+
+TEST_F(ViaTest, timer1OneShot) {
+    at(100);
+    via.write(Via6522::T1CL, 10);
+    via.write(Via6522::T1CH, 0);
+    EXPECT_EQ(10, via.timer1());
+    at(105);
+    EXPECT_EQ(5, via.timer1());
+    at(110);
+    EXPECT_EQ(0, via.timer1());
+    EXPECT_FALSE(via.interruptFlags() & Via6522::IrqT1);
+    at(111);
+    EXPECT_EQ(0xFFFF, via.timer1());
+    EXPECT_EQ(Via6522::IrqT1, via.interruptFlags());
+    // Keeps counting down, and times out only once
+    at(100111);
+    EXPECT_EQ(Word(0xFFFF - 100000), via.timer1());
+    EXPECT_EQ(10, via.read(Via6522::T1LL));
+    EXPECT_EQ(Word(0xFFFF - 100000) & 0xFF, via.read(Via6522::T1CL));
+    EXPECT_EQ(0, via.interruptFlags());
+    at(300000);
+    EXPECT_EQ(0, via.interruptFlags());
+}
+
+TEST_F(ViaTest, timer1FreeRunning) {
+    via.write(Via6522::ACR, 0xC0);
+    at(100);
+    via.write(Via6522::T1CL, 10);
+    via.write(Via6522::T1CH, 0);
+    EXPECT_FALSE(via.pb7());
+    // Timeouts at 111, 123, 135, ...: N+2 cycles apart
+    at(111);
+    EXPECT_EQ(0xFFFF, via.timer1());
+    EXPECT_TRUE(via.pb7());
+    at(112);
+    EXPECT_EQ(10, via.timer1());
+    at(122);
+    EXPECT_EQ(0, via.timer1());
+    EXPECT_TRUE(via.pb7());
+    at(123);
+    EXPECT_EQ(0xFFFF, via.timer1());
+    EXPECT_FALSE(via.pb7());
+    // A thousand periods later in one step
+    at(123 + 12 * 1000 + 5);
+    EXPECT_EQ(6, via.timer1());
+    EXPECT_FALSE(via.pb7());
+    EXPECT_EQ(0, via.read(Via6522::ORB) & 0x80);
+    // A new latch takes effect at the next reload
+    via.write(Via6522::T1LL, 20);
+    EXPECT_EQ(6, via.timer1());
+    at(123 + 12 * 1000 + 13);
+    EXPECT_EQ(20, via.timer1());
+    EXPECT_TRUE(cpu.events.empty());
+}
+
+TEST_F(ViaTest, timer2) {
+    at(50);
+    via.write(Via6522::T2CL, 0x34);
+    via.write(Via6522::T2CH, 0x12);
+    EXPECT_EQ(0x1234, via.timer2());
+    at(50 + 0x1234 + 1);
+    EXPECT_EQ(0xFFFF, via.timer2());
+    EXPECT_EQ(Via6522::IrqT2, via.interruptFlags());
+    EXPECT_EQ(0xFF, via.read(Via6522::T2CL));
+    EXPECT_EQ(0, via.interruptFlags());
+
+    // Counting PB6 pulses instead
+    via.write(Via6522::ACR, 0x20);
+    via.write(Via6522::T2CL, 3);
+    via.write(Via6522::T2CH, 0);
+    at(1000000);
+    EXPECT_EQ(3, via.timer2());
+    via.pulseB6();
+    via.pulseB6();
+    EXPECT_EQ(0, via.interruptFlags());
+    via.pulseB6();
+    EXPECT_EQ(0, via.timer2());
+    EXPECT_EQ(Via6522::IrqT2, via.interruptFlags());
+}
+
+TEST_F(ViaTest, interruptLine) {
+    via.write(Via6522::IER, 0x80 | Via6522::IrqT1 | Via6522::IrqCA1);
+    EXPECT_EQ(0x80 | Via6522::IrqT1 | Via6522::IrqCA1, via.read(Via6522::IER));
+    via.write(Via6522::IER, Via6522::IrqCA1);
+    EXPECT_EQ(0x80 | Via6522::IrqT1, via.read(Via6522::IER));
+
+    // A timeout raises IRQ through a scheduled event
+    via.write(Via6522::T1CL, 100);
+    via.write(Via6522::T1CH, 0);
+    EXPECT_EQ(101, cpu.events.deadline());
+    at(101);
+    cpu.events.fire(cpu);
+    EXPECT_EQ(CPUState::IrqAsserted, cpu.interrupts);
+    EXPECT_EQ(0x80 | Via6522::IrqT1, via.read(Via6522::IFR));
+    EXPECT_TRUE(cpu.events.empty());
+    // Cleared by writing IFR
+    via.write(Via6522::IFR, Via6522::IrqT1);
+    EXPECT_EQ(0, cpu.interrupts);
+
+    // A disabled source sets its flag but leaves IRQ alone
+    via.setCA1(false);
+    EXPECT_EQ(Via6522::IrqCA1, via.read(Via6522::IFR));
+    EXPECT_EQ(0, cpu.interrupts);
+    // Another chip on the same line
+    cpu.setIRQ(true, 2);
+    via.write(Via6522::IER, 0x80 | Via6522::IrqCA1);
+    via.read(Via6522::ORA);
+    EXPECT_EQ(CPUState::IrqAsserted, cpu.interrupts);
+    cpu.setIRQ(false, 2);
+    EXPECT_EQ(0, cpu.interrupts);
+}
+
+TEST_F(ViaTest, ports) {
+    Byte pinsA = 0x0F, pinsB = 0xAA;
+    std::vector<Byte> outA;
+    via.ports.readA = [&]() { return pinsA; };
+    via.ports.readB = [&]() { return pinsB; };
+    via.ports.writeA = [&](Byte pins) { outA.push_back(pins); };
+    via.write(Via6522::DDRA, 0xF0);
+    via.write(Via6522::ORA, 0x50);
+    EXPECT_EQ((std::vector<Byte> { 0x0F, 0x5F }), outA);
+    EXPECT_EQ(0x5F, via.read(Via6522::ORA));
+    EXPECT_EQ(0xAA, via.read(Via6522::ORB));
+    via.write(Via6522::DDRB, 0x0F);
+    via.write(Via6522::ORB, 0x05);
+    EXPECT_EQ(0xA5, via.read(Via6522::ORB));
+
+    // CA1 on the edge the PCR selects; reading ORA clears it, the mirror without handshake does not
+    via.setCA1(false);
+    EXPECT_EQ(Via6522::IrqCA1, via.interruptFlags());
+    via.read(Via6522::ORANoHandshake);
+    EXPECT_EQ(Via6522::IrqCA1, via.interruptFlags());
+    via.read(Via6522::ORA);
+    EXPECT_EQ(0, via.interruptFlags());
+    via.write(Via6522::PCR, 0x01);
+    via.setCA1(true);
+    EXPECT_EQ(Via6522::IrqCA1, via.interruptFlags());
+    via.write(Via6522::ORA, 0);
+    via.setCA1(false);
+    EXPECT_EQ(0, via.interruptFlags());
+
+    // CB2 as an independent input is not cleared by ORB
+    via.write(Via6522::PCR, 0x20);
+    via.setCB2(false);
+    via.read(Via6522::ORB);
+    EXPECT_EQ(Via6522::IrqCB2, via.interruptFlags());
+}
+
+TEST_F(ViaTest, shiftRegister) {
+    std::vector<Byte> out;
+    via.ports.shiftOut = [&](Byte b) { out.push_back(b); };
+    via.ports.shiftIn = [&]() { return Byte(0x3C); };
+    // Out under Phi2: 16 cycles
+    via.write(Via6522::ACR, 6 << 2);
+    at(10);
+    via.write(Via6522::SR, 0x81);
+    at(25);
+    EXPECT_EQ(0, via.interruptFlags());
+    at(26);
+    EXPECT_EQ(Via6522::IrqSR, via.interruptFlags());
+    EXPECT_EQ((std::vector<Byte> { 0x81 }), out);
+
+    // In under T2: 16 times the low latch plus two
+    via.write(Via6522::T2CL, 3);
+    via.write(Via6522::ACR, 1 << 2);
+    via.read(Via6522::SR);
+    EXPECT_EQ(0, via.interruptFlags());
+    at(26 + 16 * 5);
+    EXPECT_EQ(0x3C, via.read(Via6522::SR));
+
+    // Under CB1, when the embedder says so
+    via.write(Via6522::ACR, 7 << 2);
+    via.write(Via6522::SR, 0x42);
+    at(1000000);
+    EXPECT_EQ(0, via.interruptFlags());
+    via.shiftExternal();
+    EXPECT_EQ(Via6522::IrqSR, via.interruptFlags());
+    EXPECT_EQ(0x42, out.back());
+}
+
+TEST_F(ViaTest, guestSeesCurrentCycles) {
+    // LDA $D004 / LDY $D004 / STA $0300 / STY $0301 / JMP *
+    const std::vector<Byte> program = { 0xAD, 0x04, 0xD0, 0xAC, 0x04, 0xD0, 0x8D, 0x00, 0x03,
+                                        0x8C, 0x01, 0x03, 0x4C, 0x0C, 0x02 };
+    mem.writeBlock(0x0200, program.data(), program.size());
+    via.map(mem, 0xD0);
+    via.write(Via6522::T1CL, 0xFF);
+    via.write(Via6522::T1CH, 0);
+    cpu.PC = 0x0200;
+    EXPECT_EQ(CPU::StopReason::Trap, cpu.run(1000));
+    EXPECT_EQ(opcodeCycles[0xAC], mem.mem[0x0300] - mem.mem[0x0301]);
+
+    // The table core agrees
+    via.write(Via6522::T1CH, 0);
+    cpu.PC = 0x0200;
+    for (int step = 0; step < 4; step++)
+        cpu.execute();
+    EXPECT_EQ(opcodeCycles[0xAC], mem.mem[0x0300] - mem.mem[0x0301]);
+}
+
+TEST_F(ViaTest, guestTakesTimerInterrupts) {
+    // LDA #$C0 / STA IER / LDA #$40 / STA ACR / LDA #$E6 / STA T1CL / LDA #$03 / STA T1CH / CLI
+    // loop: INX / JMP loop
+    // handler: INC $0300 / BIT T1CL / RTI
+    const std::vector<Byte> program = { 0xA9, 0xC0, 0x8D, 0x0E, 0xD0, 0xA9, 0x40, 0x8D, 0x0B, 0xD0,
+                                        0xA9, 0xE6, 0x8D, 0x04, 0xD0, 0xA9, 0x03, 0x8D, 0x05, 0xD0,
+                                        0x58, 0xE8, 0x4C, 0x15, 0x02 };
+    const std::vector<Byte> handler = { 0xEE, 0x00, 0x03, 0x2C, 0x04, 0xD0, 0x40 };
+    mem.writeBlock(0x0200, program.data(), program.size());
+    mem.writeBlock(0x0400, handler.data(), handler.size());
+    mem.write(0xFFFE, 0x00);
+    mem.write(0xFFFF, 0x04);
+    via.map(mem, 0xD0);
+    cpu.PC = 0x0200;
+    cpu.SP = 0xFF;
+    cpu.P = 0x24;
+    EXPECT_EQ(CPU::StopReason::Budget, cpu.run(100000));
+    // A timeout every 1000 cycles, each taken once
+    EXPECT_NEAR(100, mem.mem[0x0300], 1);
+    EXPECT_EQ(1u, cpu.events.size());
+
+    // Polled rather than enabled, the timer schedules nothing
+    via.write(Via6522::IER, Via6522::IrqT1);
+    EXPECT_TRUE(cpu.events.empty());
+    Byte handled = mem.mem[0x0300];
+    EXPECT_EQ(CPU::StopReason::Budget, cpu.run(100000));
+    EXPECT_GE(handled + 1, mem.mem[0x0300]);
+    EXPECT_TRUE(via.interruptFlags() & Via6522::IrqT1);
+}